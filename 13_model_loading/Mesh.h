@@ -2,6 +2,7 @@
 #define MESH_H_INCLUDED
 
 #include <vector>
+#include <utility>
 
 #include <glad/glad.h>
 
@@ -9,22 +10,36 @@
 #include "Texture.h"
 #include "ShaderProgram.h"
 
+// one part of a Model with its own textures. Its vertices and indices are
+// a range of the buffers shared by the whole model (see Model::Load), so a
+// mesh holds no geometry of its own
 class Mesh
 {
 public:
 
-    Mesh() {}
+    Mesh() :
+        VAO(0),
+        firstIndex(0),
+        numIndices(0),
+        baseVertex(0),
+        boundsCenter(0.0f),
+        boundsRadius(0.0f)
+    {}
     ~Mesh() {}
 
-    void Init(const std::vector<Vertex>& vertices,
-        const std::vector<GLuint>& indices,
-        const std::vector<Texture>& textures)
+    // draws numIndices indices starting at firstIndex of the model's index
+    // buffer; the indices are relative to baseVertex
+    void Init(GLuint VAO,
+        size_t firstIndex,
+        size_t numIndices,
+        GLint baseVertex,
+        std::vector<Texture>&& textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
-        setupMesh();
+        this->VAO = VAO;
+        this->firstIndex = firstIndex;
+        this->numIndices = numIndices;
+        this->baseVertex = baseVertex;
+        this->textures = std::move(textures);
     }
 
     void Draw(const ShaderProgram& shader)
@@ -71,74 +86,24 @@ public:
 
         // draw the mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glDrawElementsBaseVertex(GL_TRIANGLES,
+            numIndices,
+            GL_UNSIGNED_INT,
+            (void*)(firstIndex * sizeof(GLuint)),
+            baseVertex);
         glBindVertexArray(0);
     }
 
-    std::vector<Vertex> vertices;
-    std::vector<GLuint> indices;
     std::vector<Texture> textures;
 
-private:
-    GLuint VAO; // vertex array object
-    GLuint VBO; // vertex buffer object
-    GLuint EBO; // element buffer object
-
-    void setupMesh()
-    {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+    GLuint VAO; // the model's
+    size_t firstIndex;
+    size_t numIndices;
+    GLint baseVertex;
 
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-            &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
-            &indices[0], GL_STATIC_DRAW);
-
-        // vertex attributes
-        size_t floatsPerVertex = 8;
-        size_t floatsPerPosition = 3;
-        size_t floatsPerNormal = 3;
-        size_t floatsPerTexCoord = 2;
-        int posAttribLocation = 0; // aPos, where we set location = 0
-        int normalAttribLocation = 1; // aNormal, where we set location = 1
-        int texAttribLocation = 2; // aTexCoord, where we set location = 2
-        int dataType = GL_FLOAT;
-        int shouldNormalize = GL_FALSE;
-        int vertexStride = floatsPerVertex * sizeof(GLfloat);
-        void* posBeginOffset = (void*)0;
-        void* normalBeginOffset = (void*)(offsetof(Vertex, Normal));
-        void* texBeginOffset = (void*)(offsetof(Vertex, TexCoord));
-        glVertexAttribPointer(posAttribLocation,
-            floatsPerPosition,
-            dataType,
-            shouldNormalize,
-            vertexStride,
-            posBeginOffset);
-        glEnableVertexAttribArray(posAttribLocation);
-        glVertexAttribPointer(normalAttribLocation,
-            floatsPerNormal,
-            dataType,
-            shouldNormalize,
-            vertexStride,
-            normalBeginOffset);
-        glEnableVertexAttribArray(normalAttribLocation);
-        glVertexAttribPointer(texAttribLocation,
-            floatsPerTexCoord,
-            dataType,
-            shouldNormalize,
-            vertexStride,
-            texBeginOffset);
-        glEnableVertexAttribArray(texAttribLocation);
-
-        // unbind the vertex array
-        glBindVertexArray(0);
-    }
+    // model space bounding sphere, used for the on screen texture footprint
+    glm::vec3 boundsCenter;
+    float boundsRadius;
 };
 
 #endif //! MESH_H_INCLUDED
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <chrono>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -14,6 +15,18 @@
 #include "Texture.h"
 #include "Shader.h"
 #include "Vertex.h"
+#include "TextureStreamer.h"
+#include "TransformHierarchy.h"
+
+// how long Model::Load() took and what it kept
+typedef struct ModelImportStats {
+    double readMs;              // Assimp::Importer::ReadFile()
+    double totalMs;             // including materials and the upload
+    size_t numMeshes;
+    size_t numVertices;
+    size_t numIndices;
+    size_t cpuGeometryBytes;    // still held after Load(), 0 unless keepGeometry
+} ModelImportStats;
 
 class Model
 {
@@ -22,8 +35,25 @@ public:
     Model() {}
     ~Model() {}
 
-    void Load(const std::string& filePath)
+    // if streamer is given, textures start at their mip tail and are
+    // streamed in by RequestTextureDetail()/TextureStreamer::Update()
+    //
+    // All meshes share one vertex and one index buffer, sized exactly from
+    // the Assimp meshes before anything is converted. Without keepGeometry
+    // the vertices and indices are written straight into the mapped GL
+    // buffers and the only CPU copy is Assimp's own, freed when Load()
+    // returns. With keepGeometry they are written into one array of each
+    // kept by the model (see GetVertices()/GetIndices()) and uploaded
+    // from there
+    void Load(const std::string& filePath,
+        TextureStreamer* streamer = nullptr,
+        bool keepGeometry = false)
     {
+        typedef std::chrono::high_resolution_clock Clock;
+        auto start = Clock::now();
+
+        this->streamer = streamer;
+
         Assimp::Importer import;
         const aiScene* scene = import.ReadFile(filePath,
             aiProcess_Triangulate | aiProcess_FlipUVs);
@@ -35,84 +65,187 @@ public:
             std::cout << "ASSIMP error: " << import.GetErrorString() << std::endl;
             return;
         }
+        auto read = Clock::now();
 
         directory = filePath.substr(0, filePath.find_last_of('/'));
 
-        processNode(scene->mRootNode, scene);
+        std::vector<const aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, -1, sceneMeshes);
+        transforms.Update();
+
+        // each mesh's range of the shared buffers
+        size_t numVertices = 0;
+        size_t numIndices = 0;
+        meshes.reserve(sceneMeshes.size());
+        for (const aiMesh* sceneMesh : sceneMeshes)
+        {
+            size_t meshIndices = 0;
+            for (size_t i = 0; i < sceneMesh->mNumFaces; i++) {
+                meshIndices += sceneMesh->mFaces[i].mNumIndices;
+            }
+            meshes.emplace_back();
+            meshes.back().Init(0,
+                numIndices,
+                meshIndices,
+                (GLint)numVertices,
+                loadMeshTextures(sceneMesh, scene));
+            numVertices += sceneMesh->mNumVertices;
+            numIndices += meshIndices;
+        }
+
+        setupBuffers(sceneMeshes, numVertices, numIndices, keepGeometry);
+
+        importStats.readMs = std::chrono::duration<double, std::milli>(read - start).count();
+        importStats.totalMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        importStats.numMeshes = meshes.size();
+        importStats.numVertices = numVertices;
+        importStats.numIndices = numIndices;
+        importStats.cpuGeometryBytes = vertices.capacity() * sizeof(Vertex) +
+            indices.capacity() * sizeof(GLuint);
     }
 
-    void Draw(const ShaderProgram& shader)
+    // draws each mesh with modelMat times its node's world matrix, set at
+    // uModelLocation and (with viewProjection) uTransformLocation. The
+    // locations are looked up once by the caller, with the other uniforms
+    void Draw(const ShaderProgram& shader,
+        GLint uModelLocation,
+        GLint uTransformLocation,
+        const glm::mat4& modelMat,
+        const glm::mat4& viewProjection)
     {
-        for (Mesh& mesh : meshes)
+        transforms.Update();
+
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            glm::mat4 meshModelMat = modelMat * transforms.GetWorld(meshNodes[i]);
+            glm::mat4 meshTransMat = viewProjection * meshModelMat;
+            glUniformMatrix4fv(uModelLocation, 1, GL_FALSE, glm::value_ptr(meshModelMat));
+            glUniformMatrix4fv(uTransformLocation, 1, GL_FALSE, glm::value_ptr(meshTransMat));
+            meshes[i].Draw(shader);
+        }
+    }
+
+    // the Assimp node hierarchy, one transform node per aiNode. Move parts
+    // of the model through SetTranslation()/SetRotation()/SetScale() on
+    // the node FindNode() returns; Draw() applies the changes
+    TransformHierarchy& GetTransforms() { return transforms; }
+
+    // -1 if there is no node with that name
+    int32_t FindNode(const std::string& name) const
+    {
+        for (size_t i = 0; i < nodeNames.size(); i++)
+        {
+            if (nodeNames[i] == name) {
+                return (int32_t)i;
+            }
+        }
+        return -1;
+    }
+
+    // request texture detail for each mesh from the size of its bounding
+    // sphere on screen, assuming each texture is spread over its mesh once
+    void RequestTextureDetail(const glm::mat4& modelMat,
+        const glm::vec3& cameraPosition,
+        float fovDegrees,
+        float viewportHeight)
+    {
+        if (!streamer) {
+            return;
+        }
+
+        transforms.Update();
+
+        float tanHalfFov = std::tan(glm::radians(fovDegrees) * 0.5f);
+        for (size_t i = 0; i < meshes.size(); i++)
         {
-            mesh.Draw(shader);
+            const Mesh& mesh = meshes[i];
+            glm::mat4 meshModelMat = modelMat * transforms.GetWorld(meshNodes[i]);
+            float scale = std::max(glm::length(glm::vec3(meshModelMat[0])),
+                std::max(glm::length(glm::vec3(meshModelMat[1])),
+                    glm::length(glm::vec3(meshModelMat[2]))));
+            glm::vec3 center = glm::vec3(meshModelMat * glm::vec4(mesh.boundsCenter, 1.0f));
+            float radius = mesh.boundsRadius * scale;
+            float distance = glm::length(center - cameraPosition);
+
+            // projected diameter in pixels; inside the sphere wants full detail
+            float footprint = 0.0f;
+            if (distance > radius) {
+                footprint = radius / (distance * tanHalfFov) * viewportHeight;
+            }
+            else {
+                footprint = 1.0e9f;
+            }
+
+            for (const Texture& texture : mesh.textures)
+            {
+                if (texture.streamHandle >= 0) {
+                    streamer->RequestFootprint(texture.streamHandle, footprint);
+                }
+            }
         }
     }
 
+    const ModelImportStats& GetImportStats() const { return importStats; }
+
+    // empty unless Load() was told to keep the geometry
+    const std::vector<Vertex>& GetVertices() const { return vertices; }
+    const std::vector<GLuint>& GetIndices() const { return indices; }
+
 private:
 
     std::vector<Mesh> meshes;
     std::string directory;
 
     std::vector<Texture> loaded_textures; // keep track of already loaded
+    TextureStreamer* streamer = nullptr;
+
+    // shared by every mesh
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    GLuint EBO = 0;
+    // CPU copy of the buffers, only with keepGeometry
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    ModelImportStats importStats = ModelImportStats();
 
-    void processNode(aiNode* node, const aiScene* scene)
+    TransformHierarchy transforms;
+    std::vector<std::string> nodeNames;     // per transform node
+    std::vector<size_t> meshNodes;          // transform node of each mesh
+
+    // gathers the meshes in the order they are drawn, and a transform node
+    // for each aiNode with its mTransformation relative to parentNode
+    void processNode(const aiNode* node,
+        const aiScene* scene,
+        int32_t parentNode,
+        std::vector<const aiMesh*>& sceneMeshes)
     {
+        // aiMatrix4x4 is row major
+        const aiMatrix4x4& m = node->mTransformation;
+        glm::mat4 local(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+            glm::vec4(m.a2, m.b2, m.c2, m.d2),
+            glm::vec4(m.a3, m.b3, m.c3, m.d3),
+            glm::vec4(m.a4, m.b4, m.c4, m.d4));
+        size_t transformNode = transforms.AddNode(parentNode, local);
+        nodeNames.push_back(node->mName.C_Str());
+
         // process node meshes, if any
         for (size_t i = 0; i < node->mNumMeshes; i++)
         {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+            meshNodes.push_back(transformNode);
         }
 
         // process the node children, if any
         for (size_t i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, (int32_t)transformNode, sceneMeshes);
         }
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    std::vector<Texture> loadMeshTextures(const aiMesh* mesh, const aiScene* scene)
     {
-        std::vector<Vertex> vertices;
-        std::vector<GLuint> indices;
         std::vector<Texture> textures;
-
-        for (size_t i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-
-            vertex.Position.x = mesh->mVertices[i].x;
-            vertex.Position.y = mesh->mVertices[i].y;
-            vertex.Position.z = mesh->mVertices[i].z;
-
-            vertex.Normal.x = mesh->mNormals[i].x;
-            vertex.Normal.y = mesh->mNormals[i].y;
-            vertex.Normal.z = mesh->mNormals[i].z;
-
-            // assuming a single texture for now
-            if (mesh->mTextureCoords[0])
-            {
-                vertex.TexCoord.x = mesh->mTextureCoords[0][i].x;
-                vertex.TexCoord.y = mesh->mTextureCoords[0][i].y;
-            }
-            else {
-                vertex.TexCoord.x = 0.0f;
-                vertex.TexCoord.y = 0.0f;
-            }
-
-            vertices.push_back(vertex);
-        }
-
-        for (size_t i = 0; i < mesh->mNumFaces; i++)
-        {
-            aiFace face = mesh->mFaces[i];
-            for (size_t j = 0; j < face.mNumIndices; j++)
-            {
-                indices.push_back(face.mIndices[j]);
-            }
-        }
-
         if (mesh->mMaterialIndex >= 0)
         {
             aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -128,10 +261,169 @@ private:
                 specularMaps.begin(), 
                 specularMaps.end());
         }
+        return textures;
+    }
+
+    // converts every mesh into vertexData/indexData at the ranges Load()
+    // gave them. Only writes to them, since they may be mapped GL memory,
+    // and computes each mesh's bounds on the way
+    void writeGeometry(const std::vector<const aiMesh*>& sceneMeshes,
+        Vertex* vertexData,
+        GLuint* indexData)
+    {
+        for (size_t m = 0; m < sceneMeshes.size(); m++)
+        {
+            const aiMesh* mesh = sceneMeshes[m];
+            Vertex* meshVertices = vertexData + meshes[m].baseVertex;
+            GLuint* meshIndices = indexData + meshes[m].firstIndex;
+
+            glm::vec3 minPos(0.0f);
+            glm::vec3 maxPos(0.0f);
+            if (mesh->mNumVertices > 0) {
+                minPos = maxPos = glm::vec3(mesh->mVertices[0].x,
+                    mesh->mVertices[0].y,
+                    mesh->mVertices[0].z);
+            }
+
+            for (size_t i = 0; i < mesh->mNumVertices; i++)
+            {
+                Vertex vertex;
+
+                vertex.Position.x = mesh->mVertices[i].x;
+                vertex.Position.y = mesh->mVertices[i].y;
+                vertex.Position.z = mesh->mVertices[i].z;
+
+                if (mesh->mNormals)
+                {
+                    vertex.Normal.x = mesh->mNormals[i].x;
+                    vertex.Normal.y = mesh->mNormals[i].y;
+                    vertex.Normal.z = mesh->mNormals[i].z;
+                }
+                else {
+                    vertex.Normal = glm::vec3(0.0f);
+                }
+
+                // assuming a single texture for now
+                if (mesh->mTextureCoords[0])
+                {
+                    vertex.TexCoord.x = mesh->mTextureCoords[0][i].x;
+                    vertex.TexCoord.y = mesh->mTextureCoords[0][i].y;
+                }
+                else {
+                    vertex.TexCoord.x = 0.0f;
+                    vertex.TexCoord.y = 0.0f;
+                }
 
-        Mesh myMesh;
-        myMesh.Init(vertices, indices, textures);
-        return myMesh;
+                minPos = glm::min(minPos, vertex.Position);
+                maxPos = glm::max(maxPos, vertex.Position);
+                meshVertices[i] = vertex;
+            }
+
+            for (size_t i = 0; i < mesh->mNumFaces; i++)
+            {
+                const aiFace& face = mesh->mFaces[i];
+                for (size_t j = 0; j < face.mNumIndices; j++)
+                {
+                    *meshIndices++ = face.mIndices[j];
+                }
+            }
+
+            meshes[m].boundsCenter = (minPos + maxPos) * 0.5f;
+            meshes[m].boundsRadius = glm::length(maxPos - minPos) * 0.5f;
+        }
+    }
+
+    void setupBuffers(const std::vector<const aiMesh*>& sceneMeshes,
+        size_t numVertices,
+        size_t numIndices,
+        bool keepGeometry)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        size_t vertexBytes = numVertices * sizeof(Vertex);
+        size_t indexBytes = numIndices * sizeof(GLuint);
+        bool uploaded = false;
+        if (!keepGeometry && numVertices > 0 && numIndices > 0)
+        {
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+            void* vertexData = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            void* indexData = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (vertexData && indexData) {
+                writeGeometry(sceneMeshes, (Vertex*)vertexData, (GLuint*)indexData);
+            }
+            // unmapping fails if the contents were lost meanwhile (e.g. a
+            // mode switch); the copy below writes them again
+            bool vertexUnmapped = vertexData && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+            bool indexUnmapped = indexData && glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE;
+            uploaded = vertexUnmapped && indexUnmapped;
+            if (!uploaded) {
+                std::cout << "Model: failed to map the geometry buffers, uploading a copy" << std::endl;
+            }
+        }
+        if (!uploaded)
+        {
+            vertices.resize(numVertices);
+            indices.resize(numIndices);
+            writeGeometry(sceneMeshes, vertices.data(), indices.data());
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices.data(), GL_STATIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices.data(), GL_STATIC_DRAW);
+            if (!keepGeometry) {
+                std::vector<Vertex>().swap(vertices);
+                std::vector<GLuint>().swap(indices);
+            }
+        }
+
+        // vertex attributes
+        size_t floatsPerVertex = 8;
+        size_t floatsPerPosition = 3;
+        size_t floatsPerNormal = 3;
+        size_t floatsPerTexCoord = 2;
+        int posAttribLocation = 0; // aPos, where we set location = 0
+        int normalAttribLocation = 1; // aNormal, where we set location = 1
+        int texAttribLocation = 2; // aTexCoord, where we set location = 2
+        int dataType = GL_FLOAT;
+        int shouldNormalize = GL_FALSE;
+        int vertexStride = floatsPerVertex * sizeof(GLfloat);
+        void* posBeginOffset = (void*)0;
+        void* normalBeginOffset = (void*)(offsetof(Vertex, Normal));
+        void* texBeginOffset = (void*)(offsetof(Vertex, TexCoord));
+        glVertexAttribPointer(posAttribLocation,
+            floatsPerPosition,
+            dataType,
+            shouldNormalize,
+            vertexStride,
+            posBeginOffset);
+        glEnableVertexAttribArray(posAttribLocation);
+        glVertexAttribPointer(normalAttribLocation,
+            floatsPerNormal,
+            dataType,
+            shouldNormalize,
+            vertexStride,
+            normalBeginOffset);
+        glEnableVertexAttribArray(normalAttribLocation);
+        glVertexAttribPointer(texAttribLocation,
+            floatsPerTexCoord,
+            dataType,
+            shouldNormalize,
+            vertexStride,
+            texBeginOffset);
+        glEnableVertexAttribArray(texAttribLocation);
+
+        // unbind the vertex array
+        glBindVertexArray(0);
+
+        for (Mesh& mesh : meshes) {
+            mesh.VAO = VAO;
+        }
     }
 
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat,
@@ -155,7 +447,10 @@ private:
             }
             if (!alreadyLoaded) {
                 std::cout << "Model loading texture: " << fullName << std::endl;
-                Texture texture = createTexture(fullName);
+                Texture texture = streamer ?
+                    streamer->Register(fullName, typeName) :
+                    createTexture(fullName);
+                texture.type = typeName;
                 textures.push_back(texture);
                 loaded_textures.push_back(texture);
             }
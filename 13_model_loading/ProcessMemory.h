@@ -0,0 +1,40 @@
+#ifndef PROCESS_MEMORY_H_INCLUDED
+#define PROCESS_MEMORY_H_INCLUDED
+
+#include <cstddef>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// the most physical memory (resident set / working set) this process has
+// used so far, in bytes. Only ever grows, so to see what a step costs
+// compare it before and after the step while it is the biggest thing the
+// process has done yet
+size_t getPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss; // bytes
+#else
+    return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+#endif // !PROCESS_MEMORY_H_INCLUDED
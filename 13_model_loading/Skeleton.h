@@ -0,0 +1,207 @@
+#ifndef SKELETON_H_INCLUDED
+#define SKELETON_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "TransformHierarchy.h"
+
+// a local translation/rotation/scale for every node of a Skeleton
+typedef struct SkeletonPose {
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+} SkeletonPose;
+
+// the node hierarchy of a skinned model and which nodes are bones. Nodes
+// are stored parents first like TransformHierarchy, so one pass in index
+// order computes every world matrix
+typedef struct Skeleton {
+    std::vector<std::string> nodeNames;
+    std::vector<int32_t> nodeParents;   // -1 = root
+    SkeletonPose bindPose;              // the node transforms from the file
+    std::vector<size_t> boneNodes;      // node driving each bone
+    std::vector<glm::mat4> boneOffsets; // mesh space -> bone space, per bone
+    glm::mat4 globalInverse;            // inverse of the root node's transform
+} Skeleton;
+
+// keyframes of one node; times are in seconds and sorted
+typedef struct AnimationChannel {
+    size_t node;
+    std::vector<float> positionTimes;
+    std::vector<glm::vec3> positions;
+    std::vector<float> rotationTimes;
+    std::vector<glm::quat> rotations;
+    std::vector<float> scaleTimes;
+    std::vector<glm::vec3> scales;
+} AnimationChannel;
+
+typedef struct AnimationClip {
+    std::string name;
+    float duration; // seconds
+    std::vector<AnimationChannel> channels;
+} AnimationClip;
+
+// -1 if there is no node with that name
+int32_t findSkeletonNode(const Skeleton& skeleton, const std::string& name)
+{
+    for (size_t i = 0; i < skeleton.nodeNames.size(); i++)
+    {
+        if (skeleton.nodeNames[i] == name) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+// index of the last key at or before time, and how far time is from it
+// towards the next key in [0, 1]
+static size_t findKey(const std::vector<float>& times, float time, float& t)
+{
+    t = 0.0f;
+    if (times.size() < 2 || time <= times.front()) {
+        return 0;
+    }
+    if (time >= times.back()) {
+        return times.size() - 1;
+    }
+    size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    size_t key = next - 1;
+    float span = times[next] - times[key];
+    t = span > 0.0f ? (time - times[key]) / span : 0.0f;
+    return key;
+}
+
+// normalized lerp, taking the short way around; for neighbouring keys and
+// pose blends it is close enough to slerp and much cheaper
+static glm::quat nlerpQuat(const glm::quat& a, const glm::quat& b, float t)
+{
+    float cosAngle = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+    float wb = cosAngle < 0.0f ? -t : t;
+    float wa = 1.0f - t;
+    glm::quat q(wa * a.w + wb * b.w,
+        wa * a.x + wb * b.x,
+        wa * a.y + wb * b.y,
+        wa * a.z + wb * b.z);
+    float length = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    float invLength = length > 0.0f ? 1.0f / length : 0.0f;
+    return glm::quat(q.w * invLength, q.x * invLength, q.y * invLength, q.z * invLength);
+}
+
+static glm::vec3 sampleVec3Keys(const std::vector<float>& times,
+    const std::vector<glm::vec3>& values,
+    float time)
+{
+    float t;
+    size_t key = findKey(times, time, t);
+    if (t == 0.0f) {
+        return values[key];
+    }
+    return glm::mix(values[key], values[key + 1], t);
+}
+
+static glm::quat sampleQuatKeys(const std::vector<float>& times,
+    const std::vector<glm::quat>& values,
+    float time)
+{
+    float t;
+    size_t key = findKey(times, time, t);
+    if (t == 0.0f) {
+        return values[key];
+    }
+    return nlerpQuat(values[key], values[key + 1], t);
+}
+
+// pose = the skeleton's bind pose with clip's channels at time (seconds,
+// clamped to the clip) on top. Reuses pose's arrays, so sampling into the
+// same pose every frame doesn't allocate
+void sampleAnimation(const Skeleton& skeleton,
+    const AnimationClip& clip,
+    float time,
+    SkeletonPose& pose)
+{
+    pose.translations.assign(skeleton.bindPose.translations.begin(), skeleton.bindPose.translations.end());
+    pose.rotations.assign(skeleton.bindPose.rotations.begin(), skeleton.bindPose.rotations.end());
+    pose.scales.assign(skeleton.bindPose.scales.begin(), skeleton.bindPose.scales.end());
+
+    for (const AnimationChannel& channel : clip.channels)
+    {
+        if (!channel.positions.empty()) {
+            pose.translations[channel.node] = sampleVec3Keys(channel.positionTimes, channel.positions, time);
+        }
+        if (!channel.rotations.empty()) {
+            pose.rotations[channel.node] = sampleQuatKeys(channel.rotationTimes, channel.rotations, time);
+        }
+        if (!channel.scales.empty()) {
+            pose.scales[channel.node] = sampleVec3Keys(channel.scaleTimes, channel.scales, time);
+        }
+    }
+}
+
+// out = a blended towards b by weight (0 = a, 1 = b); out may be a or b
+void blendPoses(const SkeletonPose& a,
+    const SkeletonPose& b,
+    float weight,
+    SkeletonPose& out)
+{
+    size_t numNodes = a.translations.size();
+    out.translations.resize(numNodes);
+    out.rotations.resize(numNodes);
+    out.scales.resize(numNodes);
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        out.translations[i] = glm::mix(a.translations[i], b.translations[i], weight);
+        out.rotations[i] = nlerpQuat(a.rotations[i], b.rotations[i], weight);
+        out.scales[i] = glm::mix(a.scales[i], b.scales[i], weight);
+    }
+}
+
+// writes modelMat * globalInverse * world(bone node) * offset for every
+// bone of the skeleton in pose, as the top 3 rows of each matrix (the
+// last row is always 0 0 0 1), so 12 floats per bone. worlds is scratch
+// space for the node world matrices
+void computeBonePalette(const Skeleton& skeleton,
+    const SkeletonPose& pose,
+    const glm::mat4& modelMat,
+    std::vector<glm::mat4>& worlds,
+    float* palette)
+{
+    size_t numNodes = skeleton.nodeParents.size();
+    worlds.resize(numNodes);
+
+    glm::mat4 rootMat = modelMat * skeleton.globalInverse;
+    glm::mat4 local;
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        composeTransform(pose.translations[i], pose.rotations[i], pose.scales[i], local);
+        int32_t parent = skeleton.nodeParents[i];
+        multiplyMat4(glm::value_ptr(parent >= 0 ? worlds[parent] : rootMat),
+            glm::value_ptr(local),
+            glm::value_ptr(worlds[i]));
+    }
+
+    glm::mat4 bone;
+    for (size_t b = 0; b < skeleton.boneNodes.size(); b++)
+    {
+        multiplyMat4(glm::value_ptr(worlds[skeleton.boneNodes[b]]),
+            glm::value_ptr(skeleton.boneOffsets[b]),
+            glm::value_ptr(bone));
+        float* rows = palette + b * 12;
+        for (int row = 0; row < 3; row++)
+        {
+            rows[row * 4 + 0] = bone[0][row];
+            rows[row * 4 + 1] = bone[1][row];
+            rows[row * 4 + 2] = bone[2][row];
+            rows[row * 4 + 3] = bone[3][row];
+        }
+    }
+}
+
+#endif // !SKELETON_H_INCLUDED
@@ -0,0 +1,286 @@
+#ifndef SKINNED_CROWD_H_INCLUDED
+#define SKINNED_CROWD_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "SkinnedModel.h"
+#include "Skeleton.h"
+#include "ShaderProgram.h"
+#include "ThreadPool.h"
+
+// one animated copy of the crowd's model: two clips played at their own
+// times and blended by a weight that drifts back and forth
+typedef struct CrowdCharacter {
+    glm::mat4 modelMat;
+    size_t clips[2];
+    float times[2];     // seconds into each clip
+    float blendPhase;   // offsets the weight of clips[1], also used as heading
+    float speed;        // playback rate
+} CrowdCharacter;
+
+// many instances of one SkinnedModel, animated on the CPU across a
+// ThreadPool and drawn with a single instanced draw per sub mesh.
+//
+// Every frame Update() samples and blends each character's clips and
+// writes its bone palette (its model matrix already folded in) straight
+// into a mapped buffer; the vertex shader reads the palettes through a
+// buffer texture at gl_InstanceID. A uniform buffer would be simpler but
+// is only guaranteed 16KB, about 5 characters' worth of a 60 bone rig
+class SkinnedCrowd
+{
+public:
+
+    SkinnedCrowd() :
+        model(nullptr),
+        pool(nullptr),
+        paletteBuffer(0),
+        paletteTexture(0),
+        paletteCapacity(0),
+        palettesValid(false),
+        maxCharacters(0),
+        time(0.0f),
+        animationMs(0.0),
+        random(1234)
+    {}
+    ~SkinnedCrowd() {}
+
+    // shader is the one Draw() uses; its uniforms are looked up here
+    void Init(const SkinnedModel* model, ThreadPool* pool, const ShaderProgram& shader)
+    {
+        this->model = model;
+        this->pool = pool;
+
+        program = shader.id;
+        uViewProjection = glGetUniformLocation(program, "uViewProjection");
+        uNumBones = glGetUniformLocation(program, "uNumBones");
+        uLightDirection = glGetUniformLocation(program, "uLightDirection");
+        uBonePalettes = glGetUniformLocation(program, "uBonePalettes");
+        uDiffuse = glGetUniformLocation(program, "uDiffuse");
+
+        glGenBuffers(1, &paletteBuffer);
+        glGenTextures(1, &paletteTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        // a buffer texture can't be bigger than this many texels, 3 per bone
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        size_t texelsPerCharacter = std::max<size_t>(model->NumBones(), 1) * 3;
+        maxCharacters = (size_t)maxTexels / texelsPerCharacter;
+
+        // stand every character on y = 0 and make it 1.8 units tall
+        glm::vec3 boundsMin = model->GetBoundsMin();
+        glm::vec3 boundsMax = model->GetBoundsMax();
+        float height = boundsMax.y - boundsMin.y;
+        float scale = height > 0.0f ? 1.8f / height : 1.0f;
+        glm::vec3 feet((boundsMin.x + boundsMax.x) * 0.5f, boundsMin.y, (boundsMin.z + boundsMax.z) * 0.5f);
+        normalizeMat = glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+        normalizeMat = glm::translate(normalizeMat, -feet);
+    }
+
+    // keeps the animation state of existing characters and lays everyone
+    // out on a square grid in front of the origin
+    void Resize(size_t numCharacters)
+    {
+        if (numCharacters > maxCharacters) {
+            numCharacters = maxCharacters;
+        }
+
+        size_t numClips = std::max<size_t>(model->GetClips().size(), 1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        while (characters.size() < numCharacters)
+        {
+            CrowdCharacter character;
+            for (int c = 0; c < 2; c++)
+            {
+                character.clips[c] = (size_t)(unit(random) * numClips) % numClips;
+                float duration = model->GetClips().empty() ? 0.0f : model->GetClips()[character.clips[c]].duration;
+                character.times[c] = unit(random) * duration;
+            }
+            character.blendPhase = unit(random) * 6.2831853f;
+            character.speed = 0.8f + 0.4f * unit(random);
+            characters.push_back(character);
+        }
+        characters.resize(numCharacters);
+
+        const float spacing = 1.5f;
+        size_t side = (size_t)std::ceil(std::sqrt((double)numCharacters));
+        for (size_t i = 0; i < numCharacters; i++)
+        {
+            glm::vec3 position((float(i % side) - 0.5f * float(side - 1)) * spacing,
+                -1.8f,
+                -3.0f - float(i / side) * spacing);
+            glm::mat4 placement = glm::translate(glm::mat4(1.0f), position);
+            placement = glm::rotate(placement, characters[i].blendPhase, glm::vec3(0.0f, 1.0f, 0.0f));
+            characters[i].modelMat = placement * normalizeMat;
+        }
+    }
+
+    // advances every character by dt seconds and writes the palettes for
+    // this frame
+    void Update(float dt)
+    {
+        typedef std::chrono::high_resolution_clock Clock;
+        auto start = Clock::now();
+        time += dt;
+
+        size_t numCharacters = characters.size();
+        size_t floatsPerCharacter = model->NumBones() * 12;
+        size_t bytes = numCharacters * floatsPerCharacter * sizeof(float);
+        if (bytes == 0) {
+            animationMs = 0.0;
+            palettesValid = true; // nothing to read
+            return;
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+        if (bytes > paletteCapacity) {
+            paletteCapacity = bytes + bytes / 2;
+            glBufferData(GL_TEXTURE_BUFFER, paletteCapacity, nullptr, GL_STREAM_DRAW);
+        }
+        // the GPU may still be drawing last frame's palettes; invalidating
+        // lets the driver hand out fresh memory instead of waiting
+        float* palettes = (float*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!palettes) {
+            std::cout << "SkinnedCrowd: failed to map the palette buffer" << std::endl;
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            palettesValid = false;
+            return;
+        }
+
+        // one contiguous range and one set of scratch poses per task
+        size_t numTasks = pool->NumThreads();
+        scratch.resize(numTasks);
+        pool->ParallelFor(numTasks, [&](size_t firstTask, size_t lastTask) {
+            for (size_t task = firstTask; task < lastTask; task++)
+            {
+                size_t begin = numCharacters * task / numTasks;
+                size_t end = numCharacters * (task + 1) / numTasks;
+                for (size_t i = begin; i < end; i++)
+                {
+                    animateCharacter(characters[i], dt, scratch[task], palettes + i * floatsPerCharacter);
+                }
+            }
+        });
+
+        // if the contents were lost while mapped (e.g. a mode switch) they
+        // are undefined, so skip drawing until the next Update() writes
+        // them again
+        palettesValid = glUnmapBuffer(GL_TEXTURE_BUFFER) == GL_TRUE;
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        animationMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // draws with the shader given to Init()
+    void Draw(const glm::mat4& viewProjection,
+        const glm::vec3& lightDirection)
+    {
+        if (characters.empty() || !palettesValid) {
+            return;
+        }
+
+        glUseProgram(program);
+        glUniformMatrix4fv(uViewProjection, 1, GL_FALSE, glm::value_ptr(viewProjection));
+        glUniform1i(uNumBones, (GLint)model->NumBones());
+        glUniform3fv(uLightDirection, 1, glm::value_ptr(lightDirection));
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glUniform1i(uBonePalettes, 1);
+        // the model binds its diffuse maps to unit 0
+        model->Draw(uDiffuse, characters.size());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Delete()
+    {
+        glDeleteTextures(1, &paletteTexture);
+        glDeleteBuffers(1, &paletteBuffer);
+        paletteTexture = paletteBuffer = 0;
+        paletteCapacity = 0;
+    }
+
+    size_t Size() const { return characters.size(); }
+    // limited by GL_MAX_TEXTURE_BUFFER_SIZE
+    size_t MaxCharacters() const { return maxCharacters; }
+    // CPU time of the last Update(), mapping included
+    double GetAnimationMs() const { return animationMs; }
+
+private:
+
+    typedef struct Scratch {
+        SkeletonPose poses[2];
+        std::vector<glm::mat4> worlds;
+    } Scratch;
+
+    const SkinnedModel* model;
+    ThreadPool* pool;
+    std::vector<CrowdCharacter> characters;
+    std::vector<Scratch> scratch;
+
+    GLuint paletteBuffer;
+    GLuint paletteTexture; // GL_TEXTURE_BUFFER over paletteBuffer
+    size_t paletteCapacity; // bytes
+    bool palettesValid;     // false until Update() wrote and unmapped them
+    size_t maxCharacters;
+
+    GLuint program;
+    GLint uViewProjection;
+    GLint uNumBones;
+    GLint uLightDirection;
+    GLint uBonePalettes;
+    GLint uDiffuse;
+
+    glm::mat4 normalizeMat; // model space -> standing on y = 0, 1.8 tall
+    float time;
+    double animationMs;
+    std::mt19937 random;
+
+    void animateCharacter(CrowdCharacter& character,
+        float dt,
+        Scratch& scratch,
+        float* palette)
+    {
+        const Skeleton& skeleton = model->GetSkeleton();
+        const std::vector<AnimationClip>& clips = model->GetClips();
+        if (clips.empty()) {
+            computeBonePalette(skeleton, skeleton.bindPose, character.modelMat, scratch.worlds, palette);
+            return;
+        }
+
+        for (int c = 0; c < 2; c++)
+        {
+            float duration = clips[character.clips[c]].duration;
+            character.times[c] += dt * character.speed;
+            if (duration > 0.0f) {
+                character.times[c] = std::fmod(character.times[c], duration);
+            }
+        }
+
+        float weight = 0.5f + 0.5f * std::sin(character.blendPhase + time * 0.5f);
+        sampleAnimation(skeleton, clips[character.clips[0]], character.times[0], scratch.poses[0]);
+        if (weight > 0.001f) {
+            sampleAnimation(skeleton, clips[character.clips[1]], character.times[1], scratch.poses[1]);
+            blendPoses(scratch.poses[0], scratch.poses[1], weight, scratch.poses[0]);
+        }
+        computeBonePalette(skeleton, scratch.poses[0], character.modelMat, scratch.worlds, palette);
+    }
+};
+
+#endif // !SKINNED_CROWD_H_INCLUDED
@@ -0,0 +1,502 @@
+#ifndef SKINNED_MODEL_H_INCLUDED
+#define SKINNED_MODEL_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cmath>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Texture.h"
+#include "Skeleton.h"
+
+// bone indices are bytes, so one skinned model has at most this many
+#define SKINNED_MAX_BONES 256
+
+// 32 bytes, the size of a plain Vertex: packing the normal into 10 bits
+// per component makes room for 4 byte bone indices and weights. With
+// floats for all of them it would be 64
+typedef struct SkinnedVertex {
+    glm::vec3 Position;
+    GLuint Normal;              // GL_INT_2_10_10_10_REV
+    glm::vec2 TexCoord;
+    uint8_t BoneIndices[4];
+    uint8_t BoneWeights[4];     // sum to 255
+} SkinnedVertex;
+
+// snorm 10 bits per component, for GL_INT_2_10_10_10_REV
+static GLuint packNormal(const glm::vec3& normal)
+{
+    GLuint packed = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        float value = glm::clamp(normal[i], -1.0f, 1.0f) * 511.0f;
+        int32_t snorm = (int32_t)std::floor(value + 0.5f);
+        packed |= ((GLuint)snorm & 0x3FF) << (10 * i);
+    }
+    return packed;
+}
+
+// a model whose vertices are moved by the bones of a Skeleton on the GPU,
+// with its animation clips. Draw() draws numInstances copies; the vertex
+// shader (vertexShader_skinned.glsl) takes each copy's bone palette from
+// a buffer texture, see SkinnedCrowd.h
+class SkinnedModel
+{
+public:
+
+    SkinnedModel() :
+        rootTransform(1.0f),
+        VAO(0),
+        VBO(0),
+        EBO(0),
+        whiteTexture(0),
+        boundsMin(0.0f),
+        boundsMax(0.0f)
+    {}
+    ~SkinnedModel() {}
+
+    // returns false if the file couldn't be read
+    bool Load(const std::string& filePath)
+    {
+        Assimp::Importer import;
+        const aiScene* scene = import.ReadFile(filePath,
+            aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_LimitBoneWeights);
+
+        if (!scene ||
+            scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+            !scene->mRootNode)
+        {
+            std::cout << "ASSIMP error: " << import.GetErrorString() << std::endl;
+            return false;
+        }
+
+        directory = filePath.substr(0, filePath.find_last_of('/'));
+
+        std::vector<const aiMesh*> sceneMeshes;
+        std::vector<size_t> sceneMeshNodes;
+        processNode(scene->mRootNode, scene, -1, sceneMeshes, sceneMeshNodes);
+        skeleton.globalInverse = glm::inverse(rootTransform);
+
+        std::vector<SkinnedVertex> vertices;
+        std::vector<GLuint> indices;
+        for (size_t m = 0; m < sceneMeshes.size(); m++)
+        {
+            SubMesh subMesh;
+            subMesh.firstIndex = indices.size();
+            subMesh.baseVertex = (GLint)vertices.size();
+            subMesh.texture = loadDiffuseTexture(sceneMeshes[m], scene);
+            appendMesh(sceneMeshes[m], sceneMeshNodes[m], vertices, indices);
+            subMesh.numIndices = indices.size() - subMesh.firstIndex;
+            subMeshes.push_back(subMesh);
+        }
+
+        loadAnimations(scene);
+        computeBindBounds(vertices);
+        setupBuffers(vertices, indices);
+
+        std::cout << "SkinnedModel: " << filePath << ", "
+            << vertices.size() << " vertices, "
+            << skeleton.nodeNames.size() << " nodes, "
+            << skeleton.boneNodes.size() << " bones, "
+            << clips.size() << " animations" << std::endl;
+        return true;
+    }
+
+    // the palettes of all instances must be bound already
+    void Draw(GLint uDiffuseLocation, size_t numInstances) const
+    {
+        glBindVertexArray(VAO);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(uDiffuseLocation, 0);
+        for (const SubMesh& subMesh : subMeshes)
+        {
+            glBindTexture(GL_TEXTURE_2D, subMesh.texture ? subMesh.texture : whiteTexture);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
+                subMesh.numIndices,
+                GL_UNSIGNED_INT,
+                (void*)(subMesh.firstIndex * sizeof(GLuint)),
+                numInstances,
+                subMesh.baseVertex);
+        }
+        glBindVertexArray(0);
+    }
+
+    void Delete()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        for (const Texture& texture : textures) {
+            glDeleteTextures(1, &texture.id);
+        }
+        glDeleteTextures(1, &whiteTexture);
+        VAO = VBO = EBO = whiteTexture = 0;
+        textures.clear();
+    }
+
+    const Skeleton& GetSkeleton() const { return skeleton; }
+    const std::vector<AnimationClip>& GetClips() const { return clips; }
+    size_t NumBones() const { return skeleton.boneNodes.size(); }
+    // model space box around the vertices in the bind pose
+    const glm::vec3& GetBoundsMin() const { return boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return boundsMax; }
+
+private:
+
+    typedef struct SubMesh {
+        size_t firstIndex;
+        size_t numIndices;
+        GLint baseVertex;
+        GLuint texture; // diffuse, 0 = none
+    } SubMesh;
+
+    std::vector<SubMesh> subMeshes;
+    std::vector<Texture> textures; // loaded once each
+    std::string directory;
+
+    Skeleton skeleton;
+    std::vector<AnimationClip> clips;
+    std::map<std::string, size_t> boneIndices; // by node name
+    glm::mat4 rootTransform;
+
+    GLuint VAO;
+    GLuint VBO;
+    GLuint EBO;
+    GLuint whiteTexture; // for meshes without a diffuse map
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // one skeleton node per aiNode, parents first
+    void processNode(const aiNode* node,
+        const aiScene* scene,
+        int32_t parentNode,
+        std::vector<const aiMesh*>& sceneMeshes,
+        std::vector<size_t>& sceneMeshNodes)
+    {
+        // aiMatrix4x4 is row major
+        const aiMatrix4x4& m = node->mTransformation;
+        glm::mat4 local(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+            glm::vec4(m.a2, m.b2, m.c2, m.d2),
+            glm::vec4(m.a3, m.b3, m.c3, m.d3),
+            glm::vec4(m.a4, m.b4, m.c4, m.d4));
+        if (parentNode < 0) {
+            rootTransform = local;
+        }
+
+        size_t skeletonNode = skeleton.nodeNames.size();
+        skeleton.nodeNames.push_back(node->mName.C_Str());
+        skeleton.nodeParents.push_back(parentNode);
+        skeleton.bindPose.translations.emplace_back();
+        skeleton.bindPose.rotations.emplace_back();
+        skeleton.bindPose.scales.emplace_back();
+        decomposeTransform(local,
+            skeleton.bindPose.translations.back(),
+            skeleton.bindPose.rotations.back(),
+            skeleton.bindPose.scales.back());
+
+        for (size_t i = 0; i < node->mNumMeshes; i++)
+        {
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+            sceneMeshNodes.push_back(skeletonNode);
+        }
+
+        for (size_t i = 0; i < node->mNumChildren; i++)
+        {
+            processNode(node->mChildren[i], scene, (int32_t)skeletonNode, sceneMeshes, sceneMeshNodes);
+        }
+    }
+
+    // the bone for a node, added on first use; bone 0 once there are too many
+    size_t findOrAddBone(size_t node, const glm::mat4& offset)
+    {
+        const std::string& name = skeleton.nodeNames[node];
+        auto found = boneIndices.find(name);
+        if (found != boneIndices.end()) {
+            return found->second;
+        }
+        if (skeleton.boneNodes.size() >= SKINNED_MAX_BONES) {
+            std::cout << "SkinnedModel: more than " << SKINNED_MAX_BONES
+                << " bones, " << name << " uses bone 0" << std::endl;
+            return 0;
+        }
+        size_t bone = skeleton.boneNodes.size();
+        skeleton.boneNodes.push_back(node);
+        skeleton.boneOffsets.push_back(offset);
+        boneIndices[name] = bone;
+        return bone;
+    }
+
+    // converts mesh into vertices/indices, keeping the 4 biggest bone
+    // weights of each vertex. A mesh without bones follows its own node
+    // through a bone with no offset
+    void appendMesh(const aiMesh* mesh,
+        size_t meshNode,
+        std::vector<SkinnedVertex>& vertices,
+        std::vector<GLuint>& indices)
+    {
+        size_t baseVertex = vertices.size();
+        std::vector<uint32_t> influenceBones(mesh->mNumVertices * 4, 0);
+        std::vector<float> influenceWeights(mesh->mNumVertices * 4, 0.0f);
+
+        if (mesh->mNumBones == 0) {
+            size_t bone = findOrAddBone(meshNode, glm::mat4(1.0f));
+            for (size_t i = 0; i < mesh->mNumVertices; i++)
+            {
+                influenceBones[i * 4] = (uint32_t)bone;
+                influenceWeights[i * 4] = 1.0f;
+            }
+        }
+        for (size_t b = 0; b < mesh->mNumBones; b++)
+        {
+            const aiBone* sceneBone = mesh->mBones[b];
+            int32_t node = findSkeletonNode(skeleton, sceneBone->mName.C_Str());
+            if (node < 0) {
+                std::cout << "SkinnedModel: no node for bone " << sceneBone->mName.C_Str() << std::endl;
+                continue;
+            }
+            const aiMatrix4x4& m = sceneBone->mOffsetMatrix;
+            glm::mat4 offset(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+                glm::vec4(m.a2, m.b2, m.c2, m.d2),
+                glm::vec4(m.a3, m.b3, m.c3, m.d3),
+                glm::vec4(m.a4, m.b4, m.c4, m.d4));
+            size_t bone = findOrAddBone((size_t)node, offset);
+
+            for (size_t w = 0; w < sceneBone->mNumWeights; w++)
+            {
+                const aiVertexWeight& weight = sceneBone->mWeights[w];
+                if (weight.mVertexId >= mesh->mNumVertices) {
+                    continue;
+                }
+                // insertion into the vertex's 4 slots, biggest first
+                uint32_t* slotBones = &influenceBones[weight.mVertexId * 4];
+                float* slotWeights = &influenceWeights[weight.mVertexId * 4];
+                int slot = 4;
+                while (slot > 0 && slotWeights[slot - 1] < weight.mWeight) {
+                    slot--;
+                }
+                if (slot == 4) {
+                    continue;
+                }
+                for (int s = 3; s > slot; s--)
+                {
+                    slotBones[s] = slotBones[s - 1];
+                    slotWeights[s] = slotWeights[s - 1];
+                }
+                slotBones[slot] = (uint32_t)bone;
+                slotWeights[slot] = weight.mWeight;
+            }
+        }
+
+        vertices.resize(baseVertex + mesh->mNumVertices);
+        for (size_t i = 0; i < mesh->mNumVertices; i++)
+        {
+            SkinnedVertex& vertex = vertices[baseVertex + i];
+            vertex.Position = glm::vec3(mesh->mVertices[i].x,
+                mesh->mVertices[i].y,
+                mesh->mVertices[i].z);
+            vertex.Normal = packNormal(mesh->mNormals ?
+                glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z) :
+                glm::vec3(0.0f));
+            if (mesh->mTextureCoords[0]) {
+                vertex.TexCoord = glm::vec2(mesh->mTextureCoords[0][i].x,
+                    mesh->mTextureCoords[0][i].y);
+            }
+            else {
+                vertex.TexCoord = glm::vec2(0.0f);
+            }
+            quantizeWeights(&influenceBones[i * 4], &influenceWeights[i * 4], vertex);
+        }
+
+        for (size_t i = 0; i < mesh->mNumFaces; i++)
+        {
+            const aiFace& face = mesh->mFaces[i];
+            for (size_t j = 0; j < face.mNumIndices; j++)
+            {
+                indices.push_back(face.mIndices[j]);
+            }
+        }
+    }
+
+    // renormalizes the kept weights to sum to exactly 255 so no vertex
+    // shrinks towards the origin; the rounding error goes to the biggest
+    static void quantizeWeights(const uint32_t* bones,
+        const float* weights,
+        SkinnedVertex& vertex)
+    {
+        float total = weights[0] + weights[1] + weights[2] + weights[3];
+        int sum = 0;
+        for (int s = 0; s < 4; s++)
+        {
+            int quantized = total > 0.0f ? (int)std::floor(weights[s] / total * 255.0f + 0.5f) : 0;
+            vertex.BoneIndices[s] = (uint8_t)bones[s];
+            vertex.BoneWeights[s] = (uint8_t)quantized;
+            sum += quantized;
+        }
+        if (total <= 0.0f) {
+            // not weighted to anything: follow bone 0
+            vertex.BoneWeights[0] = 255;
+            return;
+        }
+        vertex.BoneWeights[0] = (uint8_t)(vertex.BoneWeights[0] + (255 - sum));
+    }
+
+    // Assimp keys are in ticks; clips keep seconds
+    void loadAnimations(const aiScene* scene)
+    {
+        for (size_t a = 0; a < scene->mNumAnimations; a++)
+        {
+            const aiAnimation* animation = scene->mAnimations[a];
+            double ticksPerSecond = animation->mTicksPerSecond != 0.0 ?
+                animation->mTicksPerSecond :
+                25.0;
+            float secondsPerTick = (float)(1.0 / ticksPerSecond);
+
+            AnimationClip clip;
+            clip.name = animation->mName.C_Str();
+            clip.duration = (float)animation->mDuration * secondsPerTick;
+            for (size_t c = 0; c < animation->mNumChannels; c++)
+            {
+                const aiNodeAnim* sceneChannel = animation->mChannels[c];
+                int32_t node = findSkeletonNode(skeleton, sceneChannel->mNodeName.C_Str());
+                if (node < 0) {
+                    continue;
+                }
+                AnimationChannel channel;
+                channel.node = (size_t)node;
+                for (size_t k = 0; k < sceneChannel->mNumPositionKeys; k++)
+                {
+                    const aiVectorKey& key = sceneChannel->mPositionKeys[k];
+                    channel.positionTimes.push_back((float)key.mTime * secondsPerTick);
+                    channel.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+                }
+                for (size_t k = 0; k < sceneChannel->mNumRotationKeys; k++)
+                {
+                    const aiQuatKey& key = sceneChannel->mRotationKeys[k];
+                    channel.rotationTimes.push_back((float)key.mTime * secondsPerTick);
+                    channel.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+                }
+                for (size_t k = 0; k < sceneChannel->mNumScalingKeys; k++)
+                {
+                    const aiVectorKey& key = sceneChannel->mScalingKeys[k];
+                    channel.scaleTimes.push_back((float)key.mTime * secondsPerTick);
+                    channel.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+                }
+                clip.channels.push_back(channel);
+            }
+            clips.push_back(clip);
+        }
+    }
+
+    // skins every vertex on the CPU once with the bind pose palette. With
+    // no bones resolved there is no palette and the positions are used as
+    // they are
+    void computeBindBounds(const std::vector<SkinnedVertex>& vertices)
+    {
+        std::vector<float> palette(skeleton.boneNodes.size() * 12);
+        if (palette.empty())
+        {
+            for (size_t i = 0; i < vertices.size(); i++)
+            {
+                boundsMin = i == 0 ? vertices[i].Position : glm::min(boundsMin, vertices[i].Position);
+                boundsMax = i == 0 ? vertices[i].Position : glm::max(boundsMax, vertices[i].Position);
+            }
+            return;
+        }
+        std::vector<glm::mat4> worlds;
+        computeBonePalette(skeleton, skeleton.bindPose, glm::mat4(1.0f), worlds, palette.data());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const SkinnedVertex& vertex = vertices[i];
+            glm::vec4 position(vertex.Position, 1.0f);
+            glm::vec3 skinned(0.0f);
+            for (int s = 0; s < 4; s++)
+            {
+                const float* rows = &palette[vertex.BoneIndices[s] * 12];
+                float weight = vertex.BoneWeights[s] / 255.0f;
+                skinned += weight * glm::vec3(glm::dot(glm::vec4(rows[0], rows[1], rows[2], rows[3]), position),
+                    glm::dot(glm::vec4(rows[4], rows[5], rows[6], rows[7]), position),
+                    glm::dot(glm::vec4(rows[8], rows[9], rows[10], rows[11]), position));
+            }
+            boundsMin = i == 0 ? skinned : glm::min(boundsMin, skinned);
+            boundsMax = i == 0 ? skinned : glm::max(boundsMax, skinned);
+        }
+    }
+
+    GLuint loadDiffuseTexture(const aiMesh* mesh, const aiScene* scene)
+    {
+        const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        if (material->GetTextureCount(aiTextureType_DIFFUSE) == 0) {
+            return 0;
+        }
+        aiString str;
+        material->GetTexture(aiTextureType_DIFFUSE, 0, &str);
+        std::string fullName = directory + "/" + std::string(str.C_Str());
+        for (const Texture& texture : textures)
+        {
+            if (texture.fileName == fullName) {
+                return texture.id;
+            }
+        }
+        std::cout << "SkinnedModel loading texture: " << fullName << std::endl;
+        Texture texture = createTexture(fullName);
+        texture.type = TextureType::Diffuse;
+        textures.push_back(texture);
+        return texture.id;
+    }
+
+    void setupBuffers(const std::vector<SkinnedVertex>& vertices,
+        const std::vector<GLuint>& indices)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkinnedVertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+        GLsizei stride = sizeof(SkinnedVertex);
+        // aPos
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+            (void*)offsetof(SkinnedVertex, Position));
+        glEnableVertexAttribArray(0);
+        // aNormal, unpacked to [-1, 1] by GL
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+            (void*)offsetof(SkinnedVertex, Normal));
+        glEnableVertexAttribArray(1);
+        // aTexCoords
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+            (void*)offsetof(SkinnedVertex, TexCoord));
+        glEnableVertexAttribArray(2);
+        // aBoneIndices, integers in the shader
+        glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, stride,
+            (void*)offsetof(SkinnedVertex, BoneIndices));
+        glEnableVertexAttribArray(3);
+        // aBoneWeights, 0-255 -> 0-1
+        glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+            (void*)offsetof(SkinnedVertex, BoneWeights));
+        glEnableVertexAttribArray(4);
+
+        glBindVertexArray(0);
+
+        unsigned char white[] = { 255, 255, 255, 255 };
+        glGenTextures(1, &whiteTexture);
+        glBindTexture(GL_TEXTURE_2D, whiteTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        setTextureOptions();
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif // !SKINNED_MODEL_H_INCLUDED
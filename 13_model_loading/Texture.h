@@ -20,6 +20,7 @@ typedef struct Texture {
     int numChannels;
     unsigned int id;
     TextureType type;
+    int streamHandle; // TextureStreamer.h handle, -1 if fully resident
 } Texture;
 
 static void setTextureOptions()
@@ -37,6 +38,7 @@ Texture createTexture(const std::string& fileName)
     Texture texture;
 
     texture.fileName = fileName;
+    texture.streamHandle = -1;
     stbi_set_flip_vertically_on_load(true);
     unsigned char* data = stbi_load(fileName.c_str(),
         &texture.width,
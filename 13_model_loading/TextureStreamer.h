@@ -0,0 +1,578 @@
+#ifndef TEXTURE_STREAMER_H_INCLUDED
+#define TEXTURE_STREAMER_H_INCLUDED
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+
+#include <glad/glad.h>
+
+#include "Texture.h"
+#include "ThreadPool.h"
+
+// streams textures in one mip level at a time under a memory budget.
+//
+// The first time an image is registered its whole mip chain is built on the
+// CPU and written next to it as <file>.mips, so afterwards a single level can
+// be read with one seek instead of decoding the full jpg/png. Levels no larger
+// than TEXTURE_STREAMER_TAIL_SIZE (the mip tail) are uploaded immediately and
+// are never evicted. Finer levels are requested each frame from the on screen
+// footprint, read from disk by the worker threads and uploaded on the GL
+// thread in Update(), finest level last.
+//
+// GL 3.3 has no sparse or immutable storage, so residency is expressed with
+// GL_TEXTURE_BASE_LEVEL: only levels [base, numLevels) are defined and
+// sampled. Evicting a level raises the base and respecifies the level as 0x0
+// so the driver can release its memory.
+#define TEXTURE_STREAMER_TAIL_SIZE 128
+#define TEXTURE_STREAMER_CACHE_MAGIC 0x5350494D // "MIPS"
+
+typedef struct TextureStreamerStats {
+    size_t numTextures;
+    size_t numFullQuality;   // textures showing at least the detail they asked for
+    size_t residentBytes;    // texel bytes of every uploaded level
+    size_t budgetBytes;
+    size_t pendingRequests;  // levels being read on the worker threads
+    size_t levelsLoaded;     // totals since Init()
+    size_t levelsEvicted;
+    size_t levelsDiscarded;  // arrived after they stopped being wanted
+    double lastTimeToFullQualityMs; // request -> finest wanted level resident
+    double avgTimeToFullQualityMs;
+} TextureStreamerStats;
+
+class TextureStreamer
+{
+public:
+
+    TextureStreamer() {}
+    ~TextureStreamer() { Shutdown(); }
+
+    void Init(size_t budgetBytes, size_t numThreads = 2)
+    {
+        budget = budgetBytes;
+        pool.Init(numThreads);
+    }
+
+    // waits for any in flight reads
+    void Shutdown()
+    {
+        pool.Shutdown();
+    }
+
+    // build/read the mip cache for fileName and upload its mip tail. The
+    // returned texture id stays valid while levels stream in and out
+    Texture Register(const std::string& fileName, TextureType type)
+    {
+        StreamedTexture tex;
+        tex.cacheFileName = fileName + ".mips";
+
+        int width, height, numChannels;
+        if (!stbi_info(fileName.c_str(), &width, &height, &numChannels)) {
+            std::cout << "Failed to load texture data: " << fileName << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        // 1 and 3 channel images are expanded to RGB, 2 and 4 to RGBA
+        numChannels = (numChannels == 2 || numChannels == 4) ? 4 : 3;
+
+        if (!readMipCacheHeader(tex.cacheFileName, width, height, numChannels)) {
+            std::cout << "TextureStreamer building mip cache: " << tex.cacheFileName << std::endl;
+            buildMipCache(fileName, tex.cacheFileName, numChannels);
+        }
+
+        tex.numChannels = numChannels;
+        tex.internalFormat = numChannels == 4 ? GL_RGBA8 : GL_RGB8;
+        tex.format = numChannels == 4 ? GL_RGBA : GL_RGB;
+        tex.levels = computeMipLevels(width, height, numChannels);
+        tex.tailLevel = (int)tex.levels.size() - 1;
+        while (tex.tailLevel > 0 &&
+               std::max(tex.levels[tex.tailLevel - 1].width, tex.levels[tex.tailLevel - 1].height) <= TEXTURE_STREAMER_TAIL_SIZE)
+        {
+            --tex.tailLevel;
+        }
+        tex.residentLevel = (int)tex.levels.size();
+        tex.desiredLevel = tex.tailLevel;
+        tex.requestedLevel = -1;
+        tex.lastUsedFrame = frame;
+        tex.waitingForFullQuality = false;
+
+        glGenTextures(1, &tex.id);
+        glBindTexture(GL_TEXTURE_2D, tex.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)tex.levels.size() - 1);
+
+        // the tail is small enough to read synchronously, coarsest first
+        for (int level = (int)tex.levels.size() - 1; level >= tex.tailLevel; --level)
+        {
+            std::vector<unsigned char> data;
+            if (!readMipLevel(tex.cacheFileName, tex.levels[level], data)) {
+                std::cout << "Failed to read mip cache: " << tex.cacheFileName << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            uploadLevel(tex, level, &data[0]);
+            ++levelsLoaded;
+        }
+
+        textures.push_back(tex);
+
+        Texture texture;
+        texture.fileName = fileName;
+        texture.width = width;
+        texture.height = height;
+        texture.numChannels = numChannels;
+        texture.id = tex.id;
+        texture.type = type;
+        texture.streamHandle = (int)textures.size() - 1;
+        return texture;
+    }
+
+    // ask for enough detail to cover footprintPixels screen pixels with the
+    // whole texture (i.e. at most one texel per pixel). Call every frame the
+    // texture is visible, before Update(); the finest request wins
+    void RequestFootprint(int handle, float footprintPixels)
+    {
+        StreamedTexture& tex = textures[handle];
+        int level = 0;
+        if (footprintPixels > 0.0f) {
+            const MipLevel& base = tex.levels[0];
+            float texelsPerPixel = (float)std::max(base.width, base.height) / footprintPixels;
+            if (texelsPerPixel > 1.0f) {
+                level = (int)std::floor(std::log2(texelsPerPixel));
+            }
+        }
+        else {
+            level = tex.tailLevel;
+        }
+        level = std::min(level, tex.tailLevel);
+
+        tex.desiredLevel = std::min(tex.desiredLevel, level);
+        tex.lastUsedFrame = frame;
+    }
+
+    // once per frame on the GL thread: upload finished reads, evict under
+    // the budget and issue reads for the next finer level of each texture
+    void Update()
+    {
+        uploadCompletedLevels();
+        updateFullQualityTimers();
+
+        // the budget may have been lowered; unused levels go first
+        if (!makeRoom(0, false)) {
+            makeRoom(0, true);
+        }
+
+        // blurriest textures first
+        std::vector<int> order;
+        for (size_t i = 0; i < textures.size(); ++i)
+        {
+            if (textures[i].requestedLevel < 0 &&
+                textures[i].desiredLevel < textures[i].residentLevel) {
+                order.push_back((int)i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            int gapA = textures[a].residentLevel - textures[a].desiredLevel;
+            int gapB = textures[b].residentLevel - textures[b].desiredLevel;
+            if (gapA != gapB) {
+                return gapA > gapB;
+            }
+            return a < b;
+        });
+        for (int handle : order)
+        {
+            StreamedTexture& tex = textures[handle];
+            int level = tex.residentLevel - 1;
+            const MipLevel& mip = tex.levels[level];
+            if (!makeRoom(mip.bytes, false)) {
+                continue;
+            }
+            requestLevel(handle, level);
+        }
+
+        // next frame starts asking again from the tail
+        for (StreamedTexture& tex : textures) {
+            tex.desiredLevel = tex.tailLevel;
+        }
+        ++frame;
+    }
+
+    void SetBudget(size_t budgetBytes) { budget = budgetBytes; }
+    size_t GetBudget() const { return budget; }
+
+    TextureStreamerStats GetStats() const
+    {
+        TextureStreamerStats stats;
+        stats.numTextures = textures.size();
+        stats.numFullQuality = 0;
+        stats.pendingRequests = 0;
+        for (const StreamedTexture& tex : textures)
+        {
+            if (!tex.waitingForFullQuality) {
+                ++stats.numFullQuality;
+            }
+            if (tex.requestedLevel >= 0) {
+                ++stats.pendingRequests;
+            }
+        }
+        stats.residentBytes = residentBytes;
+        stats.budgetBytes = budget;
+        stats.levelsLoaded = levelsLoaded;
+        stats.levelsEvicted = levelsEvicted;
+        stats.levelsDiscarded = levelsDiscarded;
+        stats.lastTimeToFullQualityMs = lastTimeToFullQualityMs;
+        stats.avgTimeToFullQualityMs = numFullQualityWaits > 0 ?
+            totalTimeToFullQualityMs / numFullQualityWaits : 0.0;
+        return stats;
+    }
+
+private:
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    typedef struct MipLevel {
+        int width;
+        int height;
+        size_t offset; // in the cache file
+        size_t bytes;
+    } MipLevel;
+
+    typedef struct StreamedTexture {
+        std::string cacheFileName;
+        GLuint id;
+        int numChannels;
+        GLint internalFormat;
+        GLenum format;
+        std::vector<MipLevel> levels;
+        int tailLevel;      // levels >= tailLevel are always resident
+        int residentLevel;  // finest uploaded level
+        int desiredLevel;   // finest level asked for this frame
+        int requestedLevel; // level being read, -1 if none
+        uint64_t lastUsedFrame;
+        bool waitingForFullQuality;
+        Clock::time_point waitStart;
+    } StreamedTexture;
+
+    typedef struct LoadedLevel {
+        int handle;
+        int level;
+        bool ok;
+        std::vector<unsigned char> data;
+    } LoadedLevel;
+
+    // magic, width, height, channels, number of levels
+    static const size_t cacheHeaderSize = 5 * sizeof(uint32_t);
+
+    std::vector<StreamedTexture> textures;
+    ThreadPool pool;
+
+    std::mutex completedMutex;
+    std::vector<LoadedLevel> completed; // filled by the workers
+
+    size_t budget = 0;
+    size_t residentBytes = 0;
+    size_t pendingBytes = 0;
+    uint64_t frame = 0;
+
+    size_t levelsLoaded = 0;
+    size_t levelsEvicted = 0;
+    size_t levelsDiscarded = 0;
+    double lastTimeToFullQualityMs = 0.0;
+    double totalTimeToFullQualityMs = 0.0;
+    size_t numFullQualityWaits = 0;
+
+    static std::vector<MipLevel> computeMipLevels(int width, int height, int numChannels)
+    {
+        std::vector<MipLevel> levels;
+        size_t offset = cacheHeaderSize;
+        while (true)
+        {
+            MipLevel level;
+            level.width = width;
+            level.height = height;
+            level.offset = offset;
+            level.bytes = (size_t)width * height * numChannels;
+            levels.push_back(level);
+            offset += level.bytes;
+            if (width == 1 && height == 1) {
+                break;
+            }
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return levels;
+    }
+
+    static bool readMipCacheHeader(const std::string& cacheFileName,
+                                   int width, int height, int numChannels)
+    {
+        FILE* file = fopen(cacheFileName.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        uint32_t header[5];
+        bool ok = fread(header, sizeof(header), 1, file) == 1 &&
+            header[0] == TEXTURE_STREAMER_CACHE_MAGIC &&
+            header[1] == (uint32_t)width &&
+            header[2] == (uint32_t)height &&
+            header[3] == (uint32_t)numChannels &&
+            header[4] == (uint32_t)computeMipLevels(width, height, numChannels).size();
+        fclose(file);
+        return ok;
+    }
+
+    // 2x2 box filter; odd sizes repeat the last row/column
+    static void downsampleMipLevel(const unsigned char* src, int srcWidth, int srcHeight,
+                                   unsigned char* dst, int dstWidth, int dstHeight,
+                                   int numChannels)
+    {
+        for (int y = 0; y < dstHeight; ++y)
+        {
+            int y0 = std::min(y * 2, srcHeight - 1);
+            int y1 = std::min(y * 2 + 1, srcHeight - 1);
+            for (int x = 0; x < dstWidth; ++x)
+            {
+                int x0 = std::min(x * 2, srcWidth - 1);
+                int x1 = std::min(x * 2 + 1, srcWidth - 1);
+                for (int c = 0; c < numChannels; ++c)
+                {
+                    int sum = src[(y0 * srcWidth + x0) * numChannels + c] +
+                        src[(y0 * srcWidth + x1) * numChannels + c] +
+                        src[(y1 * srcWidth + x0) * numChannels + c] +
+                        src[(y1 * srcWidth + x1) * numChannels + c];
+                    dst[(y * dstWidth + x) * numChannels + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    static void buildMipCache(const std::string& fileName,
+                              const std::string& cacheFileName,
+                              int numChannels)
+    {
+        int width, height, fileChannels;
+        stbi_set_flip_vertically_on_load(true);
+        unsigned char* data = stbi_load(fileName.c_str(),
+            &width,
+            &height,
+            &fileChannels,
+            numChannels);
+        if (!data) {
+            std::cout << "Failed to load texture data: " << fileName << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        FILE* file = fopen(cacheFileName.c_str(), "wb");
+        if (!file) {
+            std::cout << "Failed to write mip cache: " << cacheFileName << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        std::vector<MipLevel> levels = computeMipLevels(width, height, numChannels);
+        uint32_t header[5] = {
+            TEXTURE_STREAMER_CACHE_MAGIC,
+            (uint32_t)width,
+            (uint32_t)height,
+            (uint32_t)numChannels,
+            (uint32_t)levels.size()
+        };
+        fwrite(header, sizeof(header), 1, file);
+        fwrite(data, levels[0].bytes, 1, file);
+
+        std::vector<unsigned char> src(data, data + levels[0].bytes);
+        std::vector<unsigned char> dst;
+        stbi_image_free(data);
+        for (size_t i = 1; i < levels.size(); ++i)
+        {
+            dst.resize(levels[i].bytes);
+            downsampleMipLevel(&src[0], levels[i - 1].width, levels[i - 1].height,
+                &dst[0], levels[i].width, levels[i].height,
+                numChannels);
+            fwrite(&dst[0], levels[i].bytes, 1, file);
+            src.swap(dst);
+        }
+        fclose(file);
+    }
+
+    static bool readMipLevel(const std::string& cacheFileName,
+                             const MipLevel& level,
+                             std::vector<unsigned char>& data)
+    {
+        FILE* file = fopen(cacheFileName.c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        data.resize(level.bytes);
+        bool ok = fseek(file, (long)level.offset, SEEK_SET) == 0 &&
+            fread(&data[0], level.bytes, 1, file) == 1;
+        fclose(file);
+        return ok;
+    }
+
+    void uploadLevel(StreamedTexture& tex, int level, const unsigned char* data)
+    {
+        const MipLevel& mip = tex.levels[level];
+        glBindTexture(GL_TEXTURE_2D, tex.id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows aren't 4 byte aligned
+        glTexImage2D(GL_TEXTURE_2D,
+            level,
+            tex.internalFormat,
+            mip.width,
+            mip.height,
+            0,
+            tex.format,
+            GL_UNSIGNED_BYTE,
+            data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+        tex.residentLevel = level;
+        residentBytes += mip.bytes;
+    }
+
+    void evictFinestLevel(StreamedTexture& tex)
+    {
+        int level = tex.residentLevel;
+        glBindTexture(GL_TEXTURE_2D, tex.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+        glTexImage2D(GL_TEXTURE_2D,
+            level,
+            tex.internalFormat,
+            0,
+            0,
+            0,
+            tex.format,
+            GL_UNSIGNED_BYTE,
+            NULL);
+
+        tex.residentLevel = level + 1;
+        residentBytes -= tex.levels[level].bytes;
+        ++levelsEvicted;
+    }
+
+    // evict least recently used levels until extraBytes more fit in the
+    // budget. Without allowInUse only textures not requested this frame, or
+    // with more detail than they asked for, may lose levels
+    bool makeRoom(size_t extraBytes, bool allowInUse)
+    {
+        while (residentBytes + pendingBytes + extraBytes > budget)
+        {
+            int victim = -1;
+            for (size_t i = 0; i < textures.size(); ++i)
+            {
+                const StreamedTexture& tex = textures[i];
+                if (tex.residentLevel >= tex.tailLevel) {
+                    continue;
+                }
+                bool surplus = tex.residentLevel < tex.desiredLevel;
+                if (!allowInUse && tex.lastUsedFrame == frame && !surplus) {
+                    continue;
+                }
+                if (victim < 0) {
+                    victim = (int)i;
+                    continue;
+                }
+                const StreamedTexture& best = textures[victim];
+                if (tex.lastUsedFrame != best.lastUsedFrame) {
+                    if (tex.lastUsedFrame < best.lastUsedFrame) {
+                        victim = (int)i;
+                    }
+                }
+                else if (tex.levels[tex.residentLevel].bytes > best.levels[best.residentLevel].bytes) {
+                    victim = (int)i;
+                }
+            }
+            if (victim < 0) {
+                return false;
+            }
+            evictFinestLevel(textures[victim]);
+        }
+        return true;
+    }
+
+    void requestLevel(int handle, int level)
+    {
+        StreamedTexture& tex = textures[handle];
+        tex.requestedLevel = level;
+        MipLevel mip = tex.levels[level];
+        pendingBytes += mip.bytes;
+
+        std::string cacheFileName = tex.cacheFileName;
+        pool.Push([this, handle, level, mip, cacheFileName]() {
+            LoadedLevel loaded;
+            loaded.handle = handle;
+            loaded.level = level;
+            loaded.ok = readMipLevel(cacheFileName, mip, loaded.data);
+
+            std::lock_guard<std::mutex> lock(completedMutex);
+            completed.push_back(std::move(loaded));
+        });
+    }
+
+    void uploadCompletedLevels()
+    {
+        std::vector<LoadedLevel> loadedLevels;
+        {
+            std::lock_guard<std::mutex> lock(completedMutex);
+            loadedLevels.swap(completed);
+        }
+
+        for (LoadedLevel& loaded : loadedLevels)
+        {
+            StreamedTexture& tex = textures[loaded.handle];
+            const MipLevel& mip = tex.levels[loaded.level];
+            tex.requestedLevel = -1;
+            pendingBytes -= mip.bytes;
+
+            if (!loaded.ok) {
+                std::cout << "Failed to read mip cache: " << tex.cacheFileName << std::endl;
+                ++levelsDiscarded;
+                continue;
+            }
+            // levels have to arrive finest-after-coarser; anything else was
+            // overtaken by an eviction or is no longer wanted
+            if (loaded.level != tex.residentLevel - 1 ||
+                loaded.level < tex.desiredLevel ||
+                residentBytes + pendingBytes + mip.bytes > budget) {
+                ++levelsDiscarded;
+                continue;
+            }
+            uploadLevel(tex, loaded.level, &loaded.data[0]);
+            ++levelsLoaded;
+        }
+    }
+
+    void updateFullQualityTimers()
+    {
+        Clock::time_point now = Clock::now();
+        for (StreamedTexture& tex : textures)
+        {
+            // textures off screen this frame keep whatever state they had
+            if (tex.lastUsedFrame != frame) {
+                continue;
+            }
+            bool wantsMore = tex.desiredLevel < tex.residentLevel;
+            if (wantsMore && !tex.waitingForFullQuality) {
+                tex.waitingForFullQuality = true;
+                tex.waitStart = now;
+            }
+            else if (!wantsMore && tex.waitingForFullQuality) {
+                tex.waitingForFullQuality = false;
+                lastTimeToFullQualityMs =
+                    std::chrono::duration<double, std::milli>(now - tex.waitStart).count();
+                totalTimeToFullQualityMs += lastTimeToFullQualityMs;
+                ++numFullQualityWaits;
+            }
+        }
+    }
+};
+
+#endif // !TEXTURE_STREAMER_H_INCLUDED
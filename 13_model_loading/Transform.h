@@ -43,6 +43,23 @@ glm::mat4 createTransformationMatrix()
     return transMat;
 }
 
+// projection * view for the camera, i.e. world->clip space
+glm::mat4 createViewProjectionMatrix(const Camera& camera)
+{
+    glm::mat4 viewMat = glm::lookAt(
+        camera.position,
+        camera.position + camera.front,
+        camera.up);
+    float aspectRatio = 800.0F / 600.0F;
+    float nearClip = 0.1F;
+    float farClip = 100.0F;
+    glm::mat4 projMat = glm::perspective(glm::radians(camera.FOV),
+        aspectRatio,
+        nearClip,
+        farClip);
+    return projMat * viewMat;
+}
+
 void updateTransformationMatrix(glm::mat4& transMat, 
                                 const glm::vec3& objectPosition,
                                 const Camera& camera)
@@ -0,0 +1,265 @@
+#ifndef TRANSFORM_HIERARCHY_H_INCLUDED
+#define TRANSFORM_HIERARCHY_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_HIERARCHY_SSE
+#endif
+
+// out = a * b for column major 4x4 matrices. out must not be b
+inline void multiplyMat4(const float* a, const float* b, float* out)
+{
+#ifdef TRANSFORM_HIERARCHY_SSE
+    // each column of out is the columns of a weighted by a column of b
+    __m128 a0 = _mm_loadu_ps(a + 0);
+    __m128 a1 = _mm_loadu_ps(a + 4);
+    __m128 a2 = _mm_loadu_ps(a + 8);
+    __m128 a3 = _mm_loadu_ps(a + 12);
+    for (int j = 0; j < 4; j++)
+    {
+        __m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[4 * j + 0]));
+        column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[4 * j + 1])));
+        column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[4 * j + 2])));
+        column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[4 * j + 3])));
+        _mm_storeu_ps(out + 4 * j, column);
+    }
+#else
+    for (int j = 0; j < 4; j++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            out[4 * j + i] = a[i] * b[4 * j + 0] +
+                a[4 + i] * b[4 * j + 1] +
+                a[8 + i] * b[4 * j + 2] +
+                a[12 + i] * b[4 * j + 3];
+        }
+    }
+#endif
+}
+
+// splits a matrix into translation, rotation and scale; shear is lost
+inline void decomposeTransform(const glm::mat4& m,
+    glm::vec3& translation,
+    glm::quat& rotation,
+    glm::vec3& scale)
+{
+    scale = glm::vec3(glm::length(glm::vec3(m[0])),
+        glm::length(glm::vec3(m[1])),
+        glm::length(glm::vec3(m[2])));
+    glm::mat3 basis(glm::vec3(m[0]) / (scale.x > 0.0f ? scale.x : 1.0f),
+        glm::vec3(m[1]) / (scale.y > 0.0f ? scale.y : 1.0f),
+        glm::vec3(m[2]) / (scale.z > 0.0f ? scale.z : 1.0f));
+    // a mirrored basis isn't a rotation; keep the mirror in the scale
+    if (glm::dot(glm::cross(basis[0], basis[1]), basis[2]) < 0.0f) {
+        scale.x = -scale.x;
+        basis[0] = -basis[0];
+    }
+    translation = glm::vec3(m[3]);
+    rotation = glm::quat_cast(basis);
+}
+
+// out = T * R * S
+inline void composeTransform(const glm::vec3& translation,
+    const glm::quat& rotation,
+    const glm::vec3& scale,
+    glm::mat4& out)
+{
+    glm::mat3 basis = glm::mat3_cast(rotation);
+    out[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+    out[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+    out[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+    out[3] = glm::vec4(translation, 1.0f);
+}
+
+// parent/child transforms for a scene, e.g. the nodes of a Model. Every
+// node has a local translation/rotation/scale relative to its parent and
+// a world matrix, each kept in its own array indexed by node. Nodes are
+// stored parents first, which AddNode() enforces, so one pass in index
+// order sees every parent before its children.
+//
+// SetLocal() keeps the matrix as given, shear and all, so imported nodes
+// match their source exactly; the TRS setters rebuild the local matrix
+// from translation/rotation/scale, which for a sheared node drops the
+// shear from then on.
+//
+// Changing a node only marks it dirty. Update() then rebuilds the
+// local matrices of the dirty nodes and the world matrices of those
+// nodes and everything below them, starting from the first dirty node;
+// nodes before it and untouched subtrees are skipped.
+//
+//   size_t root = transforms.AddNode(-1, glm::mat4(1.0f));
+//   size_t arm = transforms.AddNode(root, armMatrix);
+//   transforms.SetRotation(arm, glm::angleAxis(angle, axis));
+//   transforms.Update();
+//   draw(transforms.GetWorld(arm));
+class TransformHierarchy
+{
+public:
+
+    TransformHierarchy() :
+        firstDirty(0),
+        stamp(0),
+        numUpdated(0)
+    {}
+
+    void Reserve(size_t numNodes)
+    {
+        parents.reserve(numNodes);
+        translations.reserve(numNodes);
+        rotations.reserve(numNodes);
+        scales.reserve(numNodes);
+        locals.reserve(numNodes);
+        worlds.reserve(numNodes);
+        localDirty.reserve(numNodes);
+        updated.reserve(numNodes);
+    }
+
+    // parent must already exist (-1 = no parent), so nodes are always in
+    // an order where parents come first. Returns the node index
+    size_t AddNode(int32_t parent, const glm::mat4& local)
+    {
+        size_t node = parents.size();
+        if (parent >= (int32_t)node) {
+            std::cout << "TransformHierarchy: parent " << parent << " added after its child" << std::endl;
+            parent = -1;
+        }
+        parents.push_back(parent);
+        translations.push_back(glm::vec3(0.0f));
+        rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+        scales.push_back(glm::vec3(1.0f));
+        locals.push_back(glm::mat4(1.0f));
+        worlds.push_back(glm::mat4(1.0f));
+        localDirty.push_back(LOCAL_CLEAN);
+        updated.push_back(0);
+        SetLocal(node, local);
+        return node;
+    }
+
+    // used as is; the TRS the other setters start from is its
+    // decomposition, without any shear
+    void SetLocal(size_t node, const glm::mat4& local)
+    {
+        locals[node] = local;
+        decomposeTransform(local, translations[node], rotations[node], scales[node]);
+        markDirty(node, LOCAL_SET);
+    }
+
+    void SetTranslation(size_t node, const glm::vec3& translation)
+    {
+        translations[node] = translation;
+        markDirty(node, LOCAL_FROM_TRS);
+    }
+
+    void SetRotation(size_t node, const glm::quat& rotation)
+    {
+        rotations[node] = rotation;
+        markDirty(node, LOCAL_FROM_TRS);
+    }
+
+    void SetScale(size_t node, const glm::vec3& scale)
+    {
+        scales[node] = scale;
+        markDirty(node, LOCAL_FROM_TRS);
+    }
+
+    // brings every world matrix up to date; cheap when nothing changed
+    void Update()
+    {
+        numUpdated = 0;
+        size_t numNodes = parents.size();
+        if (firstDirty >= numNodes) {
+            return;
+        }
+        stamp++;
+
+        // dirty locals first, so the world pass below is only matrix
+        // products over the arrays
+        for (size_t i = firstDirty; i < numNodes; i++)
+        {
+            if (localDirty[i]) {
+                if (localDirty[i] == LOCAL_FROM_TRS) {
+                    composeLocal(i);
+                }
+                localDirty[i] = LOCAL_CLEAN;
+                updated[i] = stamp;
+            }
+        }
+
+        // a node needs a new world matrix if its local changed or its
+        // parent's world did; parents were handled earlier in this loop
+        for (size_t i = firstDirty; i < numNodes; i++)
+        {
+            int32_t parent = parents[i];
+            bool parentChanged = parent >= 0 && updated[parent] == stamp;
+            if (!parentChanged && updated[i] != stamp) {
+                continue;
+            }
+            if (parent >= 0) {
+                multiplyMat4(glm::value_ptr(worlds[parent]),
+                    glm::value_ptr(locals[i]),
+                    glm::value_ptr(worlds[i]));
+            }
+            else {
+                worlds[i] = locals[i];
+            }
+            updated[i] = stamp;
+            numUpdated++;
+        }
+
+        firstDirty = numNodes;
+    }
+
+    size_t Size() const { return parents.size(); }
+    int32_t GetParent(size_t node) const { return parents[node]; }
+    const glm::mat4& GetLocal(size_t node) const { return locals[node]; }
+    // as of the last Update()
+    const glm::mat4& GetWorld(size_t node) const { return worlds[node]; }
+    const std::vector<glm::mat4>& GetWorlds() const { return worlds; }
+    // world matrices recomputed by the last Update()
+    size_t GetNumUpdated() const { return numUpdated; }
+
+private:
+
+    std::vector<int32_t> parents;   // -1 = root
+    std::vector<glm::vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint8_t> localDirty; // LOCAL_*
+    std::vector<uint32_t> updated;  // == stamp if the node changed in this Update()
+
+    size_t firstDirty;  // nodes before this are up to date
+    uint32_t stamp;
+    size_t numUpdated;
+
+    enum : uint8_t {
+        LOCAL_CLEAN = 0,
+        LOCAL_SET = 1,      // locals[node] was set directly, only its world changes
+        LOCAL_FROM_TRS = 2  // locals[node] has to be rebuilt from TRS
+    };
+
+    void markDirty(size_t node, uint8_t change)
+    {
+        // the last change before Update() decides how the local is built
+        localDirty[node] = change;
+        firstDirty = std::min(firstDirty, node);
+    }
+
+    void composeLocal(size_t node)
+    {
+        composeTransform(translations[node], rotations[node], scales[node], locals[node]);
+    }
+};
+
+#endif // !TRANSFORM_HIERARCHY_H_INCLUDED
@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+in vec3 FragPosition;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform sampler2D uDiffuse;
+uniform vec3 uLightDirection;
+
+// a single directional light; crowds are about the vertex work
+void main()
+{
+    vec3 albedo = texture(uDiffuse, TexCoords).rgb;
+    float diffuse = max(dot(normalize(Normal), normalize(-uLightDirection)), 0.0);
+    FragColor = vec4(albedo * (0.2 + 0.8 * diffuse), 1.0);
+}
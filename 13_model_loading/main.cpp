@@ -3,6 +3,8 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <chrono>
+#include <functional>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +21,12 @@
 #include "Camera.h"
 #include "LightSource.h"
 #include "Mesh.h"
+#include "TextureStreamer.h"
+#include "ProcessMemory.h"
+#include "TransformHierarchy.h"
+#include "ThreadPool.h"
+#include "SkinnedModel.h"
+#include "SkinnedCrowd.h"
 
 
 // Globals
@@ -33,6 +41,7 @@ Cube gCube;
 glm::mat4 gCubeModelMat;
 
 Model gModel;
+TextureStreamer gTextureStreamer;
 glm::mat4 gModelModelMat;
 glm::vec3 gModelPosition = glm::vec3(0.0f, 0.0f, 0.0f);
 
@@ -48,6 +57,18 @@ ShaderProgram gLightShaderProgram;
 glm::mat4 gModelTransMat;
 glm::mat4 gLightTransMat;
 Camera gCamera;
+
+// a crowd of an animated model given as argv[1], drawn in front of the
+// backpack; C grows/shrinks it to what fits in CROWD_FRAME_BUDGET_MS
+#define CROWD_FRAME_BUDGET_MS 16.7
+SkinnedModel gSkinnedModel;
+SkinnedCrowd gCrowd;
+ThreadPool gCrowdThreads;
+bool gHasCrowd = false;
+bool gCrowdBenchmark = false;
+Shader gSkinnedVertexShader;
+Shader gSkinnedFragmentShader;
+ShaderProgram gSkinnedShaderProgram;
 ////////////////////////////////////////////////////
 
 // GLFW callback functions
@@ -273,20 +294,20 @@ static void draw()
     glClearColor(r, g, b, a);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // draw the model
+    // draw the model; Model::Draw() sets uModel and uTransform for each
+    // mesh from its node transform
     glUseProgram(gShaderProgram.id);
-    updateTransformationMatrix(gModelTransMat, gModelPosition, gCamera);
-    glUniformMatrix4fv(gUniformLocations["uTransform"],
-        1, // number of matrices
-        GL_FALSE, // should the matrices be transposed?
-        glm::value_ptr(gModelTransMat)); // pointer to data
     gModelModelMat = glm::mat4(1.0F);
     gModelModelMat = glm::translate(gModelModelMat, gModelPosition);
-    glUniformMatrix4fv(gUniformLocations["uModel"],
-        1,
-        GL_FALSE,
-        glm::value_ptr(gModelModelMat));
-    gModel.Draw(gShaderProgram);
+    gModel.Draw(gShaderProgram,
+        gUniformLocations["uModel"],
+        gUniformLocations["uTransform"],
+        gModelModelMat,
+        createViewProjectionMatrix(gCamera));
+
+    if (gHasCrowd) {
+        gCrowd.Draw(createViewProjectionMatrix(gCamera), gLightDirection);
+    }
 
     // draw the light source
     glUseProgram(gLightShaderProgram.id);
@@ -294,7 +315,86 @@ static void draw()
     glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
 }
 
-int main(void)
+// times TransformHierarchy::Update() on a hierarchy of numNodes nodes
+// where each node has 4 children, for a few kinds of change
+static void benchmarkTransformHierarchy(size_t numNodes)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    TransformHierarchy transforms;
+    transforms.Reserve(numNodes);
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        glm::mat4 local = glm::translate(glm::mat4(1.0F), glm::vec3(1.0F, 0.0F, 0.0F));
+        local = glm::rotate(local, glm::radians(float(i % 360)), glm::vec3(0.0F, 1.0F, 0.0F));
+        transforms.AddNode(i == 0 ? -1 : int32_t((i - 1) / 4), local);
+    }
+
+    const int numRuns = 10;
+    auto timeUpdates = [&](const char* name, const std::function<void(int)>& change) {
+        double totalMs = 0.0;
+        for (int run = 0; run < numRuns; run++)
+        {
+            change(run);
+            auto start = Clock::now();
+            transforms.Update();
+            totalMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+        double ms = totalMs / numRuns;
+        std::cout << "  " << name << ": " << ms << " ms, "
+            << transforms.GetNumUpdated() << " world matrices, "
+            << (ms > 0.0 ? transforms.GetNumUpdated() / (ms * 1000.0) : 0.0) << " M nodes/s" << std::endl;
+    };
+
+    std::cout << "Transform hierarchy, " << numNodes << " nodes:" << std::endl;
+    timeUpdates("every node changed", [&](int run) {
+        for (size_t i = 0; i < numNodes; i++) {
+            transforms.SetScale(i, glm::vec3(1.0F + 0.01F * run));
+        }
+    });
+    timeUpdates("root moved", [&](int run) {
+        transforms.SetTranslation(0, glm::vec3(float(run), 0.0F, 0.0F));
+    });
+    timeUpdates("1% of the nodes moved", [&](int run) {
+        for (size_t i = 0; i < numNodes / 100; i++) {
+            size_t node = (i * 2654435761u + run) % numNodes;
+            transforms.SetTranslation(node, glm::vec3(1.0F, 0.01F * run, 0.0F));
+        }
+    });
+    timeUpdates("nothing changed", [&](int run) {});
+}
+
+// while the crowd benchmark is on, every half second grows the crowd if
+// frames took less than the budget and shrinks it if they took more, so
+// it settles at about as many characters as fit in a frame
+static void updateCrowdBudget(double frameMs)
+{
+    static double totalMs = 0.0;
+    static size_t numFrames = 0;
+    static double lastAdjustTime = glfwGetTime();
+    totalMs += frameMs;
+    numFrames++;
+    if (glfwGetTime() - lastAdjustTime < 0.5) {
+        return;
+    }
+
+    double averageMs = totalMs / numFrames;
+    size_t numCharacters = gCrowd.Size();
+    if (averageMs < CROWD_FRAME_BUDGET_MS * 0.9) {
+        numCharacters = std::max<size_t>(numCharacters + 1, numCharacters * 5 / 4);
+    }
+    else if (averageMs > CROWD_FRAME_BUDGET_MS) {
+        numCharacters = std::max<size_t>(numCharacters * 4 / 5, 1);
+    }
+    gCrowd.Resize(numCharacters);
+
+    totalMs = 0.0;
+    numFrames = 0;
+    lastAdjustTime = glfwGetTime();
+}
+
+// argv[1]: optional animated model (e.g. an FBX or glTF character) for
+// the skinned crowd
+int main(int argc, char** argv)
 {
     initGlfw();
     createWindow();
@@ -322,8 +422,25 @@ int main(void)
         gFragmentShader);
     glUseProgram(gShaderProgram.id);
 
+    // TextureStreamer.h
+    // 96MB holds the backpack's diffuse and specular maps at full detail
+    // for one of them at a time; [ and ] halve/double it at runtime
+    gTextureStreamer.Init(96 * 1024 * 1024);
+
     // Model.h
-    gModel.Load("backpack/backpack.obj");
+    // the peak RSS is only meaningful for the import once the texture mip
+    // caches exist, since building them decodes every texture first
+    size_t peakBytesBeforeImport = getPeakResidentBytes();
+    gModel.Load("backpack/backpack.obj", &gTextureStreamer);
+    const ModelImportStats& importStats = gModel.GetImportStats();
+    std::cout << "Model import: " << importStats.totalMs << " ms (Assimp "
+        << importStats.readMs << " ms), "
+        << importStats.numMeshes << " meshes, "
+        << importStats.numVertices << " vertices, "
+        << importStats.numIndices << " indices, "
+        << importStats.cpuGeometryBytes / 1024 << " KB geometry kept, "
+        << "peak RSS " << peakBytesBeforeImport / (1024 * 1024) << " -> "
+        << getPeakResidentBytes() / (1024 * 1024) << " MB" << std::endl;
 
     gUniformLocations["uCameraPosition"] = glGetUniformLocation(gShaderProgram.id, "uCameraPosition");
     gUniformLocations["uTransform"] = glGetUniformLocation(gShaderProgram.id, "uTransform");
@@ -365,6 +482,18 @@ int main(void)
     // Transform.h
     gLightTransMat = createTransformationMatrix();
 
+    // SkinnedModel.h/SkinnedCrowd.h
+    if (argc > 1 && gSkinnedModel.Load(argv[1])) {
+        gSkinnedVertexShader = createVertexShader("vertexShader_skinned.glsl");
+        gSkinnedFragmentShader = createFragmentShader("fragmentShader_skinned.glsl");
+        gSkinnedShaderProgram = createShaderProgram(gSkinnedVertexShader,
+            gSkinnedFragmentShader);
+        gCrowdThreads.Init();
+        gCrowd.Init(&gSkinnedModel, &gCrowdThreads, gSkinnedShaderProgram);
+        gCrowd.Resize(100);
+        gHasCrowd = true;
+    }
+
     while (!glfwWindowShouldClose(gWindow))
     {
         if (glfwGetKey(gWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
@@ -382,6 +511,52 @@ int main(void)
             gCube.renderMode = rectRenderModes[renderIndex];
         }
 
+        // [ and ] halve/double the texture streaming budget
+        static bool budgetDownWasPressed = false;
+        static bool budgetUpWasPressed = false;
+        bool budgetDownPressed = glfwGetKey(gWindow, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS;
+        bool budgetUpPressed = glfwGetKey(gWindow, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+        if (budgetDownPressed && !budgetDownWasPressed) {
+            gTextureStreamer.SetBudget(std::max<size_t>(gTextureStreamer.GetBudget() / 2, 1024 * 1024));
+            std::cout << "Texture budget: " << gTextureStreamer.GetBudget() / (1024 * 1024) << " MB" << std::endl;
+        }
+        if (budgetUpPressed && !budgetUpWasPressed) {
+            gTextureStreamer.SetBudget(gTextureStreamer.GetBudget() * 2);
+            std::cout << "Texture budget: " << gTextureStreamer.GetBudget() / (1024 * 1024) << " MB" << std::endl;
+        }
+        budgetDownWasPressed = budgetDownPressed;
+        budgetUpWasPressed = budgetUpPressed;
+
+        // press B to benchmark the node transform updates
+        static bool benchmarkWasPressed = false;
+        bool benchmarkPressed = glfwGetKey(gWindow, GLFW_KEY_B) == GLFW_PRESS;
+        if (benchmarkPressed && !benchmarkWasPressed) {
+            benchmarkTransformHierarchy(1000000);
+        }
+        benchmarkWasPressed = benchmarkPressed;
+
+        // press C to size the crowd to the frame budget; vsync is off
+        // meanwhile so the frame time isn't rounded up to the refresh rate
+        static bool crowdBenchmarkWasPressed = false;
+        bool crowdBenchmarkPressed = glfwGetKey(gWindow, GLFW_KEY_C) == GLFW_PRESS;
+        if (crowdBenchmarkPressed && !crowdBenchmarkWasPressed && gHasCrowd) {
+            gCrowdBenchmark = !gCrowdBenchmark;
+            glfwSwapInterval(gCrowdBenchmark ? 0 : 1);
+            std::cout << "Crowd benchmark: " << (gCrowdBenchmark ? "on" : "off") << std::endl;
+        }
+        crowdBenchmarkWasPressed = crowdBenchmarkPressed;
+
+        static double lastFrameTime = glfwGetTime();
+        double frameTime = glfwGetTime();
+        double frameSeconds = frameTime - lastFrameTime;
+        lastFrameTime = frameTime;
+        if (gHasCrowd) {
+            if (gCrowdBenchmark) {
+                updateCrowdBudget(frameSeconds * 1000.0);
+            }
+            gCrowd.Update((float)frameSeconds);
+        }
+
         moveCamera();
 
         // move the light around
@@ -397,10 +572,52 @@ int main(void)
 
         draw();
 
+        // pick texture detail from what was just drawn; new levels
+        // show up from next frame on
+        gModel.RequestTextureDetail(gModelModelMat,
+            gCamera.position,
+            gCamera.FOV,
+            (float)WINDOW_HEIGHT);
+        gTextureStreamer.Update();
+
+        static double lastStatsTime = glfwGetTime();
+        if (glfwGetTime() - lastStatsTime >= 1.0) {
+            lastStatsTime = glfwGetTime();
+            TextureStreamerStats stats = gTextureStreamer.GetStats();
+            std::cout << "Textures: "
+                << stats.residentBytes / (1024 * 1024) << "/"
+                << stats.budgetBytes / (1024 * 1024) << " MB resident, "
+                << stats.numFullQuality << "/" << stats.numTextures << " full quality, "
+                << stats.pendingRequests << " pending, "
+                << stats.levelsLoaded << " loaded, "
+                << stats.levelsEvicted << " evicted, "
+                << stats.levelsDiscarded << " discarded, "
+                << "time to full quality last/avg: "
+                << stats.lastTimeToFullQualityMs << "/"
+                << stats.avgTimeToFullQualityMs << " ms" << std::endl;
+            if (gHasCrowd) {
+                std::cout << "Crowd: " << gCrowd.Size() << " characters at "
+                    << frameSeconds * 1000.0 << " ms/frame ("
+                    << CROWD_FRAME_BUDGET_MS << " ms budget), animation "
+                    << gCrowd.GetAnimationMs() << " ms on "
+                    << gCrowdThreads.NumThreads() << " threads"
+                    << (gCrowd.Size() == gCrowd.MaxCharacters() ? " (buffer texture full)" : "")
+                    << std::endl;
+            }
+        }
+
         glfwSwapBuffers(gWindow);
         glfwPollEvents();
     }
 
+    gTextureStreamer.Shutdown();
+    if (gHasCrowd) {
+        gCrowd.Delete();
+        gSkinnedModel.Delete();
+        gCrowdThreads.Shutdown();
+        glDeleteShader(gSkinnedVertexShader.id);
+        glDeleteShader(gSkinnedFragmentShader.id);
+    }
     glDeleteShader(gVertexShader.id);
     glDeleteShader(gFragmentShader.id);
     glfwTerminate();
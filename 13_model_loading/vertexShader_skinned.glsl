@@ -0,0 +1,42 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal; // packed 10 bits per component
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in uvec4 aBoneIndices;
+layout (location = 4) in vec4 aBoneWeights; // sum to 1
+
+// uNumBones palettes per instance, each bone the top 3 rows of its
+// matrix in 3 texels (see computeBonePalette() in Skeleton.h). The
+// instance's model matrix is already part of it
+uniform samplerBuffer uBonePalettes;
+uniform int uNumBones;
+uniform mat4 uViewProjection;
+
+// normal and fragment position (in world space) for lighting calculation
+out vec3 Normal;
+out vec3 FragPosition;
+out vec2 TexCoords;
+
+void main()
+{
+    // blend the bone matrices, then transform once
+    int firstTexel = gl_InstanceID * uNumBones * 3;
+    vec4 row0 = vec4(0.0);
+    vec4 row1 = vec4(0.0);
+    vec4 row2 = vec4(0.0);
+    for (int i = 0; i < 4; i++)
+    {
+        int texel = firstTexel + int(aBoneIndices[i]) * 3;
+        row0 += aBoneWeights[i] * texelFetch(uBonePalettes, texel);
+        row1 += aBoneWeights[i] * texelFetch(uBonePalettes, texel + 1);
+        row2 += aBoneWeights[i] * texelFetch(uBonePalettes, texel + 2);
+    }
+
+    vec4 position = vec4(aPos, 1.0);
+    vec3 worldPos = vec3(dot(row0, position), dot(row1, position), dot(row2, position));
+    gl_Position = uViewProjection * vec4(worldPos, 1.0);
+    // fine as long as the bones don't scale unevenly
+    Normal = vec3(dot(row0.xyz, aNormal), dot(row1.xyz, aNormal), dot(row2.xyz, aNormal));
+    FragPosition = worldPos;
+    TexCoords = aTexCoords;
+}
@@ -0,0 +1,193 @@
+#ifndef BOUNDING_BOX_H_INCLUDED
+#define BOUNDING_BOX_H_INCLUDED
+
+#include <cfloat>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// axis aligned bounding box
+typedef struct BoundingBox {
+    glm::vec3 min;
+    glm::vec3 max;
+} BoundingBox;
+
+// the six clip planes of a camera, stored structure-of-arrays style
+// so four planes can be tested at once. Planes 6 and 7 are padding
+// that always pass (normal of zero, large positive distance)
+typedef struct Frustum {
+    float nx[8];
+    float ny[8];
+    float nz[8];
+    float d[8];
+} Frustum;
+
+// results of testing a box against a frustum
+enum class CullResult {
+    Outside,
+    Intersecting,
+    Inside
+};
+
+// an "empty" box that any point will expand
+static inline BoundingBox createEmptyBoundingBox()
+{
+    BoundingBox box;
+    box.min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    box.max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    return box;
+}
+
+static inline void growBoundingBox(BoundingBox& box, const glm::vec3& point)
+{
+    box.min = glm::min(box.min, point);
+    box.max = glm::max(box.max, point);
+}
+
+static inline void growBoundingBox(BoundingBox& box, const BoundingBox& other)
+{
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+static inline glm::vec3 boundingBoxCenter(const BoundingBox& box)
+{
+    return (box.min + box.max) * 0.5f;
+}
+
+// used as the cost metric when building the BVH
+static inline float boundingBoxSurfaceArea(const BoundingBox& box)
+{
+    glm::vec3 e = box.max - box.min;
+    if (e.x < 0.0f || e.y < 0.0f || e.z < 0.0f) {
+        return 0.0f;
+    }
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+// transform a local space box into a (possibly larger) world space box
+// using the center/extents method (Arvo) instead of transforming all 8 corners
+BoundingBox transformBoundingBox(const BoundingBox& box, const glm::mat4& modelMat)
+{
+    glm::vec3 center = boundingBoxCenter(box);
+    glm::vec3 extents = (box.max - box.min) * 0.5f;
+
+    glm::vec3 newCenter = glm::vec3(modelMat * glm::vec4(center, 1.0f));
+    glm::vec3 newExtents(0.0f);
+    for (int col = 0; col < 3; ++col) {
+        for (int row = 0; row < 3; ++row) {
+            newExtents[row] += std::fabs(modelMat[col][row]) * extents[col];
+        }
+    }
+
+    BoundingBox res;
+    res.min = newCenter - newExtents;
+    res.max = newCenter + newExtents;
+    return res;
+}
+
+// extract the clip planes from a combined projection * view matrix
+// (Gribb/Hartmann). Plane normals point towards the inside of the frustum
+Frustum createFrustum(const glm::mat4& projViewMat)
+{
+    Frustum frustum;
+
+    // glm matrices are column major: m[col][row]
+    #define ROW(r) glm::vec4(projViewMat[0][r], projViewMat[1][r], projViewMat[2][r], projViewMat[3][r])
+    glm::vec4 planes[6] = {
+        ROW(3) + ROW(0), // left
+        ROW(3) - ROW(0), // right
+        ROW(3) + ROW(1), // bottom
+        ROW(3) - ROW(1), // top
+        ROW(3) + ROW(2), // near
+        ROW(3) - ROW(2)  // far
+    };
+    #undef ROW
+
+    for (size_t i = 0; i < 6; ++i)
+    {
+        float len = glm::length(glm::vec3(planes[i]));
+        frustum.nx[i] = planes[i].x / len;
+        frustum.ny[i] = planes[i].y / len;
+        frustum.nz[i] = planes[i].z / len;
+        frustum.d[i] = planes[i].w / len;
+    }
+    for (size_t i = 6; i < 8; ++i)
+    {
+        frustum.nx[i] = 0.0f;
+        frustum.ny[i] = 0.0f;
+        frustum.nz[i] = 0.0f;
+        frustum.d[i] = FLT_MAX;
+    }
+
+    return frustum;
+}
+
+// test a box against all planes of the frustum. For each plane the signed
+// distance of the box center (s) is compared against the projected radius
+// of the box onto the plane normal (r):
+//   s + r < 0 for any plane  -> completely outside
+//   s - r >= 0 for all planes -> completely inside
+CullResult testFrustumBoundingBox(const Frustum& frustum, const BoundingBox& box)
+{
+    glm::vec3 c = boundingBoxCenter(box);
+    glm::vec3 e = (box.max - box.min) * 0.5f;
+
+#ifdef __SSE2__
+    const __m128 cx = _mm_set1_ps(c.x);
+    const __m128 cy = _mm_set1_ps(c.y);
+    const __m128 cz = _mm_set1_ps(c.z);
+    const __m128 ex = _mm_set1_ps(e.x);
+    const __m128 ey = _mm_set1_ps(e.y);
+    const __m128 ez = _mm_set1_ps(e.z);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    int outsideMask = 0;
+    int intersectMask = 0;
+    for (size_t i = 0; i < 8; i += 4)
+    {
+        __m128 nx = _mm_loadu_ps(&frustum.nx[i]);
+        __m128 ny = _mm_loadu_ps(&frustum.ny[i]);
+        __m128 nz = _mm_loadu_ps(&frustum.nz[i]);
+        __m128 d = _mm_loadu_ps(&frustum.d[i]);
+
+        __m128 s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                              _mm_add_ps(_mm_mul_ps(nz, cz), d));
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, absMask), ex),
+                                         _mm_mul_ps(_mm_and_ps(ny, absMask), ey)),
+                              _mm_mul_ps(_mm_and_ps(nz, absMask), ez));
+
+        outsideMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(s, r), _mm_setzero_ps()));
+        intersectMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(s, r), _mm_setzero_ps()));
+    }
+
+    if (outsideMask) {
+        return CullResult::Outside;
+    }
+    return intersectMask ? CullResult::Intersecting : CullResult::Inside;
+#else
+    bool intersecting = false;
+    for (size_t i = 0; i < 6; ++i)
+    {
+        float s = frustum.nx[i] * c.x + frustum.ny[i] * c.y + frustum.nz[i] * c.z + frustum.d[i];
+        float r = std::fabs(frustum.nx[i]) * e.x +
+                  std::fabs(frustum.ny[i]) * e.y +
+                  std::fabs(frustum.nz[i]) * e.z;
+        if (s + r < 0.0f) {
+            return CullResult::Outside;
+        }
+        if (s - r < 0.0f) {
+            intersecting = true;
+        }
+    }
+    return intersecting ? CullResult::Intersecting : CullResult::Inside;
+#endif
+}
+
+#endif // !BOUNDING_BOX_H_INCLUDED
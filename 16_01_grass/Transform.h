@@ -80,5 +80,27 @@ void updateTransformationMatrix(glm::mat4& transMat,
     transMat = projMat * viewMat * modelMat;
 }
 
+void createProjectionMatrix(glm::mat4& res, const Camera& cam)
+{
+    float aspectRatio = 800.0F / 600.0F;
+    float nearClip = 0.1F;
+    float farClip = 100.0F;
+    res = glm::perspective(glm::radians(cam.FOV),
+        aspectRatio,
+        nearClip,
+        farClip);
+}
+
+void createViewMatrix(glm::mat4& res, const Camera& cam)
+{
+    // View/camera matrix (world->view coordinates)
+    // OpenGL is a right handed system so world moves in the negative z axis
+    // (-z axis = forwards/away, +z axis = backwards/towards)
+    res = glm::lookAt(
+        cam.position,
+        cam.position + cam.front,
+        cam.up);
+}
+
 #endif // !TRANSFORM_H_INCLUDED
 
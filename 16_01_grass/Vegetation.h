@@ -0,0 +1,427 @@
+#ifndef VEGETATION_H_INCLUDED
+#define VEGETATION_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Texture.h" // stb_image
+#include "Grass.h"
+#include "BoundingBox.h"
+
+// a field of grass quads drawn with instancing. Instances are generated
+// once on the CPU from a density map and split into square chunks; each
+// frame only the chunk bounds are frustum tested and the number of instances
+// drawn per chunk is reduced with distance. Orientation, scale, wind and the
+// per blade fade out all happen in vertexShader_vegetation.glsl
+
+// values in [0,1], sampled across the whole field
+typedef struct DensityMap {
+    std::vector<float> values;
+    size_t width;
+    size_t height;
+} DensityMap;
+
+// 16 bytes per blade. rotation and scale are normalized to [0,1] and
+// expanded in the vertex shader
+typedef struct GrassInstance {
+    GLfloat  position[3]; // base of the blade on the ground
+    GLushort rotation;    // angle around y / 2pi
+    GLushort scale;       // mix(uMinScale, uMaxScale, scale)
+} GrassInstance;
+
+// a contiguous range of the instance buffer. Instances in a chunk are in
+// random order, so drawing the first N of them is an even thinning
+typedef struct VegetationChunk {
+    BoundingBox bounds;
+    size_t first;
+    size_t count;
+} VegetationChunk;
+
+typedef struct VegetationStats {
+    size_t visibleChunks;
+    size_t drawnInstances;
+} VegetationStats;
+
+typedef struct Vegetation {
+    std::vector<VegetationChunk> chunks;
+    size_t numInstances;
+    size_t numVertices; // per blade
+    GLuint VAO;
+    GLuint instanceVBO;
+    // distance based thinning, also passed to the vertex shader
+    float thinStart;       // full density closer than this
+    float thinEnd;         // thinMinFraction of the blades past this
+    float thinMinFraction;
+} Vegetation;
+
+#define VEGETATION_CHUNK_SIZE 8.0f
+#define VEGETATION_MIN_SCALE 0.6f
+#define VEGETATION_MAX_SCALE 1.4f
+#define VEGETATION_WIND_STRENGTH 0.15f // uWindStrength
+// the peak of the sway sum in vertexShader_vegetation.glsl
+// (sin * 0.7 + sin * 0.3 + 0.5)
+#define VEGETATION_MAX_SWAY 1.5f
+// the furthest any vertex of a blade gets from its base in xz: half the
+// quad's width plus the bend of its top edge, both scaled with the blade.
+// Chunk bounds are padded by this so edge blades aren't culled on screen
+#define VEGETATION_BOUNDS_PADDING \
+    (VEGETATION_MAX_SCALE * (0.5f + VEGETATION_MAX_SWAY * VEGETATION_WIND_STRENGTH))
+
+// xorshift32; a separate stream is seeded per chunk so the result doesn't
+// depend on how the chunks are spread over threads
+static inline uint32_t nextVegetationRandom(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static inline float nextVegetationRandomFloat(uint32_t& state)
+{
+    return (nextVegetationRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline uint32_t hashVegetationSeed(uint32_t seed, uint32_t x, uint32_t y)
+{
+    uint32_t h = seed ^ (x * 0x8DA6B343u) ^ (y * 0xD8163841u);
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h ? h : 0x9E3779B9u; // xorshift state can't be zero
+}
+
+static float vegetationValueNoise(float x, float y, uint32_t seed)
+{
+    int xi = (int)std::floor(x);
+    int yi = (int)std::floor(y);
+    float fx = x - xi;
+    float fy = y - yi;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fy = fy * fy * (3.0f - 2.0f * fy);
+
+    float corners[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        uint32_t state = hashVegetationSeed(seed, xi + (i & 1), yi + (i >> 1));
+        corners[i] = nextVegetationRandomFloat(state);
+    }
+    float top = corners[0] + (corners[1] - corners[0]) * fx;
+    float bottom = corners[2] + (corners[3] - corners[2]) * fx;
+    return top + (bottom - top) * fy;
+}
+
+// patches of dense and sparse grass, used when there is no density image
+DensityMap createProceduralDensityMap(size_t size, uint32_t seed)
+{
+    DensityMap map;
+    map.width = size;
+    map.height = size;
+    map.values.resize(size * size);
+
+    for (size_t y = 0; y < size; ++y)
+    {
+        for (size_t x = 0; x < size; ++x)
+        {
+            float u = (float)x / size;
+            float v = (float)y / size;
+            float n = 0.65f * vegetationValueNoise(u * 4.0f, v * 4.0f, seed) +
+                      0.35f * vegetationValueNoise(u * 11.0f, v * 11.0f, seed + 1);
+            // smoothstep(0.3, 0.7, n)
+            float t = std::min(1.0f, std::max(0.0f, (n - 0.3f) / 0.4f));
+            map.values[y * size + x] = t * t * (3.0f - 2.0f * t);
+        }
+    }
+
+    return map;
+}
+
+// grayscale image, white = full density
+DensityMap loadDensityMap(const std::string& fileName)
+{
+    DensityMap map;
+    int width, height, numChannels;
+    unsigned char* data = stbi_load(fileName.c_str(), &width, &height, &numChannels, 1);
+    if (!data) {
+        std::cout << "Failed to load density map: " << fileName << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    map.width = width;
+    map.height = height;
+    map.values.resize(width * height);
+    for (size_t i = 0; i < map.values.size(); ++i) {
+        map.values[i] = data[i] / 255.0f;
+    }
+    stbi_image_free(data);
+
+    return map;
+}
+
+// bilinear, u and v in [0,1]
+static float sampleDensityMap(const DensityMap& map, float u, float v)
+{
+    float x = std::min(std::max(u * map.width - 0.5f, 0.0f), (float)(map.width - 1));
+    float y = std::min(std::max(v * map.height - 0.5f, 0.0f), (float)(map.height - 1));
+    size_t x0 = (size_t)x;
+    size_t y0 = (size_t)y;
+    size_t x1 = std::min(x0 + 1, map.width - 1);
+    size_t y1 = std::min(y0 + 1, map.height - 1);
+    float fx = x - x0;
+    float fy = y - y0;
+    float top = map.values[y0 * map.width + x0] * (1.0f - fx) + map.values[y0 * map.width + x1] * fx;
+    float bottom = map.values[y1 * map.width + x0] * (1.0f - fx) + map.values[y1 * map.width + x1] * fx;
+    return top * (1.0f - fy) + bottom * fy;
+}
+
+// rejection sample random points in one chunk against the density map
+static void generateVegetationChunk(const DensityMap& map,
+                                    float fieldSize,
+                                    float groundHeight,
+                                    float bladesPerSquareMeter,
+                                    uint32_t seed,
+                                    size_t chunkX,
+                                    size_t chunkZ,
+                                    std::vector<GrassInstance>& out)
+{
+    float minX = -fieldSize * 0.5f + chunkX * VEGETATION_CHUNK_SIZE;
+    float minZ = -fieldSize * 0.5f + chunkZ * VEGETATION_CHUNK_SIZE;
+    size_t numCandidates = (size_t)(VEGETATION_CHUNK_SIZE * VEGETATION_CHUNK_SIZE * bladesPerSquareMeter);
+
+    uint32_t state = hashVegetationSeed(seed, (uint32_t)chunkX, (uint32_t)chunkZ);
+    out.clear();
+    out.reserve(numCandidates);
+    for (size_t i = 0; i < numCandidates; ++i)
+    {
+        // always draw all four numbers so the sequence doesn't depend on the map
+        float x = minX + nextVegetationRandomFloat(state) * VEGETATION_CHUNK_SIZE;
+        float z = minZ + nextVegetationRandomFloat(state) * VEGETATION_CHUNK_SIZE;
+        float keep = nextVegetationRandomFloat(state);
+        uint32_t bits = nextVegetationRandom(state);
+
+        float density = sampleDensityMap(map,
+            (x / fieldSize) + 0.5f,
+            (z / fieldSize) + 0.5f);
+        if (keep >= density) {
+            continue;
+        }
+
+        GrassInstance instance;
+        instance.position[0] = x;
+        instance.position[1] = groundHeight;
+        instance.position[2] = z;
+        instance.rotation = (GLushort)(bits & 0xFFFF);
+        instance.scale = (GLushort)(bits >> 16);
+        out.push_back(instance);
+    }
+}
+
+// fill instances/chunks for a square field centered on the origin. The
+// output only depends on the inputs and seed, not on numThreads
+// (0 = one per hardware thread)
+void generateVegetationInstances(const DensityMap& map,
+                                 float fieldSize,
+                                 float groundHeight,
+                                 float bladesPerSquareMeter,
+                                 uint32_t seed,
+                                 size_t numThreads,
+                                 std::vector<GrassInstance>& instances,
+                                 std::vector<VegetationChunk>& chunks)
+{
+    size_t chunksPerSide = std::max<size_t>(1, (size_t)std::ceil(fieldSize / VEGETATION_CHUNK_SIZE));
+    size_t numChunks = chunksPerSide * chunksPerSide;
+    std::vector<std::vector<GrassInstance>> chunkInstances(numChunks);
+
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    numThreads = std::min(numThreads, numChunks);
+
+    // threads grab chunks until none are left
+    std::atomic<size_t> nextChunk(0);
+    auto worker = [&]() {
+        size_t chunk;
+        while ((chunk = nextChunk++) < numChunks)
+        {
+            generateVegetationChunk(map, fieldSize, groundHeight, bladesPerSquareMeter, seed,
+                chunk % chunksPerSide, chunk / chunksPerSide, chunkInstances[chunk]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; ++i) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // concatenate in chunk order
+    size_t total = 0;
+    for (const std::vector<GrassInstance>& c : chunkInstances) {
+        total += c.size();
+    }
+    instances.clear();
+    instances.reserve(total);
+    chunks.resize(numChunks);
+    for (size_t i = 0; i < numChunks; ++i)
+    {
+        VegetationChunk& chunk = chunks[i];
+        float minX = -fieldSize * 0.5f + (i % chunksPerSide) * VEGETATION_CHUNK_SIZE;
+        float minZ = -fieldSize * 0.5f + (i / chunksPerSide) * VEGETATION_CHUNK_SIZE;
+        chunk.bounds.min = glm::vec3(minX - VEGETATION_BOUNDS_PADDING,
+                                     groundHeight,
+                                     minZ - VEGETATION_BOUNDS_PADDING);
+        chunk.bounds.max = glm::vec3(minX + VEGETATION_CHUNK_SIZE + VEGETATION_BOUNDS_PADDING,
+                                     groundHeight + VEGETATION_MAX_SCALE,
+                                     minZ + VEGETATION_CHUNK_SIZE + VEGETATION_BOUNDS_PADDING);
+        chunk.first = instances.size();
+        chunk.count = chunkInstances[i].size();
+        instances.insert(instances.end(), chunkInstances[i].begin(), chunkInstances[i].end());
+    }
+}
+
+// upload the instances; the CPU copy isn't needed after this. Shares the
+// quad vertices of an existing Grass object
+Vegetation createVegetation(const Grass& grass,
+                            const std::vector<GrassInstance>& instances,
+                            const std::vector<VegetationChunk>& chunks)
+{
+    Vegetation vegetation;
+    vegetation.chunks = chunks;
+    vegetation.numInstances = instances.size();
+    vegetation.numVertices = grass.numVertices;
+    vegetation.thinStart = 10.0f;
+    vegetation.thinEnd = 40.0f;
+    vegetation.thinMinFraction = 0.1f;
+
+    size_t floatsPerVertex = 8;
+    size_t floatsPerPosition = 3;
+    size_t floatsPerNormal = 3;
+    size_t floatsPerTexCoord = 2;
+    int vertexStride = floatsPerVertex * sizeof(GLfloat);
+
+    glGenVertexArrays(1, &vegetation.VAO);
+    glBindVertexArray(vegetation.VAO);
+
+    // per vertex attributes, same layout as Grass.h
+    glBindBuffer(GL_ARRAY_BUFFER, grass.VBO);
+    glVertexAttribPointer(0,
+        floatsPerPosition,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1,
+        floatsPerNormal,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)(floatsPerPosition * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2,
+        floatsPerTexCoord,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)((floatsPerPosition + floatsPerNormal) * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+
+    // per instance data; the pointers are re-set per chunk in drawVegetation
+    // since GL 3.3 has no base instance for instanced draws
+    glGenBuffers(1, &vegetation.instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, vegetation.instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER,
+        instances.size() * sizeof(GrassInstance),
+        instances.empty() ? NULL : &instances[0],
+        GL_STATIC_DRAW);
+    glEnableVertexAttribArray(3);
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(3, 1); // 1 = update the attribute every instance (0 = every vertex)
+    glVertexAttribDivisor(4, 1);
+
+    // unbind the current buffers
+    // ORDER MATTERS - the VAO must be unbinded FIRST!
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return vegetation;
+}
+
+// fraction of a chunk's blades drawn at the given distance; matches
+// the fade in vertexShader_vegetation.glsl
+static float vegetationKeepFraction(const Vegetation& vegetation, float distance)
+{
+    float t = (distance - vegetation.thinStart) / (vegetation.thinEnd - vegetation.thinStart);
+    t = std::min(1.0f, std::max(0.0f, t));
+    return 1.0f + (vegetation.thinMinFraction - 1.0f) * t;
+}
+
+// one instanced draw per visible chunk. The shader program must already be
+// in use; uChunkInstanceCountLoc is its uChunkInstanceCount uniform
+void drawVegetation(const Vegetation& vegetation,
+                    const Frustum& frustum,
+                    const glm::vec3& cameraPosition,
+                    GLint uChunkInstanceCountLoc,
+                    VegetationStats* stats = nullptr)
+{
+    VegetationStats localStats = {0, 0};
+
+    glBindVertexArray(vegetation.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, vegetation.instanceVBO);
+    for (const VegetationChunk& chunk : vegetation.chunks)
+    {
+        if (chunk.count == 0 ||
+            testFrustumBoundingBox(frustum, chunk.bounds) == CullResult::Outside) {
+            continue;
+        }
+
+        // the closest point of the chunk decides how many blades might be
+        // visible; the shader fades out the rest per blade
+        glm::vec3 closest = glm::clamp(cameraPosition, chunk.bounds.min, chunk.bounds.max);
+        float distance = glm::length(glm::vec2(closest.x - cameraPosition.x,
+                                               closest.z - cameraPosition.z));
+        size_t count = (size_t)std::ceil(vegetationKeepFraction(vegetation, distance) * chunk.count);
+        count = std::min(count, chunk.count);
+
+        size_t offset = chunk.first * sizeof(GrassInstance);
+        glVertexAttribPointer(3,
+            3,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(GrassInstance),
+            (void*)(offset + offsetof(GrassInstance, position)));
+        glVertexAttribPointer(4,
+            2,
+            GL_UNSIGNED_SHORT,
+            GL_TRUE, // normalize to [0,1]
+            sizeof(GrassInstance),
+            (void*)(offset + offsetof(GrassInstance, rotation)));
+        glUniform1f(uChunkInstanceCountLoc, (float)chunk.count);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, vegetation.numVertices, count);
+
+        localStats.visibleChunks++;
+        localStats.drawnInstances += count;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (stats) {
+        *stats = localStats;
+    }
+}
+
+#endif // !VEGETATION_H_INCLUDED
@@ -3,6 +3,9 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <chrono>
+#include <cstring>
+#include <thread>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +22,8 @@
 #include "Camera.h"
 #include "LightSource.h"
 #include "Floor.h"
+#include "BoundingBox.h"
+#include "Vegetation.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -36,13 +41,14 @@ glm::vec3 gLightDirection = glm::vec3(-0.2F, -1.0F, -0.3F);
 glm::vec3 gGrassPosition = glm::vec3(0.0F, 0.0F, 0.0F);
 Grass gGrass;
 glm::mat4 gGrassModelMat;
-std::vector<glm::vec3> gGrassPositions = {
-    glm::vec3(-1.5F, 0.0F, -0.48F),
-    glm::vec3(1.5F, 0.0F,  0.51F),
-    glm::vec3(0.0F, 0.0F,  0.7F),
-    glm::vec3(-0.3F, 0.0F, -2.3F),
-    glm::vec3(0.5F, 0.0F, -0.6F)
-};
+
+// instanced grass field covering the (scaled up) floor, see Vegetation.h
+const float VEGETATION_FIELD_SIZE = 64.0F; // multiple of VEGETATION_CHUNK_SIZE
+const float VEGETATION_BLADES_PER_SQUARE_METER = 96.0F; // at full density
+const uint32_t VEGETATION_SEED = 1234;
+Vegetation gVegetation;
+VegetationStats gVegetationStats;
+double gVegetationGpuMilliseconds = 0.0; // previous frame
 
 Floor gFloor;
 glm::vec3 gFloorPosition = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -58,6 +64,12 @@ std::map<std::string, int> gUniformLocations;
 Shader gLightFragmentShader;
 ShaderProgram gLightShaderProgram;
 
+// shader for the instanced grass field; uses fragmentShader.glsl
+Shader gVegetationVertexShader;
+ShaderProgram gVegetationShaderProgram;
+glm::mat4 gViewMat;
+glm::mat4 gProjMat;
+
 glm::mat4 gGrassTransMat;
 glm::mat4 gLightTransMat;
 Camera gCamera;
@@ -278,6 +290,61 @@ static void updateUniforms()
     glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightDiffuse));
 }
 
+// set the per frame uniforms and draw the visible chunks of the grass field.
+// The GPU time is read back from a ring of queries once the GPU has
+// finished them, so reading it never stalls the CPU
+static void drawGrassField()
+{
+    glUseProgram(gVegetationShaderProgram.id);
+    static GLint uViewLoc = glGetUniformLocation(gVegetationShaderProgram.id, "uView");
+    static GLint uProjectionLoc = glGetUniformLocation(gVegetationShaderProgram.id, "uProjection");
+    static GLint uCameraPositionLoc = glGetUniformLocation(gVegetationShaderProgram.id, "uCameraPosition");
+    static GLint uTimeLoc = glGetUniformLocation(gVegetationShaderProgram.id, "uTime");
+    static GLint uChunkInstanceCountLoc = glGetUniformLocation(gVegetationShaderProgram.id, "uChunkInstanceCount");
+    glUniformMatrix4fv(uViewLoc, 1, GL_FALSE, glm::value_ptr(gViewMat));
+    glUniformMatrix4fv(uProjectionLoc, 1, GL_FALSE, glm::value_ptr(gProjMat));
+    glUniform3fv(uCameraPositionLoc, 1, glm::value_ptr(gCamera.position));
+    glUniform1f(uTimeLoc, (float)glfwGetTime());
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gDiffuseMap.id);
+    glPolygonMode(GL_FRONT_AND_BACK, gGrass.renderMode);
+
+    const size_t numQueries = 4;
+    static GLuint queries[numQueries] = {0, 0, 0, 0};
+    static bool queryIssued[numQueries] = {false, false, false, false};
+    static size_t frame = 0;
+    if (queries[0] == 0) {
+        glGenQueries(numQueries, queries);
+    }
+
+    // oldest first, so the newest finished one is kept
+    for (size_t age = numQueries - 1; age > 0; age--)
+    {
+        size_t slot = (frame + numQueries - age) % numQueries;
+        if (!queryIssued[slot]) {
+            continue;
+        }
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+            gVegetationGpuMilliseconds = nanoseconds / 1000000.0;
+            queryIssued[slot] = false;
+        }
+    }
+
+    // a query still unfinished after numQueries frames is reused anyway
+    size_t slot = frame % numQueries;
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+    Frustum frustum = createFrustum(gProjMat * gViewMat);
+    drawVegetation(gVegetation, frustum, gCamera.position, uChunkInstanceCountLoc, &gVegetationStats);
+    glEndQuery(GL_TIME_ELAPSED);
+    queryIssued[slot] = true;
+    frame++;
+}
+
 // called once every frame during main loop
 static void draw()
 {
@@ -289,43 +356,24 @@ static void draw()
     glClearColor(r, g, b, a);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // draw the grass textures
-    glUseProgram(gShaderProgram.id);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gDiffuseMap.id);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, gSpecularMap.id);
-    glPolygonMode(GL_FRONT_AND_BACK, gGrass.renderMode);
-    for (glm::vec3& position : gGrassPositions)
-    {
-        updateTransformationMatrix(gGrassTransMat, position, gCamera);
-        glUniformMatrix4fv(gUniformLocations["uTransform"],
-            1, // number of matrices
-            GL_FALSE, // should the matrices be transposed?
-            glm::value_ptr(gGrassTransMat)); // pointer to data
-        gGrassModelMat = glm::mat4(1.0F);
-        gGrassModelMat = glm::translate(gGrassModelMat, position);
-        glUniformMatrix4fv(gUniformLocations["uModel"],
-            1,
-            GL_FALSE,
-            glm::value_ptr(gGrassModelMat));
-        glBindVertexArray(gGrass.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gGrass.numVertices);
-    }
+    createViewMatrix(gViewMat, gCamera);
+    createProjectionMatrix(gProjMat, gCamera);
 
-    // draw the floor
+    // draw the floor, scaled up to the size of the grass field
     glUseProgram(gShaderProgram.id);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, gMetalTexture.id);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, gSpecularMap.id);
-    updateTransformationMatrix(gFloorTransMat, gFloorPosition, gCamera);
+    gFloorModelMat = glm::mat4(1.0F);
+    gFloorModelMat = glm::translate(gFloorModelMat, gFloorPosition);
+    gFloorModelMat = glm::scale(gFloorModelMat,
+        glm::vec3(VEGETATION_FIELD_SIZE / 10.0F, 1.0F, VEGETATION_FIELD_SIZE / 10.0F));
+    gFloorTransMat = gProjMat * gViewMat * gFloorModelMat;
     glUniformMatrix4fv(gUniformLocations["uTransform"],
         1, // number of matrices
         GL_FALSE, // should the matrices be transposed?
         glm::value_ptr(gFloorTransMat)); // pointer to data
-    gFloorModelMat = glm::mat4(1.0F);
-    gFloorModelMat = glm::translate(gFloorModelMat, gFloorPosition);
     glUniformMatrix4fv(gUniformLocations["uModel"],
         1,
         GL_FALSE,
@@ -337,6 +385,61 @@ static void draw()
     glUseProgram(gLightShaderProgram.id);
     glBindVertexArray(gLightSource.VAO);
     glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
+
+    // draw the grass
+    drawGrassField();
+}
+
+// generate the grass field once single threaded and once on every hardware
+// thread, print the throughput of both and check they give the same blades
+static void createGrassField()
+{
+    DensityMap densityMap = createProceduralDensityMap(256, VEGETATION_SEED);
+    float groundHeight = gFloorPosition.y - 0.5F; // top of Floor.h
+    std::vector<GrassInstance> instances;
+    std::vector<VegetationChunk> chunks;
+    std::vector<GrassInstance> singleThreadInstances;
+
+    size_t threadCounts[2] = { 1, std::max(1u, std::thread::hardware_concurrency()) };
+    for (size_t i = 0; i < 2; ++i)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        generateVegetationInstances(densityMap,
+            VEGETATION_FIELD_SIZE,
+            groundHeight,
+            VEGETATION_BLADES_PER_SQUARE_METER,
+            VEGETATION_SEED,
+            threadCounts[i],
+            instances,
+            chunks);
+        auto end = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        std::cout << "Vegetation: generated " << instances.size() << " blades in "
+            << chunks.size() << " chunks on " << threadCounts[i] << " thread(s) in "
+            << ms << " ms, " << instances.size() / ms << " blades/ms" << std::endl;
+        if (i == 0) {
+            singleThreadInstances.swap(instances);
+        }
+    }
+    bool same = singleThreadInstances.size() == instances.size() &&
+        (instances.empty() || memcmp(&instances[0], &singleThreadInstances[0],
+                                     instances.size() * sizeof(GrassInstance)) == 0);
+    std::cout << "Vegetation: multithreaded result "
+        << (same ? "matches" : "DOES NOT match") << " single threaded" << std::endl;
+
+    gVegetation = createVegetation(gGrass, instances, chunks);
+
+    // uniforms that don't change
+    glUseProgram(gVegetationShaderProgram.id);
+    GLuint id = gVegetationShaderProgram.id;
+    glUniform1f(glGetUniformLocation(id, "uMinScale"), VEGETATION_MIN_SCALE);
+    glUniform1f(glGetUniformLocation(id, "uMaxScale"), VEGETATION_MAX_SCALE);
+    glUniform2fv(glGetUniformLocation(id, "uWindDirection"), 1,
+        glm::value_ptr(glm::normalize(glm::vec2(1.0F, 0.4F))));
+    glUniform1f(glGetUniformLocation(id, "uWindStrength"), VEGETATION_WIND_STRENGTH);
+    glUniform1f(glGetUniformLocation(id, "uThinStart"), gVegetation.thinStart);
+    glUniform1f(glGetUniformLocation(id, "uThinEnd"), gVegetation.thinEnd);
+    glUniform1f(glGetUniformLocation(id, "uThinMinFraction"), gVegetation.thinMinFraction);
 }
 
 int main(void)
@@ -352,10 +455,10 @@ int main(void)
 
     // prevent triangles behind other triangles from being drawn
     glEnable(GL_DEPTH_TEST);
-    // tell OpenGL to always draw the pixel, ignoring the depth buffer
     // by default the function is GL_LESS 
     // (if the depth of the new pixel is less than the current pixel)
-    glDepthFunc(GL_ALWAYS);
+    // the grass field needs it; press space for GL_ALWAYS
+    glDepthFunc(GL_LESS);
 
     // Cube.h
     gCube = createCube();
@@ -417,6 +520,11 @@ int main(void)
     gLightShaderProgram = createShaderProgram(gVertexShader,
         gLightFragmentShader);
 
+    // instanced grass field shader
+    gVegetationVertexShader = createVertexShader("vertexShader_vegetation.glsl");
+    gVegetationShaderProgram = createShaderProgram(gVegetationVertexShader,
+        gFragmentShader);
+
     // LightSource.h
     gLightSource = createLightSource(gCube);
 
@@ -430,6 +538,9 @@ int main(void)
     gSpecularMap = createTexture("container2_specular.png");
     gMetalTexture = createTexture("metal.png");
 
+    // Vegetation.h
+    createGrassField();
+
     while (!glfwWindowShouldClose(gWindow))
     {
         if (glfwGetKey(gWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
@@ -442,7 +553,7 @@ int main(void)
                 GL_ALWAYS,
                 GL_LESS
             };
-            static size_t funcIndex = 0;
+            static size_t funcIndex = 1;
             funcIndex = !funcIndex;
             glDepthFunc(depthFuncs[funcIndex]);
         }
@@ -463,6 +574,28 @@ int main(void)
 
         draw();
 
+        // print grass field statistics about once a second
+        static size_t chunksTotal = 0;
+        static size_t bladesTotal = 0;
+        static double gpuTime = 0.0;
+        static size_t numFrames = 0;
+        static double lastPrintTime = glfwGetTime();
+        chunksTotal += gVegetationStats.visibleChunks;
+        bladesTotal += gVegetationStats.drawnInstances;
+        gpuTime += gVegetationGpuMilliseconds;
+        numFrames++;
+        if (glfwGetTime() - lastPrintTime >= 1.0)
+        {
+            std::cout << "Vegetation: drew " << bladesTotal / numFrames
+                << " / " << gVegetation.numInstances << " blades in "
+                << chunksTotal / numFrames << " / " << gVegetation.chunks.size()
+                << " chunks, gpu " << gpuTime / numFrames << " ms, "
+                << (gpuTime > 0.0 ? bladesTotal / gpuTime : 0.0) << " blades/ms" << std::endl;
+            chunksTotal = bladesTotal = numFrames = 0;
+            gpuTime = 0.0;
+            lastPrintTime = glfwGetTime();
+        }
+
         glfwSwapBuffers(gWindow);
         glfwPollEvents();
     }
@@ -0,0 +1,197 @@
+// CPU only check of Vegetation.h: generates the same field as main.cpp,
+// runs every blade through a copy of vertexShader_vegetation.glsl over a
+// full wind cycle, and checks that
+//   - every vertex stays inside its chunk's bounds
+//   - no chunk that drawVegetation would cull has a vertex in the frustum
+//   - the per chunk instance count drawVegetation picks covers every
+//     blade the shader doesn't fade out
+//
+//   make vegcheck
+//   ./vegetationCheck
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+#include "Vegetation.h"
+
+// main.cpp's settings
+const float FIELD_SIZE = 64.0f;
+const float BLADES_PER_SQUARE_METER = 96.0f;
+const uint32_t SEED = 1234;
+const float GROUND_HEIGHT = -0.5f;
+const glm::vec2 WIND_DIRECTION = glm::normalize(glm::vec2(1.0f, 0.4f));
+
+// sample times over one period of the slower wind term, sin(phase)
+const size_t NUM_WIND_SAMPLES = 32;
+
+static std::mt19937 gRandom(1234);
+
+static float randomFloat(float lo, float hi)
+{
+    return std::uniform_real_distribution<float>(lo, hi)(gRandom);
+}
+
+// vertexShader_vegetation.glsl without the camera transform. fade is the
+// factor the distance thinning scales the blade by
+static glm::vec3 bladeVertex(const GrassInstance& instance,
+                             const glm::vec3& aPos,
+                             const glm::vec2& aTexCoords,
+                             float time,
+                             float fade)
+{
+    float angle = (instance.rotation / 65535.0f) * 6.2831853f;
+    float t = instance.scale / 65535.0f;
+    float scale = VEGETATION_MIN_SCALE + (VEGETATION_MAX_SCALE - VEGETATION_MIN_SCALE) * t;
+    scale *= fade;
+
+    glm::vec3 local = glm::vec3(aPos.x, aPos.y + 0.5f, aPos.z) * scale;
+    float c = std::cos(angle);
+    float s = std::sin(angle);
+    local = glm::vec3(c * local.x + s * local.z, local.y, -s * local.x + c * local.z);
+
+    glm::vec2 base(instance.position[0], instance.position[2]);
+    float phase = glm::dot(base, WIND_DIRECTION) * 0.35f - time * 2.0f;
+    float sway = (std::sin(phase) * 0.7f + std::sin(phase * 2.3f + 1.7f) * 0.3f + 0.5f) * VEGETATION_WIND_STRENGTH;
+    local.x += WIND_DIRECTION.x * sway * aTexCoords.y * scale;
+    local.z += WIND_DIRECTION.y * sway * aTexCoords.y * scale;
+
+    return glm::vec3(instance.position[0], instance.position[1], instance.position[2]) + local;
+}
+
+// the shader's fade for the blade with index id in a chunk of count blades
+static float bladeFade(const Vegetation& vegetation,
+                       const GrassInstance& instance,
+                       size_t id,
+                       size_t count,
+                       const glm::vec3& cameraPosition)
+{
+    float dist = glm::length(glm::vec2(instance.position[0] - cameraPosition.x,
+                                       instance.position[2] - cameraPosition.z));
+    float keep = vegetationKeepFraction(vegetation, dist);
+    float rank = float(id) / float(count);
+    return std::min(1.0f, std::max(0.0f, (keep - rank) * 20.0f));
+}
+
+static bool pointInFrustum(const glm::mat4& projView, const glm::vec3& p)
+{
+    glm::vec4 clip = projView * glm::vec4(p, 1.0f);
+    return std::fabs(clip.x) <= clip.w && std::fabs(clip.y) <= clip.w && std::fabs(clip.z) <= clip.w;
+}
+
+int main()
+{
+    DensityMap densityMap = createProceduralDensityMap(256, SEED);
+    std::vector<GrassInstance> instances;
+    std::vector<VegetationChunk> chunks;
+    generateVegetationInstances(densityMap, FIELD_SIZE, GROUND_HEIGHT,
+        BLADES_PER_SQUARE_METER, SEED, 0, instances, chunks);
+    std::cout << instances.size() << " blades in " << chunks.size()
+        << " chunks, bounds padded by " << VEGETATION_BOUNDS_PADDING << std::endl;
+
+    // the four corners of Grass.h's quad
+    const glm::vec3 corners[4] = {
+        glm::vec3(-0.5f, -0.5f, 0.0f), glm::vec3(0.5f, -0.5f, 0.0f),
+        glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(-0.5f, 0.5f, 0.0f)
+    };
+    const glm::vec2 cornerTexCoords[4] = {
+        glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f),
+        glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f)
+    };
+
+    // bounds: every vertex inside its chunk's box, and how close any gets
+    // to the sides, which is what the padding is for
+    float minMargin = FLT_MAX;
+    size_t numOutside = 0;
+    for (const VegetationChunk& chunk : chunks)
+    {
+        for (size_t i = chunk.first; i < chunk.first + chunk.count; ++i)
+        {
+            bool outside = false;
+            for (size_t w = 0; w < NUM_WIND_SAMPLES; ++w)
+            {
+                float time = w * 3.14159265f / NUM_WIND_SAMPLES;
+                for (size_t c = 0; c < 4; ++c)
+                {
+                    glm::vec3 p = bladeVertex(instances[i], corners[c], cornerTexCoords[c], time, 1.0f);
+                    glm::vec3 below = p - chunk.bounds.min;
+                    glm::vec3 above = chunk.bounds.max - p;
+                    outside |= std::min(std::min(below.x, below.y), below.z) < 0.0f ||
+                               std::min(std::min(above.x, above.y), above.z) < 0.0f;
+                    minMargin = std::min(minMargin, std::min(std::min(below.x, below.z),
+                                                             std::min(above.x, above.z)));
+                }
+            }
+            numOutside += outside ? 1 : 0;
+        }
+    }
+    std::cout << "bounds: " << numOutside << " blades leave their chunk, closest vertex is "
+        << minMargin << " from the side" << std::endl;
+
+    // culling and thinning: random cameras over the field
+    Vegetation vegetation;
+    vegetation.chunks = chunks;
+    vegetation.thinStart = 10.0f; // createVegetation's defaults
+    vegetation.thinEnd = 40.0f;
+    vegetation.thinMinFraction = 0.1f;
+
+    const size_t numCameras = 40;
+    size_t numFalseCulls = 0;
+    size_t numUndrawn = 0;
+    size_t chunksCulled = 0;
+    for (size_t cam = 0; cam < numCameras; ++cam)
+    {
+        glm::vec3 eye(randomFloat(-40.0f, 40.0f), randomFloat(0.2f, 6.0f), randomFloat(-40.0f, 40.0f));
+        glm::vec3 target(randomFloat(-32.0f, 32.0f), GROUND_HEIGHT, randomFloat(-32.0f, 32.0f));
+        glm::mat4 projView = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f) *
+            glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = createFrustum(projView);
+        float time = randomFloat(0.0f, 100.0f);
+
+        for (const VegetationChunk& chunk : chunks)
+        {
+            if (chunk.count == 0) {
+                continue;
+            }
+
+            // same as drawVegetation
+            bool culled = testFrustumBoundingBox(frustum, chunk.bounds) == CullResult::Outside;
+            glm::vec3 closest = glm::clamp(eye, chunk.bounds.min, chunk.bounds.max);
+            float distance = glm::length(glm::vec2(closest.x - eye.x, closest.z - eye.z));
+            size_t drawn = (size_t)std::ceil(vegetationKeepFraction(vegetation, distance) * chunk.count);
+            drawn = std::min(drawn, chunk.count);
+            chunksCulled += culled ? 1 : 0;
+
+            for (size_t id = 0; id < chunk.count; ++id)
+            {
+                const GrassInstance& instance = instances[chunk.first + id];
+                float fade = bladeFade(vegetation, instance, id, chunk.count, eye);
+                if (fade == 0.0f) {
+                    continue; // degenerate, nothing rasterized
+                }
+                if (id >= drawn) {
+                    numUndrawn++;
+                }
+                if (culled) {
+                    for (size_t c = 0; c < 4; ++c)
+                    {
+                        if (pointInFrustum(projView, bladeVertex(instance, corners[c], cornerTexCoords[c], time, fade))) {
+                            numFalseCulls++;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::cout << "culling: " << numCameras << " cameras, " << chunksCulled / numCameras
+        << " / " << chunks.size() << " chunks culled on average, "
+        << numFalseCulls << " visible blades culled, "
+        << numUndrawn << " unfaded blades past the drawn count" << std::endl;
+
+    bool passed = numOutside == 0 && numFalseCulls == 0 && numUndrawn == 0;
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
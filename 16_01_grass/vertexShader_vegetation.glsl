@@ -0,0 +1,64 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance, see GrassInstance in Vegetation.h
+layout (location = 3) in vec3 aInstancePosition;      // base of the blade on the ground
+layout (location = 4) in vec2 aInstanceRotationScale; // both normalized to [0,1]
+
+uniform mat4 uProjection;
+uniform mat4 uView;
+uniform vec3 uCameraPosition;
+
+uniform float uMinScale;
+uniform float uMaxScale;
+
+// wind
+uniform float uTime;
+uniform vec2 uWindDirection; // normalized, in the xz plane
+uniform float uWindStrength; // chunk bounds are padded for its peak, see Vegetation.h
+
+// distance based thinning; instances in a chunk are in random order, so the
+// blade's index in the draw is used as its random rank
+uniform float uThinStart;
+uniform float uThinEnd;
+uniform float uThinMinFraction;
+uniform float uChunkInstanceCount;
+
+out vec3 Normal;
+out vec3 FragPosition;
+out vec2 TexCoords;
+
+void main()
+{
+    float angle = aInstanceRotationScale.x * 6.2831853;
+    float scale = mix(uMinScale, uMaxScale, aInstanceRotationScale.y);
+
+    // shrink blades past the fraction kept at this distance to nothing
+    // (degenerate triangles aren't rasterized) instead of popping them
+    float dist = length(aInstancePosition.xz - uCameraPosition.xz);
+    float keep = mix(1.0, uThinMinFraction,
+                     clamp((dist - uThinStart) / (uThinEnd - uThinStart), 0.0, 1.0));
+    float rank = float(gl_InstanceID) / uChunkInstanceCount;
+    scale *= clamp((keep - rank) * 20.0, 0.0, 1.0);
+
+    // the quad is centered on the origin, move its bottom edge to the ground
+    vec3 local = vec3(aPos.x, aPos.y + 0.5, aPos.z) * scale;
+    float c = cos(angle);
+    float s = sin(angle);
+    mat3 rotY = mat3(c, 0.0, -s,
+                     0.0, 1.0, 0.0,
+                     s, 0.0, c);
+    local = rotY * local;
+
+    // bend the top of the blade (texcoord y = 1), with the phase
+    // travelling across the field along the wind direction
+    float phase = dot(aInstancePosition.xz, uWindDirection) * 0.35 - uTime * 2.0;
+    float sway = (sin(phase) * 0.7 + sin(phase * 2.3 + 1.7) * 0.3 + 0.5) * uWindStrength;
+    local.xz += uWindDirection * sway * aTexCoords.y * scale;
+
+    FragPosition = aInstancePosition + local;
+    gl_Position = uProjection * uView * vec4(FragPosition, 1.0);
+    Normal = rotY * aNormal;
+    TexCoords = aTexCoords;
+}
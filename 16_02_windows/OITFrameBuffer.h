@@ -0,0 +1,177 @@
+#ifndef OIT_FRAMEBUFFER_H_INCLUDED
+#define OIT_FRAMEBUFFER_H_INCLUDED
+
+#include <iostream>
+#include <cstdlib>
+
+#include <glad/glad.h>
+
+// targets for weighted blended order independent transparency
+// (McGuire/Bavoil). Opaque geometry is drawn into opaqueFBO, then the
+// transparent geometry is drawn in any order into transparentFBO, which
+// shares the same depth buffer so transparent fragments behind opaque ones
+// are rejected. A composite pass then blends the result over the opaque color.
+//
+// GL 3.3 can't set a different blend function per draw buffer (glBlendFunci
+// is 4.0), so the revealage product is kept in the alpha channel of the
+// accumulation target using glBlendFuncSeparate:
+//   accumTexID    RGBA16F: rgb = sum(color * alpha * weight)  (ONE, ONE)
+//                          a   = product(1 - alpha)          (ZERO, ONE_MINUS_SRC_ALPHA)
+//   weightTexID   R16F:    r   = sum(alpha * weight)          (ONE, ONE)
+typedef struct OITFrameBuffer {
+    GLuint opaqueFBO;
+    GLuint opaqueTexID;
+    GLuint transparentFBO;
+    GLuint accumTexID;
+    GLuint weightTexID;
+    GLuint depthRenderBufferID;
+    size_t width;
+    size_t height;
+} OITFrameBuffer;
+
+static GLuint createOITTexture(GLint internalFormat, GLenum format, GLenum type,
+                               size_t width, size_t height)
+{
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 internalFormat,
+                 width,
+                 height,
+                 0,
+                 format,
+                 type,
+                 NULL);
+    // the composite pass reads 1:1 with the screen
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return id;
+}
+
+static void checkOITFrameBufferComplete(const char* name)
+{
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "OIT framebuffer error: " << name << " incomplete" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+OITFrameBuffer createOITFrameBuffer(size_t width, size_t height)
+{
+    OITFrameBuffer frameBuffer;
+    frameBuffer.width = width;
+    frameBuffer.height = height;
+
+    // depth/stencil shared between both framebuffers
+    glGenRenderbuffers(1, &frameBuffer.depthRenderBufferID);
+    glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer.depthRenderBufferID);
+    glRenderbufferStorage(GL_RENDERBUFFER,
+                          GL_DEPTH24_STENCIL8,
+                          width,
+                          height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    // opaque pass
+    frameBuffer.opaqueTexID = createOITTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    glGenFramebuffers(1, &frameBuffer.opaqueFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.opaqueFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           frameBuffer.opaqueTexID,
+                           0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                              GL_DEPTH_STENCIL_ATTACHMENT,
+                              GL_RENDERBUFFER,
+                              frameBuffer.depthRenderBufferID);
+    checkOITFrameBufferComplete("opaque");
+
+    // transparent accumulation pass
+    frameBuffer.accumTexID = createOITTexture(GL_RGBA16F, GL_RGBA, GL_FLOAT, width, height);
+    frameBuffer.weightTexID = createOITTexture(GL_R16F, GL_RED, GL_FLOAT, width, height);
+    glGenFramebuffers(1, &frameBuffer.transparentFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.transparentFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           frameBuffer.accumTexID,
+                           0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT1,
+                           GL_TEXTURE_2D,
+                           frameBuffer.weightTexID,
+                           0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                              GL_DEPTH_STENCIL_ATTACHMENT,
+                              GL_RENDERBUFFER,
+                              frameBuffer.depthRenderBufferID);
+    GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    checkOITFrameBufferComplete("transparent");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    return frameBuffer;
+}
+
+// bind the opaque target; the caller clears it and draws opaque geometry
+void beginOITOpaquePass(const OITFrameBuffer& frameBuffer)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.opaqueFBO);
+}
+
+// bind and clear the accumulation targets and set up blending. Depth is
+// tested against the opaque pass but not written, so draw order is irrelevant
+void beginOITTransparentPass(const OITFrameBuffer& frameBuffer)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.transparentFBO);
+
+    const GLfloat accumClear[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; // revealage starts at 1
+    const GLfloat weightClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, accumClear);
+    glClearBufferfv(GL_COLOR, 1, weightClear);
+
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+// copy the opaque color to the default framebuffer, then blend the resolved
+// transparent color over it with a single full screen pass. The composite
+// shader outputs (average color, revealage)
+void compositeOIT(const OITFrameBuffer& frameBuffer,
+                  GLuint compositeProgramID,
+                  GLuint screenQuadVAO,
+                  size_t screenQuadNumVertices)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer.opaqueFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, frameBuffer.width, frameBuffer.height,
+                      0, 0, frameBuffer.width, frameBuffer.height,
+                      GL_COLOR_BUFFER_BIT,
+                      GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+    glUseProgram(compositeProgramID);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, frameBuffer.accumTexID);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, frameBuffer.weightTexID);
+    glBindVertexArray(screenQuadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, screenQuadNumVertices);
+
+    // restore the state the rest of the chapter expects
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+#endif // !OIT_FRAMEBUFFER_H_INCLUDED
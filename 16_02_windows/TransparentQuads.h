@@ -0,0 +1,160 @@
+#ifndef TRANSPARENT_QUADS_H_INCLUDED
+#define TRANSPARENT_QUADS_H_INCLUDED
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Grass.h"
+
+// a set of window quads drawn with a single instanced draw call. Each
+// instance is just a world space offset (aInstanceOffset, location = 3).
+// The sorted path reorders and re-uploads the offsets back to front every
+// frame; the OIT path uploads them once in whatever order they were given
+typedef struct TransparentQuads {
+    GLuint VAO;
+    GLuint instanceVBO;
+    size_t numVertices;      // per quad
+    size_t numInstances;
+    size_t instanceCapacity; // size of instanceVBO in instances
+    std::vector<glm::vec3> positions;       // unsorted
+    std::vector<glm::vec3> sortedPositions; // scratch, reused every frame
+    std::vector<std::pair<float, uint32_t>> sortKeys; // scratch, (squared distance, index)
+} TransparentQuads;
+
+// shares the quad vertices of an existing Grass object
+TransparentQuads createTransparentQuads(const Grass& grass)
+{
+    TransparentQuads quads;
+    quads.numVertices = grass.numVertices;
+    quads.numInstances = 0;
+    quads.instanceCapacity = 0;
+
+    size_t floatsPerVertex = 8;
+    size_t floatsPerPosition = 3;
+    size_t floatsPerNormal = 3;
+    size_t floatsPerTexCoord = 2;
+    int vertexStride = floatsPerVertex * sizeof(GLfloat);
+
+    glGenVertexArrays(1, &quads.VAO);
+    glBindVertexArray(quads.VAO);
+
+    // per vertex attributes, same layout as Grass.h
+    glBindBuffer(GL_ARRAY_BUFFER, grass.VBO);
+    glVertexAttribPointer(0,
+        floatsPerPosition,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1,
+        floatsPerNormal,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)(floatsPerPosition * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2,
+        floatsPerTexCoord,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)((floatsPerPosition + floatsPerNormal) * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+
+    // per instance offset
+    size_t instanceOffsetLoc = 3;
+    glGenBuffers(1, &quads.instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, quads.instanceVBO);
+    glVertexAttribPointer(instanceOffsetLoc,
+        3,
+        GL_FLOAT,
+        GL_FALSE,
+        sizeof(glm::vec3),
+        (void*)0);
+    glEnableVertexAttribArray(instanceOffsetLoc);
+    glVertexAttribDivisor(instanceOffsetLoc, 1); // 1 = update the attribute every instance (0 = every vertex)
+
+    // unbind the current buffers
+    // ORDER MATTERS - the VAO must be unbinded FIRST!
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return quads;
+}
+
+static void uploadTransparentQuadInstances(TransparentQuads& quads, const glm::vec3* data)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, quads.instanceVBO);
+    if (quads.numInstances > quads.instanceCapacity) {
+        quads.instanceCapacity = quads.numInstances;
+        glBufferData(GL_ARRAY_BUFFER,
+            quads.instanceCapacity * sizeof(glm::vec3),
+            data,
+            GL_DYNAMIC_DRAW);
+    } else {
+        // orphan the old storage so we don't stall on a draw still using it
+        glBufferData(GL_ARRAY_BUFFER,
+            quads.instanceCapacity * sizeof(glm::vec3),
+            NULL,
+            GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER,
+            0,
+            quads.numInstances * sizeof(glm::vec3),
+            data);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// replace the instance list and upload it unsorted
+void setTransparentQuadPositions(TransparentQuads& quads, const std::vector<glm::vec3>& positions)
+{
+    quads.positions = positions;
+    quads.numInstances = positions.size();
+    quads.sortedPositions.resize(positions.size());
+    quads.sortKeys.resize(positions.size());
+    if (!positions.empty()) {
+        uploadTransparentQuadInstances(quads, &quads.positions[0]);
+    }
+}
+
+// reorder the instances back to front relative to the camera and upload
+// them. Equal distances keep their original relative order
+void sortTransparentQuads(TransparentQuads& quads, const glm::vec3& cameraPosition)
+{
+    if (quads.numInstances == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < quads.numInstances; ++i)
+    {
+        glm::vec3 diff = cameraPosition - quads.positions[i];
+        quads.sortKeys[i].first = glm::dot(diff, diff);
+        quads.sortKeys[i].second = (uint32_t)i;
+    }
+    std::sort(quads.sortKeys.begin(), quads.sortKeys.end(),
+        [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+            if (a.first != b.first) {
+                return a.first > b.first; // farthest first
+            }
+            return a.second < b.second;
+        });
+    for (size_t i = 0; i < quads.numInstances; ++i)
+    {
+        quads.sortedPositions[i] = quads.positions[quads.sortKeys[i].second];
+    }
+
+    uploadTransparentQuadInstances(quads, &quads.sortedPositions[0]);
+}
+
+void drawTransparentQuads(const TransparentQuads& quads)
+{
+    glBindVertexArray(quads.VAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, quads.numVertices, quads.numInstances);
+}
+
+#endif // !TRANSPARENT_QUADS_H_INCLUDED
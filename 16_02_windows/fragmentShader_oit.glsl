@@ -0,0 +1,31 @@
+#version 330 core
+// see OITFrameBuffer.h for what each target holds
+layout (location = 0) out vec4 AccumColor;
+layout (location = 1) out float AccumWeight;
+
+in vec3 FragPosition;
+in vec3 Normal;
+in vec2 TexCoords;
+
+struct Material {
+    sampler2D texture_diffuse1;
+};
+
+uniform Material uMaterial;
+
+void main()
+{
+    vec4 color = texture(uMaterial.texture_diffuse1, TexCoords);
+
+    // depth weight from McGuire and Bavoil (2013), eq. 10: closer and more
+    // opaque fragments dominate the weighted average. Capped at 300 as in
+    // McGuire's later revision rather than the paper's 3e3: the sums go
+    // into half floats (max 65504), which 3e3 overflows after about 22
+    // near, opaque layers; 300 takes over 200
+    float a = min(1.0, color.a * 10.0) + 0.01;
+    float b = 1.0 - gl_FragCoord.z * 0.9;
+    float weight = clamp(a * a * a * 1e8 * b * b * b, 1e-2, 3e2);
+
+    AccumColor = vec4(color.rgb * color.a * weight, color.a);
+    AccumWeight = color.a * weight;
+}
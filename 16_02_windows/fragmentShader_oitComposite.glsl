@@ -0,0 +1,33 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D uAccumTexture;  // rgb = sum(color * alpha * weight), a = revealage
+uniform sampler2D uWeightTexture; // r = sum(alpha * weight)
+
+const float HALF_MAX = 65504.0;
+
+void main()
+{
+    vec4 accum = texture(uAccumTexture, TexCoords);
+    float revealage = accum.a;
+    // nothing transparent covers this pixel
+    if (revealage == 1.0) {
+        discard;
+    }
+
+    // with enough layers the half float sums can still overflow to inf,
+    // and inf / inf is NaN; cap both so the average stays finite
+    float weightSum = texture(uWeightTexture, TexCoords).r;
+    vec3 accumColor = min(accum.rgb, vec3(HALF_MAX));
+    weightSum = min(weightSum, HALF_MAX);
+    vec3 averageColor = accumColor / max(weightSum, 1e-5);
+    if (any(isnan(averageColor)) || any(isinf(averageColor))) {
+        averageColor = vec3(0.0);
+    }
+
+    // blended with (ONE_MINUS_SRC_ALPHA, SRC_ALPHA):
+    // result = average * (1 - revealage) + opaque * revealage
+    FragColor = vec4(averageColor, revealage);
+}
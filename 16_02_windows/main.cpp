@@ -3,6 +3,7 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <chrono>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +20,9 @@
 #include "Camera.h"
 #include "LightSource.h"
 #include "Floor.h"
+#include "ScreenTexture.h"
+#include "OITFrameBuffer.h"
+#include "TransparentQuads.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -43,6 +47,13 @@ std::vector<glm::vec3> gWindowPositions = {
     glm::vec3(-0.3F, 0.0F, -2.3F),
     glm::vec3(0.5F, 0.0F, -0.6F)
 };
+// the windows are drawn with one instanced draw call, either sorted back to
+// front with regular alpha blending, or unsorted with weighted blended
+// order independent transparency (press T to switch, B to benchmark)
+TransparentQuads gWindows;
+bool gUseOIT = true;
+OITFrameBuffer gOITFrameBuffer;
+ScreenTexture gScreenTexture;
 
 Floor gFloor;
 glm::vec3 gFloorPosition = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -58,6 +69,17 @@ std::map<std::string, int> gUniformLocations;
 Shader gLightFragmentShader;
 ShaderProgram gLightShaderProgram;
 
+// shaders for the instanced windows and the OIT composite pass
+Shader gInstancedVertexShader;
+Shader gOITFragmentShader;
+ShaderProgram gSortedShaderProgram; // uses fragmentShader.glsl
+ShaderProgram gOITShaderProgram;
+Shader gScreenVertexShader;
+Shader gOITCompositeFragmentShader;
+ShaderProgram gOITCompositeShaderProgram;
+glm::mat4 gViewMat;
+glm::mat4 gProjMat;
+
 glm::mat4 gGrassTransMat;
 glm::mat4 gLightTransMat;
 Camera gCamera;
@@ -278,15 +300,62 @@ static void updateUniforms()
     glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightDiffuse));
 }
 
+// draw the transparent windows. The sorted path reorders the instances back
+// to front and relies on the blend order; the OIT path draws them in any
+// order into the accumulation targets and resolves them in one composite pass
+static void drawWindows()
+{
+    createViewMatrix(gViewMat, gCamera);
+    createProjectionMatrix(gProjMat, gCamera);
+
+    GLuint programID;
+    if (gUseOIT) {
+        beginOITTransparentPass(gOITFrameBuffer);
+        programID = gOITShaderProgram.id;
+    } else {
+        sortTransparentQuads(gWindows, gCamera.position);
+        programID = gSortedShaderProgram.id;
+    }
+
+    glUseProgram(programID);
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uView"),
+        1,
+        GL_FALSE,
+        glm::value_ptr(gViewMat));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uProjection"),
+        1,
+        GL_FALSE,
+        glm::value_ptr(gProjMat));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gDiffuseMap.id);
+    glPolygonMode(GL_FRONT_AND_BACK, gGrass.renderMode);
+    drawTransparentQuads(gWindows);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    if (gUseOIT) {
+        compositeOIT(gOITFrameBuffer,
+            gOITCompositeShaderProgram.id,
+            gScreenTexture.VAO,
+            gScreenTexture.numVertices);
+    }
+}
+
 // called once every frame during main loop
-// to draw multiple blended objects, need to draw the blended ones in order (otherwise
-// depth test disables the background stuff)
+// to draw multiple blended objects, either draw the blended ones in order
+// (otherwise depth test disables the background stuff) or use OIT
 // the drawing order is then:
-// 1. opaque objects
-// 2. sort all transparent objects
-// 3. draw the transparent objects in sorted order
+// 1. opaque objects (offscreen when using OIT)
+// 2. transparent objects, see drawWindows()
 static void draw()
 {
+    // with OIT the opaque objects are drawn offscreen so the transparent
+    // pass can depth test against them
+    if (gUseOIT) {
+        beginOITOpaquePass(gOITFrameBuffer);
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
     // clear the screen
     GLfloat r = 0.2F; // red
     GLfloat g = 0.3F; // green
@@ -320,37 +389,69 @@ static void draw()
     glBindVertexArray(gLightSource.VAO);
     glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
 
-    // sort the transparent windows
-    std::map<float, glm::vec3> sortedWindows;
-    for (const glm::vec3& pos : gWindowPositions)
-    {
-        float distance = glm::length(gCamera.position - pos);
-        sortedWindows[distance] = pos;
-    }
+    drawWindows();
+}
 
-    // draw the window textures
-    glUseProgram(gShaderProgram.id);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gDiffuseMap.id);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, gSpecularMap.id);
-    glPolygonMode(GL_FRONT_AND_BACK, gGrass.renderMode);
-    for (auto it = sortedWindows.rbegin(); it != sortedWindows.rend(); it++)
+// time the sorted and OIT paths at increasing numbers of window quads.
+// CPU time covers sorting/uploading and issuing the draw calls; GPU time
+// is measured with a GL_TIME_ELAPSED query around the whole frame
+static void runTransparencyBenchmark()
+{
+    const size_t quadCounts[] = { 10, 1000, 100000 };
+    const size_t numFrames = 30;
+    const bool savedUseOIT = gUseOIT;
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    std::cout << "Transparency benchmark, average of " << numFrames << " frames" << std::endl;
+    for (size_t count : quadCounts)
     {
-        updateTransformationMatrix(gGrassTransMat, it->second, gCamera);
-        glUniformMatrix4fv(gUniformLocations["uTransform"],
-            1, // number of matrices
-            GL_FALSE, // should the matrices be transposed?
-            glm::value_ptr(gGrassTransMat)); // pointer to data
-        gGrassModelMat = glm::mat4(1.0F);
-        gGrassModelMat = glm::translate(gGrassModelMat, it->second);
-        glUniformMatrix4fv(gUniformLocations["uModel"],
-            1,
-            GL_FALSE,
-            glm::value_ptr(gGrassModelMat));
-        glBindVertexArray(gGrass.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gGrass.numVertices);
+        // same pseudo random positions every run, spread out in front of the origin
+        std::vector<glm::vec3> positions(count);
+        srand(1234);
+        for (glm::vec3& pos : positions)
+        {
+            pos.x = (rand() % 2000) / 100.0F - 10.0F;
+            pos.y = (rand() % 500) / 100.0F;
+            pos.z = -(rand() % 3000) / 100.0F;
+        }
+        setTransparentQuadPositions(gWindows, positions);
+
+        for (int mode = 0; mode < 2; ++mode)
+        {
+            gUseOIT = (mode == 1);
+            double cpuMicroseconds = 0.0;
+            double gpuMicroseconds = 0.0;
+            // frame 0 is a warm up and isn't counted
+            for (size_t frame = 0; frame <= numFrames; ++frame)
+            {
+                glFinish();
+                auto start = std::chrono::high_resolution_clock::now();
+                glBeginQuery(GL_TIME_ELAPSED, query);
+                draw();
+                glEndQuery(GL_TIME_ELAPSED);
+                auto end = std::chrono::high_resolution_clock::now();
+
+                GLuint64 gpuNanoseconds = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuNanoseconds); // blocks until done
+                if (frame == 0) {
+                    continue;
+                }
+                cpuMicroseconds += std::chrono::duration<double, std::micro>(end - start).count();
+                gpuMicroseconds += gpuNanoseconds / 1000.0;
+            }
+
+            std::cout << "  " << count << " quads, "
+                << (gUseOIT ? "OIT:    " : "sorted: ")
+                << "cpu " << cpuMicroseconds / numFrames << " us, "
+                << "gpu " << gpuMicroseconds / numFrames << " us" << std::endl;
+        }
     }
+
+    glDeleteQueries(1, &query);
+    gUseOIT = savedUseOIT;
+    setTransparentQuadPositions(gWindows, gWindowPositions);
 }
 
 int main(void)
@@ -435,6 +536,29 @@ int main(void)
     gLightShaderProgram = createShaderProgram(gVertexShader,
         gLightFragmentShader);
 
+    // instanced window shaders; the sorted path reuses the main fragment shader
+    gInstancedVertexShader = createVertexShader("vertexShader_instanced.glsl");
+    gSortedShaderProgram = createShaderProgram(gInstancedVertexShader,
+        gFragmentShader);
+    gOITFragmentShader = createFragmentShader("fragmentShader_oit.glsl");
+    gOITShaderProgram = createShaderProgram(gInstancedVertexShader,
+        gOITFragmentShader);
+    gScreenVertexShader = createVertexShader("vertexShader_screenTexture.glsl");
+    gOITCompositeFragmentShader = createFragmentShader("fragmentShader_oitComposite.glsl");
+    gOITCompositeShaderProgram = createShaderProgram(gScreenVertexShader,
+        gOITCompositeFragmentShader);
+    glUseProgram(gOITCompositeShaderProgram.id);
+    glUniform1i(glGetUniformLocation(gOITCompositeShaderProgram.id, "uAccumTexture"), 0);
+    glUniform1i(glGetUniformLocation(gOITCompositeShaderProgram.id, "uWeightTexture"), 1);
+
+    // TransparentQuads.h
+    gWindows = createTransparentQuads(gGrass);
+    setTransparentQuadPositions(gWindows, gWindowPositions);
+
+    // OITFrameBuffer.h/ScreenTexture.h
+    gOITFrameBuffer = createOITFrameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT);
+    gScreenTexture = createScreenTexture();
+
     // LightSource.h
     gLightSource = createLightSource(gCube);
 
@@ -465,6 +589,29 @@ int main(void)
             glDepthFunc(depthFuncs[funcIndex]);
         }
 
+        // T switches between sorted and OIT windows
+        static bool tWasPressed = false;
+        if (glfwGetKey(gWindow, GLFW_KEY_T) == GLFW_PRESS) {
+            if (!tWasPressed) {
+                gUseOIT = !gUseOIT;
+                std::cout << "Use OIT: " << gUseOIT << std::endl;
+                tWasPressed = true;
+            }
+        } else {
+            tWasPressed = false;
+        }
+
+        // B runs the sorted vs OIT benchmark
+        static bool bWasPressed = false;
+        if (glfwGetKey(gWindow, GLFW_KEY_B) == GLFW_PRESS) {
+            if (!bWasPressed) {
+                runTransparencyBenchmark();
+                bWasPressed = true;
+            }
+        } else {
+            bWasPressed = false;
+        }
+
         moveCamera();
 
         // move the light around
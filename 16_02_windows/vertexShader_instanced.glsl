@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance world space position of the quad
+layout (location = 3) in vec3 aInstanceOffset;
+
+// input transformation matrices from CPU/main application
+uniform mat4 uProjection;
+uniform mat4 uView;
+
+// normal and fragment position (in world space) for lighting calculation
+out vec3 Normal;
+out vec3 FragPosition;
+out vec2 TexCoords;
+
+void main()
+{
+    // instances are only translated, so the normal needs no normal matrix
+    FragPosition = aPos + aInstanceOffset;
+    gl_Position = uProjection * uView * vec4(FragPosition, 1.0);
+    Normal = aNormal;
+    TexCoords = aTexCoords;
+}
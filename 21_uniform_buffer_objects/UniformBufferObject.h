@@ -8,11 +8,13 @@
 
 typedef struct UniformBufferObject {
     unsigned int id;
-    size_t bufferSize;
+    size_t bufferSize;  // size of one copy of the block
     size_t bindPoint;
+    size_t sliceSize;   // bufferSize rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    size_t numSlices;   // one copy per frame in flight, see FramePipeline.h
 } UniformBufferObject;
 
-UniformBufferObject createUniformBufferObject() {
+UniformBufferObject createUniformBufferObject(size_t numSlices = 1) {
 
     UniformBufferObject ubo;
 
@@ -21,15 +23,55 @@ UniformBufferObject createUniformBufferObject() {
 
     // enough to hold the view and projection matrices
     ubo.bufferSize = 2*sizeof(glm::mat4);
-    glBufferData(GL_UNIFORM_BUFFER, ubo.bufferSize, NULL, GL_STATIC_DRAW);
+
+    // each slice has to start at a multiple of the offset alignment
+    // to be bound with glBindBufferRange
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    ubo.sliceSize = (ubo.bufferSize + alignment - 1) / alignment * alignment;
+    ubo.numSlices = numSlices;
+    glBufferData(GL_UNIFORM_BUFFER, ubo.sliceSize * ubo.numSlices, NULL, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    // entire buffer, at binding point 0
+    // first slice, at binding point 0
     ubo.bindPoint = 0;
     glBindBufferRange(GL_UNIFORM_BUFFER, ubo.bindPoint, ubo.id, 0, ubo.bufferSize);
 
     return ubo;
 }
 
+// write one slice without waiting on the GPU. Only safe once the GPU is
+// done with every draw that read this slice, which is what
+// FramePipeline's beginFrame() waits for
+void* mapUniformBufferSlice(const UniformBufferObject& ubo, size_t slice)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo.id);
+    return glMapBufferRange(GL_UNIFORM_BUFFER,
+        slice * ubo.sliceSize,
+        ubo.bufferSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+// finish the write and point the binding point at the slice. Returns
+// false if the contents were lost while mapped (see glUnmapBuffer) and
+// the slice has to be written again
+bool unmapUniformBufferSlice(const UniformBufferObject& ubo, size_t slice)
+{
+    bool intact = glUnmapBuffer(GL_UNIFORM_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, ubo.bindPoint, ubo.id, slice * ubo.sliceSize, ubo.bufferSize);
+    return intact;
+}
+
+// fallback for when mapping fails: copies bufferSize bytes of data into
+// the slice (waiting on the GPU if it has to) and binds it
+void writeUniformBufferSlice(const UniformBufferObject& ubo, size_t slice, const void* data)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo.id);
+    glBufferSubData(GL_UNIFORM_BUFFER, slice * ubo.sliceSize, ubo.bufferSize, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, ubo.bindPoint, ubo.id, slice * ubo.sliceSize, ubo.bufferSize);
+}
+
 #endif // !UNIFORM_BUFFER_OBJECT_H_INCLUDED
 
@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <cmath>
 #include <vector>
+#include <cstring>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -15,6 +16,7 @@
 #include "ShaderProgram.h"
 #include "Transform.h"
 #include "UniformBufferObject.h"
+#include "FramePipeline.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -33,6 +35,18 @@ ShaderProgram gShaderPrograms[4];
 glm::mat4 gTransMat;
 
 UniformBufferObject gUbo;
+
+// F cycles the number of frames in flight (1 = no CPU/GPU overlap)
+FramePipeline gFramePipeline;
+
+// averaged and printed once per second
+typedef struct FrameStats {
+    double cpuWaitMs;
+    double gpuIdleMs;
+    size_t numFrames;
+    double lastPrintTime;
+} FrameStats;
+FrameStats gFrameStats;
 ////////////////////////////////////////////////////
 
 // GLFW callback functions
@@ -131,7 +145,15 @@ int main(void)
     gTransMat = createTransformationMatrix();
 
     // UniformBufferObject.h
-    gUbo = createUniformBufferObject();
+    // one slice per frame that can be in flight
+    gUbo = createUniformBufferObject(MAX_FRAMES_IN_FLIGHT);
+
+    // FramePipeline.h
+    gFramePipeline = createFramePipeline(2);
+    gFrameStats.cpuWaitMs = 0.0;
+    gFrameStats.gpuIdleMs = 0.0;
+    gFrameStats.numFrames = 0;
+    gFrameStats.lastPrintTime = glfwGetTime();
 
     // Shader.h/ShaderProgram.h
     for (size_t i = 0; i < gCubePositions.size(); i++)
@@ -161,36 +183,75 @@ int main(void)
             gCube.renderMode = rectRenderModes[renderIndex];
         }
 
+        // press F to change how many frames the CPU may run ahead
+        static bool framesInFlightWasPressed = false;
+        bool framesInFlightPressed = glfwGetKey(gWindow, GLFW_KEY_F) == GLFW_PRESS;
+        if (framesInFlightPressed && !framesInFlightWasPressed) {
+            size_t numFramesInFlight = gFramePipeline.numFramesInFlight % MAX_FRAMES_IN_FLIGHT + 1;
+            setFramesInFlight(gFramePipeline, numFramesInFlight);
+            std::cout << "Frames in flight: " << numFramesInFlight << std::endl;
+        }
+        framesInFlightWasPressed = framesInFlightPressed;
+
+        // blocks only if the GPU is still using this frame's slot
+        size_t frameSlot = beginFrame(gFramePipeline);
+
         // update the common uniform buffer object data between all shaders
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), 
                                                 float(WINDOW_WIDTH)/float(WINDOW_HEIGHT),
                                                 0.1f,
                                                 100.0f);
         //glm::mat4 projection = glm::mat4(1.0f);
-        // send the projection data to the GPU
-        glBindBuffer(GL_UNIFORM_BUFFER, gUbo.id);
-        glBufferSubData(GL_UNIFORM_BUFFER, 
-            0,                              // start addr
-            sizeof(glm::mat4),              // size
-            glm::value_ptr(projection));
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
         // send the "camera" data to the GPU 
         // (set to identity here just for example since we don't have camera)
         glm::mat4 view = glm::mat4(1.0);
         view = glm::translate(view, glm::vec3(0.0f, 0.0f, -6.0f));
-        glBindBuffer(GL_UNIFORM_BUFFER, gUbo.id);
-        glBufferSubData(GL_UNIFORM_BUFFER, 
-            sizeof(glm::mat4),              // start addr
-            sizeof(glm::mat4),              // size
-            glm::value_ptr(view));
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        // write this frame's slice of the uniform buffer; the other slices
+        // may still be read by frames the GPU hasn't finished yet
+        char* uboData = (char*)mapUniformBufferSlice(gUbo, frameSlot);
+        bool uboWritten = false;
+        if (uboData) {
+            memcpy(uboData,                     // projection at start addr 0
+                glm::value_ptr(projection),
+                sizeof(glm::mat4));
+            memcpy(uboData + sizeof(glm::mat4), // view right after it
+                glm::value_ptr(view),
+                sizeof(glm::mat4));
+            uboWritten = unmapUniformBufferSlice(gUbo, frameSlot);
+        }
+        // the map failed or lost its contents: copy the slice instead
+        if (!uboWritten) {
+            glm::mat4 matrices[2] = {projection, view};
+            writeUniformBufferSlice(gUbo, frameSlot, matrices);
+        }
 
         draw();
 
         glfwSwapBuffers(gWindow);
+        endFrame(gFramePipeline);
         glfwPollEvents();
+
+        // the wait and idle times belong to the frame that just retired
+        gFrameStats.cpuWaitMs += gFramePipeline.cpuWaitMs;
+        gFrameStats.gpuIdleMs += gFramePipeline.gpuIdleMs;
+        gFrameStats.numFrames++;
+        double now = glfwGetTime();
+        if (now - gFrameStats.lastPrintTime >= 1.0) {
+            double frameMs = (now - gFrameStats.lastPrintTime) * 1000.0 / double(gFrameStats.numFrames);
+            std::cout << gFramePipeline.numFramesInFlight << " frames in flight: "
+                << "frame " << frameMs << " ms, "
+                << "CPU wait " << gFrameStats.cpuWaitMs / double(gFrameStats.numFrames) << " ms, "
+                << "GPU idle " << gFrameStats.gpuIdleMs / double(gFrameStats.numFrames) << " ms"
+                << std::endl;
+            gFrameStats.cpuWaitMs = 0.0;
+            gFrameStats.gpuIdleMs = 0.0;
+            gFrameStats.numFrames = 0;
+            gFrameStats.lastPrintTime = now;
+        }
     }
 
+    deleteFramePipeline(gFramePipeline);
+
     //glDeleteShader(gVertexShader.id);
     //glDeleteShader(gFragmentShader.id);
     glfwTerminate();
@@ -0,0 +1,219 @@
+#ifndef ASTEROID_BELT_H_INCLUDED
+#define ASTEROID_BELT_H_INCLUDED
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASTEROID_BELT_SSE
+#endif
+
+// a belt of rocks orbiting the origin in the XZ plane, each also spinning
+// about its own axis. The orbit and spin state is kept one array per
+// parameter so updateAsteroidBelt() can step 4 rocks at a time with SSE,
+// split across a thread pool, writing the instances for the vertex shader
+// (vertexShader_asteroidBelt.glsl) straight to a mapped buffer
+const float ASTEROID_BELT_TWO_PI = 6.28318530718f;
+
+// per instance vertex attributes, 32 bytes
+typedef struct AsteroidInstance {
+    glm::vec4 positionScale;    // xyz = world position, w = uniform scale
+    glm::vec4 rotation;         // quaternion, xyz = vector part
+} AsteroidInstance;
+
+typedef struct AsteroidBelt {
+    size_t numRocks;
+    size_t numPaddedRocks;          // rounded up to 4; padding has scale 0
+
+    std::vector<float> orbitRadius;
+    std::vector<float> orbitAngle;  // radians, kept in [0, 2pi)
+    std::vector<float> orbitSpeed;  // radians per second
+    std::vector<float> height;
+    std::vector<float> scale;
+    std::vector<float> spinAxisX;   // unit length
+    std::vector<float> spinAxisY;
+    std::vector<float> spinAxisZ;
+    std::vector<float> spinAngle;   // radians, kept in [0, 2pi)
+    std::vector<float> spinSpeed;   // radians per second
+} AsteroidBelt;
+
+// rocks spread like the static belt: within offset of radius and a
+// flatter band in height. Orbit speeds fall off with radius^-1.5 as for
+// real orbits, about one turn a minute at radius
+AsteroidBelt createAsteroidBelt(size_t numRocks, float radius, float offset, unsigned seed = 1)
+{
+    AsteroidBelt belt;
+    belt.numRocks = numRocks;
+    belt.numPaddedRocks = (numRocks + 3) & ~size_t(3);
+
+    size_t n = belt.numPaddedRocks;
+    belt.orbitRadius.assign(n, radius);
+    belt.orbitAngle.assign(n, 0.0f);
+    belt.orbitSpeed.assign(n, 0.0f);
+    belt.height.assign(n, 0.0f);
+    belt.scale.assign(n, 0.0f);
+    belt.spinAxisX.assign(n, 0.0f);
+    belt.spinAxisY.assign(n, 1.0f);
+    belt.spinAxisZ.assign(n, 0.0f);
+    belt.spinAngle.assign(n, 0.0f);
+    belt.spinSpeed.assign(n, 0.0f);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> displacement(-offset, offset);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_real_distribution<float> axis(-1.0f, 1.0f);
+    float orbitConstant = ASTEROID_BELT_TWO_PI / 60.0f * radius * std::sqrt(radius);
+    for (size_t i = 0; i < numRocks; i++)
+    {
+        float r = radius + displacement(rng);
+        belt.orbitRadius[i] = r;
+        belt.orbitAngle[i] = unit(rng) * ASTEROID_BELT_TWO_PI;
+        belt.orbitSpeed[i] = orbitConstant / (r * std::sqrt(r));
+        belt.height[i] = displacement(rng) * 0.4f; // keep height smaller
+        belt.scale[i] = unit(rng) * 0.2f + 0.05f;
+
+        glm::vec3 spinAxis(axis(rng), axis(rng), axis(rng));
+        float length = glm::length(spinAxis);
+        spinAxis = length > 0.001f ? spinAxis / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        belt.spinAxisX[i] = spinAxis.x;
+        belt.spinAxisY[i] = spinAxis.y;
+        belt.spinAxisZ[i] = spinAxis.z;
+        belt.spinAngle[i] = unit(rng) * ASTEROID_BELT_TWO_PI;
+        belt.spinSpeed[i] = unit(rng) * 1.5f + 0.1f;
+    }
+    return belt;
+}
+
+#ifdef ASTEROID_BELT_SSE
+// sin and cos of 4 angles, to about 1e-7 for angles within a few turns.
+// Reduces to [-pi/2, pi/2] and uses the Taylor series from there
+inline void sinCos4(__m128 x, __m128& s, __m128& c)
+{
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 pi = _mm_set1_ps(3.14159265359f);
+    const __m128 halfPi = _mm_set1_ps(1.57079632679f);
+
+    // to [-pi, pi]
+    __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.0f / ASTEROID_BELT_TWO_PI))));
+    x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(ASTEROID_BELT_TWO_PI)));
+
+    // past pi/2 use sin(pi - x) = sin(x), cos(pi - x) = -cos(x)
+    __m128 xSign = _mm_and_ps(x, signBit);
+    __m128 absX = _mm_andnot_ps(signBit, x);
+    __m128 reflect = _mm_cmpgt_ps(absX, halfPi);
+    __m128 reflected = _mm_or_ps(_mm_sub_ps(pi, absX), xSign);
+    x = _mm_or_ps(_mm_and_ps(reflect, reflected), _mm_andnot_ps(reflect, x));
+    __m128 cosSign = _mm_and_ps(reflect, signBit);
+
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 sinPoly = _mm_set1_ps(-1.0f / 39916800.0f);
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(1.0f / 362880.0f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(-1.0f / 5040.0f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(1.0f / 120.0f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(-1.0f / 6.0f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(1.0f));
+    s = _mm_mul_ps(sinPoly, x);
+
+    __m128 cosPoly = _mm_set1_ps(1.0f / 479001600.0f);
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(-1.0f / 3628800.0f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(1.0f / 40320.0f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(-1.0f / 720.0f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(1.0f / 24.0f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(-1.0f / 2.0f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(1.0f));
+    c = _mm_xor_ps(cosPoly, cosSign);
+}
+
+// angle + speed * dt, wrapped back into [0, 2pi)
+inline __m128 advanceAngle4(const float* angle, const float* speed, __m128 dt)
+{
+    const __m128 twoPi = _mm_set1_ps(ASTEROID_BELT_TWO_PI);
+    __m128 a = _mm_add_ps(_mm_loadu_ps(angle), _mm_mul_ps(_mm_loadu_ps(speed), dt));
+    return _mm_sub_ps(a, _mm_and_ps(_mm_cmpge_ps(a, twoPi), twoPi));
+}
+#endif
+
+// steps rocks [begin, end) by dt and writes their instances to out[begin..end).
+// begin and end must be multiples of 4
+void updateAsteroidBeltRange(AsteroidBelt& belt, float dt, size_t begin, size_t end, AsteroidInstance* out)
+{
+#ifdef ASTEROID_BELT_SSE
+    __m128 dt4 = _mm_set1_ps(dt);
+    __m128 half = _mm_set1_ps(0.5f);
+    for (size_t i = begin; i < end; i += 4)
+    {
+        __m128 orbitAngle = advanceAngle4(&belt.orbitAngle[i], &belt.orbitSpeed[i], dt4);
+        _mm_storeu_ps(&belt.orbitAngle[i], orbitAngle);
+        __m128 sinOrbit, cosOrbit;
+        sinCos4(orbitAngle, sinOrbit, cosOrbit);
+        __m128 radius = _mm_loadu_ps(&belt.orbitRadius[i]);
+        __m128 x = _mm_mul_ps(sinOrbit, radius);
+        __m128 y = _mm_loadu_ps(&belt.height[i]);
+        __m128 z = _mm_mul_ps(cosOrbit, radius);
+        __m128 scale = _mm_loadu_ps(&belt.scale[i]);
+
+        __m128 spinAngle = advanceAngle4(&belt.spinAngle[i], &belt.spinSpeed[i], dt4);
+        _mm_storeu_ps(&belt.spinAngle[i], spinAngle);
+        __m128 sinHalfSpin, cosHalfSpin;
+        sinCos4(_mm_mul_ps(spinAngle, half), sinHalfSpin, cosHalfSpin);
+        __m128 qx = _mm_mul_ps(_mm_loadu_ps(&belt.spinAxisX[i]), sinHalfSpin);
+        __m128 qy = _mm_mul_ps(_mm_loadu_ps(&belt.spinAxisY[i]), sinHalfSpin);
+        __m128 qz = _mm_mul_ps(_mm_loadu_ps(&belt.spinAxisZ[i]), sinHalfSpin);
+        __m128 qw = cosHalfSpin;
+
+        // 4 rocks per register -> one rock's vec4 per register
+        _MM_TRANSPOSE4_PS(x, y, z, scale);
+        _MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+        float* dst = (float*)&out[i];
+        _mm_storeu_ps(dst + 0, x);
+        _mm_storeu_ps(dst + 4, qx);
+        _mm_storeu_ps(dst + 8, y);
+        _mm_storeu_ps(dst + 12, qy);
+        _mm_storeu_ps(dst + 16, z);
+        _mm_storeu_ps(dst + 20, qz);
+        _mm_storeu_ps(dst + 24, scale);
+        _mm_storeu_ps(dst + 28, qw);
+    }
+#else
+    for (size_t i = begin; i < end; i++)
+    {
+        float orbitAngle = belt.orbitAngle[i] + belt.orbitSpeed[i] * dt;
+        if (orbitAngle >= ASTEROID_BELT_TWO_PI) {
+            orbitAngle -= ASTEROID_BELT_TWO_PI;
+        }
+        belt.orbitAngle[i] = orbitAngle;
+        float spinAngle = belt.spinAngle[i] + belt.spinSpeed[i] * dt;
+        if (spinAngle >= ASTEROID_BELT_TWO_PI) {
+            spinAngle -= ASTEROID_BELT_TWO_PI;
+        }
+        belt.spinAngle[i] = spinAngle;
+
+        float radius = belt.orbitRadius[i];
+        out[i].positionScale = glm::vec4(std::sin(orbitAngle) * radius,
+            belt.height[i],
+            std::cos(orbitAngle) * radius,
+            belt.scale[i]);
+        float sinHalfSpin = std::sin(spinAngle * 0.5f);
+        out[i].rotation = glm::vec4(belt.spinAxisX[i] * sinHalfSpin,
+            belt.spinAxisY[i] * sinHalfSpin,
+            belt.spinAxisZ[i] * sinHalfSpin,
+            std::cos(spinAngle * 0.5f));
+    }
+#endif
+}
+
+// out must hold numPaddedRocks instances
+void updateAsteroidBelt(AsteroidBelt& belt, float dt, ThreadPool& pool, AsteroidInstance* out)
+{
+    pool.ParallelFor(belt.numPaddedRocks / 4, [&belt, dt, out](size_t begin, size_t end) {
+        updateAsteroidBeltRange(belt, dt, begin * 4, end * 4, out);
+    });
+}
+
+#endif // !ASTEROID_BELT_H_INCLUDED
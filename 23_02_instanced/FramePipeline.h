@@ -0,0 +1,125 @@
+#ifndef FRAME_PIPELINE_H_INCLUDED
+#define FRAME_PIPELINE_H_INCLUDED
+
+#include <chrono>
+
+#include <glad/glad.h>
+
+// lets the CPU build frame N+1 while the GPU is still drawing frame N.
+// Every frame in flight gets its own slot; anything the CPU writes each
+// frame (see the sliced UniformBufferObject.h) has one copy per slot. A
+// fence at the end of each frame tells beginFrame() when the GPU is done
+// with a slot so it can be written again without an implicit sync.
+//
+// numFramesInFlight = 1 is the old serialized loop: the CPU waits for the
+// previous frame before it starts the next one
+const size_t MAX_FRAMES_IN_FLIGHT = 3;
+
+typedef struct FramePipeline {
+    size_t numFramesInFlight;
+    size_t frameNumber;     // frames begun so far
+    size_t slot;            // slot of the current frame
+
+    GLsync fences[MAX_FRAMES_IN_FLIGHT];
+    // GL_TIMESTAMP at the start and end of each frame's commands
+    GLuint startQueries[MAX_FRAMES_IN_FLIGHT];
+    GLuint endQueries[MAX_FRAMES_IN_FLIGHT];
+    bool queriesPending[MAX_FRAMES_IN_FLIGHT];
+    GLuint64 lastGpuEnd;    // end timestamp of the last retired frame, 0 if none
+
+    // of the last retired frame
+    double cpuWaitMs;       // time beginFrame() blocked on the slot's fence
+    double gpuIdleMs;       // gap between the previous frame finishing and this one starting on the GPU
+} FramePipeline;
+
+FramePipeline createFramePipeline(size_t numFramesInFlight)
+{
+    FramePipeline pipeline;
+    pipeline.numFramesInFlight = numFramesInFlight;
+    pipeline.frameNumber = 0;
+    pipeline.slot = 0;
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        pipeline.fences[i] = 0;
+        pipeline.queriesPending[i] = false;
+    }
+    glGenQueries(MAX_FRAMES_IN_FLIGHT, pipeline.startQueries);
+    glGenQueries(MAX_FRAMES_IN_FLIGHT, pipeline.endQueries);
+    pipeline.lastGpuEnd = 0;
+    pipeline.cpuWaitMs = 0.0;
+    pipeline.gpuIdleMs = 0.0;
+    return pipeline;
+}
+
+// waits until the GPU has finished the frame that last used the current
+// slot, then starts timing the new frame
+size_t beginFrame(FramePipeline& pipeline)
+{
+    pipeline.slot = pipeline.frameNumber % pipeline.numFramesInFlight;
+    size_t slot = pipeline.slot;
+
+    pipeline.cpuWaitMs = 0.0;
+    if (pipeline.fences[slot]) {
+        auto waitStart = std::chrono::high_resolution_clock::now();
+        while (glClientWaitSync(pipeline.fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        auto waitEnd = std::chrono::high_resolution_clock::now();
+        pipeline.cpuWaitMs = std::chrono::duration<double, std::milli>(waitEnd - waitStart).count();
+        glDeleteSync(pipeline.fences[slot]);
+        pipeline.fences[slot] = 0;
+    }
+
+    // the fence covers the end query, so both results are ready now.
+    // Frames retire in order, so lastGpuEnd belongs to the previous frame
+    pipeline.gpuIdleMs = 0.0;
+    if (pipeline.queriesPending[slot]) {
+        GLuint64 gpuStart = 0;
+        GLuint64 gpuEnd = 0;
+        glGetQueryObjectui64v(pipeline.startQueries[slot], GL_QUERY_RESULT, &gpuStart);
+        glGetQueryObjectui64v(pipeline.endQueries[slot], GL_QUERY_RESULT, &gpuEnd);
+        if (pipeline.lastGpuEnd != 0 && gpuStart > pipeline.lastGpuEnd) {
+            pipeline.gpuIdleMs = double(gpuStart - pipeline.lastGpuEnd) / 1000000.0;
+        }
+        pipeline.lastGpuEnd = gpuEnd;
+        pipeline.queriesPending[slot] = false;
+    }
+
+    glQueryCounter(pipeline.startQueries[slot], GL_TIMESTAMP);
+    return slot;
+}
+
+// call after glfwSwapBuffers so the fence also covers the swap
+void endFrame(FramePipeline& pipeline)
+{
+    size_t slot = pipeline.slot;
+    glQueryCounter(pipeline.endQueries[slot], GL_TIMESTAMP);
+    pipeline.queriesPending[slot] = true;
+    pipeline.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pipeline.frameNumber++;
+}
+
+// drains the pipeline before changing the number of slots, since frames
+// in flight were assigned slots with the old count
+void setFramesInFlight(FramePipeline& pipeline, size_t numFramesInFlight)
+{
+    glFinish();
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        if (pipeline.fences[i]) {
+            glDeleteSync(pipeline.fences[i]);
+            pipeline.fences[i] = 0;
+        }
+        pipeline.queriesPending[i] = false;
+    }
+    pipeline.lastGpuEnd = 0;
+    pipeline.numFramesInFlight = numFramesInFlight;
+}
+
+void deleteFramePipeline(FramePipeline& pipeline)
+{
+    setFramesInFlight(pipeline, pipeline.numFramesInFlight);
+    glDeleteQueries(MAX_FRAMES_IN_FLIGHT, pipeline.startQueries);
+    glDeleteQueries(MAX_FRAMES_IN_FLIGHT, pipeline.endQueries);
+}
+
+#endif // !FRAME_PIPELINE_H_INCLUDED
@@ -27,6 +27,28 @@ public:
         setupMesh();
     }
 
+    // same as Init() for buffers that were already filled elsewhere
+    // (UploadService.h). Only the vertex array is made here
+    void InitWithBuffers(const std::vector<Vertex>& vertices,
+        const std::vector<GLuint>& indices,
+        const std::vector<Texture>& textures,
+        GLuint VBO,
+        GLuint EBO)
+    {
+        this->vertices = vertices;
+        this->indices = indices;
+        this->textures = textures;
+        this->VBO = VBO;
+        this->EBO = EBO;
+
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        setVertexAttributes();
+        glBindVertexArray(0);
+    }
+
     void Draw(const ShaderProgram& shader)
     {
         unsigned int diffuseCount = 1;
@@ -76,6 +98,20 @@ public:
         glBindVertexArray(0);
     }
 
+    // another vertex array over this mesh's buffers, for drawing it with
+    // per-instance attributes laid out differently from VAO's
+    GLuint CreateVertexArray()
+    {
+        GLuint vertexArray;
+        glGenVertexArrays(1, &vertexArray);
+        glBindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        setVertexAttributes();
+        glBindVertexArray(0);
+        return vertexArray;
+    }
+
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
@@ -101,6 +137,15 @@ private:
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
             &indices[0], GL_STATIC_DRAW);
 
+        setVertexAttributes();
+
+        // unbind the vertex array
+        glBindVertexArray(0);
+    }
+
+    // assumes the VAO and VBO are bound
+    void setVertexAttributes()
+    {
         // vertex attributes
         size_t floatsPerVertex = 8;
         size_t floatsPerPosition = 3;
@@ -136,9 +181,6 @@ private:
             vertexStride,
             texBeginOffset);
         glEnableVertexAttribArray(texAttribLocation);
-
-        // unbind the vertex array
-        glBindVertexArray(0);
     }
 };
 
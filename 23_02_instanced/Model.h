@@ -3,6 +3,9 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <thread>
+#include <algorithm>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -14,13 +17,23 @@
 #include "Texture.h"
 #include "Shader.h"
 #include "Vertex.h"
+#include "UploadService.h"
 
 class Model
 {
 public:
 
     Model() {}
-    ~Model() {}
+    ~Model() { WaitForLoader(); }
+
+    // block until LoadAsync's loader thread has queued all of its uploads.
+    // Call before shutting down the UploadService it was given
+    void WaitForLoader()
+    {
+        if (loaderThread.joinable()) {
+            loaderThread.join();
+        }
+    }
 
     void Load(const std::string& filePath)
     {
@@ -41,6 +54,18 @@ public:
         processNode(scene->mRootNode, scene);
     }
 
+    // import the model and decode its textures on a loader thread, then send
+    // everything through uploader. Meshes appear in Draw() as their buffers
+    // arrive; uploader.Poll() has to be called every frame. Call once per Model
+    void LoadAsync(const std::string& filePath, UploadService& uploader)
+    {
+        directory = filePath.substr(0, filePath.find_last_of('/'));
+        loading = true;
+        loaderThread = std::thread(&Model::loadAsyncWorker, this, filePath, &uploader);
+    }
+
+    bool IsLoading() const { return loading; }
+
     void Draw(const ShaderProgram& shader)
     {
         for (Mesh& mesh : meshes)
@@ -56,6 +81,18 @@ public:
     std::vector<Texture> loaded_textures; // keep track of already loaded
 
 private:
+
+    // CPU side of a mesh while it's loaded off the render thread
+    typedef struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<size_t> textureIndices; // into the async texture list
+        std::vector<TextureType> textureTypes;
+    } MeshData;
+
+    std::thread loaderThread;
+    bool loading = false; // only touched on the render thread after LoadAsync()
+
     void processNode(aiNode* node, const aiScene* scene)
     {
         // process node meshes, if any
@@ -78,6 +115,33 @@ private:
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
 
+        processMeshGeometry(mesh, vertices, indices);
+
+        if (mesh->mMaterialIndex >= 0)
+        {
+            aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+            
+            std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
+                    aiTextureType_DIFFUSE,
+                    TextureType::Diffuse);
+            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+
+            std::vector<Texture> specularMaps = loadMaterialTextures(material, 
+                aiTextureType_SPECULAR, TextureType::Specular);
+            textures.insert(textures.end(), 
+                specularMaps.begin(), 
+                specularMaps.end());
+        }
+
+        Mesh myMesh;
+        myMesh.Init(vertices, indices, textures);
+        return myMesh;
+    }
+
+    void processMeshGeometry(aiMesh* mesh,
+        std::vector<Vertex>& vertices,
+        std::vector<GLuint>& indices)
+    {
         for (size_t i = 0; i < mesh->mNumVertices; i++)
         {
             Vertex vertex;
@@ -112,26 +176,147 @@ private:
                 indices.push_back(face.mIndices[j]);
             }
         }
+    }
 
-        if (mesh->mMaterialIndex >= 0)
+    // loader thread: no GL calls here, everything GL goes through uploader
+    // and the callbacks it runs on the render thread
+    void loadAsyncWorker(std::string filePath, UploadService* uploader)
+    {
+        Assimp::Importer import;
+        const aiScene* scene = import.ReadFile(filePath,
+            aiProcess_Triangulate | aiProcess_FlipUVs);
+
+        std::vector<std::shared_ptr<MeshData>> meshDatas;
+        std::vector<std::string> textureFiles;
+        if (!scene || 
+            scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || 
+            !scene->mRootNode)
+        {
+            std::cout << "ASSIMP error: " << import.GetErrorString() << std::endl;
+        }
+        else {
+            processNodeData(scene->mRootNode, scene, meshDatas, textureFiles);
+        }
+
+        // all textures in one job so they're ready before any mesh using them
+        std::vector<UploadItem> textureItems;
+        std::vector<Texture> textureInfos; // everything but the id
+        for (const std::string& fileName : textureFiles)
         {
+            std::cout << "Model loading texture: " << fileName << std::endl;
+            int width, height, numChannels;
+            if (!stbi_info(fileName.c_str(), &width, &height, &numChannels)) {
+                std::cout << "Failed to load texture data: " << fileName
+                    << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            // 1 and 3 channel images are expanded to RGB, 2 and 4 to RGBA
+            numChannels = (numChannels == 2 || numChannels == 4) ? 4 : 3;
+            int fileChannels;
+            stbi_set_flip_vertically_on_load(true);
+            unsigned char* data = stbi_load(fileName.c_str(), &width, &height, &fileChannels, numChannels);
+            if (!data) {
+                std::cout << "Failed to load texture data: " << fileName
+                    << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            std::shared_ptr<const void> pixels(data, [](const void* p) { stbi_image_free((void*)p); });
+            textureItems.push_back(createTextureUploadItem(pixels, width, height, numChannels));
+            Texture info;
+            info.fileName = fileName;
+            info.width = width;
+            info.height = height;
+            info.numChannels = numChannels;
+            textureInfos.push_back(info);
+        }
+        std::shared_ptr<std::vector<Texture>> textures(new std::vector<Texture>());
+        uploader->Queue(textureItems, [this, textures, textureInfos](const std::vector<GLuint>& ids) {
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                Texture texture = textureInfos[i];
+                texture.id = ids[i];
+                textures->push_back(texture);
+                loaded_textures.push_back(texture);
+            }
+        });
+
+        for (std::shared_ptr<MeshData>& meshData : meshDatas)
+        {
+            std::vector<UploadItem> items;
+            items.push_back(createBufferUploadItem(
+                std::shared_ptr<const void>(meshData, &meshData->vertices[0]),
+                meshData->vertices.size() * sizeof(Vertex),
+                GL_STATIC_DRAW));
+            items.push_back(createBufferUploadItem(
+                std::shared_ptr<const void>(meshData, &meshData->indices[0]),
+                meshData->indices.size() * sizeof(GLuint),
+                GL_STATIC_DRAW));
+            uploader->Queue(items, [this, meshData, textures](const std::vector<GLuint>& ids) {
+                std::vector<Texture> meshTextures;
+                for (size_t i = 0; i < meshData->textureIndices.size(); i++)
+                {
+                    Texture texture = (*textures)[meshData->textureIndices[i]];
+                    texture.type = meshData->textureTypes[i];
+                    meshTextures.push_back(texture);
+                }
+                Mesh mesh;
+                mesh.InitWithBuffers(meshData->vertices, meshData->indices, meshTextures,
+                    ids[0], ids[1]);
+                meshes.push_back(mesh);
+            });
+        }
+
+        // jobs finish in order, so this runs after the last mesh
+        uploader->Queue(std::vector<UploadItem>(), [this](const std::vector<GLuint>&) {
+            loading = false;
+        });
+    }
+
+    void processNodeData(aiNode* node, const aiScene* scene,
+        std::vector<std::shared_ptr<MeshData>>& meshDatas,
+        std::vector<std::string>& textureFiles)
+    {
+        for (size_t i = 0; i < node->mNumMeshes; i++)
+        {
+            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            std::shared_ptr<MeshData> meshData(new MeshData());
+            processMeshGeometry(mesh, meshData->vertices, meshData->indices);
+
             aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-            
-            std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
-                    aiTextureType_DIFFUSE,
-                    TextureType::Diffuse);
-            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+            addMaterialTextureFiles(material, aiTextureType_DIFFUSE, TextureType::Diffuse,
+                *meshData, textureFiles);
+            addMaterialTextureFiles(material, aiTextureType_SPECULAR, TextureType::Specular,
+                *meshData, textureFiles);
 
-            std::vector<Texture> specularMaps = loadMaterialTextures(material, 
-                aiTextureType_SPECULAR, TextureType::Specular);
-            textures.insert(textures.end(), 
-                specularMaps.begin(), 
-                specularMaps.end());
+            if (!meshData->vertices.empty() && !meshData->indices.empty()) {
+                meshDatas.push_back(meshData);
+            }
         }
 
-        Mesh myMesh;
-        myMesh.Init(vertices, indices, textures);
-        return myMesh;
+        for (size_t i = 0; i < node->mNumChildren; i++)
+        {
+            processNodeData(node->mChildren[i], scene, meshDatas, textureFiles);
+        }
+    }
+
+    void addMaterialTextureFiles(aiMaterial* mat,
+        aiTextureType type, TextureType typeName,
+        MeshData& meshData,
+        std::vector<std::string>& textureFiles)
+    {
+        for (size_t i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            std::string fullName = directory + "/" + std::string(str.C_Str());
+            size_t index = std::find(textureFiles.begin(), textureFiles.end(), fullName) -
+                textureFiles.begin();
+            if (index == textureFiles.size()) {
+                textureFiles.push_back(fullName);
+            }
+            meshData.textureIndices.push_back(index);
+            meshData.textureTypes.push_back(typeName);
+        }
     }
 
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat,
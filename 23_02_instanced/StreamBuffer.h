@@ -0,0 +1,109 @@
+#ifndef STREAM_BUFFER_H_INCLUDED
+#define STREAM_BUFFER_H_INCLUDED
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// a vertex buffer rewritten by the CPU every frame, split into numSlices
+// slices so the CPU can write one while the GPU still reads the others
+// (pair with FramePipeline.h, which says which slice is free).
+//
+// With GL_ARB_buffer_storage the whole buffer stays persistently mapped
+// and mapStreamBufferSlice() is just a pointer. Our GL 3.3 glad doesn't
+// have it, so the entry point is looked up by hand; without it each slice
+// is mapped unsynchronized per frame instead, which is safe for the same
+// reason (the fence already said the GPU is done with it)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFN_BUFFER_STORAGE)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+typedef struct StreamBuffer {
+    GLuint id;
+    size_t sliceSize;
+    size_t numSlices;
+    unsigned char* persistentData; // the whole buffer, null if not persistently mapped
+} StreamBuffer;
+
+StreamBuffer createStreamBuffer(size_t sliceSize, size_t numSlices)
+{
+    StreamBuffer buffer;
+    buffer.sliceSize = sliceSize;
+    buffer.numSlices = numSlices;
+    buffer.persistentData = nullptr;
+
+    PFN_BUFFER_STORAGE bufferStorage = nullptr;
+    if (glfwExtensionSupported("GL_ARB_buffer_storage")) {
+        bufferStorage = (PFN_BUFFER_STORAGE)glfwGetProcAddress("glBufferStorage");
+    }
+
+    glGenBuffers(1, &buffer.id);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+    GLsizeiptr size = sliceSize * numSlices;
+    if (bufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        buffer.persistentData = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    }
+    if (!buffer.persistentData) {
+        if (bufferStorage) {
+            // immutable storage can't be respecified
+            glDeleteBuffers(1, &buffer.id);
+            glGenBuffers(1, &buffer.id);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+        }
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return buffer;
+}
+
+// the CPU side of a slice; only valid until unmapStreamBufferSlice()
+void* mapStreamBufferSlice(StreamBuffer& buffer, size_t slice)
+{
+    if (buffer.persistentData) {
+        return buffer.persistentData + slice * buffer.sliceSize;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+    void* data = glMapBufferRange(GL_ARRAY_BUFFER,
+        slice * buffer.sliceSize,
+        buffer.sliceSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return data;
+}
+
+// returns false if the slice's contents were lost and it has to be
+// written again (see glUnmapBuffer)
+bool unmapStreamBufferSlice(StreamBuffer& buffer)
+{
+    if (buffer.persistentData) {
+        return true;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+    bool intact = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return intact;
+}
+
+size_t streamBufferSliceOffset(const StreamBuffer& buffer, size_t slice)
+{
+    return slice * buffer.sliceSize;
+}
+
+void deleteStreamBuffer(StreamBuffer& buffer)
+{
+    if (buffer.persistentData) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        buffer.persistentData = nullptr;
+    }
+    glDeleteBuffers(1, &buffer.id);
+    buffer.id = 0;
+}
+
+#endif // !STREAM_BUFFER_H_INCLUDED
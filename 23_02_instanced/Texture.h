@@ -13,13 +13,15 @@ enum class TextureType {
     Specular
 };
 
+// zero until loaded; Model::LoadAsync hands these out before the
+// upload thread has created the texture
 typedef struct Texture {
     std::string fileName;
-    int width;
-    int height;
-    int numChannels;
-    unsigned int id;
-    TextureType type;
+    int width = 0;
+    int height = 0;
+    int numChannels = 0;
+    unsigned int id = 0;
+    TextureType type = TextureType::Diffuse;
 } Texture;
 
 static void setTextureOptions()
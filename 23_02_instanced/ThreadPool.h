@@ -0,0 +1,121 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// minimal fixed size pool of worker threads. Tasks may push more tasks;
+// Wait() returns once every pushed task (including those) has finished
+class ThreadPool
+{
+public:
+
+    ThreadPool() {}
+    ~ThreadPool() { Shutdown(); }
+
+    void Init(size_t numThreads = 0)
+    {
+        if (numThreads == 0) {
+            numThreads = std::thread::hardware_concurrency();
+        }
+        if (numThreads == 0) {
+            numThreads = 1;
+        }
+
+        quit = false;
+        pending = 0;
+        for (size_t i = 0; i < numThreads; ++i)
+        {
+            threads.push_back(std::thread(&ThreadPool::workerLoop, this));
+        }
+    }
+
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        taskCv.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+    }
+
+    void Push(const std::function<void()>& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(task);
+            ++pending;
+        }
+        taskCv.notify_one();
+    }
+
+    // block until all tasks are finished
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCv.wait(lock, [this]() { return pending == 0; });
+    }
+
+    // split [0, count) into roughly even ranges, one task each, and wait
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& func)
+    {
+        size_t numTasks = threads.size();
+        size_t perTask = (count + numTasks - 1) / numTasks;
+        for (size_t begin = 0; begin < count; begin += perTask)
+        {
+            size_t end = std::min(count, begin + perTask);
+            Push([func, begin, end]() { func(begin, end); });
+        }
+        Wait();
+    }
+
+    size_t NumThreads() const { return threads.size(); }
+
+private:
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskCv;
+    std::condition_variable doneCv;
+    size_t pending = 0; // queued + running
+    bool quit = false;
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskCv.wait(lock, [this]() { return quit || !tasks.empty(); });
+                if (quit && tasks.empty()) {
+                    return;
+                }
+                task = tasks.front();
+                tasks.pop_front();
+            }
+
+            task();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --pending;
+                if (pending == 0) {
+                    doneCv.notify_all();
+                }
+            }
+        }
+    }
+};
+
+#endif // !THREAD_POOL_H_INCLUDED
@@ -0,0 +1,435 @@
+#ifndef UPLOAD_SERVICE_H_INCLUDED
+#define UPLOAD_SERVICE_H_INCLUDED
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "Texture.h"
+
+// uploads buffers and textures from a second GL context on its own thread so
+// the render thread never blocks on glBufferData/glTexImage2D.
+//
+// The upload context lives in a hidden 1x1 window that shares objects with
+// the main window. Data goes through a small ring of staging buffers: each
+// chunk is copied into a mapped staging buffer, then into the destination
+// with glCopyBufferSubData (buffers) or glTexSubImage2D from a
+// GL_PIXEL_UNPACK_BUFFER (textures), and a fence marks when the staging
+// buffer can be refilled. GL 3.3 has no persistent mapping, so each chunk is
+// mapped with GL_MAP_UNSYNCHRONIZED_BIT instead; the per buffer fence is what
+// makes that safe.
+//
+// Every job ends with a fence. Poll() on the render thread checks the
+// oldest fences with a zero timeout and runs the job callbacks in queue order
+// once they have signalled. Vertex array objects aren't shared between
+// contexts, so callbacks are where VAOs for the new buffers get made
+#define UPLOAD_SERVICE_NUM_STAGING_BUFFERS 4
+#define UPLOAD_SERVICE_STAGING_BUFFER_SIZE (4 * 1024 * 1024)
+
+enum class UploadItemType {
+    Buffer,
+    Texture
+};
+
+typedef struct UploadItem {
+    UploadItemType type;
+    std::shared_ptr<const void> data; // kept alive until the upload thread is done with it
+    size_t size;     // bytes
+    GLenum usage;    // buffers
+    int width;       // textures, 8 bits per channel
+    int height;
+    int numChannels; // 3 or 4
+} UploadItem;
+
+UploadItem createBufferUploadItem(const std::shared_ptr<const void>& data,
+                                  size_t size,
+                                  GLenum usage)
+{
+    UploadItem item;
+    item.type = UploadItemType::Buffer;
+    item.data = data;
+    item.size = size;
+    item.usage = usage;
+    item.width = 0;
+    item.height = 0;
+    item.numChannels = 0;
+    return item;
+}
+
+UploadItem createTextureUploadItem(const std::shared_ptr<const void>& pixels,
+                                   int width,
+                                   int height,
+                                   int numChannels)
+{
+    UploadItem item;
+    item.type = UploadItemType::Texture;
+    item.data = pixels;
+    item.size = (size_t)width * height * numChannels;
+    item.usage = 0;
+    item.width = width;
+    item.height = height;
+    item.numChannels = numChannels;
+    return item;
+}
+
+// called on the render thread with one GL object per item, in item order
+typedef std::function<void(const std::vector<GLuint>&)> UploadCallback;
+
+typedef struct UploadServiceStats {
+    size_t jobsQueued;    // waiting for the upload thread
+    size_t jobsInFlight;  // uploaded, waiting for their fence
+    size_t jobsCompleted;
+    size_t bytesUploaded;
+    size_t stagingWaits;  // times the upload thread had to wait for a staging buffer
+    double uploadThreadMs; // time spent issuing uploads
+} UploadServiceStats;
+
+class UploadService
+{
+public:
+
+    UploadService() {}
+    ~UploadService() { Shutdown(); }
+
+    // call on the main thread after the main window's context is created
+    void Init(GLFWwindow* mainWindow)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        uploadWindow = glfwCreateWindow(1, 1, "Upload", NULL, mainWindow);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (uploadWindow == nullptr) {
+            std::cout << "Failed to create upload context" << std::endl;
+            glfwTerminate();
+            exit(EXIT_FAILURE);
+        }
+
+        quit = false;
+        thread = std::thread(&UploadService::workerLoop, this);
+    }
+
+    // jobs that haven't started are dropped, which frees their data, and
+    // the objects of jobs whose callbacks haven't run are deleted. Jobs
+    // queued after this are dropped as well
+    void Shutdown()
+    {
+        if (!uploadWindow) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            jobs.clear();
+        }
+        jobCv.notify_all();
+        thread.join();
+
+        for (FinishedJob& job : finished)
+        {
+            glDeleteSync(job.fence);
+            for (size_t i = 0; i < job.objects.size(); ++i)
+            {
+                if (job.objectTypes[i] == UploadItemType::Buffer) {
+                    glDeleteBuffers(1, &job.objects[i]);
+                } else {
+                    glDeleteTextures(1, &job.objects[i]);
+                }
+            }
+        }
+        finished.clear();
+
+        glfwDestroyWindow(uploadWindow);
+        uploadWindow = nullptr;
+    }
+
+    // safe to call from any thread
+    void Queue(const std::vector<UploadItem>& items, const UploadCallback& onReady)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (quit) {
+                return;
+            }
+            Job job;
+            job.items = items;
+            job.onReady = onReady;
+            jobs.push_back(job);
+        }
+        jobCv.notify_one();
+    }
+
+    // render thread, once per frame. Never waits on the GPU
+    void Poll()
+    {
+        while (true)
+        {
+            FinishedJob job;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (finished.empty()) {
+                    return;
+                }
+                GLenum result = glClientWaitSync(finished.front().fence, 0, 0);
+                if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+                    return;
+                }
+                job = finished.front();
+                finished.pop_front();
+                ++jobsCompleted;
+            }
+            glDeleteSync(job.fence);
+            if (job.onReady) {
+                job.onReady(job.objects);
+            }
+        }
+    }
+
+    UploadServiceStats GetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        UploadServiceStats stats;
+        stats.jobsQueued = jobs.size() + (busy ? 1 : 0);
+        stats.jobsInFlight = finished.size();
+        stats.jobsCompleted = jobsCompleted;
+        stats.bytesUploaded = bytesUploaded;
+        stats.stagingWaits = stagingWaits;
+        stats.uploadThreadMs = uploadThreadMs;
+        return stats;
+    }
+
+private:
+
+    typedef struct Job {
+        std::vector<UploadItem> items;
+        UploadCallback onReady;
+    } Job;
+
+    typedef struct FinishedJob {
+        std::vector<GLuint> objects;
+        std::vector<UploadItemType> objectTypes;
+        UploadCallback onReady;
+        GLsync fence;
+    } FinishedJob;
+
+    GLFWwindow* uploadWindow = nullptr;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable jobCv;
+    std::deque<Job> jobs;
+    std::deque<FinishedJob> finished;
+    bool quit = false;
+    bool busy = false;
+
+    // only touched by the upload thread
+    GLuint stagingBuffers[UPLOAD_SERVICE_NUM_STAGING_BUFFERS];
+    GLsync stagingFences[UPLOAD_SERVICE_NUM_STAGING_BUFFERS];
+    size_t nextStagingBuffer = 0;
+
+    // guarded by mutex
+    size_t jobsCompleted = 0;
+    size_t bytesUploaded = 0;
+    size_t stagingWaits = 0;
+    double uploadThreadMs = 0.0;
+
+    void workerLoop()
+    {
+        glfwMakeContextCurrent(uploadWindow);
+
+        glGenBuffers(UPLOAD_SERVICE_NUM_STAGING_BUFFERS, stagingBuffers);
+        for (size_t i = 0; i < UPLOAD_SERVICE_NUM_STAGING_BUFFERS; ++i)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffers[i]);
+            glBufferData(GL_COPY_READ_BUFFER,
+                UPLOAD_SERVICE_STAGING_BUFFER_SIZE,
+                NULL,
+                GL_STREAM_DRAW);
+            stagingFences[i] = 0;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows aren't 4 byte aligned
+
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                busy = false;
+                jobCv.wait(lock, [this]() { return quit || !jobs.empty(); });
+                if (quit && jobs.empty()) {
+                    break;
+                }
+                job = jobs.front();
+                jobs.pop_front();
+                busy = true;
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            FinishedJob done;
+            size_t jobBytes = 0;
+            for (const UploadItem& item : job.items)
+            {
+                if (item.type == UploadItemType::Buffer) {
+                    done.objects.push_back(uploadBuffer(item));
+                }
+                else {
+                    done.objects.push_back(uploadTexture(item));
+                }
+                done.objectTypes.push_back(item.type);
+                jobBytes += item.size;
+            }
+            done.onReady = job.onReady;
+            done.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            // make the commands (and the fence) visible to the render context
+            glFlush();
+            auto end = std::chrono::high_resolution_clock::now();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(done);
+            bytesUploaded += jobBytes;
+            uploadThreadMs += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+
+        for (size_t i = 0; i < UPLOAD_SERVICE_NUM_STAGING_BUFFERS; ++i)
+        {
+            if (stagingFences[i]) {
+                glDeleteSync(stagingFences[i]);
+            }
+        }
+        glDeleteBuffers(UPLOAD_SERVICE_NUM_STAGING_BUFFERS, stagingBuffers);
+        glFinish();
+        glfwMakeContextCurrent(NULL);
+    }
+
+    // the next staging buffer in the ring, once the GPU is done reading it
+    size_t acquireStagingBuffer()
+    {
+        size_t index = nextStagingBuffer;
+        nextStagingBuffer = (nextStagingBuffer + 1) % UPLOAD_SERVICE_NUM_STAGING_BUFFERS;
+
+        GLsync fence = stagingFences[index];
+        if (fence) {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++stagingWaits;
+                }
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+                }
+            }
+            glDeleteSync(fence);
+            stagingFences[index] = 0;
+        }
+        return index;
+    }
+
+    void releaseStagingBuffer(size_t index)
+    {
+        stagingFences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copy size bytes into the bound staging buffer on target
+    static void fillStagingBuffer(GLenum target, const void* data, size_t size)
+    {
+        void* dst = glMapBufferRange(target,
+            0,
+            size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (dst) {
+            memcpy(dst, data, size);
+            glUnmapBuffer(target);
+        }
+        else {
+            glBufferSubData(target, 0, size, data);
+        }
+    }
+
+    GLuint uploadBuffer(const UploadItem& item)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, item.size, NULL, item.usage);
+
+        const unsigned char* src = (const unsigned char*)item.data.get();
+        for (size_t offset = 0; offset < item.size; offset += UPLOAD_SERVICE_STAGING_BUFFER_SIZE)
+        {
+            size_t chunkSize = std::min<size_t>(UPLOAD_SERVICE_STAGING_BUFFER_SIZE, item.size - offset);
+            size_t staging = acquireStagingBuffer();
+            glBindBuffer(GL_COPY_READ_BUFFER, stagingBuffers[staging]);
+            fillStagingBuffer(GL_COPY_READ_BUFFER, src + offset, chunkSize);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER,
+                GL_COPY_WRITE_BUFFER,
+                0,
+                offset,
+                chunkSize);
+            releaseStagingBuffer(staging);
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    GLuint uploadTexture(const UploadItem& item)
+    {
+        GLenum format = item.numChannels == 4 ? GL_RGBA : GL_RGB;
+        size_t rowBytes = (size_t)item.width * item.numChannels;
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D,
+            0,
+            format,
+            item.width,
+            item.height,
+            0,
+            format,
+            GL_UNSIGNED_BYTE,
+            NULL);
+
+        const unsigned char* src = (const unsigned char*)item.data.get();
+        size_t rowsPerChunk = UPLOAD_SERVICE_STAGING_BUFFER_SIZE / rowBytes;
+        if (rowsPerChunk == 0) {
+            // a single row doesn't fit, upload straight from client memory
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, item.width, item.height,
+                format, GL_UNSIGNED_BYTE, src);
+        }
+        for (size_t row = 0; rowsPerChunk > 0 && row < (size_t)item.height; row += rowsPerChunk)
+        {
+            size_t numRows = std::min<size_t>(rowsPerChunk, item.height - row);
+            size_t staging = acquireStagingBuffer();
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffers[staging]);
+            fillStagingBuffer(GL_PIXEL_UNPACK_BUFFER, src + row * rowBytes, numRows * rowBytes);
+            glTexSubImage2D(GL_TEXTURE_2D,
+                0,
+                0,
+                row,
+                item.width,
+                numRows,
+                format,
+                GL_UNSIGNED_BYTE,
+                (void*)0); // offset into the unpack buffer
+            releaseStagingBuffer(staging);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glGenerateMipmap(GL_TEXTURE_2D);
+        setTextureOptions();
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+
+#endif // !UPLOAD_SERVICE_H_INCLUDED
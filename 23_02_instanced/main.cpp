@@ -3,6 +3,9 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <memory>
+#include <chrono>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +22,11 @@
 #include "Camera.h"
 #include "LightSource.h"
 #include "Mesh.h"
+#include "UploadService.h"
+#include "AsteroidBelt.h"
+#include "StreamBuffer.h"
+#include "FramePipeline.h"
+#include "ThreadPool.h"
 
 
 // Globals
@@ -38,12 +46,58 @@ float offset = 2.5F;
 Model gAsteroidModel;
 glm::mat4* gAsteroidModelMats = new glm::mat4[amount];
 GLuint gAsteroidInstanceVBO;
+bool gAsteroidsReady = false; // instance buffer has arrived from gUploadService
+
+// O switches to an animated belt whose orbits are stepped every frame on
+// gBeltThreads and written into the frame's slice of gBeltStream. N
+// cycles the number of rocks in it
+bool gAnimateBelt = false;
+const size_t gBeltRockCounts[] = { 100000, 1000000 };
+size_t gBeltRockCountIndex = 0;
+AsteroidBelt gAsteroidBelt;
+StreamBuffer gBeltStream;
+std::vector<GLuint> gBeltVAOs; // rock meshes with the belt's instance attributes
+ThreadPool gBeltThreads;
+FramePipeline gFramePipeline;
+
+// once per second
+typedef struct BeltStats {
+    size_t numFrames;
+    double updateMs;    // stepping the belt into the mapped slice
+    double waitMs;      // beginFrame() waiting for the slice to be free
+} BeltStats;
+BeltStats gBeltStats = { 0, 0.0, 0.0 };
 
 Model gPlanetModel;
 glm::mat4 gPlanetModelMat;
 
+// UploadService.h
+UploadService gUploadService;
+
+// extra planets loaded mid-session to compare frame hitches:
+// K loads synchronously on the render thread, L through gUploadService
+Model gSyncLoadedModel;
+Model gAsyncLoadedModel;
+bool gSyncLoadStarted = false;
+bool gAsyncLoadStarted = false;
+
+// frame times while a mid-session load is in progress
+typedef struct HitchMeasurement {
+    bool active;
+    const char* name;
+    const Model* model;     // measurement ends once it has finished loading
+    double startTime;
+    double baselineFrameMs; // average frame time before the load started
+    size_t numFrames;
+    size_t numHitches;      // frames over twice the baseline
+    double worstFrameMs;
+} HitchMeasurement;
+HitchMeasurement gHitchMeasurement = { false, "", nullptr, 0.0, 0.0, 0, 0, 0.0 };
+double gAverageFrameMs = 0.0;
+
 ShaderProgram gShaderProgram;
 ShaderProgram gAsteroidsShaderProgram;
+ShaderProgram gAsteroidBeltShaderProgram;
 
 // shaders just used by the object representing the light
 //ShaderProgram gLightShaderProgram; 
@@ -199,10 +253,11 @@ static void updateUniforms()
 {
     static ShaderProgram* shaderPtrs[] = {
         &gShaderProgram,
-        &gAsteroidsShaderProgram
+        &gAsteroidsShaderProgram,
+        &gAsteroidBeltShaderProgram
     };
 
-    for (size_t i = 0; i < 2; i++)
+    for (size_t i = 0; i < 3; i++)
     {
 
         ShaderProgram* sPtr = shaderPtrs[i];
@@ -261,6 +316,80 @@ static void updateUniforms()
     //gLightShaderProgram.SetVec3fv("uLightColor", lightDiffuse);
 }
 
+// (re)makes the animated belt with numRocks rocks
+static void createAnimatedBelt(size_t numRocks)
+{
+    // the old buffer may still be in use by frames in flight
+    setFramesInFlight(gFramePipeline, gFramePipeline.numFramesInFlight);
+    if (gBeltStream.id != 0) {
+        deleteStreamBuffer(gBeltStream);
+    }
+
+    gAsteroidBelt = createAsteroidBelt(numRocks, radius, offset);
+    gBeltStream = createStreamBuffer(gAsteroidBelt.numPaddedRocks * sizeof(AsteroidInstance),
+        MAX_FRAMES_IN_FLIGHT);
+    if (gBeltVAOs.empty()) {
+        for (Mesh& mesh : gAsteroidModel.meshes) {
+            gBeltVAOs.push_back(mesh.CreateVertexArray());
+        }
+    }
+    std::cout << "Animated asteroid belt: " << numRocks << " rocks, "
+        << (gBeltStream.persistentData ? "persistently mapped" : "mapped per frame") << std::endl;
+}
+
+// steps the belt and writes it into this frame's slice
+static void updateAnimatedBelt(size_t slot, float dt)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto start = Clock::now();
+    AsteroidInstance* instances = (AsteroidInstance*)mapStreamBufferSlice(gBeltStream, slot);
+    if (instances) {
+        updateAsteroidBelt(gAsteroidBelt, dt, gBeltThreads, instances);
+    }
+    if (!unmapStreamBufferSlice(gBeltStream) || !instances) {
+        std::cout << "Asteroid belt: failed to write the instance buffer" << std::endl;
+    }
+    gBeltStats.updateMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void drawAnimatedBelt()
+{
+    gAsteroidBeltShaderProgram.Use();
+    size_t sliceOffset = streamBufferSliceOffset(gBeltStream, gFramePipeline.slot);
+    glBindBuffer(GL_ARRAY_BUFFER, gBeltStream.id);
+    for (size_t i = 0; i < gAsteroidModel.meshes.size(); i++)
+    {
+        // point the instance attributes at this frame's slice
+        glBindVertexArray(gBeltVAOs[i]);
+        size_t positionScaleLoc = 3; // attribute layout locations
+        size_t rotationLoc = 4;
+        glEnableVertexAttribArray(positionScaleLoc);
+        glVertexAttribPointer(positionScaleLoc,
+                              4,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              sizeof(AsteroidInstance),
+                              (void*)(sliceOffset + offsetof(AsteroidInstance, positionScale)));
+        glVertexAttribDivisor(positionScaleLoc, 1);
+        glEnableVertexAttribArray(rotationLoc);
+        glVertexAttribPointer(rotationLoc,
+                              4,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              sizeof(AsteroidInstance),
+                              (void*)(sliceOffset + offsetof(AsteroidInstance, rotation)));
+        glVertexAttribDivisor(rotationLoc, 1);
+
+        glDrawElementsInstanced(GL_TRIANGLES,
+                                gAsteroidModel.meshes[i].indices.size(),
+                                GL_UNSIGNED_INT,
+                                0,
+                                gAsteroidBelt.numRocks);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 // called once every frame during main loop
 static void draw()
 {
@@ -282,7 +411,30 @@ static void draw()
     gShaderProgram.SetMat4fv("uTransform", gModelTransMat);
     gPlanetModel.Draw(gShaderProgram);
 
+    // draw the models loaded mid-session, whatever part of them is ready
+    static Model* loadedModels[] = { &gSyncLoadedModel, &gAsyncLoadedModel };
+    static glm::vec3 loadedModelPositions[] = {
+        glm::vec3(-20.0F, 5.0F, 0.0F),
+        glm::vec3(20.0F, 5.0F, 0.0F)
+    };
+    for (size_t i = 0; i < 2; i++)
+    {
+        glm::mat4 modelMat = glm::translate(glm::mat4(1.0F), loadedModelPositions[i]);
+        modelMat = glm::scale(modelMat, glm::vec3(2.0F, 2.0F, 2.0F));
+        gShaderProgram.SetMat4fv("uModel", modelMat);
+        updateTransformationMatrix(gModelTransMat, modelMat, gCamera);
+        gShaderProgram.SetMat4fv("uTransform", gModelTransMat);
+        loadedModels[i]->Draw(gShaderProgram);
+    }
+
     // draw the asteroids
+    if (gAnimateBelt) {
+        drawAnimatedBelt();
+        return;
+    }
+    if (!gAsteroidsReady) {
+        return;
+    }
     gAsteroidsShaderProgram.Use();
     for (size_t i = 0; i < gAsteroidModel.meshes.size(); i++)
     {
@@ -295,6 +447,99 @@ static void draw()
     }
 }
 
+// the asteroid meshes were loaded synchronously, so their VAOs exist by the
+// time the instance buffer arrives; VAOs have to be made on this context
+static void setupAsteroidInstanceAttributes()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, gAsteroidInstanceVBO);
+    for (size_t i = 0; i < gAsteroidModel.meshes.size(); i++)
+    {
+        GLuint VAO = gAsteroidModel.meshes[i].VAO;
+        glBindVertexArray(VAO);
+
+        // vertex attributes
+        size_t v4size = sizeof(glm::vec4);
+        size_t instanceMatLoc = 3; // attribute layout location
+        size_t floatsPerPosition = 4;
+        //size_t vertexStride = floatsPerPosition * v4size;
+        size_t vertexStride = sizeof(glm::mat4);
+        glEnableVertexAttribArray(instanceMatLoc + 0);
+        glVertexAttribPointer(instanceMatLoc + 0,
+                              floatsPerPosition,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              vertexStride,
+                              (void*)0); // column 0 offset
+        glEnableVertexAttribArray(instanceMatLoc + 1);
+        glVertexAttribPointer(instanceMatLoc + 1,
+                              floatsPerPosition,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              vertexStride,
+                              (void*)(1*v4size)); // column 0 offset
+        glEnableVertexAttribArray(instanceMatLoc + 2);
+        glVertexAttribPointer(instanceMatLoc + 2,
+                              floatsPerPosition,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              vertexStride,
+                              (void*)(2*v4size)); // column 0 offset
+        glEnableVertexAttribArray(instanceMatLoc + 3);
+        glVertexAttribPointer(instanceMatLoc + 3,
+                              floatsPerPosition,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              vertexStride,
+                              (void*)(3*v4size)); // column 0 offset
+
+        glVertexAttribDivisor(instanceMatLoc + 0, 1); // 1 = update the attribute every instance (0 = every vertex)
+        glVertexAttribDivisor(instanceMatLoc + 1, 1); // 1 = update the attribute every instance (0 = every vertex)
+        glVertexAttribDivisor(instanceMatLoc + 2, 1); // 1 = update the attribute every instance (0 = every vertex)
+        glVertexAttribDivisor(instanceMatLoc + 3, 1); // 1 = update the attribute every instance (0 = every vertex)
+
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void beginHitchMeasurement(const char* name, const Model* model)
+{
+    gHitchMeasurement.active = true;
+    gHitchMeasurement.name = name;
+    gHitchMeasurement.model = model;
+    gHitchMeasurement.startTime = glfwGetTime();
+    gHitchMeasurement.baselineFrameMs = gAverageFrameMs;
+    gHitchMeasurement.numFrames = 0;
+    gHitchMeasurement.numHitches = 0;
+    gHitchMeasurement.worstFrameMs = 0.0;
+}
+
+// call once per frame with the previous frame's time
+static void updateHitchMeasurement(double frameMs)
+{
+    if (!gHitchMeasurement.active) {
+        return;
+    }
+    gHitchMeasurement.numFrames++;
+    gHitchMeasurement.worstFrameMs = std::max(gHitchMeasurement.worstFrameMs, frameMs);
+    if (frameMs > 2.0 * gHitchMeasurement.baselineFrameMs) {
+        gHitchMeasurement.numHitches++;
+    }
+    if (!gHitchMeasurement.model->IsLoading()) {
+        gHitchMeasurement.active = false;
+        UploadServiceStats stats = gUploadService.GetStats();
+        std::cout << gHitchMeasurement.name << " load: "
+            << (glfwGetTime() - gHitchMeasurement.startTime) * 1000.0 << " ms over "
+            << gHitchMeasurement.numFrames << " frames, worst frame "
+            << gHitchMeasurement.worstFrameMs << " ms (baseline "
+            << gHitchMeasurement.baselineFrameMs << " ms), "
+            << gHitchMeasurement.numHitches << " hitches; upload thread "
+            << stats.bytesUploaded / (1024 * 1024) << " MB total in "
+            << stats.uploadThreadMs << " ms, "
+            << stats.stagingWaits << " staging waits" << std::endl;
+    }
+}
+
 int main(void)
 {
     initGlfw();
@@ -310,6 +555,9 @@ int main(void)
     // prevent triangles behind other triangles from being drawn
     glEnable(GL_DEPTH_TEST);
 
+    // UploadService.h
+    gUploadService.Init(gWindow);
+
     // Cube.h
     // for the light source
     gCube = createCube();
@@ -321,6 +569,11 @@ int main(void)
     gShaderProgram.Create("vertexShader.glsl", "fragmentShader.glsl");
     gShaderProgram.Use();
     gAsteroidsShaderProgram.Create("vertexShader_instanced.glsl", "fragmentShader.glsl");
+    gAsteroidBeltShaderProgram.Create("vertexShader_asteroidBelt.glsl", "fragmentShader.glsl");
+
+    // AsteroidBelt.h/FramePipeline.h
+    gBeltThreads.Init();
+    gFramePipeline = createFramePipeline(MAX_FRAMES_IN_FLIGHT);
 
     // Model.h
     gAsteroidModel.Load("rock/rock.obj");
@@ -366,62 +619,18 @@ int main(void)
         gAsteroidModelMats[i] = model;
     }
 
-    // Create instanced drawing buffer
-    //gAsteroidsShaderProgram.Use();
-    glGenBuffers(1, &gAsteroidInstanceVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, gAsteroidInstanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, 
+    // Create instanced drawing buffer on the upload thread; the asteroids
+    // are drawn once it has arrived. gAsteroidModelMats outlives the upload
+    std::vector<UploadItem> asteroidItems;
+    asteroidItems.push_back(createBufferUploadItem(
+        std::shared_ptr<const void>(gAsteroidModelMats, [](const void*) {}),
         amount * sizeof(glm::mat4),
-        &gAsteroidModelMats[0],
-        GL_STATIC_DRAW);
-
-    for (size_t i = 0; i < gAsteroidModel.meshes.size(); i++)
-    {
-        GLuint VAO = gAsteroidModel.meshes[i].VAO;
-        glBindVertexArray(VAO);
-
-        // vertex attributes
-        size_t v4size = sizeof(glm::vec4);
-        size_t instanceMatLoc = 3; // attribute layout location
-        size_t floatsPerPosition = 4;
-        //size_t vertexStride = floatsPerPosition * v4size;
-        size_t vertexStride = sizeof(glm::mat4);
-        glEnableVertexAttribArray(instanceMatLoc + 0);
-        glVertexAttribPointer(instanceMatLoc + 0,
-                              floatsPerPosition,
-                              GL_FLOAT,
-                              GL_FALSE,
-                              vertexStride,
-                              (void*)0); // column 0 offset
-        glEnableVertexAttribArray(instanceMatLoc + 1);
-        glVertexAttribPointer(instanceMatLoc + 1,
-                              floatsPerPosition,
-                              GL_FLOAT,
-                              GL_FALSE,
-                              vertexStride,
-                              (void*)(1*v4size)); // column 0 offset
-        glEnableVertexAttribArray(instanceMatLoc + 2);
-        glVertexAttribPointer(instanceMatLoc + 2,
-                              floatsPerPosition,
-                              GL_FLOAT,
-                              GL_FALSE,
-                              vertexStride,
-                              (void*)(2*v4size)); // column 0 offset
-        glEnableVertexAttribArray(instanceMatLoc + 3);
-        glVertexAttribPointer(instanceMatLoc + 3,
-                              floatsPerPosition,
-                              GL_FLOAT,
-                              GL_FALSE,
-                              vertexStride,
-                              (void*)(3*v4size)); // column 0 offset
-
-        glVertexAttribDivisor(instanceMatLoc + 0, 1); // 1 = update the attribute every instance (0 = every vertex)
-        glVertexAttribDivisor(instanceMatLoc + 1, 1); // 1 = update the attribute every instance (0 = every vertex)
-        glVertexAttribDivisor(instanceMatLoc + 2, 1); // 1 = update the attribute every instance (0 = every vertex)
-        glVertexAttribDivisor(instanceMatLoc + 3, 1); // 1 = update the attribute every instance (0 = every vertex)
-
-        glBindVertexArray(0);
-    }
+        GL_STATIC_DRAW));
+    gUploadService.Queue(asteroidItems, [](const std::vector<GLuint>& ids) {
+        gAsteroidInstanceVBO = ids[0];
+        setupAsteroidInstanceAttributes();
+        gAsteroidsReady = true;
+    });
 
     while (!glfwWindowShouldClose(gWindow))
     {
@@ -440,6 +649,59 @@ int main(void)
             gCube.renderMode = rectRenderModes[renderIndex];
         }
 
+        // frame time for the hitch measurement
+        static double lastFrameTime = glfwGetTime();
+        double frameMs = (glfwGetTime() - lastFrameTime) * 1000.0;
+        lastFrameTime = glfwGetTime();
+        gAverageFrameMs = gAverageFrameMs == 0.0 ? frameMs : gAverageFrameMs * 0.95 + frameMs * 0.05;
+        updateHitchMeasurement(frameMs);
+
+        // pick up finished uploads, never blocks
+        gUploadService.Poll();
+
+        // K loads a model on the render thread, L through the upload thread
+        if (glfwGetKey(gWindow, GLFW_KEY_K) == GLFW_PRESS &&
+            !gSyncLoadStarted && !gHitchMeasurement.active) {
+            gSyncLoadStarted = true;
+            beginHitchMeasurement("Synchronous", &gSyncLoadedModel);
+            gSyncLoadedModel.Load("planet/planet.obj");
+        }
+        if (glfwGetKey(gWindow, GLFW_KEY_L) == GLFW_PRESS &&
+            !gAsyncLoadStarted && !gHitchMeasurement.active) {
+            gAsyncLoadStarted = true;
+            beginHitchMeasurement("Asynchronous", &gAsyncLoadedModel);
+            gAsyncLoadedModel.LoadAsync("planet/planet.obj", gUploadService);
+        }
+
+        // O switches between the static and the animated belt
+        static bool animateWasPressed = false;
+        bool animatePressed = glfwGetKey(gWindow, GLFW_KEY_O) == GLFW_PRESS;
+        if (animatePressed && !animateWasPressed) {
+            gAnimateBelt = !gAnimateBelt;
+            if (gAnimateBelt && gBeltStream.id == 0) {
+                createAnimatedBelt(gBeltRockCounts[gBeltRockCountIndex]);
+            }
+        }
+        animateWasPressed = animatePressed;
+
+        // N cycles the number of animated rocks
+        static bool rockCountWasPressed = false;
+        bool rockCountPressed = glfwGetKey(gWindow, GLFW_KEY_N) == GLFW_PRESS;
+        if (rockCountPressed && !rockCountWasPressed && gAnimateBelt) {
+            size_t numRockCounts = sizeof(gBeltRockCounts) / sizeof(gBeltRockCounts[0]);
+            gBeltRockCountIndex = (gBeltRockCountIndex + 1) % numRockCounts;
+            createAnimatedBelt(gBeltRockCounts[gBeltRockCountIndex]);
+        }
+        rockCountWasPressed = rockCountPressed;
+
+        // waits until the GPU is done with this frame's slice
+        size_t slot = beginFrame(gFramePipeline);
+        if (gAnimateBelt) {
+            gBeltStats.waitMs += gFramePipeline.cpuWaitMs;
+            gBeltStats.numFrames++;
+            updateAnimatedBelt(slot, std::min(float(frameMs / 1000.0), 0.1F));
+        }
+
         moveCamera();
 
         // move the light around
@@ -458,9 +720,31 @@ int main(void)
         draw();
 
         glfwSwapBuffers(gWindow);
+        endFrame(gFramePipeline);
         glfwPollEvents();
+
+        static double lastStatsTime = glfwGetTime();
+        if (glfwGetTime() - lastStatsTime >= 1.0) {
+            lastStatsTime = glfwGetTime();
+            if (gBeltStats.numFrames > 0) {
+                std::cout << "Asteroid belt: " << gAsteroidBelt.numRocks << " rocks, update "
+                    << gBeltStats.updateMs / gBeltStats.numFrames << " ms/frame on "
+                    << gBeltThreads.NumThreads() << " threads, slice wait "
+                    << gBeltStats.waitMs / gBeltStats.numFrames << " ms/frame, frame "
+                    << gAverageFrameMs << " ms" << std::endl;
+            }
+            gBeltStats = { 0, 0.0, 0.0 };
+        }
     }
 
+    gBeltThreads.Shutdown();
+    if (gBeltStream.id != 0) {
+        deleteStreamBuffer(gBeltStream);
+    }
+    deleteFramePipeline(gFramePipeline);
+    // the loader must have queued everything before the uploader stops
+    gAsyncLoadedModel.WaitForLoader();
+    gUploadService.Shutdown();
     delete[] gAsteroidModelMats;
     glfwTerminate();
     return 0;
@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// written every frame by AsteroidBelt.h: 2 vec4s per rock instead of a
+// whole matrix, so the CPU writes and the GPU reads half as much
+layout (location = 3) in vec4 aInstancePositionScale; // xyz = position, w = scale
+layout (location = 4) in vec4 aInstanceRotation; // quaternion
+
+uniform mat4 uProjection;
+uniform mat4 uView;
+
+// normal and fragment position (in world space) for lighting calculation
+out vec3 Normal;
+out vec3 FragPosition;
+out vec2 TexCoords;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    vec3 worldPos = rotate(aInstanceRotation, aPos * aInstancePositionScale.w) + aInstancePositionScale.xyz;
+    gl_Position = uProjection * uView * vec4(worldPos, 1.0);
+    // the scale is uniform, so normals only need the rotation
+    Normal = rotate(aInstanceRotation, aNormal);
+    FragPosition = worldPos;
+    TexCoords = aTexCoords;
+}
@@ -0,0 +1,389 @@
+#ifndef CONE_STEP_MAP_H_INCLUDED
+#define CONE_STEP_MAP_H_INCLUDED
+
+#include <vector>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+
+// relaxed cone step maps (Policarpo and Oliveira, "Relaxed Cone Stepping
+// for Relief Mapping", GPU Gems 3). Every texel of a depth map gets a cone
+// standing on its surface point and opening up towards the top. A ray
+// that is inside a texel's cone can step straight to the cone's edge;
+// the relaxed cone is as wide as it can be while a ray doing that still
+// crosses the surface at most once, so once a step ends up under the
+// surface a short binary search finds the hit.
+//
+// No GL in here: coneStepMap.cpp builds the maps offline and
+// fragmentShader.glsl traces them with the same steps as
+// traceRelaxedConeStep()
+//
+// depth follows bricks2_disp.png: 0 = the top of the surface, 1 = deepest.
+// Distances across the map are in uv, so a cone ratio is uv per unit of
+// depth, which doesn't depend on the height scale it is drawn with
+
+typedef struct ConeStepMap {
+    int width;
+    int height;
+    std::vector<float> depth;
+    std::vector<float> coneRatio;
+} ConeStepMap;
+
+// the ratios are stored as sqrt(ratio) in 8 bits, which keeps more
+// precision for the narrow cones that the tracing is most sensitive to.
+// Encoding rounds down so the stored cone is never wider than computed,
+// but leaves at least 1 so no texel stalls the trace
+inline unsigned char encodeConeRatio(float ratio)
+{
+    float code = std::floor(std::sqrt(std::min(std::max(ratio, 0.0f), 1.0f)) * 255.0f);
+    return (unsigned char)std::max(code, 1.0f);
+}
+
+inline float decodeConeRatio(float code)
+{
+    return code * code;
+}
+
+// runs fn(i) for i in [0, count) spread over the hardware threads
+inline void parallelFor(int count, const std::function<void(int)>& fn)
+{
+    int numThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::min(numThreads, count);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++)
+    {
+        // interleaved, so threads get about the same mix of flat and
+        // detailed rows
+        threads.push_back(std::thread([t, numThreads, count, &fn]() {
+            for (int i = t; i < count; i += numThreads) {
+                fn(i);
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// bilinear, wrapping like GL_REPEAT; x and y in texels
+inline float sampleWrapped(const std::vector<float>& values,
+    int width,
+    int height,
+    float x,
+    float y)
+{
+    x -= 0.5f;
+    y -= 0.5f;
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    float tx = x - fx;
+    float ty = y - fy;
+    int x0 = ((int)fx % width + width) % width;
+    int y0 = ((int)fy % height + height) % height;
+    int x1 = (x0 + 1) % width;
+    int y1 = (y0 + 1) % height;
+    float top = values[y0 * width + x0] * (1.0f - tx) + values[y0 * width + x1] * tx;
+    float bottom = values[y1 * width + x0] * (1.0f - tx) + values[y1 * width + x1] * tx;
+    return top * (1.0f - ty) + bottom * ty;
+}
+
+inline float sampleConeStepDepth(const ConeStepMap& map, float u, float v)
+{
+    return sampleWrapped(map.depth, map.width, map.height, u * map.width, v * map.height);
+}
+
+// the cone for one texel. Rays are cast from the top of the texel's axis
+// in numDirections directions; along each one, depth(r) / r is the
+// steepest ray that is already under the surface at distance r. A point
+// further out where the surface is above a shallower ray's depth is where
+// such a ray would come back out, and the cone must stop short of it.
+// Beyond searchRadius texels nothing is checked; a ray can't come back
+// out higher than the top, so that caps the ratio at searchRadius / depth
+inline float computeRelaxedConeRatio(const ConeStepMap& map,
+    int x,
+    int y,
+    int searchRadius,
+    int numDirections)
+{
+    const float pi = 3.14159265f;
+    float texelDepth = map.depth[y * map.width + x];
+    float step = 1.0f / float(std::max(map.width, map.height));
+    if (texelDepth <= 0.0f) {
+        // on top, so a ray reaching it has hit
+        return 1.0f;
+    }
+    float ratio = std::min(float(searchRadius) * step / texelDepth, 1.0f);
+
+    float u = (float(x) + 0.5f) / float(map.width);
+    float v = (float(y) + 0.5f) / float(map.height);
+    for (int i = 0; i < numDirections; i++)
+    {
+        float angle = 2.0f * pi * float(i) / float(numDirections);
+        float dirU = std::cos(angle) * step;
+        float dirV = std::sin(angle) * step;
+        float minSlope = 1e30f; // of the rays that have gone under so far
+        for (int k = 1; k <= searchRadius; k++)
+        {
+            float distance = float(k) * step;
+            float depth = sampleConeStepDepth(map, u + dirU * k, v + dirV * k);
+            float slope = depth / distance;
+            if (minSlope < slope && depth < texelDepth) {
+                ratio = std::min(ratio, distance / (texelDepth - depth));
+            }
+            minSlope = std::min(minSlope, slope);
+        }
+    }
+    return ratio;
+}
+
+// fills map.coneRatio from map.depth, a row per task
+inline void computeRelaxedConeStepMap(ConeStepMap& map,
+    int searchRadius = 64,
+    int numDirections = 64)
+{
+    map.coneRatio.assign(map.depth.size(), 0.0f);
+    parallelFor(map.height, [&map, searchRadius, numDirections](int y) {
+        for (int x = 0; x < map.width; x++) {
+            map.coneRatio[y * map.width + x] =
+                computeRelaxedConeRatio(map, x, y, searchRadius, numDirections);
+        }
+    });
+}
+
+// the ratios as the shader reads them back, after encoding
+inline std::vector<float> quantizedConeRatios(const ConeStepMap& map)
+{
+    std::vector<float> codes(map.coneRatio.size());
+    for (size_t i = 0; i < codes.size(); i++) {
+        codes[i] = float(encodeConeRatio(map.coneRatio[i])) / 255.0f;
+    }
+    return codes;
+}
+
+////////////////////////////////////////////////////
+
+// CPU versions of fragmentShader.glsl's searches, for measuring them.
+// viewDir is the tangent space direction to the eye; they return the uv
+// of the hit and count depth map fetches in numFetches
+
+const int PARALLAX_MIN_LAYERS = 8;
+const int PARALLAX_MAX_LAYERS = 32;
+const int CONE_STEPS = 24;
+const int CONE_BINARY_STEPS = 6;
+// in depth. Cones are the same in every direction, so a ray running
+// along a narrow groove would otherwise only creep down it; this can step
+// through a wall thinner than it, which the binary search can't undo
+const float CONE_MIN_STEP = 1.0f / 32.0f;
+
+// steep parallax: fixed steps through depth layers, more of them at
+// glancing angles, then a linear interpolation between the last two
+inline void traceSteepParallax(const ConeStepMap& map,
+    float u, float v,
+    float viewX, float viewY, float viewZ,
+    float heightScale,
+    float& hitU, float& hitV,
+    int& numFetches)
+{
+    float numLayers = PARALLAX_MAX_LAYERS +
+        (PARALLAX_MIN_LAYERS - PARALLAX_MAX_LAYERS) * std::fabs(viewZ);
+    float layerDepth = 1.0f / numLayers;
+    float deltaU = viewX / viewZ * heightScale / numLayers;
+    float deltaV = viewY / viewZ * heightScale / numLayers;
+
+    float layer = 0.0f;
+    float depth = sampleConeStepDepth(map, u, v);
+    numFetches = 1;
+    while (layer < depth)
+    {
+        u -= deltaU;
+        v -= deltaV;
+        depth = sampleConeStepDepth(map, u, v);
+        layer += layerDepth;
+        numFetches++;
+    }
+
+    float after = depth - layer;
+    float before = sampleConeStepDepth(map, u + deltaU, v + deltaV) - layer + layerDepth;
+    numFetches++;
+    float weight = after / (after - before);
+    hitU = (u + deltaU) * weight + u * (1.0f - weight);
+    hitV = (v + deltaV) * weight + v * (1.0f - weight);
+}
+
+// relaxed cone stepping; coneCodes from quantizedConeRatios()
+inline void traceRelaxedConeStep(const ConeStepMap& map,
+    const std::vector<float>& coneCodes,
+    float u, float v,
+    float viewX, float viewY, float viewZ,
+    float heightScale,
+    float& hitU, float& hitV,
+    int& numFetches)
+{
+    // uv moved per unit of depth
+    float dirU = -viewX / viewZ * heightScale;
+    float dirV = -viewY / viewZ * heightScale;
+    float dirLength = std::sqrt(dirU * dirU + dirV * dirV);
+
+    float z = 0.0f;
+    float prevU = u, prevV = v, prevZ = z;
+    float above = 1.0f;
+    numFetches = 0;
+    for (int i = 0; i < CONE_STEPS; i++)
+    {
+        float depth = sampleConeStepDepth(map, u, v);
+        float ratio = decodeConeRatio(
+            sampleWrapped(coneCodes, map.width, map.height, u * map.width, v * map.height));
+        numFetches++;
+        above = depth - z;
+        if (above < 0.5f / 255.0f) {
+            break;
+        }
+        prevU = u;
+        prevV = v;
+        prevZ = z;
+        float t = std::max(ratio * above / (dirLength + ratio), CONE_MIN_STEP);
+        u += dirU * t;
+        v += dirV * t;
+        z += t;
+    }
+
+    if (above < 0.0f)
+    {
+        // the last step went under: the hit is between it and the one
+        // before
+        for (int i = 0; i < CONE_BINARY_STEPS; i++)
+        {
+            float midU = 0.5f * (prevU + u);
+            float midV = 0.5f * (prevV + v);
+            float midZ = 0.5f * (prevZ + z);
+            numFetches++;
+            if (sampleConeStepDepth(map, midU, midV) < midZ) {
+                u = midU;
+                v = midV;
+                z = midZ;
+            }
+            else {
+                prevU = midU;
+                prevV = midV;
+                prevZ = midZ;
+            }
+        }
+    }
+    hitU = u;
+    hitV = v;
+}
+
+// reference: small fixed steps, then bisection
+inline void traceReference(const ConeStepMap& map,
+    float u, float v,
+    float viewX, float viewY, float viewZ,
+    float heightScale,
+    float& hitU, float& hitV)
+{
+    const int steps = 512;
+    float dirU = -viewX / viewZ * heightScale / steps;
+    float dirV = -viewY / viewZ * heightScale / steps;
+    float z = 0.0f;
+    int i = 0;
+    while (i < steps && sampleConeStepDepth(map, u, v) > z)
+    {
+        u += dirU;
+        v += dirV;
+        z += 1.0f / steps;
+        i++;
+    }
+    float lo = -1.0f, hi = 0.0f; // in steps, relative to u, v
+    for (int j = 0; j < 12; j++)
+    {
+        float mid = 0.5f * (lo + hi);
+        if (sampleConeStepDepth(map, u + dirU * mid, v + dirV * mid) < z + mid / steps) {
+            hi = mid;
+        }
+        else {
+            lo = mid;
+        }
+    }
+    hitU = u + dirU * hi;
+    hitV = v + dirV * hi;
+}
+
+typedef struct ParallaxSearchStats {
+    double averageFetches; // depth map reads per pixel
+    int maxFetches;
+    double averageError;   // from the reference hit, in texels
+    double missRate;       // fraction more than 2 texels off
+} ParallaxSearchStats;
+
+// traces both searches from every stride'th texel, viewed from tilt
+// degrees off the normal at 8 azimuths
+inline void measureParallaxSearches(const ConeStepMap& map,
+    float heightScale,
+    float tilt,
+    int stride,
+    ParallaxSearchStats& steep,
+    ParallaxSearchStats& cone)
+{
+    const float pi = 3.14159265f;
+    const int numAzimuths = 8;
+    std::vector<float> coneCodes = quantizedConeRatios(map);
+    float theta = tilt * pi / 180.0f;
+
+    int rows = map.height / stride;
+    std::vector<ParallaxSearchStats> rowResults(rows * 2, ParallaxSearchStats{ 0.0, 0, 0.0, 0.0 });
+    parallelFor(rows, [&](int row) {
+        ParallaxSearchStats& rowSteep = rowResults[row * 2];
+        ParallaxSearchStats& rowCone = rowResults[row * 2 + 1];
+        for (int x = 0; x < map.width; x += stride)
+        {
+            float u = (float(x) + 0.5f) / map.width;
+            float v = (float(row * stride) + 0.5f) / map.height;
+            for (int azimuth = 0; azimuth < numAzimuths; azimuth++)
+            {
+                float phi = 2.0f * pi * azimuth / numAzimuths;
+                float viewX = std::sin(theta) * std::cos(phi);
+                float viewY = std::sin(theta) * std::sin(phi);
+                float viewZ = std::cos(theta);
+
+                float refU, refV, hitU, hitV;
+                int numFetches;
+                traceReference(map, u, v, viewX, viewY, viewZ, heightScale, refU, refV);
+
+                traceSteepParallax(map, u, v, viewX, viewY, viewZ, heightScale, hitU, hitV, numFetches);
+                double error = std::hypot((hitU - refU) * map.width, (hitV - refV) * map.height);
+                rowSteep.averageFetches += numFetches;
+                rowSteep.maxFetches = std::max(rowSteep.maxFetches, numFetches);
+                rowSteep.averageError += error;
+                rowSteep.missRate += error > 2.0 ? 1.0 : 0.0;
+
+                traceRelaxedConeStep(map, coneCodes, u, v, viewX, viewY, viewZ, heightScale, hitU, hitV, numFetches);
+                error = std::hypot((hitU - refU) * map.width, (hitV - refV) * map.height);
+                rowCone.averageFetches += numFetches;
+                rowCone.maxFetches = std::max(rowCone.maxFetches, numFetches);
+                rowCone.averageError += error;
+                rowCone.missRate += error > 2.0 ? 1.0 : 0.0;
+            }
+        }
+    });
+
+    ParallaxSearchStats* totals[2] = { &steep, &cone };
+    double numTraces = double(rows) * ((map.width + stride - 1) / stride) * numAzimuths;
+    for (int i = 0; i < 2; i++)
+    {
+        ParallaxSearchStats& total = *totals[i];
+        total = ParallaxSearchStats{ 0.0, 0, 0.0, 0.0 };
+        for (int row = 0; row < rows; row++)
+        {
+            const ParallaxSearchStats& result = rowResults[row * 2 + i];
+            total.averageFetches += result.averageFetches;
+            total.maxFetches = std::max(total.maxFetches, result.maxFetches);
+            total.averageError += result.averageError;
+            total.missRate += result.missRate;
+        }
+        total.averageFetches /= numTraces;
+        total.averageError /= numTraces;
+        total.missRate /= numTraces;
+    }
+}
+
+#endif // !CONE_STEP_MAP_H_INCLUDED
@@ -0,0 +1,118 @@
+// offline tool: builds the relaxed cone step map for a depth map and
+// writes it as a TGA (which stb_image loads) with the depth in red and
+// the encoded cone ratio in green, then prints how the steep parallax and
+// cone step searches compare on it
+//
+//   make conestep
+//   ./coneStepMap bricks2_disp.png bricks2_disp_cone.tga
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include "ConeStepMap.h"
+
+// uncompressed 24 bit, rows stored top first like the input image
+static bool writeTga(const std::string& fileName,
+    int width,
+    int height,
+    const std::vector<unsigned char>& rgb)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    unsigned char header[18] = { 0 };
+    header[2] = 2; // uncompressed true color
+    header[12] = width & 0xFF;
+    header[13] = (width >> 8) & 0xFF;
+    header[14] = height & 0xFF;
+    header[15] = (height >> 8) & 0xFF;
+    header[16] = 24;
+    header[17] = 0x20; // top left origin
+    file.write((const char*)header, sizeof(header));
+    std::vector<unsigned char> bgr(rgb.size());
+    for (size_t i = 0; i < rgb.size(); i += 3)
+    {
+        bgr[i + 0] = rgb[i + 2];
+        bgr[i + 1] = rgb[i + 1];
+        bgr[i + 2] = rgb[i + 0];
+    }
+    file.write((const char*)bgr.data(), bgr.size());
+    return file.good();
+}
+
+static void printStats(const char* name, const ParallaxSearchStats& stats)
+{
+    std::cout << "      " << name << ": " << stats.averageFetches
+        << " fetches/pixel (max " << stats.maxFetches << "), error "
+        << stats.averageError << " texels, "
+        << stats.missRate * 100.0 << "% off by > 2" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string inFileName = argc > 1 ? argv[1] : "bricks2_disp.png";
+    std::string outFileName = argc > 2 ? argv[2] : "bricks2_disp_cone.tga";
+
+    int width, height, numChannels;
+    unsigned char* data = stbi_load(inFileName.c_str(), &width, &height, &numChannels, 0);
+    if (!data) {
+        std::cout << "Failed to load depth map: " << inFileName << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ConeStepMap map;
+    map.width = width;
+    map.height = height;
+    map.depth.resize(width * height);
+    for (int i = 0; i < width * height; i++) {
+        map.depth[i] = data[i * numChannels] / 255.0f;
+    }
+
+    std::cout << "Computing cone step map for " << inFileName << " ("
+        << width << "x" << height << ", "
+        << std::thread::hardware_concurrency() << " threads)" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    computeRelaxedConeStepMap(map);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "  took " << std::chrono::duration<double>(end - start).count()
+        << " s" << std::endl;
+
+    // the original depth bytes are kept as they were
+    std::vector<unsigned char> rgb(width * height * 3, 0);
+    for (int i = 0; i < width * height; i++)
+    {
+        rgb[i * 3 + 0] = data[i * numChannels];
+        rgb[i * 3 + 1] = encodeConeRatio(map.coneRatio[i]);
+    }
+    stbi_image_free(data);
+
+    if (!writeTga(outFileName, width, height, rgb)) {
+        std::cout << "Failed to write " << outFileName << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote " << outFileName << std::endl;
+
+    // main.cpp draws with a height scale of 0.3
+    const float heightScales[] = { 0.1f, 0.3f };
+    for (float heightScale : heightScales)
+    {
+        std::cout << "  height scale " << heightScale << ":" << std::endl;
+        for (int tilt = 0; tilt <= 75; tilt += 15)
+        {
+            ParallaxSearchStats steep, cone;
+            measureParallaxSearches(map, heightScale, float(tilt), 4, steep, cone);
+            std::cout << "    " << tilt << " degrees" << std::endl;
+            printStats("steep parallax", steep);
+            printStats("relaxed cones ", cone);
+        }
+    }
+
+    return 0;
+}
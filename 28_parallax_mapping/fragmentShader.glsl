@@ -12,27 +12,131 @@ in VS_OUT {
 
 uniform sampler2D uDiffuseTex;
 uniform sampler2D uNormalMap; // aka bump map
-uniform sampler2D uDepthMap;
+uniform sampler2D uDepthMap; // depth in r, relaxed cone ratio in g (ConeStepMap.h)
 
 uniform float uHeightScale;
+uniform int uParallaxMode; // 0 = offset, 1 = steep parallax, 2 = relaxed cone stepping
+uniform bool uShowFetches;
+
+// depth map reads by the search, for uShowFetches
+int gNumFetches = 0;
 
 // calculates/offsets texture coordinates based on view dir
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 {
     float height = texture(uDepthMap, texCoords).r;
     vec2 p = viewDir.xy / viewDir.z * (height * uHeightScale);
+    gNumFetches = 1;
     return texCoords - p;
 }
 
+// steps through fixed depth layers until it's under the surface, then
+// interpolates between the last two; see traceSteepParallax()
+const float MIN_LAYERS = 8.0;
+const float MAX_LAYERS = 32.0;
+
+vec2 SteepParallaxMapping(vec2 texCoords, vec3 viewDir)
+{
+    // the loop's fetches use the gradients of the unshifted coordinates
+    vec2 dx = dFdx(texCoords);
+    vec2 dy = dFdy(texCoords);
+
+    // more layers when looking along the surface
+    float numLayers = mix(MAX_LAYERS, MIN_LAYERS, abs(viewDir.z));
+    float layerDepth = 1.0 / numLayers;
+    vec2 deltaTexCoords = viewDir.xy / viewDir.z * uHeightScale / numLayers;
+
+    float currentLayerDepth = 0.0;
+    vec2 currentTexCoords = texCoords;
+    float currentDepth = textureGrad(uDepthMap, currentTexCoords, dx, dy).r;
+    gNumFetches = 1;
+    while (currentLayerDepth < currentDepth)
+    {
+        currentTexCoords -= deltaTexCoords;
+        currentDepth = textureGrad(uDepthMap, currentTexCoords, dx, dy).r;
+        currentLayerDepth += layerDepth;
+        gNumFetches++;
+    }
+
+    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
+    float afterDepth = currentDepth - currentLayerDepth;
+    float beforeDepth = textureGrad(uDepthMap, prevTexCoords, dx, dy).r - currentLayerDepth + layerDepth;
+    gNumFetches++;
+    float weight = afterDepth / (afterDepth - beforeDepth);
+    return prevTexCoords * weight + currentTexCoords * (1.0 - weight);
+}
+
+// steps to the edge of each texel's relaxed cone, which can't take the
+// ray through the surface more than once, then binary searches the step
+// that went under; see traceRelaxedConeStep()
+const int CONE_STEPS = 24;
+const int CONE_BINARY_STEPS = 6;
+const float CONE_MIN_STEP = 1.0 / 32.0;
+
+vec2 ConeStepMapping(vec2 texCoords, vec3 viewDir)
+{
+    // uv moved per unit of depth
+    vec3 dir = vec3(-viewDir.xy / viewDir.z * uHeightScale, 1.0);
+    float dirLength = length(dir.xy);
+
+    vec3 pos = vec3(texCoords, 0.0);
+    vec3 prevPos = pos;
+    float above = 1.0;
+    gNumFetches = 0;
+    for (int i = 0; i < CONE_STEPS; i++)
+    {
+        // level 0: a cone averaged over a mip texel can be wider than
+        // some of the cones under it
+        vec2 cone = textureLod(uDepthMap, pos.xy, 0.0).rg;
+        gNumFetches++;
+        above = cone.r - pos.z;
+        if (above < 0.5 / 255.0) {
+            break;
+        }
+        float ratio = cone.g * cone.g;
+        prevPos = pos;
+        pos += dir * max(ratio * above / (dirLength + ratio), CONE_MIN_STEP);
+    }
+
+    if (above < 0.0)
+    {
+        for (int i = 0; i < CONE_BINARY_STEPS; i++)
+        {
+            vec3 mid = 0.5 * (prevPos + pos);
+            gNumFetches++;
+            if (textureLod(uDepthMap, mid.xy, 0.0).r < mid.z) {
+                pos = mid;
+            } else {
+                prevPos = mid;
+            }
+        }
+    }
+    return pos.xy;
+}
+
 
 void main()
 {
     vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
-    vec2 texCoords = ParallaxMapping(fs_in.TexCoords, viewDir);
+    vec2 texCoords;
+    if (uParallaxMode == 2) {
+        texCoords = ConeStepMapping(fs_in.TexCoords, viewDir);
+    } else if (uParallaxMode == 1) {
+        texCoords = SteepParallaxMapping(fs_in.TexCoords, viewDir);
+    } else {
+        texCoords = ParallaxMapping(fs_in.TexCoords, viewDir);
+    }
     if (texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0) {
         discard;
     }
 
+    if (uShowFetches) {
+        // red is the exact count for main.cpp to read back, and blue = 0
+        // tells these pixels apart from the background and the light
+        FragColor = vec4(float(gNumFetches) / 255.0, float(gNumFetches) / 32.0, 0.0, 1.0);
+        return;
+    }
+
     vec3 normal = texture(uNormalMap, texCoords).rgb;
     normal = normalize(normal * 2.0 - 1.0);
 
@@ -3,6 +3,7 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -33,6 +34,24 @@ Texture gDiffuseMap;
 Texture gNormalMap;
 Texture gDepthMap;
 
+// how fragmentShader.glsl finds where the view ray hits the depth map
+enum class ParallaxMode {
+    Offset = 0,   // one fetch, no search
+    Steep = 1,    // fixed depth layers
+    ConeStep = 2  // relaxed cone stepping
+};
+ParallaxMode gParallaxMode = ParallaxMode::ConeStep;
+// draws the depth map fetches per pixel instead of the lit color
+bool gShowFetches = false;
+
+// GL_TIME_ELAPSED around the parallax mapped planes. Two queries, so the
+// one read back each frame was issued the frame before and has normally
+// finished by then
+GLuint gParallaxTimeQueries[2];
+size_t gParallaxFrame = 0;
+double gParallaxGpuMsTotal = 0.0;
+size_t gParallaxGpuFrames = 0;
+
 Cube gCube; // for the light source to use
 LightSource gLightSource;
 glm::vec3 gLightPosition = glm::vec3(0.5f, 1.0f, 0.3F);
@@ -127,6 +146,18 @@ void mouseScrollCallback(GLFWwindow* window, double x, double y)
 
 ////////////////////////////////////////////////////
 
+static const char* parallaxModeName(ParallaxMode mode)
+{
+    switch (mode)
+    {
+    case ParallaxMode::Offset: return "offset";
+    case ParallaxMode::Steep: return "steep parallax";
+    case ParallaxMode::ConeStep: return "relaxed cone stepping";
+    default:
+        break;
+    }
+    return "unknown";
+}
 
 static void initGlfw()
 {
@@ -218,6 +249,8 @@ static void draw()
     static GLuint uLightPos = GET_LOC("uLightPos");
     static GLuint uViewPos = GET_LOC("uViewPos");
     static GLuint uHeightScale = GET_LOC("uHeightScale");
+    static GLuint uParallaxMode = GET_LOC("uParallaxMode");
+    static GLuint uShowFetches = GET_LOC("uShowFetches");
     #undef GET_LOC
 
     glUseProgram(gLightShaderProgram.id);
@@ -284,6 +317,17 @@ static void draw()
     
     // set height map scale
     glUniform1f(uHeightScale, 0.3); // TODO - make this adjustable
+    glUniform1i(uParallaxMode, (GLint)gParallaxMode);
+    glUniform1i(uShowFetches, gShowFetches);
+
+    // last frame's query should be done by now
+    if (gParallaxFrame > 0) {
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(gParallaxTimeQueries[(gParallaxFrame - 1) % 2], GL_QUERY_RESULT, &elapsedNs);
+        gParallaxGpuMsTotal += double(elapsedNs) / 1000000.0;
+        gParallaxGpuFrames++;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, gParallaxTimeQueries[gParallaxFrame % 2]);
 
     // draw some planes 
     glActiveTexture(GL_TEXTURE0);
@@ -306,6 +350,8 @@ static void draw()
         glBindVertexArray(gTangentPlane.VAO);
         glDrawArrays(GL_TRIANGLES, 0, gTangentPlane.numVertices);
     }
+    glEndQuery(GL_TIME_ELAPSED);
+    gParallaxFrame++;
 
     // draw the light source
     glUseProgram(gLightShaderProgram.id);
@@ -316,6 +362,45 @@ static void draw()
 
 }
 
+// the planes' average GPU time since the last print and, when the
+// fetches are shown, reads them back from the frame just drawn and
+// averages them over the parallax mapped pixels
+static void printParallaxStats()
+{
+    std::cout << "Parallax: " << parallaxModeName(gParallaxMode) << ", ";
+    if (gParallaxGpuFrames > 0) {
+        std::cout << gParallaxGpuMsTotal / double(gParallaxGpuFrames) << " ms GPU over "
+            << gParallaxGpuFrames << " frames";
+    }
+    std::cout << std::endl;
+    gParallaxGpuMsTotal = 0.0;
+    gParallaxGpuFrames = 0;
+
+    if (!gShowFetches) {
+        std::cout << "  press I to show depth map fetches per pixel" << std::endl;
+        return;
+    }
+    std::vector<unsigned char> pixels(WINDOW_WIDTH * WINDOW_HEIGHT * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    size_t numPixels = 0;
+    size_t numFetches = 0;
+    size_t maxFetches = 0;
+    for (size_t i = 0; i < pixels.size(); i += 3)
+    {
+        if (pixels[i + 2] == 0) {
+            numPixels++;
+            numFetches += pixels[i];
+            maxFetches = std::max(maxFetches, (size_t)pixels[i]);
+        }
+    }
+    if (numPixels > 0) {
+        std::cout << "  " << double(numFetches) / double(numPixels)
+            << " depth map fetches/pixel (max " << maxFetches << ") over "
+            << numPixels << " pixels" << std::endl;
+    }
+}
+
 int main(void)
 {
     initGlfw();
@@ -381,7 +466,13 @@ int main(void)
     // Texture.h
     gDiffuseMap = createTexture("bricks2.jpg");
     gNormalMap = createTexture("bricks2_normal.jpg");
-    gDepthMap = createTexture("bricks2_disp.png");
+    // bricks2_disp.png with the relaxed cone ratios from coneStepMap.cpp
+    // in its green channel
+    gDepthMap = createTexture("bricks2_disp_cone.tga");
+    std::cout << "Parallax: " << parallaxModeName(gParallaxMode)
+        << " (M to switch, I to show fetches, P to print)" << std::endl;
+
+    glGenQueries(2, gParallaxTimeQueries);
 
     // DepthMap.h
     //gDepthMap = createDepthMap();
@@ -397,6 +488,26 @@ int main(void)
 
         moveCamera();
 
+        // press M to switch the parallax search; times restart with it
+        static bool parallaxModeWasPressed = false;
+        bool parallaxModePressed = glfwGetKey(gWindow, GLFW_KEY_M) == GLFW_PRESS;
+        if (parallaxModePressed && !parallaxModeWasPressed) {
+            gParallaxMode = ParallaxMode(((int)gParallaxMode + 1) % 3);
+            gParallaxGpuMsTotal = 0.0;
+            gParallaxGpuFrames = 0;
+            std::cout << "Parallax: " << parallaxModeName(gParallaxMode) << std::endl;
+        }
+        parallaxModeWasPressed = parallaxModePressed;
+
+        // press I to show the depth map fetches per pixel, brighter green
+        // for more
+        static bool showFetchesWasPressed = false;
+        bool showFetchesPressed = glfwGetKey(gWindow, GLFW_KEY_I) == GLFW_PRESS;
+        if (showFetchesPressed && !showFetchesWasPressed) {
+            gShowFetches = !gShowFetches;
+        }
+        showFetchesWasPressed = showFetchesPressed;
+
         // move the light around
         //static float lightMoveRadius = 5.0F;
         //gLightPosition.x = cos(glfwGetTime()) * lightMoveRadius;
@@ -408,10 +519,20 @@ int main(void)
 
         draw();
 
+        // press P to print the parallax stats; after draw() so the
+        // fetches can be read back from this frame
+        static bool printStatsWasPressed = false;
+        bool printStatsPressed = glfwGetKey(gWindow, GLFW_KEY_P) == GLFW_PRESS;
+        if (printStatsPressed && !printStatsWasPressed) {
+            printParallaxStats();
+        }
+        printStatsWasPressed = printStatsPressed;
+
         glfwSwapBuffers(gWindow);
         glfwPollEvents();
     }
 
+    glDeleteQueries(2, gParallaxTimeQueries);
     glDeleteShader(gVertexShader.id);
     glDeleteShader(gFragmentShader.id);
     glfwTerminate();
@@ -0,0 +1,453 @@
+#ifndef POST_EFFECT_CHAIN_H_INCLUDED
+#define POST_EFFECT_CHAIN_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "ShaderProgram.h"
+#include "ScreenTexture.h"
+#include "GpuProfiler.h"
+
+enum class PostEffectType {
+    // per pixel: only look at their own pixel, so any number of them can
+    // share one pass
+    BloomAdd,   // color += texture * amount
+    Exposure,   // color *= amount
+    Tonemap,    // HDR -> [0, 1] with tonemapOperator
+    Gamma,      // color ^ (1 / amount)
+    ColorGrade, // color = 3D lookup table (texture, see createColorGradeLut)
+    Vignette,   // darkens towards the corners by amount
+    // neighborhood: 3x3 kernels over the previous result, amount pixels
+    // apart, so whatever came before has to be written out first
+    Sharpen,
+    Blur,
+    EdgeDetect
+};
+
+enum class TonemapOperator {
+    Exponential,    // 1 - exp(-color), this chapter's original composite
+    Reinhard,
+    ACES            // Narkowicz's curve fit
+};
+
+typedef struct PostEffect {
+    PostEffectType type;
+    float amount;
+    TonemapOperator tonemapOperator;
+    GLuint texture; // BloomAdd: 2D texture, ColorGrade: 3D texture
+} PostEffect;
+
+PostEffect createPostEffect(PostEffectType type, float amount = 1.0f)
+{
+    PostEffect effect;
+    effect.type = type;
+    effect.amount = amount;
+    effect.tonemapOperator = TonemapOperator::Exponential;
+    effect.texture = 0;
+    return effect;
+}
+
+static bool isNeighborhoodEffect(PostEffectType type)
+{
+    return type == PostEffectType::Sharpen ||
+        type == PostEffectType::Blur ||
+        type == PostEffectType::EdgeDetect;
+}
+
+// full screen passes and the memory traffic they cause for one frame
+typedef struct PostChainCost {
+    size_t numPasses;
+    size_t bytesRead;
+    size_t bytesWritten;
+} PostChainCost;
+
+// a size^3 RGB table that warms and adds a little contrast; identity
+// would be out = in
+GLuint createColorGradeLut(size_t size)
+{
+    std::vector<unsigned char> texels(size * size * size * 3);
+    for (size_t b = 0; b < size; b++)
+    {
+        for (size_t g = 0; g < size; g++)
+        {
+            for (size_t r = 0; r < size; r++)
+            {
+                float in[3] = { r / float(size - 1), g / float(size - 1), b / float(size - 1) };
+                float warmth[3] = { 1.05f, 1.0f, 0.92f };
+                unsigned char* out = &texels[((b * size + g) * size + r) * 3];
+                for (int c = 0; c < 3; c++)
+                {
+                    // smoothstep blended halfway with the input
+                    float x = in[c];
+                    float curve = x * x * (3.0f - 2.0f * x);
+                    float value = (0.5f * x + 0.5f * curve) * warmth[c];
+                    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+                    out[c] = (unsigned char)(value * 255.0f + 0.5f);
+                }
+            }
+        }
+    }
+
+    GLuint lut;
+    glGenTextures(1, &lut);
+    glBindTexture(GL_TEXTURE_3D, lut);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, size, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return lut;
+}
+
+// a list of post effects applied in order to the HDR scene and drawn to
+// the screen. Build() cuts the list into passes and generates one
+// fragment shader per pass: a pass starts at a neighborhood effect (or
+// the start of the list) and takes every per pixel effect after it, so
+// a chain of only per pixel effects is one pass that reads the scene
+// once and writes the screen once. Passes in between go through RGBA16F
+// targets.
+//
+//   gPostChain.Init();
+//   gPostChain.Add(createPostEffect(PostEffectType::Exposure, 5.0f));
+//   gPostChain.Add(createPostEffect(PostEffectType::Tonemap));
+//   gPostChain.Build(800, 600, true);
+//   ...
+//   gPostChain.GetEffect(0).amount = gExposure;
+//   gPostChain.Run(hdrTexture, gScreenTexture, &gGpuProfiler);
+class PostEffectChain
+{
+public:
+
+    PostEffectChain() :
+        width(0),
+        height(0),
+        fused(true)
+    {
+        targets[0] = targets[1] = 0;
+        targetTextures[0] = targetTextures[1] = 0;
+    }
+    ~PostEffectChain() {}
+
+    // vertexShader_bloom.glsl passes the screen quad through unchanged
+    void Init()
+    {
+        vertexShader = createVertexShader("vertexShader_bloom.glsl");
+    }
+
+    // changes to the list take effect at the next Build()
+    void Add(const PostEffect& effect) { effects.push_back(effect); }
+    void Clear() { effects.clear(); }
+    PostEffect& GetEffect(size_t i) { return effects[i]; }
+    size_t Size() const { return effects.size(); }
+
+    // fuse = false gives every effect its own pass, i.e. the chain as
+    // separate shaders would run it
+    void Build(size_t width, size_t height, bool fuse)
+    {
+        deletePasses();
+        this->width = width;
+        this->height = height;
+        fused = fuse;
+
+        std::vector<size_t> starts = passStarts(effects, fuse);
+        for (size_t p = 0; p < starts.size(); p++)
+        {
+            Pass pass;
+            pass.firstEffect = starts[p];
+            pass.numEffects = (p + 1 < starts.size() ? starts[p + 1] : effects.size()) - starts[p];
+            std::string name = "post pass " + std::to_string(p);
+            pass.fragmentShader = createFragmentShaderFromSource(name, generateSource(pass));
+            pass.program.id = glCreateProgram();
+            glAttachShader(pass.program.id, vertexShader.id);
+            glAttachShader(pass.program.id, pass.fragmentShader.id);
+            glLinkProgram(pass.program.id);
+            checkShaderProgramCompileError(pass.program.id);
+
+            pass.uInput = glGetUniformLocation(pass.program.id, "uInput");
+            for (size_t i = 0; i < pass.numEffects; i++)
+            {
+                std::string index = std::to_string(pass.firstEffect + i);
+                pass.uAmounts.push_back(glGetUniformLocation(pass.program.id, ("uAmount" + index).c_str()));
+                pass.uTextures.push_back(glGetUniformLocation(pass.program.id, ("uTexture" + index).c_str()));
+            }
+            passes.push_back(pass);
+        }
+
+        if (passes.size() > 1) {
+            createTargets();
+        }
+    }
+
+    void Run(GLuint sceneTexture,
+        const ScreenTexture& screenTexture,
+        GpuProfiler* profiler)
+    {
+        glBindVertexArray(screenTexture.VAO);
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            const Pass& pass = passes[p];
+            if (profiler) {
+                profiler->Push(pass.fragmentShader.fileName);
+            }
+
+            bool last = p + 1 == passes.size();
+            glBindFramebuffer(GL_FRAMEBUFFER, last ? 0 : targets[p % 2]);
+            glUseProgram(pass.program.id);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, p == 0 ? sceneTexture : targetTextures[(p - 1) % 2]);
+            glUniform1i(pass.uInput, 0);
+
+            GLint unit = 1;
+            for (size_t i = 0; i < pass.numEffects; i++)
+            {
+                const PostEffect& effect = effects[pass.firstEffect + i];
+                glUniform1f(pass.uAmounts[i], effect.amount);
+                if (pass.uTextures[i] >= 0) {
+                    glActiveTexture(GL_TEXTURE0 + unit);
+                    glBindTexture(effect.type == PostEffectType::ColorGrade ? GL_TEXTURE_3D : GL_TEXTURE_2D,
+                        effect.texture);
+                    glUniform1i(pass.uTextures[i], unit);
+                    unit++;
+                }
+            }
+
+            glDrawArrays(GL_TRIANGLES, 0, screenTexture.numVertices);
+
+            if (profiler) {
+                profiler->Pop();
+            }
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(0);
+    }
+
+    // what running the current effects costs per frame, fused or not. A
+    // 3x3 kernel counts as one read of its input since neighbouring
+    // pixels share their taps in the texture cache
+    PostChainCost EstimateCost(bool fuse) const
+    {
+        const size_t hdrBytes = 8;      // RGBA16F
+        const size_t screenBytes = 4;   // RGBA8 back buffer
+        size_t numPixels = width * height;
+
+        std::vector<size_t> starts = passStarts(effects, fuse);
+        PostChainCost cost = { starts.size(), 0, 0 };
+        for (size_t p = 0; p < starts.size(); p++)
+        {
+            size_t end = p + 1 < starts.size() ? starts[p + 1] : effects.size();
+            cost.bytesRead += numPixels * hdrBytes;
+            for (size_t i = starts[p]; i < end; i++)
+            {
+                // the LUT is a few KB and stays in cache
+                if (effects[i].type == PostEffectType::BloomAdd) {
+                    cost.bytesRead += numPixels * hdrBytes;
+                }
+            }
+            cost.bytesWritten += numPixels * (p + 1 == starts.size() ? screenBytes : hdrBytes);
+        }
+        return cost;
+    }
+
+    size_t NumPasses() const { return passes.size(); }
+    bool IsFused() const { return fused; }
+
+    void Delete()
+    {
+        deletePasses();
+        glDeleteShader(vertexShader.id);
+    }
+
+private:
+
+    typedef struct Pass {
+        size_t firstEffect;
+        size_t numEffects;
+        Shader fragmentShader;
+        ShaderProgram program;
+        GLint uInput;
+        std::vector<GLint> uAmounts;   // per effect
+        std::vector<GLint> uTextures;  // per effect, -1 if it has none
+    } Pass;
+
+    std::vector<PostEffect> effects;
+    std::vector<Pass> passes;
+    Shader vertexShader;
+    // ping pong between passes
+    GLuint targets[2];
+    GLuint targetTextures[2];
+    size_t width;
+    size_t height;
+    bool fused;
+
+    // index of the first effect of each pass
+    static std::vector<size_t> passStarts(const std::vector<PostEffect>& effects, bool fuse)
+    {
+        std::vector<size_t> starts;
+        for (size_t i = 0; i < effects.size(); i++)
+        {
+            if (i == 0 || !fuse || isNeighborhoodEffect(effects[i].type)) {
+                starts.push_back(i);
+            }
+        }
+        // nothing to apply still has to copy the scene to the screen
+        if (starts.empty()) {
+            starts.push_back(0);
+        }
+        return starts;
+    }
+
+    std::string generateSource(const Pass& pass) const
+    {
+        std::string declarations =
+            "#version 330 core\n"
+            "out vec4 FragColor;\n"
+            "\n"
+            "in vec2 TexCoords;\n"
+            "\n"
+            "uniform sampler2D uInput;\n";
+        std::string body =
+            "void main()\n"
+            "{\n";
+
+        for (size_t i = 0; i < pass.numEffects; i++)
+        {
+            size_t index = pass.firstEffect + i;
+            const PostEffect& effect = effects[index];
+            std::string amount = "uAmount" + std::to_string(index);
+            std::string texture = "uTexture" + std::to_string(index);
+            declarations += "uniform float " + amount + ";\n";
+
+            if (i == 0 && !isNeighborhoodEffect(effect.type)) {
+                body += "    vec3 color = texture(uInput, TexCoords).rgb;\n";
+            }
+
+            switch (effect.type)
+            {
+            case PostEffectType::BloomAdd:
+                declarations += "uniform sampler2D " + texture + ";\n";
+                body += "    color += texture(" + texture + ", TexCoords).rgb * " + amount + ";\n";
+                break;
+            case PostEffectType::Exposure:
+                body += "    color *= " + amount + ";\n";
+                break;
+            case PostEffectType::Tonemap:
+                if (effect.tonemapOperator == TonemapOperator::Reinhard) {
+                    body += "    color = color / (color + vec3(1.0));\n";
+                }
+                else if (effect.tonemapOperator == TonemapOperator::ACES) {
+                    body += "    color = clamp((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);\n";
+                }
+                else {
+                    body += "    color = vec3(1.0) - exp(-color);\n";
+                }
+                break;
+            case PostEffectType::Gamma:
+                body += "    color = pow(max(color, vec3(0.0)), vec3(1.0 / " + amount + "));\n";
+                break;
+            case PostEffectType::ColorGrade:
+                // sample texel centers so 0 and 1 map to the first/last entry
+                declarations += "uniform sampler3D " + texture + ";\n";
+                body += "    {\n"
+                    "        float lutSize = float(textureSize(" + texture + ", 0).x);\n"
+                    "        vec3 lutCoords = clamp(color, 0.0, 1.0) * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize;\n"
+                    "        color = texture(" + texture + ", lutCoords).rgb;\n"
+                    "    }\n";
+                break;
+            case PostEffectType::Vignette:
+                body += "    {\n"
+                    "        vec2 fromCenter = TexCoords - vec2(0.5);\n"
+                    "        color *= 1.0 - " + amount + " * dot(fromCenter, fromCenter) * 2.0;\n"
+                    "    }\n";
+                break;
+            case PostEffectType::Sharpen:
+            case PostEffectType::Blur:
+            case PostEffectType::EdgeDetect:
+                body += generateKernel(effect.type, amount);
+                break;
+            }
+        }
+        if (pass.numEffects == 0) {
+            body += "    vec3 color = texture(uInput, TexCoords).rgb;\n";
+        }
+
+        body += "    FragColor = vec4(color, 1.0);\n"
+            "}\n";
+        return declarations + "\n" + body;
+    }
+
+    // the kernels of 18_02_post_processing; always first in their pass
+    static std::string generateKernel(PostEffectType type, const std::string& amount)
+    {
+        std::string kernel;
+        if (type == PostEffectType::Sharpen) {
+            kernel = "-1.0, -1.0, -1.0, -1.0, 9.0, -1.0, -1.0, -1.0, -1.0";
+        }
+        else if (type == PostEffectType::Blur) {
+            kernel = "1.0/16.0, 2.0/16.0, 1.0/16.0, 2.0/16.0, 4.0/16.0, 2.0/16.0, 1.0/16.0, 2.0/16.0, 1.0/16.0";
+        }
+        else {
+            kernel = "1.0, 1.0, 1.0, 1.0, -8.0, 1.0, 1.0, 1.0, 1.0";
+        }
+        return "    vec3 color = vec3(0.0);\n"
+            "    {\n"
+            "        vec2 offset = " + amount + " / vec2(textureSize(uInput, 0));\n"
+            "        vec2 offsets[9] = vec2[](\n"
+            "            vec2(-offset.x, offset.y), vec2(0.0, offset.y), vec2(offset.x, offset.y),\n"
+            "            vec2(-offset.x, 0.0), vec2(0.0, 0.0), vec2(offset.x, 0.0),\n"
+            "            vec2(-offset.x, -offset.y), vec2(0.0, -offset.y), vec2(offset.x, -offset.y));\n"
+            "        float kernel[9] = float[](" + kernel + ");\n"
+            "        for (int i = 0; i < 9; i++)\n"
+            "        {\n"
+            "            color += texture(uInput, TexCoords + offsets[i]).rgb * kernel[i];\n"
+            "        }\n"
+            "    }\n";
+    }
+
+    void createTargets()
+    {
+        glGenFramebuffers(2, targets);
+        glGenTextures(2, targetTextures);
+        for (size_t i = 0; i < 2; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, targets[i]);
+            glBindTexture(GL_TEXTURE_2D, targetTextures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // kernels sample past the edges
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetTextures[i], 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cout << "Post effect framebuffer not complete" << std::endl;
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void deletePasses()
+    {
+        for (const Pass& pass : passes)
+        {
+            glDeleteProgram(pass.program.id);
+            glDeleteShader(pass.fragmentShader.id);
+        }
+        passes.clear();
+        if (targets[0]) {
+            glDeleteFramebuffers(2, targets);
+            glDeleteTextures(2, targetTextures);
+            targets[0] = targets[1] = 0;
+            targetTextures[0] = targetTextures[1] = 0;
+        }
+    }
+};
+
+#endif // !POST_EFFECT_CHAIN_H_INCLUDED
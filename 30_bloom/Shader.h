@@ -73,15 +73,15 @@ Shader createVertexShader(const std::string& fileName)
     return vertexShader;
 }
 
-Shader createFragmentShader(const std::string& fileName)
+// for generated shaders; name is only used to tell them apart
+Shader createFragmentShaderFromSource(const std::string& name,
+    const std::string& source)
 {
     Shader      fragmentShader;
     const char* shaderSources[1];
 
-    //std::string fileName = "fragmentShader.glsl";
-
-    fragmentShader.fileName = fileName;
-    fragmentShader.source = loadShaderString(fileName);
+    fragmentShader.fileName = name;
+    fragmentShader.source = source;
 
     fragmentShader.id = glCreateShader(GL_FRAGMENT_SHADER);
     shaderSources[0] = fragmentShader.source.c_str();
@@ -95,6 +95,12 @@ Shader createFragmentShader(const std::string& fileName)
     return fragmentShader;
 }
 
+Shader createFragmentShader(const std::string& fileName)
+{
+    //std::string fileName = "fragmentShader.glsl";
+    return createFragmentShaderFromSource(fileName, loadShaderString(fileName));
+}
+
 Shader createGeometryShader(const std::string& fileName) 
 {
     Shader      geometryShader;
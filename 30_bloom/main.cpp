@@ -23,6 +23,8 @@
 #include "HDRFrameBuffer.h"
 #include "BlurFrameBuffer.h"
 #include "ScreenTexture.h"
+#include "GpuProfiler.h"
+#include "PostEffectChain.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -52,10 +54,6 @@ Shader gVertexShader;
 Shader gFragmentShader;
 ShaderProgram gShaderProgram;
 
-Shader gBloomVertexShader;
-Shader gBloomFragmentShader;
-ShaderProgram gBloomShaderProgram;
-
 Shader gBlurVertexShader;
 Shader gBlurFragmentShader;
 ShaderProgram gBlurShaderProgram;
@@ -77,6 +75,18 @@ ScreenTexture gScreenTexture;
 
 float gExposure = 5.0;
 bool gBloom = true;
+
+// bloom, exposure, tone mapping, gamma, color grading and vignette, fused
+// into as few full screen passes as possible. F switches to one pass per
+// effect to compare, K adds a sharpen (which needs its own pass)
+PostEffectChain gPostChain;
+GLuint gColorGradeLut = 0;
+bool gFusePostChain = true;
+bool gSharpen = false;
+
+// P prints the last frame's GPU pass times, T writes a trace of the next
+// 120 frames to gpu_trace.json (open in ui.perfetto.dev)
+GpuProfiler gGpuProfiler;
 ////////////////////////////////////////////////////
 
 // GLFW callback functions
@@ -257,14 +267,6 @@ static void draw()
     static GLuint uProjection_light = glGetUniformLocation(gLightShaderProgram.id, "uProjection");
     static GLuint uLightColor_light = glGetUniformLocation(gLightShaderProgram.id, "uLightColor");
 
-    glUseProgram(gBloomShaderProgram.id);
-    #define GET_LOC(name) glGetUniformLocation(gBloomShaderProgram.id, name)
-    static GLuint uScene_bloom = GET_LOC("uScene");
-    static GLuint uBloomBlur = GET_LOC("uBloomBlur");
-    static GLuint uBloom = GET_LOC("uBloom");
-    static GLuint uExposure = GET_LOC("uExposure");
-    #undef GET_LOC
-
     glUseProgram(gBlurShaderProgram.id);
     #define GET_LOC(name) glGetUniformLocation(gBlurShaderProgram.id, name)
     static GLuint uHorizontal = GET_LOC("uHorizontal");
@@ -274,6 +276,7 @@ static void draw()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // render the scene into the floating point framebuffer
+    gGpuProfiler.Push("Scene");
     glBindFramebuffer(GL_FRAMEBUFFER, gHDRFrameBuffer.id);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(gShaderProgram.id);
@@ -367,6 +370,7 @@ static void draw()
             glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
         }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGpuProfiler.Pop();
 #if 0
     // Debug draw intial buffer
     glUseProgram(gDebugBufferShaderProgram.id);
@@ -381,9 +385,11 @@ static void draw()
     bool horizontal = true;
     bool firstPass = true;
     const size_t numPasses = 10;
+    gGpuProfiler.Push("Blur");
     glUseProgram(gBlurShaderProgram.id);
     for (size_t i = 0; i < numPasses; i++)
     {
+        GpuProfileScope passScope(gGpuProfiler, horizontal ? "Horizontal" : "Vertical");
         glBindFramebuffer(GL_FRAMEBUFFER, gBlurFrameBuffer.ids[horizontal]);
         glUniform1i(uHorizontal, horizontal);
         glBindTexture(GL_TEXTURE_2D, firstPass ? 
@@ -399,6 +405,7 @@ static void draw()
         }
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGpuProfiler.Pop();
 
 #if 0
     // Debug draw blur buffer
@@ -410,19 +417,48 @@ static void draw()
     glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
 #endif
 
-    // Render the combination/addition of the blur buffer and floating point buffer
+    // Render the combination/addition of the blur buffer and floating point
+    // buffer, with the rest of the post effects
+    GpuProfileScope compositeScope(gGpuProfiler, "Composite");
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(gBloomShaderProgram.id);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gHDRFrameBuffer.colorBufferIDs[0]);
-    glUniform1i(uScene_bloom, 0); // for GL_TEXTURE0
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, gBlurFrameBuffer.colorBufferIDs[!horizontal]);
-    glUniform1i(uBloomBlur, 1); // for GL_TEXTURE1
-    glUniform1i(uBloom, gBloom);
-    glUniform1f(uExposure, gExposure);
-    glBindVertexArray(gScreenTexture.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
+    gPostChain.GetEffect(0).texture = gBlurFrameBuffer.colorBufferIDs[!horizontal];
+    gPostChain.GetEffect(0).amount = gBloom ? 1.0f : 0.0f;
+    gPostChain.GetEffect(1).amount = gExposure;
+    gPostChain.Run(gHDRFrameBuffer.colorBufferIDs[0], gScreenTexture, &gGpuProfiler);
+}
+
+static void printPostChainCost()
+{
+    const double MB = 1024.0 * 1024.0;
+    PostChainCost fused = gPostChain.EstimateCost(true);
+    PostChainCost separate = gPostChain.EstimateCost(false);
+    std::cout << "Post chain: " << gPostChain.Size() << " effects, "
+        << (gFusePostChain ? "fused" : "one pass per effect") << std::endl
+        << "  fused: " << fused.numPasses << " passes, "
+        << fused.bytesRead / MB << " MB read, "
+        << fused.bytesWritten / MB << " MB written per frame" << std::endl
+        << "  one pass per effect: " << separate.numPasses << " passes, "
+        << separate.bytesRead / MB << " MB read, "
+        << separate.bytesWritten / MB << " MB written per frame" << std::endl;
+}
+
+// PostEffectChain.h; effect 0 and 1 are updated every frame by draw()
+static void buildPostChain()
+{
+    gPostChain.Clear();
+    gPostChain.Add(createPostEffect(PostEffectType::BloomAdd, 1.0f));
+    gPostChain.Add(createPostEffect(PostEffectType::Exposure, gExposure));
+    gPostChain.Add(createPostEffect(PostEffectType::Tonemap));
+    gPostChain.Add(createPostEffect(PostEffectType::Gamma, 2.2f));
+    PostEffect colorGrade = createPostEffect(PostEffectType::ColorGrade);
+    colorGrade.texture = gColorGradeLut;
+    gPostChain.Add(colorGrade);
+    gPostChain.Add(createPostEffect(PostEffectType::Vignette, 0.35f));
+    if (gSharpen) {
+        gPostChain.Add(createPostEffect(PostEffectType::Sharpen, 1.0f));
+    }
+    gPostChain.Build(WINDOW_WIDTH, WINDOW_HEIGHT, gFusePostChain);
+    printPostChainCost();
 }
 
 int main(void)
@@ -459,10 +495,6 @@ int main(void)
         gFragmentShader);
     glUseProgram(gShaderProgram.id);
 
-    gBloomVertexShader = createVertexShader("vertexShader_bloom.glsl");
-    gBloomFragmentShader = createFragmentShader("fragmentShader_bloom.glsl");
-    gBloomShaderProgram = createShaderProgram(gBloomVertexShader, gBloomFragmentShader);
-
     gBlurVertexShader = createVertexShader("vertexShader_blur.glsl");
     gBlurFragmentShader = createFragmentShader("fragmentShader_blur.glsl");
     gBlurShaderProgram = createShaderProgram(gBlurVertexShader, gBlurFragmentShader);
@@ -498,12 +530,54 @@ int main(void)
     // ScreenTexture.h
     gScreenTexture = createScreenTexture();
 
+    // GpuProfiler.h
+    gGpuProfiler.Init();
+
+    // PostEffectChain.h
+    gColorGradeLut = createColorGradeLut(16);
+    gPostChain.Init();
+    buildPostChain();
+
     while (!glfwWindowShouldClose(gWindow))
     {
         if (glfwGetKey(gWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
             glfwSetWindowShouldClose(gWindow, true);
         }
 
+        // press P to print the GPU pass times
+        static bool printProfileWasPressed = false;
+        bool printProfilePressed = glfwGetKey(gWindow, GLFW_KEY_P) == GLFW_PRESS;
+        if (printProfilePressed && !printProfileWasPressed) {
+            gGpuProfiler.PrintResults();
+            std::cout << "GPU profiler stalls: " << gGpuProfiler.GetNumStalls() << std::endl;
+        }
+        printProfileWasPressed = printProfilePressed;
+
+        // press T to capture a GPU trace
+        static bool traceWasPressed = false;
+        bool tracePressed = glfwGetKey(gWindow, GLFW_KEY_T) == GLFW_PRESS;
+        if (tracePressed && !traceWasPressed && !gGpuProfiler.IsCapturing()) {
+            gGpuProfiler.StartCapture("gpu_trace.json", 120);
+        }
+        traceWasPressed = tracePressed;
+
+        // press F to switch between the fused post chain and one pass per
+        // effect, K to add/remove the sharpen
+        static bool fuseWasPressed = false;
+        bool fusePressed = glfwGetKey(gWindow, GLFW_KEY_F) == GLFW_PRESS;
+        if (fusePressed && !fuseWasPressed) {
+            gFusePostChain = !gFusePostChain;
+            buildPostChain();
+        }
+        fuseWasPressed = fusePressed;
+        static bool sharpenWasPressed = false;
+        bool sharpenPressed = glfwGetKey(gWindow, GLFW_KEY_K) == GLFW_PRESS;
+        if (sharpenPressed && !sharpenWasPressed) {
+            gSharpen = !gSharpen;
+            buildPostChain();
+        }
+        sharpenWasPressed = sharpenPressed;
+
         moveCamera();
 
         // move the light around
@@ -514,12 +588,17 @@ int main(void)
         // Transform.h
         //updateTransformationMatrix(gLightTransMat, gLightPosition, gCamera);
 
+        gGpuProfiler.BeginFrame();
         draw();
+        gGpuProfiler.EndFrame();
 
         glfwSwapBuffers(gWindow);
         glfwPollEvents();
     }
 
+    gGpuProfiler.Shutdown();
+    gPostChain.Delete();
+    glDeleteTextures(1, &gColorGradeLut);
     glDeleteShader(gVertexShader.id);
     glDeleteShader(gFragmentShader.id);
     glfwTerminate();
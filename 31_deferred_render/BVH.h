@@ -0,0 +1,299 @@
+#ifndef BVH_H_INCLUDED
+#define BVH_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include "BoundingBox.h"
+
+// bounding volume hierarchy over a list of world space boxes, used
+// to find the visible set for a frame without testing every object.
+// Has no OpenGL dependencies so it can be exercised on the CPU only
+
+typedef struct BVHNode {
+    BoundingBox bounds;
+    uint32_t leftFirst; // index of left child if interior, or first item if leaf
+    uint32_t count;     // number of items if leaf, 0 if interior
+} BVHNode;
+
+typedef struct BVH {
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> itemIndices; // leaves reference ranges of this
+    std::vector<BoundingBox> itemBounds; // copy of the input boxes
+    size_t numNodesUsed;
+} BVH;
+
+typedef struct BVHCullStats {
+    size_t nodesVisited;
+    size_t boxTests;
+    size_t visibleCount;
+    double cullTimeMicroseconds;
+} BVHCullStats;
+
+#define BVH_NUM_BINS 12
+#define BVH_MAX_LEAF_ITEMS 4
+
+static inline bool isBVHLeaf(const BVHNode& node)
+{
+    return node.count > 0;
+}
+
+static void updateBVHNodeBounds(BVH& bvh, uint32_t nodeIndex)
+{
+    BVHNode& node = bvh.nodes[nodeIndex];
+    node.bounds = createEmptyBoundingBox();
+    for (uint32_t i = 0; i < node.count; ++i)
+    {
+        growBoundingBox(node.bounds, bvh.itemBounds[bvh.itemIndices[node.leftFirst + i]]);
+    }
+}
+
+// binned surface area heuristic: returns the cost of the best split found,
+// and writes the split axis and position
+static float findBVHSplitPlane(const BVH& bvh, const BVHNode& node, int& bestAxis, float& bestPos)
+{
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        // bin over item centroids, not the node bounds
+        float boundsMin = FLT_MAX;
+        float boundsMax = -FLT_MAX;
+        for (uint32_t i = 0; i < node.count; ++i)
+        {
+            float c = boundingBoxCenter(bvh.itemBounds[bvh.itemIndices[node.leftFirst + i]])[axis];
+            boundsMin = std::min(boundsMin, c);
+            boundsMax = std::max(boundsMax, c);
+        }
+        if (boundsMin == boundsMax) {
+            continue;
+        }
+
+        BoundingBox binBounds[BVH_NUM_BINS];
+        uint32_t binCounts[BVH_NUM_BINS];
+        for (int b = 0; b < BVH_NUM_BINS; ++b) {
+            binBounds[b] = createEmptyBoundingBox();
+            binCounts[b] = 0;
+        }
+
+        // a range that is too small to divide by would put the bin index at NaN
+        float scale = BVH_NUM_BINS / (boundsMax - boundsMin);
+        if (!std::isfinite(scale)) {
+            continue;
+        }
+        for (uint32_t i = 0; i < node.count; ++i)
+        {
+            const BoundingBox& box = bvh.itemBounds[bvh.itemIndices[node.leftFirst + i]];
+            int bin = std::min(BVH_NUM_BINS - 1,
+                (int)((boundingBoxCenter(box)[axis] - boundsMin) * scale));
+            binCounts[bin]++;
+            growBoundingBox(binBounds[bin], box);
+        }
+
+        // sweep from both sides to get the area/count on each side
+        // of the BVH_NUM_BINS - 1 possible planes
+        float leftArea[BVH_NUM_BINS - 1], rightArea[BVH_NUM_BINS - 1];
+        uint32_t leftCount[BVH_NUM_BINS - 1], rightCount[BVH_NUM_BINS - 1];
+        BoundingBox leftBox = createEmptyBoundingBox();
+        BoundingBox rightBox = createEmptyBoundingBox();
+        uint32_t leftSum = 0, rightSum = 0;
+        for (int i = 0; i < BVH_NUM_BINS - 1; ++i)
+        {
+            leftSum += binCounts[i];
+            leftCount[i] = leftSum;
+            growBoundingBox(leftBox, binBounds[i]);
+            leftArea[i] = boundingBoxSurfaceArea(leftBox);
+
+            rightSum += binCounts[BVH_NUM_BINS - 1 - i];
+            rightCount[BVH_NUM_BINS - 2 - i] = rightSum;
+            growBoundingBox(rightBox, binBounds[BVH_NUM_BINS - 1 - i]);
+            rightArea[BVH_NUM_BINS - 2 - i] = boundingBoxSurfaceArea(rightBox);
+        }
+
+        scale = (boundsMax - boundsMin) / BVH_NUM_BINS;
+        for (int i = 0; i < BVH_NUM_BINS - 1; ++i)
+        {
+            float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestPos = boundsMin + scale * (i + 1);
+            }
+        }
+    }
+    return bestCost;
+}
+
+static void subdivideBVHNode(BVH& bvh, uint32_t nodeIndex)
+{
+    BVHNode& node = bvh.nodes[nodeIndex];
+    if (node.count <= 1) {
+        return;
+    }
+
+    int axis = 0;
+    float splitPos = 0.0f;
+    float splitCost = findBVHSplitPlane(bvh, node, axis, splitPos);
+    float noSplitCost = node.count * boundingBoxSurfaceArea(node.bounds);
+    if (node.count <= BVH_MAX_LEAF_ITEMS && splitCost >= noSplitCost) {
+        return;
+    }
+    if (splitCost == FLT_MAX) {
+        return; // all centroids are equal, can't split
+    }
+
+    // partition the item range in place
+    int i = node.leftFirst;
+    int j = i + node.count - 1;
+    while (i <= j)
+    {
+        if (boundingBoxCenter(bvh.itemBounds[bvh.itemIndices[i]])[axis] < splitPos) {
+            i++;
+        } else {
+            std::swap(bvh.itemIndices[i], bvh.itemIndices[j--]);
+        }
+    }
+
+    uint32_t leftCount = i - node.leftFirst;
+    if (leftCount == 0 || leftCount == node.count) {
+        return;
+    }
+
+    // children are always allocated after their parent; refitBVH relies on this
+    uint32_t leftChild = bvh.numNodesUsed++;
+    uint32_t rightChild = bvh.numNodesUsed++;
+    bvh.nodes[leftChild].leftFirst = node.leftFirst;
+    bvh.nodes[leftChild].count = leftCount;
+    bvh.nodes[rightChild].leftFirst = i;
+    bvh.nodes[rightChild].count = node.count - leftCount;
+    node.leftFirst = leftChild;
+    node.count = 0;
+
+    updateBVHNodeBounds(bvh, leftChild);
+    updateBVHNodeBounds(bvh, rightChild);
+
+    subdivideBVHNode(bvh, leftChild);
+    subdivideBVHNode(bvh, rightChild);
+}
+
+BVH createBVH(const std::vector<BoundingBox>& itemBounds)
+{
+    BVH bvh;
+
+    bvh.itemBounds = itemBounds;
+    bvh.itemIndices.resize(itemBounds.size());
+    for (size_t i = 0; i < itemBounds.size(); ++i) {
+        bvh.itemIndices[i] = (uint32_t)i;
+    }
+
+    // a binary tree with N leaves has at most 2N - 1 nodes
+    bvh.nodes.resize(std::max<size_t>(1, itemBounds.size() * 2));
+    bvh.numNodesUsed = 1;
+
+    BVHNode& root = bvh.nodes[0];
+    root.leftFirst = 0;
+    root.count = (uint32_t)itemBounds.size();
+    updateBVHNodeBounds(bvh, 0);
+    if (root.count == 0) {
+        return bvh;
+    }
+
+    subdivideBVHNode(bvh, 0);
+
+    return bvh;
+}
+
+// recompute node bounds bottom up after some of bvh.itemBounds were updated
+// (objects moved), without changing the tree topology. Quality degrades as
+// objects move far from where the tree was built; call createBVH again then
+void refitBVH(BVH& bvh)
+{
+    if (bvh.itemIndices.empty()) {
+        return;
+    }
+
+    // children always have a larger index than their parent
+    for (size_t i = bvh.numNodesUsed; i-- > 0; )
+    {
+        BVHNode& node = bvh.nodes[i];
+        if (isBVHLeaf(node)) {
+            updateBVHNodeBounds(bvh, (uint32_t)i);
+            continue;
+        }
+        node.bounds = bvh.nodes[node.leftFirst].bounds;
+        growBoundingBox(node.bounds, bvh.nodes[node.leftFirst + 1].bounds);
+    }
+}
+
+// append the indices of every item whose box is at least partially inside
+// the frustum to visible. Subtrees that are fully inside are accepted without
+// testing any more boxes
+void cullBVH(const BVH& bvh, const Frustum& frustum,
+             std::vector<uint32_t>& visible, BVHCullStats* stats = nullptr)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    BVHCullStats localStats = {0, 0, 0, 0.0};
+    if (bvh.itemIndices.empty()) {
+        if (stats) {
+            *stats = localStats;
+        }
+        return;
+    }
+
+    // (node index, parent fully inside). The SAH doesn't bound the tree
+    // depth, so the stack has to be able to grow past what a balanced
+    // tree would need
+    std::vector<std::pair<uint32_t, bool>> stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(0u, false));
+
+    size_t visibleStart = visible.size();
+    while (!stack.empty())
+    {
+        const BVHNode& node = bvh.nodes[stack.back().first];
+        bool inside = stack.back().second;
+        stack.pop_back();
+        localStats.nodesVisited++;
+
+        if (!inside) {
+            localStats.boxTests++;
+            CullResult res = testFrustumBoundingBox(frustum, node.bounds);
+            if (res == CullResult::Outside) {
+                continue;
+            }
+            inside = (res == CullResult::Inside);
+        }
+
+        if (isBVHLeaf(node))
+        {
+            for (uint32_t i = 0; i < node.count; ++i)
+            {
+                uint32_t item = bvh.itemIndices[node.leftFirst + i];
+                // leaves can hold several boxes, so test each one
+                // unless the whole leaf is known to be inside
+                if (!inside) {
+                    localStats.boxTests++;
+                    if (testFrustumBoundingBox(frustum, bvh.itemBounds[item]) == CullResult::Outside) {
+                        continue;
+                    }
+                }
+                visible.push_back(item);
+            }
+            continue;
+        }
+
+        stack.push_back(std::make_pair(node.leftFirst + 1, inside));
+        stack.push_back(std::make_pair(node.leftFirst, inside));
+    }
+
+    localStats.visibleCount = visible.size() - visibleStart;
+    auto end = std::chrono::high_resolution_clock::now();
+    localStats.cullTimeMicroseconds = std::chrono::duration<double, std::micro>(end - start).count();
+    if (stats) {
+        *stats = localStats;
+    }
+}
+
+#endif // !BVH_H_INCLUDED
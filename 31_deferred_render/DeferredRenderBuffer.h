@@ -4,54 +4,74 @@
 #include <glad/glad.h>
 
 typedef struct DeferredRenderBuffer {
-    GLuint colorBufferIDs[3];
-    GLuint renderBufferID;
+    GLuint colorBufferIDs[3];   // position, normal, albedo/specular
+    GLuint renderBufferID;      // depth in the full layout
+    GLuint depthTextureID;      // depth in the compact layout
     GLuint id;
     size_t width;
     size_t height;
+    bool compact;
 } DeferredRenderBuffer;
 
-DeferredRenderBuffer createDeferredRenderBuffer() 
+// bytes per pixel of every attachment, depth included
+size_t deferredRenderBufferBytesPerPixel(bool compact)
+{
+    return compact ?
+        4 + 4 + 4 :         // normal RG16, albedo/specular RGBA8, depth 24 stencil 8
+        8 + 8 + 4 + 4;      // position RGBA16F, normal RGBA16F, albedo/specular, depth stencil
+}
+
+// compact leaves out the position attachment (colorBufferIDs[0] = 0) and
+// makes depth a texture the lighting pass rebuilds positions from;
+// normals are octahedral encoded into an RG16 attachment
+DeferredRenderBuffer createDeferredRenderBuffer(bool compact = false) 
 {
     DeferredRenderBuffer frameBuffer;
     frameBuffer.width = 800; // screen width and height
     frameBuffer.height = 600;
+    frameBuffer.compact = compact;
+    frameBuffer.renderBufferID = 0;
+    frameBuffer.depthTextureID = 0;
 
     glGenFramebuffers(1, &frameBuffer.id);
     glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.id);
 
-    glGenTextures(3, frameBuffer.colorBufferIDs);
+    frameBuffer.colorBufferIDs[0] = 0;
+    glGenTextures(2, &frameBuffer.colorBufferIDs[1]);
 
     // Position buffer
-    glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[0]);
-    glTexImage2D(GL_TEXTURE_2D, 
-                 0, 
-                GL_RGBA16F, // floating point in order to store values > 1.0 (GL_RGB clamps them)
-                frameBuffer.width,        // note if this size was different than window size we'd have to call glViewport() to render the full screen
-                frameBuffer.height, 
-                0, 
-                GL_RGBA, 
-                GL_FLOAT,  // GL_FLOAT now instead of GL_UNSIGNED_BYTE
-                NULL);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, 
-                            GL_COLOR_ATTACHMENT0,
-                            GL_TEXTURE_2D, 
-                            frameBuffer.colorBufferIDs[0], 
-                            0);
+    if (!compact) {
+        glGenTextures(1, &frameBuffer.colorBufferIDs[0]);
+        glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[0]);
+        glTexImage2D(GL_TEXTURE_2D, 
+                     0, 
+                    GL_RGBA16F, // floating point in order to store values > 1.0 (GL_RGB clamps them)
+                    frameBuffer.width,        // note if this size was different than window size we'd have to call glViewport() to render the full screen
+                    frameBuffer.height, 
+                    0, 
+                    GL_RGBA, 
+                    GL_FLOAT,  // GL_FLOAT now instead of GL_UNSIGNED_BYTE
+                    NULL);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, 
+                                GL_COLOR_ATTACHMENT0,
+                                GL_TEXTURE_2D, 
+                                frameBuffer.colorBufferIDs[0], 
+                                0);
+    }
 
     // normal buffer
     glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[1]);
     glTexImage2D(GL_TEXTURE_2D, 
                  0, 
-                GL_RGBA16F, // floating point in order to store values > 1.0 (GL_RGB clamps them)
+                compact ? GL_RG16 : GL_RGBA16F, // octahedral [0, 1] or floating point xyz
                 frameBuffer.width,        // note if this size was different than window size we'd have to call glViewport() to render the full screen
                 frameBuffer.height, 
                 0, 
-                GL_RGBA, 
-                GL_FLOAT,  // GL_FLOAT now instead of GL_UNSIGNED_BYTE
+                compact ? GL_RG : GL_RGBA, 
+                GL_FLOAT,
                 NULL);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -82,18 +102,48 @@ DeferredRenderBuffer createDeferredRenderBuffer()
                             frameBuffer.colorBufferIDs[2], 
                             0);
 
-    glGenRenderbuffers(1, &frameBuffer.renderBufferID);
-    glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer.renderBufferID);
-    glRenderbufferStorage(GL_RENDERBUFFER, 
-                            GL_DEPTH_COMPONENT,
-                            frameBuffer.width, 
-                            frameBuffer.height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, 
-                                GL_DEPTH_ATTACHMENT, 
-                                GL_RENDERBUFFER, 
-                                frameBuffer.renderBufferID);
-    // tell OpenGL which color attachments we'll use for this framebuffer
-    static GLuint attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    // depth is DEPTH24_STENCIL8 like the default framebuffer, which the
+    // lighting pass blits it to; blits between depth formats fail
+    if (compact) {
+        glGenTextures(1, &frameBuffer.depthTextureID);
+        glBindTexture(GL_TEXTURE_2D, frameBuffer.depthTextureID);
+        glTexImage2D(GL_TEXTURE_2D, 
+                     0, 
+                    GL_DEPTH24_STENCIL8,
+                    frameBuffer.width, 
+                    frameBuffer.height, 
+                    0, 
+                    GL_DEPTH_STENCIL, 
+                    GL_UNSIGNED_INT_24_8,
+                    NULL);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, 
+                                GL_DEPTH_STENCIL_ATTACHMENT,
+                                GL_TEXTURE_2D, 
+                                frameBuffer.depthTextureID, 
+                                0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    else {
+        glGenRenderbuffers(1, &frameBuffer.renderBufferID);
+        glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer.renderBufferID);
+        glRenderbufferStorage(GL_RENDERBUFFER, 
+                                GL_DEPTH24_STENCIL8,
+                                frameBuffer.width, 
+                                frameBuffer.height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, 
+                                    GL_DEPTH_STENCIL_ATTACHMENT, 
+                                    GL_RENDERBUFFER, 
+                                    frameBuffer.renderBufferID);
+    }
+    // tell OpenGL which color attachments we'll use for this framebuffer;
+    // the geometry shaders' position output goes nowhere when compact
+    GLuint attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    if (compact) {
+        attachments[0] = GL_NONE;
+    }
     glDrawBuffers(3, attachments);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         std::cout << "Framebuffer error: incomplete" << std::endl;
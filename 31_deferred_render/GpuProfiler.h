@@ -0,0 +1,313 @@
+#ifndef GPU_PROFILER_H_INCLUDED
+#define GPU_PROFILER_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "ChromeTrace.h"
+
+// KHR_debug isn't in our GL 3.3 glad, so its entry points are looked up
+// by hand; markers are skipped when the driver doesn't have them
+#ifndef GL_DEBUG_SOURCE_APPLICATION
+#define GL_DEBUG_SOURCE_APPLICATION 0x824A
+#endif
+typedef void (APIENTRYP PFN_PUSH_DEBUG_GROUP)(GLenum source, GLuint id, GLsizei length, const GLchar* message);
+typedef void (APIENTRYP PFN_POP_DEBUG_GROUP)(void);
+
+// one timed zone of a resolved frame; zones are stored depth first so a
+// zone's children directly follow it
+typedef struct GpuProfileResult {
+    std::string name;
+    size_t depth;       // 0 = the whole frame
+    double startMs;     // since the start of the frame
+    double durationMs;
+} GpuProfileResult;
+
+// nested GPU timing zones from GL_TIMESTAMP queries. A zone is a pair of
+// timestamps rather than a GL_TIME_ELAPSED query since those can't nest.
+// Queries are recycled through a pool and read back `latency` frames
+// after they were issued, by which point the GPU has normally finished
+// them, so reading never stalls the pipeline.
+//
+//   gGpuProfiler.BeginFrame();
+//   {
+//       GpuProfileScope scope(gGpuProfiler, "SSAO");
+//       ...
+//   }
+//   gGpuProfiler.EndFrame();
+//
+// Every zone is also a KHR_debug group so RenderDoc/Nsight show the
+// same names
+class GpuProfiler
+{
+public:
+
+    GpuProfiler() :
+        latency(0),
+        frameNumber(0),
+        numStalls(0),
+        gpuToTraceUs(0.0),
+        captureFramesLeft(0),
+        pushDebugGroup(nullptr),
+        popDebugGroup(nullptr)
+    {}
+
+    // latency = frames between issuing a zone and reading it back
+    void Init(size_t latency = 4)
+    {
+        this->latency = latency;
+        frames.resize(latency);
+        frameNumber = 0;
+
+        if (glfwExtensionSupported("GL_KHR_debug")) {
+            pushDebugGroup = (PFN_PUSH_DEBUG_GROUP)glfwGetProcAddress("glPushDebugGroup");
+            popDebugGroup = (PFN_POP_DEBUG_GROUP)glfwGetProcAddress("glPopDebugGroup");
+        }
+        if (!pushDebugGroup || !popDebugGroup) {
+            pushDebugGroup = nullptr;
+            popDebugGroup = nullptr;
+        }
+
+        calibrate();
+    }
+
+    void Shutdown()
+    {
+        for (Frame& frame : frames) {
+            for (Zone& zone : frame.zones) {
+                freeQueries.push_back(zone.startQuery);
+                freeQueries.push_back(zone.endQuery);
+            }
+            frame.zones.clear();
+        }
+        if (!freeQueries.empty()) {
+            glDeleteQueries(freeQueries.size(), &freeQueries[0]);
+        }
+        freeQueries.clear();
+    }
+
+    // reads back the frame issued `latency` frames ago, then opens the
+    // root "Frame" zone of the new one
+    void BeginFrame()
+    {
+        Frame& frame = frames[frameNumber % latency];
+        if (frame.issued) {
+            resolve(frame);
+        }
+        frame.issued = false;
+        frame.zones.clear();
+        frame.openZones.clear();
+        Push("Frame");
+    }
+
+    void EndFrame()
+    {
+        Frame& frame = frames[frameNumber % latency];
+        while (!frame.openZones.empty()) {
+            Pop();
+        }
+        frame.issued = true;
+        frameNumber++;
+    }
+
+    void Push(const std::string& name)
+    {
+        Frame& frame = frames[frameNumber % latency];
+        Zone zone;
+        zone.name = name;
+        zone.depth = frame.openZones.size();
+        zone.startQuery = allocQuery();
+        zone.endQuery = allocQuery();
+        glQueryCounter(zone.startQuery, GL_TIMESTAMP);
+        frame.openZones.push_back(frame.zones.size());
+        frame.zones.push_back(zone);
+        if (pushDebugGroup) {
+            pushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name.c_str());
+        }
+    }
+
+    void Pop()
+    {
+        Frame& frame = frames[frameNumber % latency];
+        if (frame.openZones.empty()) {
+            std::cout << "GpuProfiler: Pop() without Push()" << std::endl;
+            return;
+        }
+        if (popDebugGroup) {
+            popDebugGroup();
+        }
+        glQueryCounter(frame.zones[frame.openZones.back()].endQuery, GL_TIMESTAMP);
+        frame.openZones.pop_back();
+    }
+
+    // the most recently resolved frame, depth first
+    const std::vector<GpuProfileResult>& GetResults() const { return results; }
+
+    // times a result had to be waited on because the GPU was more than
+    // `latency` frames behind
+    size_t GetNumStalls() const { return numStalls; }
+
+    void PrintResults() const
+    {
+        for (const GpuProfileResult& result : results) {
+            std::cout << std::string(2 * result.depth, ' ') << result.name << ": "
+                << result.durationMs << " ms" << std::endl;
+        }
+    }
+
+    // record the next numFrames resolved frames and write them to fileName
+    // as a Chrome trace. addEvents can add other rows (e.g. the CPU zones
+    // of CpuProfiler.h) to the same file just before it is written
+    void StartCapture(const std::string& fileName,
+                      size_t numFrames,
+                      std::function<void(std::vector<ChromeTraceEvent>&, std::vector<std::string>&)> addEvents = nullptr)
+    {
+        calibrate();
+        captureFileName = fileName;
+        captureFramesLeft = numFrames;
+        captureEvents.clear();
+        captureAddEvents = addEvents;
+    }
+
+    bool IsCapturing() const { return captureFramesLeft > 0; }
+
+private:
+
+    typedef struct Zone {
+        std::string name;
+        size_t depth;
+        GLuint startQuery;
+        GLuint endQuery;
+    } Zone;
+
+    typedef struct Frame {
+        std::vector<Zone> zones;       // in Push() order, i.e. depth first
+        std::vector<size_t> openZones; // indices into zones
+        bool issued;
+        Frame() : issued(false) {}
+    } Frame;
+
+    size_t latency;
+    std::vector<Frame> frames;
+    size_t frameNumber;
+    std::vector<GLuint> freeQueries;
+    std::vector<GpuProfileResult> results;
+    size_t numStalls;
+
+    // GL_TIMESTAMP (ns) + gpuToTraceUs * 1000 = chromeTraceEpoch() time
+    double gpuToTraceUs;
+    std::string captureFileName;
+    size_t captureFramesLeft;
+    std::vector<ChromeTraceEvent> captureEvents;
+    std::function<void(std::vector<ChromeTraceEvent>&, std::vector<std::string>&)> captureAddEvents;
+
+    PFN_PUSH_DEBUG_GROUP pushDebugGroup;
+    PFN_POP_DEBUG_GROUP popDebugGroup;
+
+    GLuint allocQuery()
+    {
+        if (freeQueries.empty()) {
+            // grow the pool a few at a time; it settles after the first
+            // `latency` frames
+            GLuint newQueries[16];
+            glGenQueries(16, newQueries);
+            freeQueries.insert(freeQueries.end(), newQueries, newQueries + 16);
+        }
+        GLuint query = freeQueries.back();
+        freeQueries.pop_back();
+        return query;
+    }
+
+    // GPU timestamps count from an arbitrary point, so pair one with the
+    // CPU clock to place GPU zones on the trace timeline
+    void calibrate()
+    {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuToTraceUs = chromeTraceNowUs() - double(gpuNow) / 1000.0;
+    }
+
+    void resolve(Frame& frame)
+    {
+        if (frame.zones.empty()) {
+            return;
+        }
+
+        // the root zone ends last, so once it's ready all of them are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.zones[0].endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            numStalls++;
+        }
+
+        results.clear();
+        GLuint64 frameStart = 0;
+        for (size_t i = 0; i < frame.zones.size(); i++)
+        {
+            Zone& zone = frame.zones[i];
+            GLuint64 start = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(zone.startQuery, GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(zone.endQuery, GL_QUERY_RESULT, &end);
+            if (i == 0) {
+                frameStart = start;
+            }
+
+            GpuProfileResult result;
+            result.name = zone.name;
+            result.depth = zone.depth;
+            result.startMs = double(start - frameStart) / 1000000.0;
+            result.durationMs = double(end - start) / 1000000.0;
+            results.push_back(result);
+
+            if (captureFramesLeft > 0) {
+                ChromeTraceEvent event;
+                event.name = zone.name;
+                event.category = "gpu";
+                event.phase = 'X';
+                event.startUs = double(start) / 1000.0 + gpuToTraceUs;
+                event.durationUs = double(end - start) / 1000.0;
+                event.value = 0.0;
+                event.threadID = 0;
+                captureEvents.push_back(event);
+            }
+
+            freeQueries.push_back(zone.startQuery);
+            freeQueries.push_back(zone.endQuery);
+        }
+        frame.zones.clear();
+
+        if (captureFramesLeft > 0 && --captureFramesLeft == 0) {
+            std::vector<std::string> threadNames = { "GPU" };
+            if (captureAddEvents) {
+                captureAddEvents(captureEvents, threadNames);
+            }
+            if (writeChromeTrace(captureFileName, captureEvents, threadNames)) {
+                std::cout << "Wrote trace " << captureFileName << std::endl;
+            }
+            captureEvents.clear();
+        }
+    }
+};
+
+// times everything until the end of the enclosing block
+class GpuProfileScope
+{
+public:
+    GpuProfileScope(GpuProfiler& profiler, const std::string& name) :
+        profiler(profiler)
+    {
+        profiler.Push(name);
+    }
+    ~GpuProfileScope() { profiler.Pop(); }
+
+private:
+    GpuProfiler& profiler;
+};
+
+#endif // !GPU_PROFILER_H_INCLUDED
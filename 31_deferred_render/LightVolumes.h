@@ -0,0 +1,391 @@
+#ifndef LIGHT_VOLUMES_H_INCLUDED
+#define LIGHT_VOLUMES_H_INCLUDED
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Shader.h"
+#include "ShaderProgram.h"
+#include "DeferredRenderBuffer.h"
+#include "GpuProfiler.h"
+
+// segments of the bounding sphere mesh around and from pole to pole
+#define LIGHT_VOLUME_SLICES 16
+#define LIGHT_VOLUME_STACKS 12
+
+// distance at which a point light with attenuation
+// 1 / (constant + linear * d + quadratic * d^2) falls under 5/256 of its
+// brightest channel, about one step of an 8 bit target; beyond it the
+// light is left out
+float lightVolumeRadius(const glm::vec3& color, float constant, float linear, float quadratic)
+{
+    float maxBrightness = std::max(std::max(color.x, color.y), color.z);
+    return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - (256.0f / 5.0f) * maxBrightness))) /
+        (2.0f * quadratic);
+}
+
+// deferred point lights drawn as instanced bounding spheres, so a light
+// costs the pixels its sphere covers rather than the whole screen.
+//
+// A z-fail stencil pass first counts, per pixel, the spheres the G-buffer
+// surface is inside of: back faces behind the surface increment, front
+// faces behind it decrement. The lighting pass then draws the spheres'
+// back faces with the depth test off (so it still works with the camera
+// inside a sphere) where the count isn't 0, adding each light in. All
+// lights share the one stencil count, so the lighting shader still
+// checks the distance to its own light.
+//
+// Draw() expects the G-buffer's depth in the bound framebuffer's depth
+// buffer, and a stencil buffer it can clear
+class LightVolumes
+{
+public:
+
+    LightVolumes() :
+        numLights(0),
+        capacity(0),
+        numSphereVertices(0),
+        sphereVBO(0),
+        instanceVBO(0),
+        VAO(0),
+        queryIndex(0),
+        shadedFragments(0)
+    {
+        queries[0] = queries[1] = 0;
+        queryIssued[0] = queryIssued[1] = false;
+    }
+    ~LightVolumes() {}
+
+    void Init()
+    {
+        std::vector<glm::vec3> sphere;
+        createSphere(sphere);
+        numSphereVertices = sphere.size();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &sphereVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+        glBufferData(GL_ARRAY_BUFFER,
+            sphere.size() * sizeof(glm::vec3),
+            &sphere[0],
+            GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        // per light: position and radius, then color
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE,
+            sizeof(LightInstance), (void*)offsetof(LightInstance, positionRadius));
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE,
+            sizeof(LightInstance), (void*)offsetof(LightInstance, color));
+        for (GLuint loc = 3; loc <= 4; loc++)
+        {
+            glEnableVertexAttribArray(loc);
+            glVertexAttribDivisor(loc, 1); // 1 = update the attribute every instance (0 = every vertex)
+        }
+
+        // ORDER MATTERS - the VAO must be unbinded FIRST!
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        vertexShader = createVertexShader("vertexShader_lightVolume.glsl");
+        stencilFragmentShader = createFragmentShader("fragmentShader_lightVolumeStencil.glsl");
+        fragmentShader = createFragmentShader("fragmentShader_lightVolume.glsl");
+        stencilProgram = createShaderProgram(vertexShader, stencilFragmentShader);
+        program = createShaderProgram(vertexShader, fragmentShader);
+
+        glUseProgram(stencilProgram.id);
+        uView_stencil = glGetUniformLocation(stencilProgram.id, "uView");
+        uProjection_stencil = glGetUniformLocation(stencilProgram.id, "uProjection");
+
+        glUseProgram(program.id);
+        #define GET_LOC(name) glGetUniformLocation(program.id, name)
+        uView = GET_LOC("uView");
+        uProjection = GET_LOC("uProjection");
+        uPositionTex = GET_LOC("uPositionTex");
+        uNormalTex = GET_LOC("uNormalTex");
+        uAlbedoSpecTex = GET_LOC("uAlbedoSpecTex");
+        uDepthTex = GET_LOC("uDepthTex");
+        uCompactGBuffer = GET_LOC("uCompactGBuffer");
+        uInverseViewProjection = GET_LOC("uInverseViewProjection");
+        uScreenSize = GET_LOC("uScreenSize");
+        uConstant = GET_LOC("uConstant");
+        uLinear = GET_LOC("uLinear");
+        uQuadratic = GET_LOC("uQuadratic");
+        #undef GET_LOC
+
+        glGenQueries(2, queries);
+    }
+
+    // recomputes every light's radius; only needed when lights are
+    // added, moved or change color
+    void Update(const std::vector<glm::vec3>& positions,
+        const std::vector<glm::vec3>& colors,
+        float constant,
+        float linear,
+        float quadratic)
+    {
+        this->constant = constant;
+        this->linear = linear;
+        this->quadratic = quadratic;
+
+        numLights = std::min(positions.size(), colors.size());
+        instances.resize(numLights);
+        for (size_t i = 0; i < numLights; i++)
+        {
+            float radius = lightVolumeRadius(colors[i], constant, linear, quadratic);
+            instances[i].positionRadius = glm::vec4(positions[i], radius);
+            instances[i].color = colors[i];
+        }
+        if (numLights == 0) {
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (numLights > capacity) {
+            capacity = numLights;
+            glBufferData(GL_ARRAY_BUFFER,
+                capacity * sizeof(LightInstance),
+                &instances[0],
+                GL_STATIC_DRAW);
+        }
+        else {
+            glBufferSubData(GL_ARRAY_BUFFER,
+                0,
+                numLights * sizeof(LightInstance),
+                &instances[0]);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    float GetRadius(size_t light) const { return instances[light].positionRadius.w; }
+    size_t NumLights() const { return numLights; }
+
+    // fragments the lighting pass shaded in the most recently resolved
+    // frame, i.e. the number of light evaluations. A full screen pass
+    // does numLights * width * height
+    GLuint64 GetShadedFragments() const { return shadedFragments; }
+
+    // adds every light into the bound framebuffer (of the G-buffer's size)
+    void Draw(const DeferredRenderBuffer& gBuffer,
+        const glm::mat4& view,
+        const glm::mat4& projection,
+        GpuProfiler* profiler)
+    {
+        if (numLights == 0) {
+            return;
+        }
+        readQuery();
+
+        glBindVertexArray(VAO);
+
+        // count the spheres each surface is inside of
+        if (profiler) {
+            profiler->Push("Light volume stencil");
+        }
+        glEnable(GL_STENCIL_TEST);
+        glClear(GL_STENCIL_BUFFER_BIT);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        // wrapping so the order faces arrive in doesn't matter
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+
+        glUseProgram(stencilProgram.id);
+        glUniformMatrix4fv(uView_stencil, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(uProjection_stencil, 1, GL_FALSE, glm::value_ptr(projection));
+        glDrawArraysInstanced(GL_TRIANGLES, 0, (GLsizei)numSphereVertices, (GLsizei)numLights);
+        if (profiler) {
+            profiler->Pop();
+        }
+
+        // shade where the count isn't 0, adding each light in
+        if (profiler) {
+            profiler->Push("Light volumes");
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        glUseProgram(program.id);
+        glUniformMatrix4fv(uView, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(uProjection, 1, GL_FALSE, glm::value_ptr(projection));
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+        glUniformMatrix4fv(uInverseViewProjection, 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+        glUniform2f(uScreenSize, (float)gBuffer.width, (float)gBuffer.height);
+        glUniform1f(uConstant, constant);
+        glUniform1f(uLinear, linear);
+        glUniform1f(uQuadratic, quadratic);
+        glUniform1i(uCompactGBuffer, gBuffer.compact);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gBuffer.colorBufferIDs[0]);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gBuffer.colorBufferIDs[1]);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, gBuffer.colorBufferIDs[2]);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, gBuffer.depthTextureID);
+        glUniform1i(uPositionTex, 0);
+        glUniform1i(uNormalTex, 1);
+        glUniform1i(uAlbedoSpecTex, 2);
+        glUniform1i(uDepthTex, 3);
+
+        glBeginQuery(GL_SAMPLES_PASSED, queries[queryIndex]);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, (GLsizei)numSphereVertices, (GLsizei)numLights);
+        glEndQuery(GL_SAMPLES_PASSED);
+        queryIssued[queryIndex] = true;
+        queryIndex ^= 1;
+        if (profiler) {
+            profiler->Pop();
+        }
+
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+        glDisable(GL_STENCIL_TEST);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+        glBindVertexArray(0);
+    }
+
+    void Delete()
+    {
+        glDeleteQueries(2, queries);
+        glDeleteBuffers(1, &sphereVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(program.id);
+        glDeleteProgram(stencilProgram.id);
+        glDeleteShader(vertexShader.id);
+        glDeleteShader(fragmentShader.id);
+        glDeleteShader(stencilFragmentShader.id);
+    }
+
+private:
+
+    typedef struct LightInstance {
+        glm::vec4 positionRadius;
+        glm::vec3 color;
+    } LightInstance;
+
+    std::vector<LightInstance> instances;
+    size_t numLights;
+    size_t capacity; // of instanceVBO, in lights
+    float constant;
+    float linear;
+    float quadratic;
+
+    size_t numSphereVertices;
+    GLuint sphereVBO;
+    GLuint instanceVBO;
+    GLuint VAO;
+
+    Shader vertexShader;
+    Shader stencilFragmentShader;
+    Shader fragmentShader;
+    ShaderProgram stencilProgram;
+    ShaderProgram program;
+    GLint uView_stencil;
+    GLint uProjection_stencil;
+    GLint uView;
+    GLint uProjection;
+    GLint uPositionTex;
+    GLint uNormalTex;
+    GLint uAlbedoSpecTex;
+    GLint uDepthTex;
+    GLint uCompactGBuffer;
+    GLint uInverseViewProjection;
+    GLint uScreenSize;
+    GLint uConstant;
+    GLint uLinear;
+    GLint uQuadratic;
+
+    // GL_SAMPLES_PASSED of the lighting pass, two frames in flight so
+    // reading one back doesn't wait on the GPU
+    GLuint queries[2];
+    bool queryIssued[2];
+    size_t queryIndex; // the one the next Draw() uses
+    GLuint64 shadedFragments;
+
+    void readQuery()
+    {
+        if (!queryIssued[queryIndex]) {
+            return;
+        }
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[queryIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            // don't stall; reuse it anyway and keep the older count
+            return;
+        }
+        glGetQueryObjectui64v(queries[queryIndex], GL_QUERY_RESULT, &shadedFragments);
+        queryIssued[queryIndex] = false;
+    }
+
+    // a unit UV sphere as counter clockwise triangles, pushed out so its
+    // flat faces enclose the unit sphere instead of cutting into it
+    void createSphere(std::vector<glm::vec3>& triangles)
+    {
+        const float PI = 3.14159265359f;
+        const float enclose = 1.0f /
+            (std::cos(PI / LIGHT_VOLUME_SLICES) * std::cos(PI / (2.0f * LIGHT_VOLUME_STACKS)));
+
+        // stack 0 is the +y pole
+        std::vector<glm::vec3> points;
+        for (size_t stack = 0; stack <= LIGHT_VOLUME_STACKS; stack++)
+        {
+            float theta = PI * float(stack) / float(LIGHT_VOLUME_STACKS);
+            for (size_t slice = 0; slice <= LIGHT_VOLUME_SLICES; slice++)
+            {
+                float phi = 2.0f * PI * float(slice) / float(LIGHT_VOLUME_SLICES);
+                points.push_back(enclose * glm::vec3(std::sin(theta) * std::cos(phi),
+                    std::cos(theta),
+                    -std::sin(theta) * std::sin(phi)));
+            }
+        }
+
+        triangles.clear();
+        const size_t row = LIGHT_VOLUME_SLICES + 1;
+        for (size_t stack = 0; stack < LIGHT_VOLUME_STACKS; stack++)
+        {
+            for (size_t slice = 0; slice < LIGHT_VOLUME_SLICES; slice++)
+            {
+                glm::vec3 topLeft = points[stack * row + slice];
+                glm::vec3 topRight = points[stack * row + slice + 1];
+                glm::vec3 bottomLeft = points[(stack + 1) * row + slice];
+                glm::vec3 bottomRight = points[(stack + 1) * row + slice + 1];
+                // the pole rows would otherwise get a degenerate triangle
+                if (stack != 0) {
+                    triangles.push_back(topLeft);
+                    triangles.push_back(bottomLeft);
+                    triangles.push_back(topRight);
+                }
+                if (stack != LIGHT_VOLUME_STACKS - 1) {
+                    triangles.push_back(topRight);
+                    triangles.push_back(bottomLeft);
+                    triangles.push_back(bottomRight);
+                }
+            }
+        }
+    }
+};
+
+#endif // !LIGHT_VOLUMES_H_INCLUDED
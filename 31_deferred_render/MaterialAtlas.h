@@ -0,0 +1,293 @@
+#ifndef MATERIAL_ATLAS_H_INCLUDED
+#define MATERIAL_ATLAS_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+
+#include <glad/glad.h>
+
+#include "Texture.h" // stb_image, gMaterialTextureBinds
+
+// all material textures of a model packed into a few GL_TEXTURE_2D_ARRAYs,
+// so the whole model draws with one set of texture bindings. Textures are
+// bucketed by size and format (one array per bucket, one layer per texture).
+// GLSL 3.30 can't index an array of samplers with a per draw value, so the
+// number of arrays is capped and fragmentShader_materialAtlas.glsl picks one
+// with a branch; past the cap the least used buckets are resampled into
+// the kept bucket with the largest textures. Each material is an ivec4 in a uniform buffer:
+//   (diffuse array, diffuse layer, specular array, specular layer), -1 = none
+// and each mesh only needs its material index (uMaterialIndex)
+
+#define MATERIAL_ATLAS_MAX_ARRAYS 4
+#define MATERIAL_ATLAS_MAX_MATERIALS 256 // must match the shader
+#define MATERIAL_ATLAS_FIRST_TEXTURE_UNIT 4
+#define MATERIAL_ATLAS_UBO_BINDING 1
+
+// texture files used by one material, empty if none. The atlas holds one
+// diffuse and one specular layer per material; any further layers of a
+// type are only bound by the per mesh (non atlas) path
+typedef struct MaterialDesc {
+    std::string diffuseFile;
+    std::string specularFile;
+    std::vector<std::string> extraDiffuseFiles;
+    std::vector<std::string> extraSpecularFiles;
+} MaterialDesc;
+
+typedef struct MaterialAtlasArray {
+    GLuint id;
+    int width;
+    int height;
+    int numChannels; // 3 = GL_RGB8, 4 = GL_RGBA8
+    size_t numLayers;
+} MaterialAtlasArray;
+
+typedef struct MaterialAtlas {
+    std::vector<MaterialAtlasArray> arrays;
+    GLuint materialUBO;
+    size_t numMaterials;
+    size_t numResampled; // textures that didn't match their array's size/format
+} MaterialAtlas;
+
+// bilinear resample and/or channel conversion of 8 bit pixels
+static std::vector<unsigned char> resampleMaterialImage(const unsigned char* src,
+                                                        int srcWidth, int srcHeight, int srcChannels,
+                                                        int dstWidth, int dstHeight, int dstChannels)
+{
+    std::vector<unsigned char> dst((size_t)dstWidth * dstHeight * dstChannels);
+    float scaleX = (float)srcWidth / dstWidth;
+    float scaleY = (float)srcHeight / dstHeight;
+    for (int y = 0; y < dstHeight; ++y)
+    {
+        float sy = std::min(std::max((y + 0.5f) * scaleY - 0.5f, 0.0f), (float)(srcHeight - 1));
+        int y0 = (int)sy;
+        int y1 = std::min(y0 + 1, srcHeight - 1);
+        float fy = sy - y0;
+        for (int x = 0; x < dstWidth; ++x)
+        {
+            float sx = std::min(std::max((x + 0.5f) * scaleX - 0.5f, 0.0f), (float)(srcWidth - 1));
+            int x0 = (int)sx;
+            int x1 = std::min(x0 + 1, srcWidth - 1);
+            float fx = sx - x0;
+            for (int c = 0; c < dstChannels; ++c)
+            {
+                // missing alpha is opaque
+                if (c >= srcChannels) {
+                    dst[((size_t)y * dstWidth + x) * dstChannels + c] = 255;
+                    continue;
+                }
+                #define PIXEL(px, py) src[((size_t)(py) * srcWidth + (px)) * srcChannels + c]
+                float top = PIXEL(x0, y0) * (1.0f - fx) + PIXEL(x1, y0) * fx;
+                float bottom = PIXEL(x0, y1) * (1.0f - fx) + PIXEL(x1, y1) * fx;
+                #undef PIXEL
+                dst[((size_t)y * dstWidth + x) * dstChannels + c] =
+                    (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return dst;
+}
+
+MaterialAtlas createMaterialAtlas(const std::vector<MaterialDesc>& materials)
+{
+    MaterialAtlas atlas;
+    atlas.numMaterials = std::min<size_t>(materials.size(), MATERIAL_ATLAS_MAX_MATERIALS);
+    atlas.numResampled = 0;
+    if (materials.size() > MATERIAL_ATLAS_MAX_MATERIALS) {
+        std::cout << "MaterialAtlas: only the first " << MATERIAL_ATLAS_MAX_MATERIALS
+            << " of " << materials.size() << " materials are used" << std::endl;
+    }
+
+    // unique files, and their size/format without decoding them
+    struct ImageInfo {
+        std::string fileName;
+        int width;
+        int height;
+        int numChannels;
+        int array;
+        int layer;
+    };
+    std::vector<ImageInfo> images;
+    std::map<std::string, size_t> imageIndices;
+    for (size_t i = 0; i < atlas.numMaterials; ++i)
+    {
+        const std::string* files[2] = { &materials[i].diffuseFile, &materials[i].specularFile };
+        for (const std::string* file : files)
+        {
+            if (file->empty() || imageIndices.count(*file)) {
+                continue;
+            }
+            ImageInfo info;
+            info.fileName = *file;
+            if (!stbi_info(file->c_str(), &info.width, &info.height, &info.numChannels)) {
+                std::cout << "MaterialAtlas: failed to read " << *file << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            info.numChannels = (info.numChannels == 4 || info.numChannels == 2) ? 4 : 3;
+            imageIndices[*file] = images.size();
+            images.push_back(info);
+        }
+    }
+
+    // bucket by size and format, most used bucket first
+    std::map<std::vector<int>, std::vector<size_t>> buckets;
+    for (size_t i = 0; i < images.size(); ++i) {
+        buckets[{ images[i].width, images[i].height, images[i].numChannels }].push_back(i);
+    }
+    std::vector<std::pair<std::vector<int>, std::vector<size_t>>> sortedBuckets(buckets.begin(), buckets.end());
+    std::stable_sort(sortedBuckets.begin(), sortedBuckets.end(),
+        [](const std::pair<std::vector<int>, std::vector<size_t>>& a,
+           const std::pair<std::vector<int>, std::vector<size_t>>& b) {
+            return a.second.size() > b.second.size();
+        });
+    // fold the extra buckets into the kept one with the most texels per
+    // layer, so they are scaled up rather than losing detail; an RGBA
+    // texture forces it to RGBA
+    if (sortedBuckets.size() > MATERIAL_ATLAS_MAX_ARRAYS)
+    {
+        size_t largest = 0;
+        for (size_t b = 1; b < MATERIAL_ATLAS_MAX_ARRAYS; ++b)
+        {
+            const std::vector<int>& key = sortedBuckets[b].first;
+            const std::vector<int>& largestKey = sortedBuckets[largest].first;
+            if ((long long)key[0] * key[1] > (long long)largestKey[0] * largestKey[1]) {
+                largest = b;
+            }
+        }
+        while (sortedBuckets.size() > MATERIAL_ATLAS_MAX_ARRAYS)
+        {
+            std::vector<size_t>& extra = sortedBuckets.back().second;
+            if (sortedBuckets.back().first[2] == 4) {
+                sortedBuckets[largest].first[2] = 4;
+            }
+            sortedBuckets[largest].second.insert(sortedBuckets[largest].second.end(),
+                extra.begin(), extra.end());
+            sortedBuckets.pop_back();
+        }
+    }
+
+    // one array per bucket
+    stbi_set_flip_vertically_on_load(true);
+    for (size_t b = 0; b < sortedBuckets.size(); ++b)
+    {
+        MaterialAtlasArray array;
+        array.width = sortedBuckets[b].first[0];
+        array.height = sortedBuckets[b].first[1];
+        array.numChannels = sortedBuckets[b].first[2];
+        array.numLayers = sortedBuckets[b].second.size();
+        GLenum format = array.numChannels == 4 ? GL_RGBA : GL_RGB;
+
+        glGenTextures(1, &array.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY,
+            0,
+            array.numChannels == 4 ? GL_RGBA8 : GL_RGB8,
+            array.width,
+            array.height,
+            array.numLayers,
+            0,
+            format,
+            GL_UNSIGNED_BYTE,
+            NULL);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (size_t layer = 0; layer < array.numLayers; ++layer)
+        {
+            ImageInfo& info = images[sortedBuckets[b].second[layer]];
+            info.array = (int)b;
+            info.layer = (int)layer;
+
+            std::cout << "MaterialAtlas: loading " << info.fileName << " into array "
+                << b << " layer " << layer << std::endl;
+            int width, height, numChannels;
+            unsigned char* data = stbi_load(info.fileName.c_str(), &width, &height, &numChannels,
+                info.numChannels);
+            if (!data) {
+                std::cout << "MaterialAtlas: failed to load " << info.fileName << std::endl;
+                exit(EXIT_FAILURE);
+            }
+
+            if (width == array.width && height == array.height && info.numChannels == array.numChannels) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer,
+                    width, height, 1, format, GL_UNSIGNED_BYTE, data);
+            } else {
+                std::vector<unsigned char> resampled = resampleMaterialImage(data,
+                    width, height, info.numChannels,
+                    array.width, array.height, array.numChannels);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer,
+                    array.width, array.height, 1, format, GL_UNSIGNED_BYTE, &resampled[0]);
+                atlas.numResampled++;
+            }
+            stbi_image_free(data);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        atlas.arrays.push_back(array);
+    }
+
+    // material table, std140 array of ivec4
+    std::vector<GLint> table(MATERIAL_ATLAS_MAX_MATERIALS * 4, -1);
+    for (size_t i = 0; i < atlas.numMaterials; ++i)
+    {
+        if (!materials[i].diffuseFile.empty()) {
+            const ImageInfo& info = images[imageIndices[materials[i].diffuseFile]];
+            table[i * 4 + 0] = info.array;
+            table[i * 4 + 1] = info.layer;
+        }
+        if (!materials[i].specularFile.empty()) {
+            const ImageInfo& info = images[imageIndices[materials[i].specularFile]];
+            table[i * 4 + 2] = info.array;
+            table[i * 4 + 3] = info.layer;
+        }
+    }
+    glGenBuffers(1, &atlas.materialUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, atlas.materialUBO);
+    glBufferData(GL_UNIFORM_BUFFER, table.size() * sizeof(GLint), &table[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    std::cout << "MaterialAtlas: " << atlas.numMaterials << " materials, "
+        << images.size() << " textures in " << atlas.arrays.size() << " arrays ("
+        << atlas.numResampled << " resampled)" << std::endl;
+
+    return atlas;
+}
+
+// point a program's atlas samplers and material table at the units/binding
+// bindMaterialAtlas uses. Only needs to be called once per program
+void setupMaterialAtlasShader(GLuint programID)
+{
+    glUseProgram(programID);
+    for (int i = 0; i < MATERIAL_ATLAS_MAX_ARRAYS; ++i)
+    {
+        std::string name = "uMaterialArray" + std::to_string(i);
+        glUniform1i(glGetUniformLocation(programID, name.c_str()),
+            MATERIAL_ATLAS_FIRST_TEXTURE_UNIT + i);
+    }
+    GLuint blockIndex = glGetUniformBlockIndex(programID, "MaterialTable");
+    glUniformBlockBinding(programID, blockIndex, MATERIAL_ATLAS_UBO_BINDING);
+}
+
+// bind everything needed to draw any mesh of the model
+void bindMaterialAtlas(const MaterialAtlas& atlas)
+{
+    for (size_t i = 0; i < atlas.arrays.size(); ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + MATERIAL_ATLAS_FIRST_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.arrays[i].id);
+        gMaterialTextureBinds++;
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_ATLAS_UBO_BINDING, atlas.materialUBO);
+}
+
+#endif // !MATERIAL_ATLAS_H_INCLUDED
@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 
 #include "Vertex.h"
+#include "BoundingBox.h"
 #include "Texture.h"
 #include "ShaderProgram.h"
 
@@ -18,11 +19,13 @@ public:
 
     void Init(const std::vector<Vertex>& vertices,
         const std::vector<GLuint>& indices,
-        const std::vector<Texture>& textures)
+        const std::vector<Texture>& textures,
+        const BoundingBox& bounds)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->bounds = bounds;
 
         setupMesh();
     }
@@ -72,10 +75,17 @@ public:
                 materialNumStr.c_str());
             glUniform1i(materialLoc, i);
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            gMaterialTextureBinds++;
         }
         glActiveTexture(GL_TEXTURE0);
 
-        // draw the mesh
+        DrawGeometry();
+    }
+
+    // draw without touching any textures or uniforms, e.g. when the
+    // textures come from a MaterialAtlas bound once for the whole model
+    void DrawGeometry()
+    {
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
@@ -84,6 +94,8 @@ public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    BoundingBox bounds; // local (model) space
+    int materialIndex = -1; // into the model's MaterialAtlas
 
 private:
     GLuint VAO; // vertex array object
@@ -107,19 +119,20 @@ private:
             &indices[0], GL_STATIC_DRAW);
 
         // vertex attributes
-        size_t floatsPerVertex = 8;
         size_t floatsPerPosition = 3;
         size_t floatsPerNormal = 3;
         size_t floatsPerTexCoord = 2;
         int posAttribLocation = 0; // aPos, where we set location = 0
         int normalAttribLocation = 1; // aNormal, where we set location = 1
         int texAttribLocation = 2; // aTexCoord, where we set location = 2
+        int tangentAttribLocation = 3; // aTangent, where we set location = 3
         int dataType = GL_FLOAT;
         int shouldNormalize = GL_FALSE;
-        int vertexStride = floatsPerVertex * sizeof(GLfloat);
+        int vertexStride = sizeof(Vertex);
         void* posBeginOffset = (void*)0;
         void* normalBeginOffset = (void*)(offsetof(Vertex, Normal));
         void* texBeginOffset = (void*)(offsetof(Vertex, TexCoord));
+        void* tangentBeginOffset = (void*)(offsetof(Vertex, Tangent));
         glVertexAttribPointer(posAttribLocation,
             floatsPerPosition,
             dataType,
@@ -141,6 +154,14 @@ private:
             vertexStride,
             texBeginOffset);
         glEnableVertexAttribArray(texAttribLocation);
+        // xyz and the bitangent sign in w, each read back as -1..1
+        glVertexAttribPointer(tangentAttribLocation,
+            4,
+            GL_INT_2_10_10_10_REV,
+            GL_TRUE,
+            vertexStride,
+            tangentBeginOffset);
+        glEnableVertexAttribArray(tangentAttribLocation);
 
         // unbind the vertex array
         glBindVertexArray(0);
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <chrono>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -14,6 +15,11 @@
 #include "Texture.h"
 #include "Shader.h"
 #include "Vertex.h"
+#include "BoundingBox.h"
+#include "MaterialAtlas.h"
+#include "CpuProfiler.h"
+#include "TangentSpace.h"
+#include "ThreadPool.h"
 
 class Model
 {
@@ -22,11 +28,18 @@ public:
     Model() {}
     ~Model() {}
 
-    void Load(const std::string& filePath)
+    // threadPool, if given, generates the tangents in parallel
+    void Load(const std::string& filePath, ThreadPool* threadPool = nullptr)
     {
+        CPU_ZONE("Model import");
+        auto importStart = std::chrono::steady_clock::now();
         Assimp::Importer import;
-        const aiScene* scene = import.ReadFile(filePath,
-            aiProcess_Triangulate | aiProcess_FlipUVs);
+        const aiScene* scene = nullptr;
+        {
+            CPU_ZONE("Assimp ReadFile");
+            scene = import.ReadFile(filePath,
+                aiProcess_Triangulate | aiProcess_FlipUVs);
+        }
 
         if (!scene || 
             scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || 
@@ -38,45 +51,143 @@ public:
 
         directory = filePath.substr(0, filePath.find_last_of('/'));
 
-        processNode(scene->mRootNode, scene);
+        double tangentMs = 0.0;
+        size_t numVertices = 0;
+        size_t numSplitVertices = 0;
+        {
+            CPU_ZONE("Process nodes");
+            std::vector<aiMesh*> sceneMeshes;
+            processNode(scene->mRootNode, scene, sceneMeshes);
+
+            // every mesh's geometry first, so all their tangents can be
+            // generated at once
+            std::vector<std::vector<Vertex>> meshVertices(sceneMeshes.size());
+            std::vector<std::vector<GLuint>> meshIndices(sceneMeshes.size());
+            std::vector<BoundingBox> meshBounds(sceneMeshes.size());
+            std::vector<TangentSpaceMesh> tangentMeshes;
+            for (size_t i = 0; i < sceneMeshes.size(); i++)
+            {
+                processMeshGeometry(sceneMeshes[i], meshVertices[i], meshIndices[i], meshBounds[i]);
+                tangentMeshes.push_back(createTangentSpaceMesh(meshVertices[i], meshIndices[i]));
+            }
+
+            auto tangentStart = std::chrono::steady_clock::now();
+            generateTangentSpaces(tangentMeshes, threadPool);
+            tangentMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - tangentStart).count();
+
+            for (size_t i = 0; i < sceneMeshes.size(); i++)
+            {
+                numVertices += meshVertices[i].size();
+                numSplitVertices += tangentMeshes[i].numSplitVertices;
+                meshes.push_back(processMesh(sceneMeshes[i], scene,
+                    meshVertices[i], meshIndices[i], meshBounds[i]));
+                growBoundingBox(bounds, meshes.back().bounds);
+            }
+        }
+
+        // pack the textures of every material into texture arrays; the
+        // atlas only takes the first layer of each type
+        materials.resize(scene->mNumMaterials);
+        size_t numLayered = 0;
+        for (size_t i = 0; i < scene->mNumMaterials; i++)
+        {
+            getMaterialFiles(scene->mMaterials[i], aiTextureType_DIFFUSE,
+                materials[i].diffuseFile, materials[i].extraDiffuseFiles);
+            getMaterialFiles(scene->mMaterials[i], aiTextureType_SPECULAR,
+                materials[i].specularFile, materials[i].extraSpecularFiles);
+            if (!materials[i].extraDiffuseFiles.empty() || !materials[i].extraSpecularFiles.empty()) {
+                numLayered++;
+            }
+        }
+        if (numLayered > 0) {
+            std::cout << "Model: " << numLayered << " materials have more than one diffuse or"
+                << " specular texture; the material atlas only uses the first of each" << std::endl;
+        }
+        {
+            CPU_ZONE("Material atlas");
+            materialAtlas = createMaterialAtlas(materials);
+        }
+
+        double importMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - importStart).count();
+        std::cout << "Model import: " << importMs << " ms, tangent space "
+            << tangentMs << " ms (" << 100.0 * tangentMs / importMs << "%) on "
+            << (threadPool ? threadPool->NumThreads() : 1) << " threads, "
+            << numVertices << " vertices (" << numSplitVertices
+            << " split for mirrored uvs)" << std::endl;
     }
 
     void Draw(const ShaderProgram& shader)
     {
+        loadMeshTextures();
         for (Mesh& mesh : meshes)
         {
             mesh.Draw(shader);
         }
     }
 
+    // draw a single mesh, e.g. one that survived culling
+    void DrawMesh(size_t index, const ShaderProgram& shader)
+    {
+        loadMeshTextures();
+        meshes[index].Draw(shader);
+    }
+
+    // bind the material atlas once, then draw any number of meshes with
+    // DrawMeshWithAtlas. The shader must have been set up with
+    // setupMaterialAtlasShader
+    void BindMaterialAtlas()
+    {
+        bindMaterialAtlas(materialAtlas);
+    }
+
+    void DrawMeshWithAtlas(size_t index, GLint materialIndexLoc)
+    {
+        glUniform1i(materialIndexLoc, meshes[index].materialIndex);
+        meshes[index].DrawGeometry();
+    }
+
+    size_t NumMeshes() const { return meshes.size(); }
+    const BoundingBox& GetMeshBounds(size_t index) const { return meshes[index].bounds; }
+    const BoundingBox& GetBounds() const { return bounds; }
+
 private:
 
     std::vector<Mesh> meshes;
     std::string directory;
+    BoundingBox bounds = createEmptyBoundingBox(); // union of all mesh bounds
 
     std::vector<Texture> loaded_textures; // keep track of already loaded
+    std::vector<MaterialDesc> materials; // texture files per material
+    MaterialAtlas materialAtlas;
+    bool meshTexturesLoaded = false;
 
-    void processNode(aiNode* node, const aiScene* scene)
+    // collects the meshes of node and its children, in draw order
+    void processNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& sceneMeshes)
     {
         // process node meshes, if any
         for (size_t i = 0; i < node->mNumMeshes; i++)
         {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
 
         // process the node children, if any
         for (size_t i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
         }
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // vertices (without tangents) and indices; no GL calls
+    void processMeshGeometry(aiMesh* mesh,
+        std::vector<Vertex>& vertices,
+        std::vector<GLuint>& indices,
+        BoundingBox& meshBounds)
     {
-        std::vector<Vertex> vertices;
-        std::vector<GLuint> indices;
-        std::vector<Texture> textures;
+        meshBounds = createEmptyBoundingBox();
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         for (size_t i = 0; i < mesh->mNumVertices; i++)
         {
@@ -85,6 +196,7 @@ private:
             vertex.Position.x = mesh->mVertices[i].x;
             vertex.Position.y = mesh->mVertices[i].y;
             vertex.Position.z = mesh->mVertices[i].z;
+            growBoundingBox(meshBounds, vertex.Position);
 
             vertex.Normal.x = mesh->mNormals[i].x;
             vertex.Normal.y = mesh->mNormals[i].y;
@@ -100,6 +212,7 @@ private:
                 vertex.TexCoord.x = 0.0f;
                 vertex.TexCoord.y = 0.0f;
             }
+            vertex.Tangent = 0;
 
             vertices.push_back(vertex);
         }
@@ -112,57 +225,90 @@ private:
                 indices.push_back(face.mIndices[j]);
             }
         }
+    }
 
-        if (mesh->mMaterialIndex >= 0)
-        {
-            aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-            
-            std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
-                    aiTextureType_DIFFUSE,
-                    TextureType::Diffuse);
-            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-            std::vector<Texture> specularMaps = loadMaterialTextures(material, 
-                aiTextureType_SPECULAR, TextureType::Specular);
-            textures.insert(textures.end(), 
-                specularMaps.begin(), 
-                specularMaps.end());
-        }
-
+    // the textures are left to loadMeshTextures
+    Mesh processMesh(aiMesh* mesh,
+        const aiScene* scene,
+        const std::vector<Vertex>& vertices,
+        const std::vector<GLuint>& indices,
+        const BoundingBox& meshBounds)
+    {
         Mesh myMesh;
-        myMesh.Init(vertices, indices, textures);
+        myMesh.Init(vertices, indices, std::vector<Texture>(), meshBounds);
+        myMesh.materialIndex = mesh->mMaterialIndex;
         return myMesh;
     }
 
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat,
-        aiTextureType type, TextureType typeName)
+    // the material atlas already holds every texture, so the per mesh
+    // copies are only loaded the first time the model is drawn without it
+    void loadMeshTextures()
+    {
+        if (meshTexturesLoaded) {
+            return;
+        }
+        meshTexturesLoaded = true;
+
+        CPU_ZONE("Mesh textures");
+        for (Mesh& mesh : meshes)
+        {
+            if (mesh.materialIndex < 0 || mesh.materialIndex >= (int)materials.size()) {
+                continue;
+            }
+            const MaterialDesc& material = materials[mesh.materialIndex];
+            if (!material.diffuseFile.empty()) {
+                mesh.textures.push_back(loadMaterialTexture(material.diffuseFile, TextureType::Diffuse));
+            }
+            for (const std::string& file : material.extraDiffuseFiles) {
+                mesh.textures.push_back(loadMaterialTexture(file, TextureType::Diffuse));
+            }
+            if (!material.specularFile.empty()) {
+                mesh.textures.push_back(loadMaterialTexture(material.specularFile, TextureType::Specular));
+            }
+            for (const std::string& file : material.extraSpecularFiles) {
+                mesh.textures.push_back(loadMaterialTexture(file, TextureType::Specular));
+            }
+        }
+    }
+
+    // every texture of one type in the material: the first in first, the
+    // rest in extra
+    void getMaterialFiles(const aiMaterial* material, aiTextureType type,
+        std::string& first, std::vector<std::string>& extra)
     {
-        std::vector<Texture> textures;
-        for (size_t i = 0; i < mat->GetTextureCount(type); i++)
+        for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
         {
             aiString str;
-            mat->GetTexture(type, i, &str);
-            std::string fullName = directory + "/" + std::string(str.C_Str());
-            bool alreadyLoaded = false;
-            for (auto& loadedTexture : loaded_textures)
-            {
-                if (loadedTexture.fileName == fullName)
-                {
-                    alreadyLoaded = true;
-                    textures.push_back(loadedTexture);
-                    break;
-                }
+            if (material->GetTexture(type, i, &str) != AI_SUCCESS) {
+                continue;
+            }
+            std::string file = directory + "/" + std::string(str.C_Str());
+            if (first.empty()) {
+                first = file;
             }
-            if (!alreadyLoaded) {
-                std::cout << "Model loading texture: " << fullName << std::endl;
-                Texture texture = createTexture(fullName);
+            else {
+                extra.push_back(file);
+            }
+        }
+    }
+
+    Texture loadMaterialTexture(const std::string& fullName, TextureType typeName)
+    {
+        for (const Texture& loadedTexture : loaded_textures)
+        {
+            if (loadedTexture.fileName == fullName) {
+                Texture texture = loadedTexture;
                 texture.type = typeName;
-                textures.push_back(texture);
-                loaded_textures.push_back(texture);
+                return texture;
             }
         }
 
-        return textures;
+        std::cout << "Model loading texture: " << fullName << std::endl;
+        CPU_ZONE("Texture decode");
+        Texture texture = createTexture(fullName);
+        texture.type = typeName;
+        loaded_textures.push_back(texture);
+        return texture;
     }
 };
 
@@ -0,0 +1,469 @@
+#ifndef OCCLUSION_BUFFER_H_INCLUDED
+#define OCCLUSION_BUFFER_H_INCLUDED
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "BoundingBox.h"
+#include "ThreadPool.h"
+#include "CpuProfiler.h"
+
+// low resolution software depth buffer used to cull objects hidden behind
+// large occluders before they are sent to the GPU. Has no OpenGL
+// dependencies so it can be run and checked entirely on the CPU.
+//
+// Results are conservative: an occluder only writes pixels it covers
+// completely (not just the pixel center), writing the farthest depth it
+// has inside that pixel, and an occludee is only rejected if every pixel
+// under its screen rectangle has an occluder strictly in front of its
+// nearest point
+
+#define OCCLUSION_TILE_SIZE 8
+
+typedef struct OcclusionBuffer {
+    std::vector<float> depth;        // per pixel, 0 = near plane, 1 = far plane
+    std::vector<float> tileMaxDepth; // farthest depth in each 8x8 tile
+    size_t width;  // must be a multiple of OCCLUSION_TILE_SIZE
+    size_t height; // must be a multiple of OCCLUSION_TILE_SIZE
+    size_t tilesX;
+    size_t tilesY;
+} OcclusionBuffer;
+
+// convex occluder polygon after near plane clipping and projection;
+// x,y are in pixels and z is depth in [0,1]
+#define OCCLUSION_MAX_POLYGON_VERTS 8
+typedef struct OcclusionPolygon {
+    glm::vec3 v[OCCLUSION_MAX_POLYGON_VERTS];
+    int numVerts;
+} OcclusionPolygon;
+
+typedef struct OcclusionStats {
+    size_t numOccluderPolygons;
+    size_t numTested;
+    size_t numOccluded;
+    double rasterTimeMicroseconds;
+    double testTimeMicroseconds;
+} OcclusionStats;
+
+OcclusionBuffer createOcclusionBuffer(size_t width = 256, size_t height = 128)
+{
+    OcclusionBuffer buffer;
+    buffer.width = width;
+    buffer.height = height;
+    buffer.tilesX = width / OCCLUSION_TILE_SIZE;
+    buffer.tilesY = height / OCCLUSION_TILE_SIZE;
+    buffer.depth.resize(width * height, 1.0f);
+    buffer.tileMaxDepth.resize(buffer.tilesX * buffer.tilesY, 1.0f);
+    return buffer;
+}
+
+// clip a convex polygon against the near plane (z >= -w) in clip space
+// and project the result to the screen
+static void clipAndProjectOcclusionPolygon(const glm::vec4* clip, int numClipVerts,
+                                           float width, float height,
+                                           std::vector<OcclusionPolygon>& out)
+{
+    OcclusionPolygon poly;
+    glm::vec4 clipped[OCCLUSION_MAX_POLYGON_VERTS];
+    int numVerts = 0;
+    for (int i = 0; i < numClipVerts; ++i)
+    {
+        const glm::vec4& a = clip[i];
+        const glm::vec4& b = clip[(i + 1) % numClipVerts];
+        float da = a.z + a.w;
+        float db = b.z + b.w;
+        if (da >= 0.0f) {
+            clipped[numVerts++] = a;
+        }
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+            float t = da / (da - db);
+            clipped[numVerts++] = a + (b - a) * t;
+        }
+    }
+    if (numVerts < 3) {
+        return;
+    }
+
+    poly.numVerts = numVerts;
+    for (int i = 0; i < numVerts; ++i)
+    {
+        float invW = 1.0f / clipped[i].w;
+        poly.v[i].x = (clipped[i].x * invW * 0.5f + 0.5f) * width;
+        poly.v[i].y = (clipped[i].y * invW * 0.5f + 0.5f) * height;
+        poly.v[i].z = clipped[i].z * invW * 0.5f + 0.5f;
+    }
+    out.push_back(poly);
+}
+
+// transform world space occluder quads (4 vertices each, planar and convex,
+// e.g. the faces of a box) to screen space. Quads are used instead of
+// triangles because pixels along a shared diagonal would not be fully
+// covered by either triangle and would leave cracks in the buffer
+void setupOcclusionPolygons(const std::vector<glm::vec3>& worldQuads,
+                            const glm::mat4& projView,
+                            const OcclusionBuffer& buffer,
+                            std::vector<OcclusionPolygon>& out)
+{
+    out.clear();
+    for (size_t i = 0; i + 3 < worldQuads.size(); i += 4)
+    {
+        glm::vec4 clip[4];
+        for (int v = 0; v < 4; ++v) {
+            clip[v] = projView * glm::vec4(worldQuads[i + v], 1.0f);
+        }
+
+        // trivially reject quads fully outside one of the side planes
+        bool outside = false;
+        for (int axis = 0; axis < 2 && !outside; ++axis)
+        {
+            bool allAbove = true;
+            bool allBelow = true;
+            for (int v = 0; v < 4; ++v) {
+                allAbove = allAbove && clip[v][axis] > clip[v].w;
+                allBelow = allBelow && clip[v][axis] < -clip[v].w;
+            }
+            outside = allAbove || allBelow;
+        }
+        if (outside) {
+            continue;
+        }
+
+        clipAndProjectOcclusionPolygon(clip, 4, (float)buffer.width, (float)buffer.height, out);
+    }
+}
+
+// rasterize into rows [rowBegin, rowEnd) only, so separate
+// threads can each own a horizontal band of the buffer
+void rasterizeOcclusionPolygons(OcclusionBuffer& buffer,
+                                const std::vector<OcclusionPolygon>& polygons,
+                                size_t rowBegin, size_t rowEnd)
+{
+    std::fill(buffer.depth.begin() + rowBegin * buffer.width,
+              buffer.depth.begin() + rowEnd * buffer.width,
+              1.0f);
+
+    for (const OcclusionPolygon& poly : polygons)
+    {
+        const int n = poly.numVerts;
+
+        // plane of the polygon (Newell's method), gives the
+        // winding and the depth gradient in one go
+        glm::vec3 normal(0.0f);
+        float minXf = FLT_MAX, maxXf = -FLT_MAX, minYf = FLT_MAX, maxYf = -FLT_MAX;
+        for (int i = 0; i < n; ++i)
+        {
+            const glm::vec3& a = poly.v[i];
+            const glm::vec3& b = poly.v[(i + 1) % n];
+            normal.x += (a.y - b.y) * (a.z + b.z);
+            normal.y += (a.z - b.z) * (a.x + b.x);
+            normal.z += (a.x - b.x) * (a.y + b.y);
+            minXf = std::min(minXf, a.x);
+            maxXf = std::max(maxXf, a.x);
+            minYf = std::min(minYf, a.y);
+            maxYf = std::max(maxYf, a.y);
+        }
+        if (std::fabs(normal.z) < 1e-6f) {
+            continue; // edge on
+        }
+
+        int minX = std::max(0, (int)std::floor(minXf));
+        int maxX = std::min((int)buffer.width - 1, (int)std::ceil(maxXf));
+        int minY = std::max((int)rowBegin, (int)std::floor(minYf));
+        int maxY = std::min((int)rowEnd - 1, (int)std::ceil(maxYf));
+        if (minX > maxX || minY > maxY) {
+            continue;
+        }
+        minX &= ~3; // 4 pixels at a time
+
+        // edge functions E(x,y) = A*x + B*y + C, positive inside.
+        // Subtracting half the pixel footprint from each means a
+        // pixel only passes if all four of its corners are inside
+        const float winding = normal.z > 0.0f ? 1.0f : -1.0f;
+        float A[OCCLUSION_MAX_POLYGON_VERTS];
+        float B[OCCLUSION_MAX_POLYGON_VERTS];
+        float C[OCCLUSION_MAX_POLYGON_VERTS];
+        for (int e = 0; e < n; ++e)
+        {
+            const glm::vec3& a = poly.v[e];
+            const glm::vec3& b = poly.v[(e + 1) % n];
+            A[e] = (a.y - b.y) * winding;
+            B[e] = (b.x - a.x) * winding;
+            C[e] = -A[e] * a.x - B[e] * a.y - 0.5f * (std::fabs(A[e]) + std::fabs(B[e]));
+        }
+
+        // depth plane, biased to the farthest point within a pixel
+        float dzdx = -normal.x / normal.z;
+        float dzdy = -normal.y / normal.z;
+        float zC = poly.v[0].z - dzdx * poly.v[0].x - dzdy * poly.v[0].y +
+                   0.5f * (std::fabs(dzdx) + std::fabs(dzdy));
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            float* row = &buffer.depth[y * buffer.width];
+#ifdef __SSE2__
+            const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 rowZ = _mm_set1_ps(dzdy * py + zC);
+            const __m128 dzdx4 = _mm_set1_ps(dzdx);
+            __m128 rowE[OCCLUSION_MAX_POLYGON_VERTS];
+            __m128 edgeA[OCCLUSION_MAX_POLYGON_VERTS];
+            for (int e = 0; e < n; ++e) {
+                rowE[e] = _mm_set1_ps(B[e] * py + C[e]);
+                edgeA[e] = _mm_set1_ps(A[e]);
+            }
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), rowE[0]), zero);
+                for (int e = 1; e < n; ++e) {
+                    inside = _mm_and_ps(inside,
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[e], px), rowE[e]), zero));
+                }
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                __m128 z = _mm_add_ps(_mm_mul_ps(dzdx4, px), rowZ);
+                __m128 old = _mm_loadu_ps(&row[x]);
+                __m128 closer = _mm_min_ps(old, z);
+                _mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, closer),
+                                                 _mm_andnot_ps(inside, old)));
+            }
+#else
+            for (int x = minX; x <= maxX; ++x)
+            {
+                float px = x + 0.5f;
+                bool inside = true;
+                for (int e = 0; e < n && inside; ++e) {
+                    inside = A[e] * px + B[e] * py + C[e] >= 0.0f;
+                }
+                if (!inside) {
+                    continue;
+                }
+                float z = dzdx * px + dzdy * py + zC;
+                row[x] = std::min(row[x], z);
+            }
+#endif
+        }
+    }
+
+    // update the hierarchical level for the tiles in this band
+    for (size_t ty = rowBegin / OCCLUSION_TILE_SIZE; ty < rowEnd / OCCLUSION_TILE_SIZE; ++ty)
+    {
+        for (size_t tx = 0; tx < buffer.tilesX; ++tx)
+        {
+            float maxDepth = 0.0f;
+            for (size_t y = 0; y < OCCLUSION_TILE_SIZE; ++y)
+            {
+                const float* row = &buffer.depth[(ty * OCCLUSION_TILE_SIZE + y) * buffer.width +
+                                                 tx * OCCLUSION_TILE_SIZE];
+                for (size_t x = 0; x < OCCLUSION_TILE_SIZE; ++x) {
+                    maxDepth = std::max(maxDepth, row[x]);
+                }
+            }
+            buffer.tileMaxDepth[ty * buffer.tilesX + tx] = maxDepth;
+        }
+    }
+}
+
+// returns true only if the box is certainly hidden behind the rasterized occluders
+bool isBoundingBoxOccluded(const OcclusionBuffer& buffer,
+                           const BoundingBox& box,
+                           const glm::mat4& projView)
+{
+    float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+    float maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? box.max.x : box.min.x,
+                         (i & 2) ? box.max.y : box.min.y,
+                         (i & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = projView * glm::vec4(corner, 1.0f);
+        // crosses the near plane: treat as visible
+        if (clip.w <= 0.0f || clip.z < -clip.w) {
+            return false;
+        }
+        float invW = 1.0f / clip.w;
+        float sx = (clip.x * invW * 0.5f + 0.5f) * buffer.width;
+        float sy = (clip.y * invW * 0.5f + 0.5f) * buffer.height;
+        float sz = clip.z * invW * 0.5f + 0.5f;
+        minX = std::min(minX, sx);
+        maxX = std::max(maxX, sx);
+        minY = std::min(minY, sy);
+        maxY = std::max(maxY, sy);
+        minZ = std::min(minZ, sz);
+    }
+
+    int x0 = std::max(0, (int)std::floor(minX));
+    int x1 = std::min((int)buffer.width - 1, (int)std::floor(maxX));
+    int y0 = std::max(0, (int)std::floor(minY));
+    int y1 = std::min((int)buffer.height - 1, (int)std::floor(maxY));
+    if (x0 > x1 || y0 > y1) {
+        return false; // off screen; leave that to frustum culling
+    }
+
+    for (int ty = y0 / OCCLUSION_TILE_SIZE; ty <= y1 / OCCLUSION_TILE_SIZE; ++ty)
+    {
+        for (int tx = x0 / OCCLUSION_TILE_SIZE; tx <= x1 / OCCLUSION_TILE_SIZE; ++tx)
+        {
+            // every occluder pixel in the tile is in front: skip the pixels
+            if (buffer.tileMaxDepth[ty * buffer.tilesX + tx] < minZ) {
+                continue;
+            }
+
+            int px0 = std::max(x0, tx * OCCLUSION_TILE_SIZE);
+            int px1 = std::min(x1, tx * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+            int py0 = std::max(y0, ty * OCCLUSION_TILE_SIZE);
+            int py1 = std::min(y1, ty * OCCLUSION_TILE_SIZE + OCCLUSION_TILE_SIZE - 1);
+            for (int y = py0; y <= py1; ++y)
+            {
+                const float* row = &buffer.depth[y * buffer.width];
+                for (int x = px0; x <= px1; ++x) {
+                    if (row[x] >= minZ) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// runs the rasterization and occludee tests on a thread pool so the
+// calling thread can keep submitting GPU work in the meantime
+class OcclusionCuller
+{
+public:
+
+    OcclusionCuller() {}
+    ~OcclusionCuller() {}
+
+    void Init(ThreadPool* pool, size_t width = 256, size_t height = 128)
+    {
+        this->pool = pool;
+        buffer = createOcclusionBuffer(width, height);
+    }
+
+    // the occludee vector must stay alive and unchanged until End()
+    void Begin(const glm::mat4& projView,
+               const std::vector<glm::vec3>& occluderQuads,
+               const std::vector<BoundingBox>& occludees)
+    {
+        this->projView = projView;
+        this->occludees = &occludees;
+        visible.assign(occludees.size(), 1);
+        numOccluded = 0;
+        startTime = std::chrono::high_resolution_clock::now();
+
+        {
+            CPU_ZONE("Occlusion setup");
+            setupOcclusionPolygons(occluderQuads, projView, buffer, polygons);
+        }
+
+        // one band per worker; with no workers, one band on this thread
+        size_t numBands = std::max<size_t>(1, std::min(numWorkers(), buffer.tilesY));
+        size_t tileRowsPerBand = (buffer.tilesY + numBands - 1) / numBands;
+        numBands = (buffer.tilesY + tileRowsPerBand - 1) / tileRowsPerBand;
+        bandsRemaining = numBands;
+        for (size_t band = 0; band < numBands; ++band)
+        {
+            size_t rowBegin = band * tileRowsPerBand * OCCLUSION_TILE_SIZE;
+            size_t rowEnd = std::min(buffer.height, rowBegin + tileRowsPerBand * OCCLUSION_TILE_SIZE);
+            runTask([this, rowBegin, rowEnd]() {
+                CPU_ZONE("Occlusion raster");
+                rasterizeOcclusionPolygons(buffer, polygons, rowBegin, rowEnd);
+                // the last band to finish starts the occludee tests
+                if (--bandsRemaining == 0) {
+                    pushTestTasks();
+                }
+            });
+        }
+    }
+
+    // wait for the results of Begin()
+    void End()
+    {
+        if (numWorkers() > 0) {
+            CPU_ZONE("Occlusion wait");
+            pool->Wait();
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+
+        stats.numOccluderPolygons = polygons.size();
+        stats.numTested = visible.size();
+        stats.numOccluded = numOccluded;
+        stats.rasterTimeMicroseconds =
+            std::chrono::duration<double, std::micro>(rasterEndTime - startTime).count();
+        stats.testTimeMicroseconds =
+            std::chrono::duration<double, std::micro>(endTime - rasterEndTime).count();
+    }
+
+    bool IsVisible(size_t occludee) const { return visible[occludee] != 0; }
+    const OcclusionStats& GetStats() const { return stats; }
+    const OcclusionBuffer& GetBuffer() const { return buffer; }
+
+private:
+
+    ThreadPool* pool = nullptr;
+    OcclusionBuffer buffer;
+    std::vector<OcclusionPolygon> polygons;
+    const std::vector<BoundingBox>* occludees = nullptr;
+    std::vector<uint8_t> visible;
+    glm::mat4 projView;
+    std::atomic<size_t> bandsRemaining;
+    std::atomic<size_t> numOccluded;
+    std::chrono::high_resolution_clock::time_point startTime;
+    std::chrono::high_resolution_clock::time_point rasterEndTime;
+    OcclusionStats stats;
+
+    size_t numWorkers() const { return pool ? pool->NumThreads() : 0; }
+
+    // a pool without threads would never run the task, so run it here
+    void runTask(const std::function<void()>& task)
+    {
+        if (numWorkers() > 0) {
+            pool->Push(task);
+        } else {
+            task();
+        }
+    }
+
+    void pushTestTasks()
+    {
+        rasterEndTime = std::chrono::high_resolution_clock::now();
+
+        const size_t chunkSize = 256;
+        for (size_t begin = 0; begin < occludees->size(); begin += chunkSize)
+        {
+            size_t end = std::min(occludees->size(), begin + chunkSize);
+            runTask([this, begin, end]() {
+                CPU_ZONE("Occlusion test");
+                size_t occluded = 0;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    if (isBoundingBoxOccluded(buffer, (*occludees)[i], projView)) {
+                        visible[i] = 0;
+                        occluded++;
+                    }
+                }
+                numOccluded += occluded;
+            });
+        }
+    }
+};
+
+#endif // !OCCLUSION_BUFFER_H_INCLUDED
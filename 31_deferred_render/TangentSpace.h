@@ -0,0 +1,429 @@
+#ifndef TANGENT_SPACE_H_INCLUDED
+#define TANGENT_SPACE_H_INCLUDED
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+#include "ThreadPool.h"
+#include "CpuProfiler.h"
+
+// per vertex tangents for normal mapping, following the rules of
+// MikkTSpace (Mikkelsen's reference implementation, which Blender,
+// Substance and xNormal bake normal maps with), so a baked map decodes
+// back to the normal it was baked from:
+//   - vertices with the same position, normal and uv are welded first
+//   - every triangle gets the uv derivative of its positions, projected
+//     into the plane of each corner's normal
+//   - a vertex averages the triangles around it weighted by their angle
+//     at that corner, but only across triangles connected by an edge and
+//     with the same uv winding; a vertex where mirrored uvs meet gets one
+//     tangent for each side, so it is split
+//   - the bitangent isn't stored: it's sign * cross(normal, tangent),
+//     with sign = +1 for triangles whose uvs wind the same way as their
+//     positions
+// Mikk's optional smoothing angle threshold isn't implemented (it's off
+// by default, which is how baked maps use it)
+
+// GL_INT_2_10_10_10_REV, normalized: x, y, z in 10 bits, the sign in
+// the top 2. A sign of -1 is stored as -2, which reads back as -1 under
+// both GL 3.3's and 4.2's signed normalized conversions
+inline uint32_t packTangent(const glm::vec3& tangent, float sign)
+{
+    auto packComponent = [](float value) {
+        int32_t bits = (int32_t)std::lround(std::fmin(std::fmax(value, -1.0f), 1.0f) * 511.0f);
+        return (uint32_t)bits & 0x3FF;
+    };
+    uint32_t w = sign < 0.0f ? 2u : 1u; // -2 and 1 in 2 bit two's complement
+    return packComponent(tangent.x) |
+        packComponent(tangent.y) << 10 |
+        packComponent(tangent.z) << 20 |
+        w << 30;
+}
+
+// xyz normalized and the sign in w, the way the vertex shader sees it
+inline glm::vec4 unpackTangent(uint32_t packed)
+{
+    auto unpackComponent = [](uint32_t bits) {
+        int32_t value = (int32_t)(bits << 22) >> 22; // sign extend 10 bits
+        return std::fmax(float(value) / 511.0f, -1.0f);
+    };
+    return glm::vec4(unpackComponent(packed),
+        unpackComponent(packed >> 10),
+        unpackComponent(packed >> 20),
+        (packed >> 31) ? -1.0f : 1.0f);
+}
+
+// one mesh to generate tangents for; vertices and indices (triangles)
+// are updated in place, vertices may be appended by splits
+typedef struct TangentSpaceMesh {
+    std::vector<Vertex>* vertices;
+    std::vector<GLuint>* indices;
+    size_t numSplitVertices;
+
+    // working data
+    std::vector<GLuint> welded;         // per vertex: the first identical one
+    std::vector<glm::vec3> faceTangent; // per triangle, dPosition / du
+    std::vector<int> faceOrientation;   // per triangle: +1, -1 or 0 = uvs degenerate
+    std::vector<unsigned char> faceDegenerate; // per triangle: two corners in one place
+    std::vector<GLuint> cornerStart;    // per welded vertex, into corners
+    std::vector<GLuint> corners;        // index buffer positions, by vertex
+    std::vector<uint32_t> cornerTangent;
+} TangentSpaceMesh;
+
+inline TangentSpaceMesh createTangentSpaceMesh(std::vector<Vertex>& vertices,
+    std::vector<GLuint>& indices)
+{
+    TangentSpaceMesh mesh;
+    mesh.vertices = &vertices;
+    mesh.indices = &indices;
+    mesh.numSplitVertices = 0;
+    return mesh;
+}
+
+// small enough to spread a mesh over the workers, big enough that the
+// task overhead doesn't show
+const size_t TANGENT_SPACE_TASK_SIZE = 4096;
+
+// runs func(mesh, begin, end) over [0, count(mesh)) of every mesh, in
+// ranges spread over the pool, or inline without one (or one that has no
+// threads, which would never run them)
+inline void tangentSpaceForEach(std::vector<TangentSpaceMesh>& meshes,
+    ThreadPool* threadPool,
+    size_t taskSize,
+    const std::function<size_t(TangentSpaceMesh&)>& count,
+    const std::function<void(TangentSpaceMesh&, size_t, size_t)>& func)
+{
+    bool useThreads = threadPool && threadPool->NumThreads() > 0;
+    for (TangentSpaceMesh& mesh : meshes)
+    {
+        size_t total = count(mesh);
+        for (size_t begin = 0; begin < total; begin += taskSize)
+        {
+            size_t end = std::min(total, begin + taskSize);
+            TangentSpaceMesh* meshPtr = &mesh;
+            if (useThreads) {
+                threadPool->Push([meshPtr, begin, end, &func]() { func(*meshPtr, begin, end); });
+            }
+            else {
+                func(mesh, begin, end);
+            }
+        }
+    }
+    if (useThreads) {
+        threadPool->Wait();
+    }
+}
+
+// bitwise, like Mikk's welding
+struct TangentSpaceVertexKey
+{
+    float values[8];
+    bool operator==(const TangentSpaceVertexKey& other) const
+    {
+        return std::memcmp(values, other.values, sizeof(values)) == 0;
+    }
+};
+
+struct TangentSpaceVertexHash
+{
+    size_t operator()(const TangentSpaceVertexKey& key) const
+    {
+        uint32_t words[8];
+        std::memcpy(words, key.values, sizeof(words));
+        size_t hash = 2166136261u;
+        for (uint32_t word : words) {
+            hash = (hash ^ word) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+inline void weldTangentSpaceVertices(TangentSpaceMesh& mesh)
+{
+    const std::vector<Vertex>& vertices = *mesh.vertices;
+    mesh.welded.resize(vertices.size());
+    std::unordered_map<TangentSpaceVertexKey, GLuint, TangentSpaceVertexHash> firstVertex;
+    firstVertex.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vertex& vertex = vertices[i];
+        TangentSpaceVertexKey key = { {
+            vertex.Position.x, vertex.Position.y, vertex.Position.z,
+            vertex.Normal.x, vertex.Normal.y, vertex.Normal.z,
+            vertex.TexCoord.x, vertex.TexCoord.y } };
+        mesh.welded[i] = firstVertex.insert(std::make_pair(key, (GLuint)i)).first->second;
+    }
+}
+
+// Mikk's per triangle tangent: dP/du, normalized unless the uvs have no
+// area, and which way the uvs wind
+inline void computeFaceTangents(TangentSpaceMesh& mesh, size_t begin, size_t end)
+{
+    const std::vector<Vertex>& vertices = *mesh.vertices;
+    const std::vector<GLuint>& indices = *mesh.indices;
+    for (size_t face = begin; face < end; face++)
+    {
+        const Vertex& v0 = vertices[indices[face * 3 + 0]];
+        const Vertex& v1 = vertices[indices[face * 3 + 1]];
+        const Vertex& v2 = vertices[indices[face * 3 + 2]];
+        glm::vec3 d1 = v1.Position - v0.Position;
+        glm::vec3 d2 = v2.Position - v0.Position;
+        glm::vec2 t21 = v1.TexCoord - v0.TexCoord;
+        glm::vec2 t31 = v2.TexCoord - v0.TexCoord;
+
+        float signedUvArea = t21.x * t31.y - t21.y * t31.x;
+        glm::vec3 tangent = d1 * t31.y - d2 * t21.y;
+        mesh.faceDegenerate[face] = v0.Position == v1.Position ||
+            v0.Position == v2.Position ||
+            v1.Position == v2.Position;
+        if (signedUvArea != 0.0f)
+        {
+            mesh.faceOrientation[face] = signedUvArea > 0.0f ? 1 : -1;
+            float length = glm::length(tangent);
+            if (length > 0.0f) {
+                tangent = tangent * (float(mesh.faceOrientation[face]) / length);
+            }
+        }
+        else {
+            mesh.faceOrientation[face] = 0;
+        }
+        mesh.faceTangent[face] = tangent;
+    }
+}
+
+// counting sort of the index buffer positions by welded vertex
+inline void buildTangentSpaceCorners(TangentSpaceMesh& mesh)
+{
+    const std::vector<GLuint>& indices = *mesh.indices;
+    size_t numVertices = mesh.vertices->size();
+    mesh.cornerStart.assign(numVertices + 1, 0);
+    for (GLuint index : indices) {
+        mesh.cornerStart[mesh.welded[index] + 1]++;
+    }
+    for (size_t i = 0; i < numVertices; i++) {
+        mesh.cornerStart[i + 1] += mesh.cornerStart[i];
+    }
+    mesh.corners.resize(indices.size());
+    std::vector<GLuint> next(mesh.cornerStart.begin(), mesh.cornerStart.end() - 1);
+    for (size_t corner = 0; corner < indices.size(); corner++) {
+        mesh.corners[next[mesh.welded[indices[corner]]]++] = (GLuint)corner;
+    }
+}
+
+// any unit vector perpendicular to n
+inline glm::vec3 anyTangent(const glm::vec3& n)
+{
+    glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 tangent = axis - n * glm::dot(n, axis);
+    return tangent / glm::length(tangent);
+}
+
+// groups the triangles around welded vertices [begin, end) and writes
+// each group's averaged tangent to its corners
+inline void computeVertexTangents(TangentSpaceMesh& mesh, size_t begin, size_t end)
+{
+    const std::vector<Vertex>& vertices = *mesh.vertices;
+    const std::vector<GLuint>& indices = *mesh.indices;
+    std::vector<int> group;
+    std::vector<int> groupOrientation;
+    std::vector<glm::vec3> groupTangent;
+    std::vector<size_t> queue;
+
+    for (size_t vertex = begin; vertex < end; vertex++)
+    {
+        GLuint first = mesh.cornerStart[vertex];
+        size_t count = mesh.cornerStart[vertex + 1] - first;
+        if (count == 0) {
+            continue;
+        }
+        const GLuint* corners = &mesh.corners[first];
+        const glm::vec3& n = vertices[vertex].Normal;
+
+        // the welded vertices at either end of a corner's two edges
+        auto edgeVertex = [&](GLuint corner, int offset) {
+            GLuint face = corner / 3;
+            return mesh.welded[indices[face * 3 + (corner % 3 + offset) % 3]];
+        };
+        auto shareEdge = [&](GLuint a, GLuint b) {
+            GLuint a1 = edgeVertex(a, 1), a2 = edgeVertex(a, 2);
+            GLuint b1 = edgeVertex(b, 1), b2 = edgeVertex(b, 2);
+            return a1 == b1 || a1 == b2 || a2 == b1 || a2 == b2;
+        };
+
+        // flood fill over shared edges between triangles of the same
+        // winding; triangles with degenerate uvs join the first group
+        // they touch, like Mikk's GROUP_WITH_ANY
+        group.assign(count, -1);
+        groupOrientation.clear();
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (size_t seed = 0; seed < count; seed++)
+            {
+                int seedOrientation = mesh.faceOrientation[corners[seed] / 3];
+                if (group[seed] >= 0 || mesh.faceDegenerate[corners[seed] / 3] ||
+                    (pass == 0 && seedOrientation == 0)) {
+                    continue;
+                }
+                int newGroup = (int)groupOrientation.size();
+                groupOrientation.push_back(seedOrientation == 0 ? 1 : seedOrientation);
+                group[seed] = newGroup;
+                queue.assign(1, seed);
+                for (size_t next = 0; next < queue.size(); next++)
+                {
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        int orientation = mesh.faceOrientation[corners[i] / 3];
+                        if (group[i] < 0 && !mesh.faceDegenerate[corners[i] / 3] &&
+                            (orientation == 0 || orientation == groupOrientation[newGroup]) &&
+                            shareEdge(corners[i], corners[queue[next]])) {
+                            group[i] = newGroup;
+                            queue.push_back(i);
+                        }
+                    }
+                }
+            }
+        }
+
+        // angle weighted sum of the face tangents in the normal's plane
+        groupTangent.assign(groupOrientation.size(), glm::vec3(0.0f));
+        for (size_t i = 0; i < count; i++)
+        {
+            if (group[i] < 0) {
+                continue;
+            }
+            GLuint corner = corners[i];
+            glm::vec3 position = vertices[indices[corner]].Position;
+            glm::vec3 toPrev = vertices[indices[corner / 3 * 3 + (corner + 2) % 3]].Position - position;
+            glm::vec3 toNext = vertices[indices[corner / 3 * 3 + (corner + 1) % 3]].Position - position;
+            toPrev = toPrev - n * glm::dot(n, toPrev);
+            toNext = toNext - n * glm::dot(n, toNext);
+            float prevLength = glm::length(toPrev);
+            float nextLength = glm::length(toNext);
+            if (prevLength > 0.0f) {
+                toPrev = toPrev / prevLength;
+            }
+            if (nextLength > 0.0f) {
+                toNext = toNext / nextLength;
+            }
+            float angle = std::acos(glm::clamp(glm::dot(toPrev, toNext), -1.0f, 1.0f));
+
+            glm::vec3 tangent = mesh.faceTangent[corner / 3];
+            tangent = tangent - n * glm::dot(n, tangent);
+            float length = glm::length(tangent);
+            if (length > 0.0f) {
+                groupTangent[group[i]] += tangent * (angle / length);
+            }
+        }
+
+        for (size_t g = 0; g < groupTangent.size(); g++)
+        {
+            float length = glm::length(groupTangent[g]);
+            groupTangent[g] = length > 0.0f ? groupTangent[g] / length : anyTangent(n);
+        }
+
+        // corners of triangles without area take the vertex's first
+        // group, like Mikk's DegenEpilog
+        for (size_t i = 0; i < count; i++)
+        {
+            if (groupTangent.empty()) {
+                mesh.cornerTangent[corners[i]] = packTangent(anyTangent(n), 1.0f);
+                continue;
+            }
+            int g = group[i] >= 0 ? group[i] : 0;
+            mesh.cornerTangent[corners[i]] = packTangent(groupTangent[g], float(groupOrientation[g]));
+        }
+    }
+}
+
+// stores the corner tangents in the vertices, appending a copy of a
+// vertex for each extra tangent it needs
+inline void splitTangentSpaceVertices(TangentSpaceMesh& mesh)
+{
+    std::vector<Vertex>& vertices = *mesh.vertices;
+    std::vector<GLuint>& indices = *mesh.indices;
+    size_t numOriginal = vertices.size();
+    std::vector<bool> assigned(numOriginal, false);
+    // (vertex, tangent) -> the copy that has it
+    std::unordered_map<uint64_t, GLuint> copies;
+    for (size_t corner = 0; corner < indices.size(); corner++)
+    {
+        GLuint index = indices[corner];
+        uint32_t tangent = mesh.cornerTangent[corner];
+        if (!assigned[index]) {
+            vertices[index].Tangent = tangent;
+            assigned[index] = true;
+        }
+        else if (vertices[index].Tangent != tangent) {
+            uint64_t key = (uint64_t)index << 32 | tangent;
+            auto found = copies.find(key);
+            if (found == copies.end()) {
+                Vertex copy = vertices[index];
+                copy.Tangent = tangent;
+                vertices.push_back(copy);
+                found = copies.insert(std::make_pair(key, (GLuint)(vertices.size() - 1))).first;
+            }
+            indices[corner] = found->second;
+        }
+    }
+    mesh.numSplitVertices = vertices.size() - numOriginal;
+
+    mesh.welded.clear();
+    mesh.faceTangent.clear();
+    mesh.faceOrientation.clear();
+    mesh.faceDegenerate.clear();
+    mesh.cornerStart.clear();
+    mesh.corners.clear();
+    mesh.cornerTangent.clear();
+}
+
+// generates the tangents of all meshes together, so the pool is spread
+// over every mesh's triangles at once rather than waiting on each mesh.
+// Welding and splitting are a task per mesh, the triangle and vertex
+// passes tasks of TANGENT_SPACE_TASK_SIZE
+inline void generateTangentSpaces(std::vector<TangentSpaceMesh>& meshes, ThreadPool* threadPool)
+{
+    CPU_ZONE("Tangent space");
+    auto oneTask = [](TangentSpaceMesh&) { return (size_t)1; };
+    auto numFaces = [](TangentSpaceMesh& mesh) { return mesh.indices->size() / 3; };
+    auto numVertices = [](TangentSpaceMesh& mesh) { return mesh.vertices->size(); };
+
+    tangentSpaceForEach(meshes, threadPool, 1, oneTask,
+        [](TangentSpaceMesh& mesh, size_t, size_t) {
+            CPU_ZONE("Weld");
+            size_t numFaces = mesh.indices->size() / 3;
+            mesh.faceTangent.resize(numFaces);
+            mesh.faceOrientation.resize(numFaces);
+            mesh.faceDegenerate.resize(numFaces);
+            mesh.cornerTangent.resize(mesh.indices->size());
+            weldTangentSpaceVertices(mesh);
+        });
+    tangentSpaceForEach(meshes, threadPool, TANGENT_SPACE_TASK_SIZE, numFaces,
+        [](TangentSpaceMesh& mesh, size_t begin, size_t end) {
+            CPU_ZONE("Face tangents");
+            computeFaceTangents(mesh, begin, end);
+        });
+    tangentSpaceForEach(meshes, threadPool, 1, oneTask,
+        [](TangentSpaceMesh& mesh, size_t, size_t) {
+            CPU_ZONE("Corners");
+            buildTangentSpaceCorners(mesh);
+        });
+    tangentSpaceForEach(meshes, threadPool, TANGENT_SPACE_TASK_SIZE, numVertices,
+        [](TangentSpaceMesh& mesh, size_t begin, size_t end) {
+            CPU_ZONE("Vertex tangents");
+            computeVertexTangents(mesh, begin, end);
+        });
+    tangentSpaceForEach(meshes, threadPool, 1, oneTask,
+        [](TangentSpaceMesh& mesh, size_t, size_t) {
+            CPU_ZONE("Split");
+            splitTangentSpaceVertices(mesh);
+        });
+}
+
+#endif // !TANGENT_SPACE_H_INCLUDED
@@ -22,6 +22,10 @@ typedef struct Texture {
     TextureType type;
 } Texture;
 
+// glBindTexture calls made for model materials (Mesh.h, MaterialAtlas.h),
+// the app resets it every frame
+size_t gMaterialTextureBinds = 0;
+
 static void setTextureOptions()
 {
     // assumes the texture is already currently bound to GL_TEXTURE_2D
@@ -1,6 +1,8 @@
 #ifndef VERTEX_H_INCLUDED
 #define VERTEX_H_INCLUDED
 
+#include <cstdint>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -10,6 +12,7 @@ typedef struct Vertex
     glm::vec3 Position;
     glm::vec3 Normal;
     glm::vec2 TexCoord;
+    uint32_t Tangent; // packed, with the handedness; see TangentSpace.h
 } Vertex;
 
 #endif //!VERTEX_H_INCLUDED
@@ -0,0 +1,144 @@
+// CPU only check of BVH.h: builds trees over random scenes and compares
+// what cullBVH returns against testing every box on its own, for random
+// cameras, before and after a refit. Also builds a deliberately deep tree
+// so the traversal has to go further than a balanced tree would
+//
+//   make bvhcheck
+//   ./bvhCheck
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "BVH.h"
+
+static std::mt19937 gRandom(1234);
+
+static float randomFloat(float lo, float hi)
+{
+    return std::uniform_real_distribution<float>(lo, hi)(gRandom);
+}
+
+static glm::vec3 randomVec3(float lo, float hi)
+{
+    return glm::vec3(randomFloat(lo, hi), randomFloat(lo, hi), randomFloat(lo, hi));
+}
+
+static BoundingBox randomBox(float extent, float maxSize)
+{
+    glm::vec3 center = randomVec3(-extent, extent);
+    glm::vec3 halfSize = randomVec3(0.01f, maxSize);
+    BoundingBox box = {center - halfSize, center + halfSize};
+    return box;
+}
+
+static Frustum randomFrustum(float extent)
+{
+    glm::vec3 eye = randomVec3(-extent, extent);
+    glm::vec3 target = randomVec3(-extent, extent);
+    if (glm::length(target - eye) < 0.1f) {
+        target = eye + glm::vec3(0.0f, 0.0f, -1.0f);
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(randomFloat(30.0f, 90.0f)),
+        randomFloat(0.5f, 2.0f), 0.1f, randomFloat(extent * 0.25f, extent * 2.0f));
+    glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+    return createFrustum(projection * view);
+}
+
+static int treeDepth(const BVH& bvh, uint32_t nodeIndex)
+{
+    if (bvh.itemIndices.empty()) {
+        return 0;
+    }
+    const BVHNode& node = bvh.nodes[nodeIndex];
+    if (isBVHLeaf(node)) {
+        return 1;
+    }
+    return 1 + std::max(treeDepth(bvh, node.leftFirst), treeDepth(bvh, node.leftFirst + 1));
+}
+
+// returns the number of frusta where the two visible sets differ
+static size_t compareWithBruteForce(const BVH& bvh, size_t numFrusta, float extent,
+                                    size_t& visibleTotal)
+{
+    size_t numMismatches = 0;
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> expected;
+    for (size_t f = 0; f < numFrusta; ++f)
+    {
+        Frustum frustum = randomFrustum(extent);
+
+        visible.clear();
+        cullBVH(bvh, frustum, visible);
+        std::sort(visible.begin(), visible.end());
+
+        expected.clear();
+        for (size_t i = 0; i < bvh.itemBounds.size(); ++i) {
+            if (testFrustumBoundingBox(frustum, bvh.itemBounds[i]) != CullResult::Outside) {
+                expected.push_back((uint32_t)i);
+            }
+        }
+
+        visibleTotal += expected.size();
+        if (visible != expected) {
+            numMismatches++;
+        }
+    }
+    return numMismatches;
+}
+
+static bool check(const char* name, const BVH& bvh, float extent)
+{
+    const size_t numFrusta = 500;
+    size_t visibleTotal = 0;
+    size_t numMismatches = compareWithBruteForce(bvh, numFrusta, extent, visibleTotal);
+    std::cout << name << ": " << bvh.itemBounds.size() << " items, "
+        << bvh.numNodesUsed << " nodes, depth " << treeDepth(bvh, 0) << ", "
+        << visibleTotal / numFrusta << " visible on average, "
+        << numMismatches << " / " << numFrusta << " frusta differ" << std::endl;
+    return numMismatches == 0;
+}
+
+int main()
+{
+    bool passed = true;
+
+    // uniformly scattered boxes, like the backpack grid
+    std::vector<BoundingBox> itemBounds;
+    for (size_t i = 0; i < 10000; ++i) {
+        itemBounds.push_back(randomBox(100.0f, 2.0f));
+    }
+    BVH bvh = createBVH(itemBounds);
+    passed &= check("random", bvh, 100.0f);
+
+    // move a few items the way updateCullingScene does
+    for (size_t i = 0; i < bvh.itemBounds.size(); i += 8) {
+        glm::vec3 offset = randomVec3(-3.0f, 3.0f);
+        bvh.itemBounds[i].min += offset;
+        bvh.itemBounds[i].max += offset;
+    }
+    refitBVH(bvh);
+    passed &= check("random, refit", bvh, 100.0f);
+
+    // every box is a bit closer to the origin than the last, so the
+    // binned splits can only peel off a few items at a time and the tree
+    // ends up far deeper than the ~log2(N) of a balanced one
+    itemBounds.clear();
+    float x = 1000.0f;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        BoundingBox box = {glm::vec3(x, -1.0f, -1.0f), glm::vec3(x * 1.01f, 1.0f, 1.0f)};
+        itemBounds.push_back(box);
+        x *= 0.9f;
+    }
+    bvh = createBVH(itemBounds);
+    passed &= check("deep", bvh, 10.0f);
+
+    // no items at all
+    bvh = createBVH(std::vector<BoundingBox>());
+    passed &= check("empty", bvh, 10.0f);
+
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -20,11 +20,29 @@ uniform sampler2D uDiffuseTex;
 uniform sampler2D uSpecularTex;
 //uniform vec3 uViewPos;
 
+// compact G-buffer: gPosition isn't stored and gNormal goes to an RG16
+// target, octahedral encoded
+uniform bool uCompactGBuffer;
+
+// folds the unit sphere onto the [-1, 1] square, the lower half
+// mirrored into the corners
+vec2 octahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n.xy * 0.5 + 0.5;
+}
+
 
 void main()
 {
     gPosition = fs_in.FragPos;
     gNormal = normalize(fs_in.Normal);
+    if (uCompactGBuffer) {
+        gNormal = vec3(octahedralEncode(gNormal), 0.0);
+    }
     gAlbedoSpec.rgb = texture(uDiffuseTex, fs_in.TexCoords).rgb;
     // TODO
     gAlbedoSpec.a = texture(uSpecularTex, fs_in.TexCoords).r;
@@ -7,34 +7,74 @@ uniform sampler2D uPositionTex;
 uniform sampler2D uNormalTex;
 uniform sampler2D uAlbedoSpecTex;
 
+// compact G-buffer: world position rebuilt from depth, normals octahedral
+uniform bool uCompactGBuffer;
+uniform sampler2D uDepthTex;
+uniform mat4 uInverseViewProjection;
+
+vec3 getWorldPosition(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return texture(uPositionTex, coords).rgb;
+    }
+    float depth = texture(uDepthTex, coords).r;
+    vec4 worldPos = uInverseViewProjection * vec4(coords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return worldPos.xyz / worldPos.w;
+}
+
+vec3 getNormal(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return texture(uNormalTex, coords).rgb;
+    }
+    vec2 f = texture(uNormalTex, coords).xy * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 struct Light
 {
     vec3 Position;
     vec3 Color;
+    float Radius; // see lightVolumeRadius() in LightVolumes.h
 };
 
 const int NUM_LIGHTS = 32;
 uniform Light lights[NUM_LIGHTS];
+uniform int uNumLights; // 0 = ambient only, the lights are drawn as volumes
 uniform vec3 uViewPos;
+uniform float uConstant;
+uniform float uLinear;
+uniform float uQuadratic;
 
 void main()
 {
     // retrieve data from G-buffer
-    vec3 FragPos = texture(uPositionTex, TexCoords).rgb;
-    vec3 Normal = texture(uNormalTex, TexCoords).rgb;
+    vec3 FragPos = getWorldPosition(TexCoords);
+    vec3 Normal = getNormal(TexCoords);
     vec3 Albedo = texture(uAlbedoSpecTex, TexCoords).rgb;
     float Specular = texture(uAlbedoSpecTex, TexCoords).a;
     
     // then calculate lighting as usual
     vec3 lighting = Albedo * 0.1; // hard-coded ambient component
     vec3 viewDir = normalize(uViewPos - FragPos);
-    for (int i = 0; i < NUM_LIGHTS; ++i)
+    for (int i = 0; i < uNumLights; ++i)
     {
+        // lights stop at the same radius as their volumes would
+        float distance = length(lights[i].Position - FragPos);
+        if (distance > lights[i].Radius) {
+            continue;
+        }
+
         // diffuse
         vec3 lightDir = normalize(lights[i].Position - FragPos);
         vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Albedo *
         lights[i].Color;
-        lighting += diffuse;
+        float attenuation = 1.0 / (uConstant + uLinear * distance + uQuadratic * distance * distance);
+        lighting += diffuse * attenuation;
     }
     FragColor = vec4(lighting, 1.0);
 }
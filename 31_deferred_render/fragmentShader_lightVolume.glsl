@@ -0,0 +1,63 @@
+#version 330 core
+out vec4 FragColor;
+
+flat in vec4 LightPosRadius;
+flat in vec3 LightColor;
+
+uniform sampler2D uPositionTex;
+uniform sampler2D uNormalTex;
+uniform sampler2D uAlbedoSpecTex;
+
+// compact G-buffer: world position rebuilt from depth, normals octahedral
+uniform bool uCompactGBuffer;
+uniform sampler2D uDepthTex;
+uniform mat4 uInverseViewProjection;
+
+uniform vec2 uScreenSize;
+uniform float uConstant;
+uniform float uLinear;
+uniform float uQuadratic;
+
+vec3 getWorldPosition(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return texture(uPositionTex, coords).rgb;
+    }
+    float depth = texture(uDepthTex, coords).r;
+    vec4 worldPos = uInverseViewProjection * vec4(coords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return worldPos.xyz / worldPos.w;
+}
+
+vec3 getNormal(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return texture(uNormalTex, coords).rgb;
+    }
+    vec2 f = texture(uNormalTex, coords).xy * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// one light's contribution, added into the target by blending
+void main()
+{
+    vec2 coords = gl_FragCoord.xy / uScreenSize;
+    vec3 FragPos = getWorldPosition(coords);
+
+    // the stencil only says some light reaches this pixel
+    vec3 toLight = LightPosRadius.xyz - FragPos;
+    float distance = length(toLight);
+    if (distance > LightPosRadius.w) {
+        discard;
+    }
+
+    vec3 Normal = getNormal(coords);
+    vec3 Albedo = texture(uAlbedoSpecTex, coords).rgb;
+
+    float attenuation = 1.0 / (uConstant + uLinear * distance + uQuadratic * distance * distance);
+    vec3 diffuse = max(dot(Normal, toLight / distance), 0.0) * Albedo * LightColor;
+    FragColor = vec4(diffuse * attenuation, 1.0);
+}
@@ -0,0 +1,7 @@
+#version 330 core
+
+// only the stencil is written; see LightVolumes.h
+
+void main()
+{
+}
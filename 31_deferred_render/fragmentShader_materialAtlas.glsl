@@ -0,0 +1,66 @@
+#version 330 core
+layout (location = 0) out vec3 gPosition;
+layout (location = 1) out vec3 gNormal;
+layout (location = 2) out vec4 gAlbedoSpec; // albedo (color) and specular
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+} fs_in;
+
+// see MaterialAtlas.h
+#define MAX_MATERIALS 256
+layout (std140) uniform MaterialTable {
+    // diffuse array, diffuse layer, specular array, specular layer; -1 = none
+    ivec4 uMaterials[MAX_MATERIALS];
+};
+uniform sampler2DArray uMaterialArray0;
+uniform sampler2DArray uMaterialArray1;
+uniform sampler2DArray uMaterialArray2;
+uniform sampler2DArray uMaterialArray3;
+uniform int uMaterialIndex;
+
+// compact G-buffer: gPosition isn't stored and gNormal goes to an RG16
+// target, octahedral encoded
+uniform bool uCompactGBuffer;
+
+// folds the unit sphere onto the [-1, 1] square, the lower half
+// mirrored into the corners
+vec2 octahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n.xy * 0.5 + 0.5;
+}
+
+// the array index is the same for the whole draw, so these branches don't diverge
+vec4 sampleMaterial(int array, int layer, vec4 fallback)
+{
+    vec3 coord = vec3(fs_in.TexCoords, float(layer));
+    if (array == 0) {
+        return texture(uMaterialArray0, coord);
+    } else if (array == 1) {
+        return texture(uMaterialArray1, coord);
+    } else if (array == 2) {
+        return texture(uMaterialArray2, coord);
+    } else if (array == 3) {
+        return texture(uMaterialArray3, coord);
+    }
+    return fallback;
+}
+
+void main()
+{
+    ivec4 material = uMaterials[uMaterialIndex];
+
+    gPosition = fs_in.FragPos;
+    gNormal = normalize(fs_in.Normal);
+    if (uCompactGBuffer) {
+        gNormal = vec3(octahedralEncode(gNormal), 0.0);
+    }
+    gAlbedoSpec.rgb = sampleMaterial(material.x, material.y, vec4(1.0)).rgb;
+    gAlbedoSpec.a = sampleMaterial(material.z, material.w, vec4(0.0)).r;
+}
@@ -4,6 +4,7 @@
 #include <vector>
 #include <ctime>
 #include <map>
+#include <chrono>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -26,6 +27,14 @@
 #include "ScreenTexture.h"
 #include "Mesh.h"
 #include "Model.h"
+#include "BoundingBox.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "OcclusionBuffer.h"
+#include "MaterialAtlas.h"
+#include "GpuProfiler.h"
+#include "LightVolumes.h"
+#include "CpuProfiler.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -61,12 +70,59 @@ ShaderProgram gLightShaderProgram;
 
 Camera gCamera;
 
-DeferredRenderBuffer gDeferredFrameBuffer;
+// G switches between the full G-buffer layout and the compact one, which
+// rebuilds position from depth and packs normals into RG16
+DeferredRenderBuffer gDeferredFrameBuffer; // one of the two below
+DeferredRenderBuffer gFullDeferredFrameBuffer;
+DeferredRenderBuffer gCompactDeferredFrameBuffer;
+bool gUseCompactGBuffer = false;
 BlurFrameBuffer gBlurFrameBuffer;
 ScreenTexture gScreenTexture;
 
 float gExposure = 5.0;
 bool gBloom = true;
+
+// BVH.h frustum culling
+// BVH items are the scene cubes followed by every mesh of every backpack
+// instance in the stress scene
+const size_t NUM_BACKPACK_ROWS = 64; // 64x64 = 4096 backpack instances
+const float BACKPACK_SPACING = 3.0f;
+std::vector<glm::mat4> gCubeModelMats;
+std::vector<glm::vec3> gBackpackPositions;
+std::vector<glm::mat4> gBackpackModelMats;
+BVH gBVH;
+std::vector<uint32_t> gVisibleItems;
+bool gUseFrustumCulling = true;
+
+// OcclusionBuffer.h occlusion culling
+// every scene cube is an occluder; the backpacks that survive frustum
+// culling are tested against them on the worker threads
+ThreadPool gThreadPool;
+OcclusionCuller gOcclusionCuller;
+std::vector<glm::vec3> gOccluderQuads; // 4 world space corners per cube face
+std::vector<uint32_t> gOccludeeItems;
+std::vector<BoundingBox> gOccludeeBounds;
+bool gUseOcclusionCulling = true;
+
+// P prints the last frame's GPU pass times, T writes a trace of the next
+// 120 frames to gpu_trace.json (open in ui.perfetto.dev) with the CPU
+// zones of CpuProfiler.h in the same file. The startup zones are written
+// to startup_trace.json
+GpuProfiler gGpuProfiler;
+
+// MaterialAtlas.h: draw the backpacks with their textures bound once per
+// frame from texture arrays instead of binding them for every mesh
+Shader gMaterialAtlasFragmentShader;
+ShaderProgram gMaterialAtlasShaderProgram;
+bool gUseMaterialAtlas = true;
+
+// LightVolumes.h: L switches between shading every light over the whole
+// screen and drawing each as a sphere of its attenuation radius
+LightVolumes gLightVolumes;
+bool gUseLightVolumes = true;
+const float LIGHT_CONSTANT = 1.0f;
+const float LIGHT_LINEAR = 0.7f;
+const float LIGHT_QUADRATIC = 1.8f;
 ////////////////////////////////////////////////////
 
 // GLFW callback functions
@@ -206,18 +262,41 @@ static void moveCamera()
             cameraSpeed;
     }
 
-#if 0
     static bool spaceWasPressed = false;
     if (glfwGetKey(gWindow, GLFW_KEY_SPACE) == GLFW_PRESS) {
         if (!spaceWasPressed) {
-            gUseHdr = !gUseHdr;
-            std::cout << "Use HDR: " << gUseHdr << std::endl;
+            gUseFrustumCulling = !gUseFrustumCulling;
+            std::cout << "Use frustum culling: " << gUseFrustumCulling << std::endl;
             spaceWasPressed = true;
         }
     } else {
         spaceWasPressed = false;
     }
 
+    static bool oWasPressed = false;
+    if (glfwGetKey(gWindow, GLFW_KEY_O) == GLFW_PRESS) {
+        if (!oWasPressed) {
+            gUseOcclusionCulling = !gUseOcclusionCulling;
+            std::cout << "Use occlusion culling: " << gUseOcclusionCulling << std::endl;
+            oWasPressed = true;
+        }
+    } else {
+        oWasPressed = false;
+    }
+
+    static bool mWasPressed = false;
+    if (glfwGetKey(gWindow, GLFW_KEY_M) == GLFW_PRESS) {
+        if (!mWasPressed) {
+            gUseMaterialAtlas = !gUseMaterialAtlas;
+            std::cout << "Use material atlas: " << gUseMaterialAtlas << std::endl;
+            mWasPressed = true;
+        }
+    } else {
+        mWasPressed = false;
+    }
+
+#if 0
+
     if (glfwGetKey(gWindow, GLFW_KEY_LEFT) == GLFW_PRESS) {
         gExposure -= 0.1f;
         std::cout << "gExposure: " << gExposure << std::endl;
@@ -228,6 +307,142 @@ static void moveCamera()
 #endif
 }
 
+BVHCullStats gCullStats;
+
+// place the scene cubes and a grid of backpacks, then build
+// the BVH over all of their world space boxes
+static void createCullingScene()
+{
+    // floor cube
+    glm::mat4 modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(0.0f, -1.0f, 0.0f));
+    modelMat = glm::scale(modelMat, glm::vec3(12.5f, 0.5f, 12.5f));
+    gCubeModelMats.push_back(modelMat);
+
+    // other scene cubes
+    modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(0.0f, 1.5f, 0.0f));
+    modelMat = glm::scale(modelMat, glm::vec3(0.5f, 0.5f, 0.5f));
+    gCubeModelMats.push_back(modelMat);
+
+    modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(2.0f, 0.0f, 1.0f));
+    modelMat = glm::scale(modelMat, glm::vec3(0.5f, 0.5f, 0.5f));
+    gCubeModelMats.push_back(modelMat);
+
+    modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(-1.0f, -1.0f, 2.0f));
+    modelMat = glm::rotate(modelMat, glm::radians(60.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)));
+    gCubeModelMats.push_back(modelMat);
+
+    modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(0.0f, 2.7f, 4.0f));
+    modelMat = glm::rotate(modelMat, glm::radians(23.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)));
+    gCubeModelMats.push_back(modelMat);
+
+    modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(-2.0f, 1.0f, -3.0f));
+    modelMat = glm::rotate(modelMat, glm::radians(127.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)));
+    gCubeModelMats.push_back(modelMat);
+
+    modelMat = glm::mat4(1.0f);
+    modelMat = glm::translate(modelMat, glm::vec3(-3.0f, 0.0f, 0.0f));
+    modelMat = glm::scale(modelMat, glm::vec3(0.5f, 0.5f, 0.5f));
+    gCubeModelMats.push_back(modelMat);
+
+    // walls around the room, open at the corners, hiding most of the backpacks
+    for (int side = 0; side < 4; ++side)
+    {
+        modelMat = glm::mat4(1.0f);
+        modelMat = glm::rotate(modelMat, glm::radians(90.0f * side), glm::vec3(0.0f, 1.0f, 0.0f));
+        modelMat = glm::translate(modelMat, glm::vec3(0.0f, 2.0f, -16.0f));
+        modelMat = glm::scale(modelMat, glm::vec3(10.0f, 3.0f, 0.5f));
+        gCubeModelMats.push_back(modelMat);
+    }
+
+    // the faces of every cube are occluders
+    static const glm::vec3 cubeFaces[6][4] = {
+        {{-1, -1, -1}, { 1, -1, -1}, { 1,  1, -1}, {-1,  1, -1}}, // back
+        {{-1, -1,  1}, { 1, -1,  1}, { 1,  1,  1}, {-1,  1,  1}}, // front
+        {{-1, -1, -1}, {-1,  1, -1}, {-1,  1,  1}, {-1, -1,  1}}, // left
+        {{ 1, -1, -1}, { 1,  1, -1}, { 1,  1,  1}, { 1, -1,  1}}, // right
+        {{-1, -1, -1}, { 1, -1, -1}, { 1, -1,  1}, {-1, -1,  1}}, // bottom
+        {{-1,  1, -1}, { 1,  1, -1}, { 1,  1,  1}, {-1,  1,  1}}  // top
+    };
+    for (const glm::mat4& mat : gCubeModelMats)
+    {
+        for (size_t face = 0; face < 6; ++face) {
+            for (size_t corner = 0; corner < 4; ++corner) {
+                gOccluderQuads.push_back(glm::vec3(mat * glm::vec4(cubeFaces[face][corner], 1.0f)));
+            }
+        }
+    }
+
+    // the original backpack followed by the stress grid
+    gBackpackPositions.push_back(glm::vec3(-2.0f, 1.0f, 3.0f));
+    const float halfWidth = NUM_BACKPACK_ROWS * BACKPACK_SPACING * 0.5f;
+    for (size_t z = 0; z < NUM_BACKPACK_ROWS; ++z)
+    {
+        for (size_t x = 0; x < NUM_BACKPACK_ROWS; ++x)
+        {
+            glm::vec3 pos(x * BACKPACK_SPACING - halfWidth,
+                          1.0f,
+                          z * BACKPACK_SPACING - halfWidth);
+            // leave the original room empty
+            if (fabs(pos.x) < 14.0f && fabs(pos.z) < 14.0f) {
+                continue;
+            }
+            gBackpackPositions.push_back(pos);
+        }
+    }
+    gBackpackModelMats.resize(gBackpackPositions.size());
+
+    const BoundingBox cubeBounds = {glm::vec3(-1.0f), glm::vec3(1.0f)};
+    std::vector<BoundingBox> itemBounds;
+    for (const glm::mat4& mat : gCubeModelMats) {
+        itemBounds.push_back(transformBoundingBox(cubeBounds, mat));
+    }
+    for (size_t i = 0; i < gBackpackPositions.size(); ++i)
+    {
+        modelMat = glm::mat4(1.0f);
+        modelMat = glm::translate(modelMat, gBackpackPositions[i]);
+        modelMat = glm::scale(modelMat, glm::vec3(0.25f));
+        gBackpackModelMats[i] = modelMat;
+        for (size_t mesh = 0; mesh < gModel.NumMeshes(); ++mesh) {
+            itemBounds.push_back(transformBoundingBox(gModel.GetMeshBounds(mesh), modelMat));
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    gBVH = createBVH(itemBounds);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "BVH: built " << gBVH.numNodesUsed << " nodes over "
+        << itemBounds.size() << " items in "
+        << std::chrono::duration<double, std::milli>(end - start).count()
+        << " ms" << std::endl;
+}
+
+// bob every 8th backpack up and down so the BVH has to be refit
+static void updateCullingScene(float time)
+{
+    const size_t numCubes = gCubeModelMats.size();
+    const size_t numMeshes = gModel.NumMeshes();
+    for (size_t i = 1; i < gBackpackPositions.size(); i += 8)
+    {
+        glm::vec3 pos = gBackpackPositions[i];
+        pos.y += sin(time + float(i)) * 0.5f;
+        glm::mat4 modelMat = glm::mat4(1.0f);
+        modelMat = glm::translate(modelMat, pos);
+        modelMat = glm::scale(modelMat, glm::vec3(0.25f));
+        gBackpackModelMats[i] = modelMat;
+        for (size_t mesh = 0; mesh < numMeshes; ++mesh) {
+            gBVH.itemBounds[numCubes + i * numMeshes + mesh] =
+                transformBoundingBox(gModel.GetMeshBounds(mesh), modelMat);
+        }
+    }
+    refitBVH(gBVH);
+}
+
 // called once every frame during main loop
 static void draw()
 {
@@ -239,6 +454,7 @@ static void draw()
     static GLuint uView = GET_LOC("uView");
     static GLuint uModel = GET_LOC("uModel");
     static GLuint uViewPos = GET_LOC("uViewPos");
+    static GLuint uCompactGBuffer = GET_LOC("uCompactGBuffer");
     #undef GET_LOC
 
     glUseProgram(gDeferredShaderProgram.id);
@@ -247,6 +463,22 @@ static void draw()
     static GLuint uNormalTex = GET_LOC("uNormalTex");
     static GLuint uAlbedoSpecTex = GET_LOC("uAlbedoSpecTex");
     static GLuint uViewPos_deferred = GET_LOC("uViewPos");
+    static GLuint uNumLights_deferred = GET_LOC("uNumLights");
+    static GLuint uConstant_deferred = GET_LOC("uConstant");
+    static GLuint uLinear_deferred = GET_LOC("uLinear");
+    static GLuint uQuadratic_deferred = GET_LOC("uQuadratic");
+    static GLuint uCompactGBuffer_deferred = GET_LOC("uCompactGBuffer");
+    static GLuint uDepthTex_deferred = GET_LOC("uDepthTex");
+    static GLuint uInverseViewProjection_deferred = GET_LOC("uInverseViewProjection");
+    #undef GET_LOC
+
+    glUseProgram(gMaterialAtlasShaderProgram.id);
+    #define GET_LOC(name) glGetUniformLocation(gMaterialAtlasShaderProgram.id, name) 
+    static GLuint uProjection_atlas = GET_LOC("uProjection");
+    static GLuint uView_atlas = GET_LOC("uView");
+    static GLuint uModel_atlas = GET_LOC("uModel");
+    static GLuint uMaterialIndex_atlas = GET_LOC("uMaterialIndex");
+    static GLuint uCompactGBuffer_atlas = GET_LOC("uCompactGBuffer");
     #undef GET_LOC
 
     glUseProgram(gLightShaderProgram.id);
@@ -259,6 +491,7 @@ static void draw()
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // render the scene into the floating point framebuffer
+    gGpuProfiler.Push("G-buffer");
     glBindFramebuffer(GL_FRAMEBUFFER, gDeferredFrameBuffer.id);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(gShaderProgram.id);
@@ -268,6 +501,7 @@ static void draw()
         createViewMatrix(viewMat, gCamera);
         glUniformMatrix4fv(uProjection, 1, GL_FALSE, glm::value_ptr(projectionMat));
         glUniformMatrix4fv(uView, 1, GL_FALSE, glm::value_ptr(viewMat));
+        glUniform1i(uCompactGBuffer, gDeferredFrameBuffer.compact);
         glActiveTexture(GL_TEXTURE0);
         glUniform1i(uDiffuseTex, 0); // GL_TEXTURE0
         glBindTexture(GL_TEXTURE_2D, gWoodTexture.id);
@@ -285,65 +519,81 @@ static void draw()
 
         glBindTexture(GL_TEXTURE_2D, gContainerTexture.id);
 
-        // floor cube
-        glm::mat4 modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(0.0f, -1.0f, 0.0f));
-        modelMat = glm::scale(modelMat, glm::vec3(12.5f, 0.5f, 12.5f));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        glBindVertexArray(gCube.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
-
-        // other scene cubes
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(0.0f, 1.5f, 0.0f));
-        modelMat = glm::scale(modelMat, glm::vec3(0.5f, 0.5f, 0.5f));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        glBindVertexArray(gCube.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
+        // find the visible cubes and backpack meshes
+        CPU_ZONE_BEGIN("Frustum cull");
+        gVisibleItems.clear();
+        if (gUseFrustumCulling) {
+            Frustum frustum = createFrustum(projectionMat * viewMat);
+            cullBVH(gBVH, frustum, gVisibleItems, &gCullStats);
+        } else {
+            for (size_t i = 0; i < gBVH.itemBounds.size(); ++i) {
+                gVisibleItems.push_back((uint32_t)i);
+            }
+        }
+        CPU_ZONE_END();
+
+        // start testing the backpacks against the occluders on the worker
+        // threads, then draw the cubes (the occluders) while they run
+        const size_t numCubes = gCubeModelMats.size();
+        const size_t numMeshes = gModel.NumMeshes();
+        gOccludeeItems.clear();
+        gOccludeeBounds.clear();
+        for (uint32_t item : gVisibleItems)
+        {
+            if (item >= numCubes) {
+                gOccludeeItems.push_back(item);
+                gOccludeeBounds.push_back(gBVH.itemBounds[item]);
+            }
+        }
+        if (gUseOcclusionCulling) {
+            gOcclusionCuller.Begin(projectionMat * viewMat, gOccluderQuads, gOccludeeBounds);
+        }
 
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(2.0f, 0.0f, 1.0f));
-        modelMat = glm::scale(modelMat, glm::vec3(0.5f, 0.5f, 0.5f));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        glBindVertexArray(gCube.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
+        gGpuProfiler.Push("Cubes");
+        for (uint32_t item : gVisibleItems)
+        {
+            if (item < numCubes) {
+                glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(gCubeModelMats[item]));
+                glBindVertexArray(gCube.VAO);
+                glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
+            }
+        }
 
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(-1.0f, -1.0f, 2.0f));
-        modelMat = glm::rotate(modelMat, glm::radians(60.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        glBindVertexArray(gCube.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
+        gGpuProfiler.Pop();
 
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(0.0f, 2.7f, 4.0f));
-        modelMat = glm::rotate(modelMat, glm::radians(23.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        glBindVertexArray(gCube.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
+        if (gUseOcclusionCulling) {
+            gOcclusionCuller.End();
+        }
 
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(-2.0f, 1.0f, -3.0f));
-        modelMat = glm::rotate(modelMat, glm::radians(127.0f), glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        glBindVertexArray(gCube.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
-        
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(-3.0f, 0.0f, 0.0f));
-        modelMat = glm::scale(modelMat, glm::vec3(0.5f, 0.5f, 0.5f));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        glBindVertexArray(gCube.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
+        gGpuProfiler.Push("Backpacks");
 
-        // Model
-        modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, glm::vec3(-2.0f, 1.0f, 3.0f));
-        modelMat = glm::scale(modelMat, glm::vec3(0.25f));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
-        gModel.Draw(gShaderProgram);
+        GLuint uModel_backpack = uModel;
+        if (gUseMaterialAtlas) {
+            glUseProgram(gMaterialAtlasShaderProgram.id);
+            glUniformMatrix4fv(uProjection_atlas, 1, GL_FALSE, glm::value_ptr(projectionMat));
+            glUniformMatrix4fv(uView_atlas, 1, GL_FALSE, glm::value_ptr(viewMat));
+            glUniform1i(uCompactGBuffer_atlas, gDeferredFrameBuffer.compact);
+            gModel.BindMaterialAtlas();
+            uModel_backpack = uModel_atlas;
+        }
+        for (size_t i = 0; i < gOccludeeItems.size(); ++i)
+        {
+            if (gUseOcclusionCulling && !gOcclusionCuller.IsVisible(i)) {
+                continue;
+            }
+            size_t instance = (gOccludeeItems[i] - numCubes) / numMeshes;
+            size_t mesh = (gOccludeeItems[i] - numCubes) % numMeshes;
+            glUniformMatrix4fv(uModel_backpack, 1, GL_FALSE, glm::value_ptr(gBackpackModelMats[instance]));
+            if (gUseMaterialAtlas) {
+                gModel.DrawMeshWithAtlas(mesh, uMaterialIndex_atlas);
+            } else {
+                gModel.DrawMesh(mesh, gShaderProgram);
+            }
+        }
+        gGpuProfiler.Pop();
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGpuProfiler.Pop();
 #if 0
     // Debug draw intial buffer
     glUseProgram(gDebugBufferShaderProgram.id);
@@ -355,18 +605,63 @@ static void draw()
 #endif
 
 #if 1
+    gGpuProfiler.Push("Lighting");
     glUseProgram(gDeferredShaderProgram.id);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (gUseLightVolumes) {
+        // the volumes are depth tested against the scene, so copy the
+        // geometry depth buffer first; the full screen pass then only
+        // adds the ambient term and must not be depth tested.
+        // Errors still queued from earlier in the frame are reported (the
+        // first time there are any) so the check after the blit only sees
+        // its own
+        static bool earlierErrorsReported = false;
+        bool hadEarlierErrors = false;
+        for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError())
+        {
+            if (!earlierErrorsReported) {
+                std::cout << "GL error before the depth blit: 0x" << std::hex << error << std::dec << std::endl;
+            }
+            hadEarlierErrors = true;
+        }
+        earlierErrorsReported = earlierErrorsReported || hadEarlierErrors;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gDeferredFrameBuffer.id);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // bind to default
+        glBlitFramebuffer(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // the blit fails if the default framebuffer's depth format differs
+        // from the G-buffer's; the volumes would then go untested, so light
+        // in the full screen pass instead
+        GLenum blitError = glGetError();
+        if (blitError != GL_NO_ERROR) {
+            std::cout << "Depth blit failed (0x" << std::hex << blitError << std::dec
+                << "), lighting without light volumes" << std::endl;
+            gUseLightVolumes = false;
+        }
+        else {
+            glDisable(GL_DEPTH_TEST);
+        }
+    }
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, gDeferredFrameBuffer.colorBufferIDs[0]);
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, gDeferredFrameBuffer.colorBufferIDs[1]);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, gDeferredFrameBuffer.colorBufferIDs[2]);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, gDeferredFrameBuffer.depthTextureID);
     glUniform1i(uPositionTex, 0);
     glUniform1i(uNormalTex, 1);
     glUniform1i(uAlbedoSpecTex, 2);
+    glUniform1i(uDepthTex_deferred, 3);
+    glUniform1i(uCompactGBuffer_deferred, gDeferredFrameBuffer.compact);
+    glm::mat4 inverseViewProjectionMat = glm::inverse(projectionMat * viewMat);
+    glUniformMatrix4fv(uInverseViewProjection_deferred, 1, GL_FALSE, glm::value_ptr(inverseViewProjectionMat));
     glUniform3fv(uViewPos_deferred, 1, glm::value_ptr(gCamera.position));
+    glUniform1i(uNumLights_deferred, gUseLightVolumes ? 0 : (GLint)gLightVolumes.NumLights());
+    glUniform1f(uConstant_deferred, LIGHT_CONSTANT);
+    glUniform1f(uLinear_deferred, LIGHT_LINEAR);
+    glUniform1f(uQuadratic_deferred, LIGHT_QUADRATIC);
     for (size_t i = 0; i < 32; i++)
     {
         std::string locString = "lights[" + std::to_string(i) + "].Position";
@@ -375,12 +670,21 @@ static void draw()
         locString = "lights[" + std::to_string(i) + "].Color";
         loc = glGetUniformLocation(gDeferredShaderProgram.id, locString.c_str());
         glUniform3fv(loc, 1, glm::value_ptr(gLightColors[i]));
+        locString = "lights[" + std::to_string(i) + "].Radius";
+        loc = glGetUniformLocation(gDeferredShaderProgram.id, locString.c_str());
+        glUniform1f(loc, gLightVolumes.GetRadius(i));
     }
     glBindVertexArray(gScreenTexture.VAO);
     glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
+    if (gUseLightVolumes) {
+        glEnable(GL_DEPTH_TEST);
+        gLightVolumes.Draw(gDeferredFrameBuffer, viewMat, projectionMat, &gGpuProfiler);
+    }
+    gGpuProfiler.Pop();
 
     // copy the geometry depth buffer from the first pass so we can
     // use it for depth testing when we draw non-deferred
+    GpuProfileScope forwardScope(gGpuProfiler, "Light sources");
     glBindFramebuffer(GL_READ_FRAMEBUFFER, gDeferredFrameBuffer.id);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // bind to default
     glBlitFramebuffer(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
@@ -392,7 +696,7 @@ static void draw()
 
     for (size_t i = 0; i < gLightPositions.size(); i++)
     {
-        modelMat = glm::mat4(1.0f);
+        glm::mat4 modelMat = glm::mat4(1.0f);
         modelMat = glm::translate(modelMat, glm::vec3(gLightPositions[i]));
         modelMat = glm::scale(modelMat, glm::vec3(0.25f));
         glUniformMatrix4fv(uModel_light, 1, GL_FALSE, glm::value_ptr(modelMat));
@@ -403,12 +707,53 @@ static void draw()
 #endif
 }
 
+// the GPU time of a named pass in the most recently resolved frame
+static double lastGpuPassMs(const std::string& name)
+{
+    for (const GpuProfileResult& result : gGpuProfiler.GetResults())
+    {
+        if (result.name == name) {
+            return result.durationMs;
+        }
+    }
+    return 0.0;
+}
+
+// light evaluations of the last resolved frame against what the full
+// screen pass does
+static void printLightVolumeStats()
+{
+    if (!gUseLightVolumes) {
+        std::cout << "Light volumes off" << std::endl;
+        return;
+    }
+    double fullScreen = double(gLightVolumes.NumLights()) * WINDOW_WIDTH * WINDOW_HEIGHT;
+    GLuint64 shaded = gLightVolumes.GetShadedFragments();
+    std::cout << "Light volumes: " << shaded << " light fragments shaded, "
+        << 100.0 * double(shaded) / fullScreen << "% of the full screen pass" << std::endl;
+}
+
+static void printGeometryBufferLayout()
+{
+    const double MB = 1024.0 * 1024.0;
+    size_t bytesPerPixel = deferredRenderBufferBytesPerPixel(gDeferredFrameBuffer.compact);
+    std::cout << "G-buffer: " << (gDeferredFrameBuffer.compact ? "compact" : "full")
+        << ", " << bytesPerPixel << " bytes/pixel, "
+        << gDeferredFrameBuffer.width * gDeferredFrameBuffer.height * bytesPerPixel / MB
+        << " MB" << std::endl;
+}
+
 int main(void)
 {
+    CPU_THREAD_NAME("Main");
+    CPU_ZONE_BEGIN("Startup");
+
+    CPU_ZONE_BEGIN("Window and GL init");
     initGlfw();
     createWindow();
     initGlad();
     registerGlfwCallbacks();
+    CPU_ZONE_END();
 
     // tell OpenGL the size and location of the rendering area
     // args: x,y,width,height
@@ -430,6 +775,7 @@ int main(void)
     gCamera = createCamera();
 
     // Shader.h/ShaderProgram.h
+    CPU_ZONE_BEGIN("Shader compile");
     std::cout << "Creating main shader" << std::endl;
     gVertexShader = createVertexShader("vertexShader.glsl");
     gFragmentShader = createFragmentShader("fragmentShader.glsl");
@@ -437,6 +783,12 @@ int main(void)
         gFragmentShader);
     glUseProgram(gShaderProgram.id);
 
+    std::cout << "Creating material atlas shader" << std::endl;
+    gMaterialAtlasFragmentShader = createFragmentShader("fragmentShader_materialAtlas.glsl");
+    gMaterialAtlasShaderProgram = createShaderProgram(gVertexShader,
+        gMaterialAtlasFragmentShader);
+    setupMaterialAtlasShader(gMaterialAtlasShaderProgram.id);
+
     std::cout << "Creating deferred shader" << std::endl;
     gDeferredVertexShader = createVertexShader("vertexShader_deferred.glsl");
     gDeferredFragmentShader = createFragmentShader("fragmentShader_deferred.glsl");
@@ -453,6 +805,7 @@ int main(void)
     gDebugBufferVertexShader = createVertexShader("vertexShader_debugBuffer.glsl");
     gDebugBufferFragmentShader = createFragmentShader("fragmentShader_debugBuffer.glsl");
     gDebugBufferShaderProgram = createShaderProgram(gDebugBufferVertexShader, gDebugBufferFragmentShader);
+    CPU_ZONE_END();
 
     // LightSource.h
     gLightSource = createLightSource(gCube);
@@ -461,11 +814,16 @@ int main(void)
     //gLightTransMat = createTransformationMatrix();
 
     // Texture.h
+    CPU_ZONE_BEGIN("Texture decode");
     gWoodTexture = createTexture("wood.png");
     gContainerTexture = createTexture("container2.png");
+    CPU_ZONE_END();
 
     // DeferredRenderBuffer.h
-    gDeferredFrameBuffer = createDeferredRenderBuffer();
+    gFullDeferredFrameBuffer = createDeferredRenderBuffer();
+    gCompactDeferredFrameBuffer = createDeferredRenderBuffer(true);
+    gDeferredFrameBuffer = gUseCompactGBuffer ? gCompactDeferredFrameBuffer : gFullDeferredFrameBuffer;
+    printGeometryBufferLayout();
 
     // BlurFrameBuffer.h
     gBlurFrameBuffer = createBlurFrameBuffer();
@@ -473,8 +831,22 @@ int main(void)
     // ScreenTexture.h
     gScreenTexture = createScreenTexture();
 
+    // ThreadPool.h; before the model, which generates its tangents on it
+    gThreadPool.Init();
+
     // Model.h
-    gModel.Load("backpack/backpack.obj");
+    gModel.Load("backpack/backpack.obj", &gThreadPool);
+
+    // BVH.h
+    CPU_ZONE_BEGIN("Culling scene");
+    createCullingScene();
+    CPU_ZONE_END();
+
+    // OcclusionBuffer.h
+    gOcclusionCuller.Init(&gThreadPool, 256, 128);
+
+    // GpuProfiler.h
+    gGpuProfiler.Init();
 
     // initialize lights
     srand(time(0));
@@ -491,12 +863,66 @@ int main(void)
         std::cout << "Light Color: " << gLightColors[i].x << " " << gLightColors[i].y << " " << gLightColors[i].z << std::endl;
     }
 
+    // LightVolumes.h
+    gLightVolumes.Init();
+    gLightVolumes.Update(gLightPositions, gLightColors, LIGHT_CONSTANT, LIGHT_LINEAR, LIGHT_QUADRATIC);
+
+    CPU_ZONE_END(); // Startup
+    std::cout << "Startup:" << std::endl;
+    CPU_PRINT_ZONES(2);
+    CPU_WRITE_TRACE("startup_trace.json");
+
     while (!glfwWindowShouldClose(gWindow))
     {
+        CPU_FRAME_MARK();
+        CPU_ZONE_BEGIN("Input");
         if (glfwGetKey(gWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
             glfwSetWindowShouldClose(gWindow, true);
         }
 
+        // press P to print the GPU pass times
+        static bool printProfileWasPressed = false;
+        bool printProfilePressed = glfwGetKey(gWindow, GLFW_KEY_P) == GLFW_PRESS;
+        if (printProfilePressed && !printProfileWasPressed) {
+            gGpuProfiler.PrintResults();
+            std::cout << "GPU profiler stalls: " << gGpuProfiler.GetNumStalls() << std::endl;
+            printLightVolumeStats();
+        }
+        printProfileWasPressed = printProfilePressed;
+
+        // press L to switch between light volumes and full screen lighting
+        static bool lightVolumesWasPressed = false;
+        bool lightVolumesPressed = glfwGetKey(gWindow, GLFW_KEY_L) == GLFW_PRESS;
+        if (lightVolumesPressed && !lightVolumesWasPressed) {
+            gUseLightVolumes = !gUseLightVolumes;
+            std::cout << "Use light volumes: " << gUseLightVolumes << std::endl;
+        }
+        lightVolumesWasPressed = lightVolumesPressed;
+
+        // press T to capture a GPU trace
+        static bool traceWasPressed = false;
+        bool tracePressed = glfwGetKey(gWindow, GLFW_KEY_T) == GLFW_PRESS;
+        if (tracePressed && !traceWasPressed && !gGpuProfiler.IsCapturing()) {
+            gGpuProfiler.StartCapture("gpu_trace.json", 120,
+                [](std::vector<ChromeTraceEvent>& events, std::vector<std::string>& threadNames) {
+                    CPU_APPEND_EVENTS(events, threadNames);
+                });
+        }
+        traceWasPressed = tracePressed;
+
+        // press G to switch the G-buffer layout; prints the G-buffer pass
+        // time of the layout being left, P prints the new one's
+        static bool compactGBufferWasPressed = false;
+        bool compactGBufferPressed = glfwGetKey(gWindow, GLFW_KEY_G) == GLFW_PRESS;
+        if (compactGBufferPressed && !compactGBufferWasPressed) {
+            std::cout << "G-buffer pass (" << (gUseCompactGBuffer ? "compact" : "full")
+                << "): " << lastGpuPassMs("G-buffer") << " ms" << std::endl;
+            gUseCompactGBuffer = !gUseCompactGBuffer;
+            gDeferredFrameBuffer = gUseCompactGBuffer ? gCompactDeferredFrameBuffer : gFullDeferredFrameBuffer;
+            printGeometryBufferLayout();
+        }
+        compactGBufferWasPressed = compactGBufferPressed;
+
         moveCamera();
 
         // move the light around
@@ -507,12 +933,82 @@ int main(void)
         // Transform.h
         //updateTransformationMatrix(gLightTransMat, gLightPosition, gCamera);
 
+        CPU_ZONE_END(); // Input
+
+        auto refitStart = std::chrono::high_resolution_clock::now();
+        CPU_ZONE_BEGIN("Refit");
+        updateCullingScene(glfwGetTime());
+        CPU_ZONE_END();
+        auto drawStart = std::chrono::high_resolution_clock::now();
+
+        CPU_ZONE_BEGIN("Draw");
+        gGpuProfiler.BeginFrame();
         draw();
+        gGpuProfiler.EndFrame();
+        CPU_ZONE_END();
+        CPU_COUNTER("Visible items", gVisibleItems.size());
+
+        // print culling statistics about once a second
+        static double refitTime = 0.0;
+        static double cullTime = 0.0;
+        static size_t visibleTotal = 0;
+        static size_t nodesTotal = 0;
+        static size_t numFrames = 0;
+        static size_t occludeesTotal = 0;
+        static size_t occludedTotal = 0;
+        static double occlusionRasterTime = 0.0;
+        static double occlusionTestTime = 0.0;
+        static size_t materialBindsTotal = 0;
+        static double lastPrintTime = glfwGetTime();
+        materialBindsTotal += gMaterialTextureBinds;
+        gMaterialTextureBinds = 0;
+        refitTime += std::chrono::duration<double, std::micro>(drawStart - refitStart).count();
+        cullTime += gUseFrustumCulling ? gCullStats.cullTimeMicroseconds : 0.0;
+        visibleTotal += gVisibleItems.size();
+        nodesTotal += gUseFrustumCulling ? gCullStats.nodesVisited : 0;
+        numFrames++;
+        if (gUseOcclusionCulling) {
+            const OcclusionStats& occlusionStats = gOcclusionCuller.GetStats();
+            occludeesTotal += occlusionStats.numTested;
+            occludedTotal += occlusionStats.numOccluded;
+            occlusionRasterTime += occlusionStats.rasterTimeMicroseconds;
+            occlusionTestTime += occlusionStats.testTimeMicroseconds;
+        }
+        if (glfwGetTime() - lastPrintTime >= 1.0)
+        {
+            std::cout << "BVH: visible " << visibleTotal / numFrames
+                << " / " << gBVH.itemBounds.size() << " items, "
+                << nodesTotal / numFrames << " nodes visited, traversal "
+                << cullTime / numFrames << " us, refit "
+                << refitTime / numFrames << " us" << std::endl;
+            if (gUseOcclusionCulling && occludeesTotal > 0) {
+                std::cout << "Occlusion: culled " << occludedTotal / numFrames
+                    << " / " << occludeesTotal / numFrames << " ("
+                    << 100.0 * occludedTotal / occludeesTotal << "%), raster "
+                    << occlusionRasterTime / numFrames << " us, test "
+                    << occlusionTestTime / numFrames << " us" << std::endl;
+            }
+            std::cout << "Materials: " << materialBindsTotal / numFrames
+                << " texture binds per frame ("
+                << (gUseMaterialAtlas ? "atlas" : "per mesh") << ")" << std::endl;
+            materialBindsTotal = 0;
+            occludeesTotal = occludedTotal = 0;
+            occlusionRasterTime = occlusionTestTime = 0.0;
+            refitTime = cullTime = 0.0;
+            visibleTotal = nodesTotal = numFrames = 0;
+            lastPrintTime = glfwGetTime();
+        }
 
+        CPU_ZONE_BEGIN("Swap");
         glfwSwapBuffers(gWindow);
         glfwPollEvents();
+        CPU_ZONE_END();
     }
 
+    gThreadPool.Shutdown();
+    gLightVolumes.Delete();
+    gGpuProfiler.Shutdown();
+
     glDeleteShader(gVertexShader.id);
     glDeleteShader(gFragmentShader.id);
     glfwTerminate();
@@ -0,0 +1,254 @@
+// CPU only check of OcclusionBuffer.h: rasterizes fixed walls (one
+// covering the screen, one covering the left half, two with a gap between
+// them) and tests random boxes against them through OcclusionCuller, with
+// no thread pool and with one. Each box is classified from its projected
+// rectangle first:
+//
+//   hidden  - entirely behind one wall, at least a pixel inside its edges;
+//             must be culled
+//   visible - partly in front of the walls, partly outside them (or in the
+//             gap) or crossing the near plane; must never be culled
+//
+// boxes within a pixel of a wall edge may go either way, since the
+// rasterizer only writes pixels a wall covers completely
+//
+//   make occlusioncheck
+//   ./occlusionCheck
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "OcclusionBuffer.h"
+
+static std::mt19937 gRandom(1234);
+
+static float randomFloat(float lo, float hi)
+{
+    return std::uniform_real_distribution<float>(lo, hi)(gRandom);
+}
+
+const float WALL_Z = -10.0f;
+
+typedef struct ScreenRect {
+    float x0, y0, x1, y1;
+} ScreenRect;
+
+enum class Expected { Hidden, Visible, Either };
+
+// world space quad at WALL_Z, two corners given
+static void addWall(std::vector<glm::vec3>& quads, float x0, float y0, float x1, float y1)
+{
+    quads.push_back(glm::vec3(x0, y0, WALL_Z));
+    quads.push_back(glm::vec3(x1, y0, WALL_Z));
+    quads.push_back(glm::vec3(x1, y1, WALL_Z));
+    quads.push_back(glm::vec3(x0, y1, WALL_Z));
+}
+
+static glm::vec3 toScreen(const glm::mat4& projView, const OcclusionBuffer& buffer,
+                          const glm::vec3& p, float& w)
+{
+    glm::vec4 clip = projView * glm::vec4(p, 1.0f);
+    w = clip.w;
+    return glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * buffer.width,
+                     (clip.y / clip.w * 0.5f + 0.5f) * buffer.height,
+                     clip.z / clip.w * 0.5f + 0.5f);
+}
+
+static ScreenRect wallRect(const std::vector<glm::vec3>& quads, size_t first,
+                           const glm::mat4& projView, const OcclusionBuffer& buffer)
+{
+    ScreenRect rect = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (size_t v = first; v < first + 4; ++v)
+    {
+        float w;
+        glm::vec3 s = toScreen(projView, buffer, quads[v], w);
+        rect.x0 = std::min(rect.x0, s.x);
+        rect.y0 = std::min(rect.y0, s.y);
+        rect.x1 = std::max(rect.x1, s.x);
+        rect.y1 = std::max(rect.y1, s.y);
+    }
+    return rect;
+}
+
+static bool isCovered(const std::vector<ScreenRect>& walls, float x, float y)
+{
+    for (const ScreenRect& wall : walls) {
+        if (x > wall.x0 && x < wall.x1 && y > wall.y0 && y < wall.y1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether some on screen point of rect is outside every wall; tests the
+// middle of each cell the wall edges cut the rectangle into
+static bool hasUncoveredPoint(const ScreenRect& rect, const std::vector<ScreenRect>& walls)
+{
+    std::vector<float> xs = {rect.x0, rect.x1};
+    std::vector<float> ys = {rect.y0, rect.y1};
+    for (const ScreenRect& wall : walls)
+    {
+        for (float x : {wall.x0, wall.x1}) {
+            if (x > rect.x0 && x < rect.x1) xs.push_back(x);
+        }
+        for (float y : {wall.y0, wall.y1}) {
+            if (y > rect.y0 && y < rect.y1) ys.push_back(y);
+        }
+    }
+    std::sort(xs.begin(), xs.end());
+    std::sort(ys.begin(), ys.end());
+    for (size_t i = 0; i + 1 < xs.size(); ++i)
+    {
+        for (size_t j = 0; j + 1 < ys.size(); ++j) {
+            if (!isCovered(walls, 0.5f * (xs[i] + xs[i + 1]), 0.5f * (ys[j] + ys[j + 1]))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static Expected classify(const BoundingBox& box, const std::vector<ScreenRect>& walls,
+                         float wallDepth, const glm::mat4& projView,
+                         const OcclusionBuffer& buffer)
+{
+    ScreenRect rect = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    float minZ = FLT_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? box.max.x : box.min.x,
+                         (i & 2) ? box.max.y : box.min.y,
+                         (i & 4) ? box.max.z : box.min.z);
+        float w;
+        glm::vec3 s = toScreen(projView, buffer, corner, w);
+        if (w <= 0.1f) {
+            return Expected::Visible; // crosses the near plane
+        }
+        rect.x0 = std::min(rect.x0, s.x);
+        rect.y0 = std::min(rect.y0, s.y);
+        rect.x1 = std::max(rect.x1, s.x);
+        rect.y1 = std::max(rect.y1, s.y);
+        minZ = std::min(minZ, s.z);
+    }
+    rect.x0 = std::max(rect.x0, 0.0f);
+    rect.y0 = std::max(rect.y0, 0.0f);
+    rect.x1 = std::min(rect.x1, (float)buffer.width);
+    rect.y1 = std::min(rect.y1, (float)buffer.height);
+    if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) {
+        return Expected::Either; // off screen, left to frustum culling
+    }
+    if (minZ < wallDepth || hasUncoveredPoint(rect, walls)) {
+        return Expected::Visible;
+    }
+
+    // the pixels under the rectangle must all be fully inside one wall
+    const float margin = 1.01f;
+    for (const ScreenRect& wall : walls)
+    {
+        bool inside = std::max(rect.x0 - margin, 0.0f) >= wall.x0 &&
+                      std::min(rect.x1 + margin, (float)buffer.width) <= wall.x1 &&
+                      std::max(rect.y0 - margin, 0.0f) >= wall.y0 &&
+                      std::min(rect.y1 + margin, (float)buffer.height) <= wall.y1;
+        if (inside && minZ > wallDepth + 1e-4f) {
+            return Expected::Hidden;
+        }
+    }
+    return Expected::Either;
+}
+
+// boxes behind, straddling and in front of the walls, plus some crossing
+// the near plane
+static std::vector<BoundingBox> createOccludees(size_t count)
+{
+    std::vector<BoundingBox> boxes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 halfSize(randomFloat(0.05f, 1.5f), randomFloat(0.05f, 1.5f), randomFloat(0.05f, 1.5f));
+        float z;
+        switch (i % 8)
+        {
+        case 0: z = randomFloat(-9.0f, -0.5f); break;                 // in front
+        case 1: z = WALL_Z + randomFloat(-halfSize.z, halfSize.z); break; // through the wall
+        case 2: z = randomFloat(-halfSize.z, halfSize.z) - 0.1f; break; // near plane
+        default: z = randomFloat(-40.0f, -12.0f); break;               // behind
+        }
+        float reach = -z * 0.7f + 2.0f;
+        glm::vec3 center(randomFloat(-reach, reach), randomFloat(-reach * 0.5f, reach * 0.5f), z);
+        BoundingBox box = {center - halfSize, center + halfSize};
+        boxes.push_back(box);
+    }
+    return boxes;
+}
+
+static bool check(const char* name, const std::vector<glm::vec3>& wallQuads, ThreadPool* pool)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f, 100.0f);
+    glm::mat4 projView = projection; // camera at the origin looking down -z
+
+    OcclusionCuller culler;
+    culler.Init(pool, 256, 128);
+    std::vector<BoundingBox> occludees = createOccludees(20000);
+    culler.Begin(projView, wallQuads, occludees);
+    culler.End();
+
+    const OcclusionBuffer& buffer = culler.GetBuffer();
+    std::vector<ScreenRect> walls;
+    for (size_t i = 0; i + 3 < wallQuads.size(); i += 4) {
+        walls.push_back(wallRect(wallQuads, i, projView, buffer));
+    }
+    float w;
+    float wallDepth = toScreen(projView, buffer, glm::vec3(0.0f, 0.0f, WALL_Z), w).z;
+
+    size_t numHidden = 0, numVisible = 0, numCulled = 0;
+    size_t hiddenKept = 0, visibleCulled = 0;
+    for (size_t i = 0; i < occludees.size(); ++i)
+    {
+        bool culled = !culler.IsVisible(i);
+        numCulled += culled;
+        Expected expected = classify(occludees[i], walls, wallDepth, projView, buffer);
+        if (expected == Expected::Hidden) {
+            numHidden++;
+            hiddenKept += !culled;
+        }
+        else if (expected == Expected::Visible) {
+            numVisible++;
+            visibleCulled += culled;
+        }
+    }
+
+    std::cout << name << (pool ? " (pool)" : "") << ": " << occludees.size() << " boxes, "
+        << numCulled << " culled (" << 100.0 * numCulled / occludees.size() << "%), "
+        << numHidden << " hidden of which " << hiddenKept << " kept, "
+        << numVisible << " visible of which " << visibleCulled << " culled" << std::endl;
+    return hiddenKept == 0 && visibleCulled == 0 && culler.GetStats().numOccluded == numCulled;
+}
+
+int main()
+{
+    ThreadPool pool;
+    pool.Init(2);
+
+    std::vector<glm::vec3> fullWall;
+    addWall(fullWall, -50.0f, -50.0f, 50.0f, 50.0f);
+
+    std::vector<glm::vec3> partialWall;
+    addWall(partialWall, -50.0f, -50.0f, 0.0f, 50.0f);
+
+    std::vector<glm::vec3> gapWall;
+    addWall(gapWall, -50.0f, -50.0f, -1.0f, 50.0f);
+    addWall(gapWall, 1.0f, -50.0f, 50.0f, 50.0f);
+
+    bool passed = true;
+    for (ThreadPool* p : {(ThreadPool*)nullptr, &pool})
+    {
+        gRandom.seed(1234);
+        passed &= check("full screen wall", fullWall, p);
+        passed &= check("partial wall", partialWall, p);
+        passed &= check("wall with a gap", gapWall, p);
+    }
+
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
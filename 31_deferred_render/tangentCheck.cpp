@@ -0,0 +1,162 @@
+// CPU only check of TangentSpace.h against tangents known in closed form:
+//
+//   quad          - one planar quad, tangent +u, sign +1, no splits
+//   mirrored quad - two quads sharing an edge, the second with its u
+//                   mirrored: sign -1 on that side and the two shared
+//                   vertices split
+//   cube          - one quad per face on a uv strip, two faces mirrored;
+//                   every face keeps its own tangent and sign, no splits
+//
+// every corner's tangent must point along dPosition/du and its sign must
+// rebuild dPosition/dv as sign * cross(normal, tangent). Each layout runs
+// inline, on a pool and on a pool that was never started
+//
+//   make tangentcheck
+//   ./tangentCheck
+
+#include <iostream>
+#include <vector>
+
+#include "TangentSpace.h"
+
+// one planar quad: corner o, edges U (along u) and V (along v), normal
+// cross(U, V). Mirrored quads run u the other way along U
+typedef struct TestQuad {
+    glm::vec3 o;
+    glm::vec3 U;
+    glm::vec3 V;
+    bool mirrored;
+    float uOffset; // where on the uv strip the quad starts
+    float uScale;
+} TestQuad;
+
+typedef struct TestMesh {
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<glm::vec3> faceTangent;   // per triangle, expected dP/du direction
+    std::vector<glm::vec3> faceBitangent; // per triangle, expected dP/dv direction
+} TestMesh;
+
+// vertices identical in position, normal and uv are shared, the way an
+// indexed importer would hand them over
+static GLuint addVertex(TestMesh& mesh, const glm::vec3& position,
+                        const glm::vec3& normal, const glm::vec2& texCoord)
+{
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const Vertex& vertex = mesh.vertices[i];
+        if (vertex.Position == position && vertex.Normal == normal && vertex.TexCoord == texCoord) {
+            return (GLuint)i;
+        }
+    }
+    Vertex vertex;
+    vertex.Position = position;
+    vertex.Normal = normal;
+    vertex.TexCoord = texCoord;
+    vertex.Tangent = 0;
+    mesh.vertices.push_back(vertex);
+    return (GLuint)(mesh.vertices.size() - 1);
+}
+
+static TestMesh createTestMesh(const std::vector<TestQuad>& quads)
+{
+    TestMesh mesh;
+    for (const TestQuad& quad : quads)
+    {
+        glm::vec3 normal = glm::normalize(glm::cross(quad.U, quad.V));
+        glm::vec3 corners[4] = {quad.o, quad.o + quad.U, quad.o + quad.U + quad.V, quad.o + quad.V};
+        float us[4] = {0.0f, 1.0f, 1.0f, 0.0f};
+        float vs[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+        GLuint index[4];
+        for (int c = 0; c < 4; c++)
+        {
+            float u = quad.mirrored ? 1.0f - us[c] : us[c];
+            index[c] = addVertex(mesh, corners[c], normal,
+                glm::vec2(quad.uOffset + u * quad.uScale, vs[c]));
+        }
+        GLuint triangles[6] = {index[0], index[1], index[2], index[0], index[2], index[3]};
+        mesh.indices.insert(mesh.indices.end(), triangles, triangles + 6);
+        for (int t = 0; t < 2; t++)
+        {
+            mesh.faceTangent.push_back(glm::normalize(quad.mirrored ? -quad.U : quad.U));
+            mesh.faceBitangent.push_back(glm::normalize(quad.V));
+        }
+    }
+    return mesh;
+}
+
+static bool check(const char* name, const std::vector<TestQuad>& quads,
+                  size_t expectedVertices, ThreadPool* pool, const char* poolName)
+{
+    TestMesh mesh = createTestMesh(quads);
+    size_t numInput = mesh.vertices.size();
+    std::vector<TangentSpaceMesh> meshes;
+    meshes.push_back(createTangentSpaceMesh(mesh.vertices, mesh.indices));
+    generateTangentSpaces(meshes, pool);
+
+    // ~1/511 from the 10 bit packing
+    const float tolerance = 0.01f;
+    size_t numBad = 0;
+    size_t numMirrored = 0;
+    for (size_t corner = 0; corner < mesh.indices.size(); corner++)
+    {
+        const Vertex& vertex = mesh.vertices[mesh.indices[corner]];
+        glm::vec4 packed = unpackTangent(vertex.Tangent);
+        glm::vec3 tangent = glm::normalize(glm::vec3(packed.x, packed.y, packed.z));
+        glm::vec3 bitangent = packed.w * glm::cross(vertex.Normal, tangent);
+        numMirrored += packed.w < 0.0f;
+        if (glm::length(tangent - mesh.faceTangent[corner / 3]) > tolerance ||
+            glm::length(bitangent - mesh.faceBitangent[corner / 3]) > tolerance) {
+            numBad++;
+        }
+    }
+
+    bool passed = numBad == 0 && mesh.vertices.size() == expectedVertices &&
+        meshes[0].numSplitVertices == expectedVertices - numInput;
+    std::cout << name << " (" << poolName << "): " << numInput << " -> "
+        << mesh.vertices.size() << " vertices (expected " << expectedVertices << "), "
+        << numMirrored << " / " << mesh.indices.size() << " corners mirrored, "
+        << numBad << " wrong" << std::endl;
+    return passed;
+}
+
+int main()
+{
+    std::vector<TestQuad> quad = {
+        {glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), false, 0.0f, 1.0f},
+    };
+
+    // u runs 0 -> 1 -> 0 across the shared edge at x = 1
+    std::vector<TestQuad> mirroredQuad = {
+        {glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), false, 0.0f, 1.0f},
+        {glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), true, 0.0f, 1.0f},
+    };
+
+    // faces on a strip of six, -x and -z mirrored; the faces meet along uv
+    // seams but have their own normals, so nothing is welded across them
+    std::vector<TestQuad> cube = {
+        {glm::vec3(1.0f, -1.0f, 1.0f), glm::vec3(0.0f, 0.0f, -2.0f), glm::vec3(0.0f, 2.0f, 0.0f), false, 0.0f / 6.0f, 1.0f / 6.0f},
+        {glm::vec3(-1.0f, -1.0f, -1.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 2.0f, 0.0f), true, 1.0f / 6.0f, 1.0f / 6.0f},
+        {glm::vec3(-1.0f, 1.0f, 1.0f), glm::vec3(2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -2.0f), false, 2.0f / 6.0f, 1.0f / 6.0f},
+        {glm::vec3(-1.0f, -1.0f, -1.0f), glm::vec3(2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 2.0f), false, 3.0f / 6.0f, 1.0f / 6.0f},
+        {glm::vec3(-1.0f, -1.0f, 1.0f), glm::vec3(2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 2.0f, 0.0f), false, 4.0f / 6.0f, 1.0f / 6.0f},
+        {glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(-2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 2.0f, 0.0f), true, 5.0f / 6.0f, 1.0f / 6.0f},
+    };
+
+    ThreadPool pool;
+    pool.Init(2);
+    ThreadPool idlePool; // never started: the work has to run inline
+
+    bool passed = true;
+    struct { ThreadPool* pool; const char* name; } runs[] = {
+        {nullptr, "inline"}, {&pool, "pool"}, {&idlePool, "idle pool"}};
+    for (const auto& run : runs)
+    {
+        passed &= check("quad", quad, 4, run.pool, run.name);
+        passed &= check("mirrored quad", mirroredQuad, 8, run.pool, run.name);
+        passed &= check("cube", cube, 24, run.pool, run.name);
+    }
+
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;            // unit sphere
+layout (location = 3) in vec4 aLightPosRadius;  // per light
+layout (location = 4) in vec3 aLightColor;      // per light
+
+flat out vec4 LightPosRadius;
+flat out vec3 LightColor;
+
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+void main()
+{
+    vec3 worldPos = aLightPosRadius.xyz + aPos * aLightPosRadius.w;
+    gl_Position = uProjection * uView * vec4(worldPos, 1.0);
+    LightPosRadius = aLightPosRadius;
+    LightColor = aLightColor;
+}
@@ -0,0 +1,282 @@
+#ifndef DYNAMIC_RESOLUTION_H_INCLUDED
+#define DYNAMIC_RESOLUTION_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "ChromeTrace.h"
+
+typedef struct DynamicResolutionSettings {
+    double targetMs;        // GPU frame time to hold
+    float minScale;         // of the output size, per axis
+    float maxScale;
+    double shrinkAbove;     // shrink when smoothed ms > targetMs * shrinkAbove
+    double growBelow;       // grow when smoothed ms < targetMs * growBelow
+    size_t settleFrames;    // frames to wait after a change before the next
+    double smoothing;       // weight of the newest frame in the average
+    size_t alignPixels;     // render sizes are multiples of this
+} DynamicResolutionSettings;
+
+DynamicResolutionSettings createDynamicResolutionSettings(double targetMs)
+{
+    DynamicResolutionSettings settings;
+    settings.targetMs = targetMs;
+    settings.minScale = 0.5f;
+    settings.maxScale = 1.0f;
+    settings.shrinkAbove = 1.0;
+    settings.growBelow = 0.85;
+    settings.settleFrames = 8;
+    settings.smoothing = 0.2;
+    settings.alignPixels = 8;
+    return settings;
+}
+
+// picks the internal render resolution from the measured GPU frame time.
+// Render targets are allocated once at maxScale and each frame renders
+// into the bottom left GetRenderWidth() x GetRenderHeight() of them, so a
+// change of scale never reallocates anything; passes that sample those
+// targets scale their texture coordinates by GetUvScaleX()/Y().
+//
+// GPU cost is roughly proportional to pixels, i.e. scale squared, so
+// Update() jumps straight to the scale that should land on the target
+// instead of stepping. Between shrinkAbove and growBelow it holds still,
+// and after a change it waits settleFrames, more than the profiler's
+// readback latency, so it never reacts to frames rendered at the old size.
+//
+//   gDynamicResolution.Update(gpuFrameMs);
+//   glViewport(0, 0, gDynamicResolution.GetRenderWidth(), gDynamicResolution.GetRenderHeight());
+class DynamicResolution
+{
+public:
+
+    DynamicResolution() :
+        outputWidth(0),
+        outputHeight(0),
+        targetWidth(0),
+        targetHeight(0),
+        renderWidth(0),
+        renderHeight(0),
+        scale(1.0f),
+        smoothedMs(0.0),
+        framesSinceChange(0),
+        enabled(true),
+        captureStartUs(-1.0)
+    {}
+
+    // outputWidth x outputHeight = the size upscaled to
+    void Init(size_t outputWidth,
+        size_t outputHeight,
+        const DynamicResolutionSettings& settings)
+    {
+        this->outputWidth = outputWidth;
+        this->outputHeight = outputHeight;
+        this->settings = settings;
+        targetWidth = alignUp(size_t(std::ceil(outputWidth * settings.maxScale)));
+        targetHeight = alignUp(size_t(std::ceil(outputHeight * settings.maxScale)));
+        scale = settings.maxScale;
+        smoothedMs = 0.0;
+        framesSinceChange = 0;
+        history.clear();
+        applyScale(scale);
+    }
+
+    // gpuMs = the latest resolved GPU frame time, 0 if there isn't one yet
+    void Update(double gpuMs)
+    {
+        framesSinceChange++;
+        if (gpuMs <= 0.0) {
+            return;
+        }
+        smoothedMs = smoothedMs > 0.0 ?
+            smoothedMs + settings.smoothing * (gpuMs - smoothedMs) :
+            gpuMs;
+        record(gpuMs);
+
+        if (!enabled || framesSinceChange < settings.settleFrames) {
+            return;
+        }
+        bool overBudget = smoothedMs > settings.targetMs * settings.shrinkAbove;
+        bool underBudget = smoothedMs < settings.targetMs * settings.growBelow;
+        if (!overBudget && !underBudget) {
+            return;
+        }
+
+        // aim a little under the target so the next frame isn't right on
+        // the shrink threshold again
+        double aimMs = settings.targetMs * (1.0 + settings.growBelow) * 0.5;
+        float wanted = scale * float(std::sqrt(aimMs / smoothedMs));
+        wanted = std::min(std::max(wanted, settings.minScale), settings.maxScale);
+        // don't grow past the target in one go
+        if (underBudget && wanted > scale) {
+            wanted = std::min(wanted, scale * 1.25f);
+        }
+
+        size_t oldWidth = renderWidth;
+        size_t oldHeight = renderHeight;
+        applyScale(wanted);
+        if (renderWidth != oldWidth || renderHeight != oldHeight) {
+            // the next measurements are of the old size; start the
+            // average over from what the new size should cost
+            double ratio = double(renderWidth * renderHeight) / double(oldWidth * oldHeight);
+            smoothedMs *= ratio;
+            framesSinceChange = 0;
+        }
+    }
+
+    // disabled = render at maxScale, still measuring
+    void SetEnabled(bool enabled)
+    {
+        this->enabled = enabled;
+        if (!enabled) {
+            applyScale(settings.maxScale);
+            framesSinceChange = 0;
+        }
+    }
+    bool IsEnabled() const { return enabled; }
+
+    void SetTargetMs(double targetMs) { settings.targetMs = targetMs; }
+    double GetTargetMs() const { return settings.targetMs; }
+
+    // size to allocate the render targets at
+    size_t GetTargetWidth() const { return targetWidth; }
+    size_t GetTargetHeight() const { return targetHeight; }
+    // the part of them rendered this frame
+    size_t GetRenderWidth() const { return renderWidth; }
+    size_t GetRenderHeight() const { return renderHeight; }
+    float GetScale() const { return scale; }
+    double GetSmoothedMs() const { return smoothedMs; }
+    // texture coordinates [0, 1] over the rendered part -> over the targets
+    float GetUvScaleX() const { return float(renderWidth) / float(targetWidth); }
+    float GetUvScaleY() const { return float(renderHeight) / float(targetHeight); }
+
+    void Print() const
+    {
+        std::cout << "Dynamic resolution " << (enabled ? "on" : "off")
+            << ": " << renderWidth << "x" << renderHeight
+            << " (scale " << scale << ")"
+            << ", GPU " << smoothedMs << " ms, target " << settings.targetMs << " ms"
+            << std::endl;
+    }
+
+    // marks the start of a GpuProfiler capture; AppendEvents() then adds
+    // everything recorded since as counters, for the addEvents argument
+    // of GpuProfiler::StartCapture()
+    void StartCapture()
+    {
+        captureStartUs = chromeTraceNowUs();
+    }
+
+    void AppendEvents(std::vector<ChromeTraceEvent>& events,
+        std::vector<std::string>& threadNames)
+    {
+        if (captureStartUs < 0.0) {
+            return;
+        }
+        int threadID = (int)threadNames.size();
+        threadNames.push_back("Dynamic resolution");
+
+        size_t numFrames = 0;
+        size_t numOverBudget = 0;
+        double sumMs = 0.0;
+        double maxMs = 0.0;
+        float minScale = settings.maxScale;
+        float maxScale = 0.0f;
+        for (const Sample& sample : history)
+        {
+            if (sample.timeUs < captureStartUs) {
+                continue;
+            }
+            ChromeTraceEvent event;
+            event.category = "dynres";
+            event.phase = 'C';
+            event.startUs = sample.timeUs;
+            event.durationUs = 0.0;
+            event.threadID = threadID;
+            event.name = "GPU frame ms";
+            event.value = sample.gpuMs;
+            events.push_back(event);
+            event.name = "Target ms";
+            event.value = sample.targetMs;
+            events.push_back(event);
+            event.name = "Render scale %";
+            event.value = sample.scale * 100.0;
+            events.push_back(event);
+
+            numFrames++;
+            numOverBudget += sample.gpuMs > sample.targetMs ? 1 : 0;
+            sumMs += sample.gpuMs;
+            maxMs = std::max(maxMs, sample.gpuMs);
+            minScale = std::min(minScale, sample.scale);
+            maxScale = std::max(maxScale, sample.scale);
+        }
+        captureStartUs = -1.0;
+
+        if (numFrames > 0) {
+            std::cout << "Dynamic resolution over " << numFrames << " frames: GPU avg "
+                << sumMs / numFrames << " ms, max " << maxMs << " ms, "
+                << 100.0 * numOverBudget / numFrames << "% over budget, scale "
+                << minScale << " - " << maxScale << std::endl;
+        }
+    }
+
+private:
+
+    typedef struct Sample {
+        double timeUs;      // chromeTraceNowUs() when it was resolved
+        double gpuMs;
+        double targetMs;
+        float scale;        // when it was resolved, not when it was rendered
+    } Sample;
+
+    size_t outputWidth;
+    size_t outputHeight;
+    size_t targetWidth;
+    size_t targetHeight;
+    size_t renderWidth;
+    size_t renderHeight;
+    float scale;
+    double smoothedMs;
+    size_t framesSinceChange;
+    bool enabled;
+    DynamicResolutionSettings settings;
+
+    // up to the last kMaxHistory frames, oldest first
+    static const size_t kMaxHistory = 4096;
+    std::vector<Sample> history;
+    double captureStartUs; // < 0 when not capturing
+
+    size_t alignUp(size_t pixels) const
+    {
+        size_t align = std::max<size_t>(settings.alignPixels, 1);
+        return (pixels + align - 1) / align * align;
+    }
+
+    void applyScale(float newScale)
+    {
+        renderWidth = std::min(alignUp(size_t(outputWidth * newScale + 0.5f)), targetWidth);
+        renderHeight = std::min(alignUp(size_t(outputHeight * newScale + 0.5f)), targetHeight);
+        scale = float(renderWidth) / float(outputWidth);
+    }
+
+    void record(double gpuMs)
+    {
+        Sample sample;
+        sample.timeUs = chromeTraceNowUs();
+        sample.gpuMs = gpuMs;
+        sample.targetMs = settings.targetMs;
+        sample.scale = scale;
+        if (history.size() < kMaxHistory) {
+            history.push_back(sample);
+        }
+        else {
+            // drop the older half rather than shifting every frame
+            history.erase(history.begin(), history.begin() + kMaxHistory / 2);
+            history.push_back(sample);
+        }
+    }
+};
+
+#endif // !DYNAMIC_RESOLUTION_H_INCLUDED
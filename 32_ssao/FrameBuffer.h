@@ -11,11 +11,11 @@ typedef struct FrameBuffer {
     size_t height;
 } FrameBuffer;
 
-FrameBuffer createFrameBuffer() 
+FrameBuffer createFrameBuffer(size_t width = 800, size_t height = 600)
 {
     FrameBuffer frameBuffer;
-    frameBuffer.width = 800;
-    frameBuffer.height = 600;
+    frameBuffer.width = width;
+    frameBuffer.height = height;
 
     glGenFramebuffers(1, &frameBuffer.id);
     glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.id);
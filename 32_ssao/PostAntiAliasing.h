@@ -0,0 +1,336 @@
+#ifndef POST_ANTI_ALIASING_H_INCLUDED
+#define POST_ANTI_ALIASING_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "ShaderProgram.h"
+#include "ScreenTexture.h"
+#include "GpuProfiler.h"
+
+enum class PostAAMode {
+    Off,
+    FXAA,   // one pass, luma based (Lottes' FXAA 2)
+    SMAA    // SMAA 1x: edges, blend weights, neighborhood blending
+};
+
+const char* postAAModeName(PostAAMode mode)
+{
+    switch (mode)
+    {
+    case PostAAMode::FXAA: return "FXAA";
+    case PostAAMode::SMAA: return "SMAA 1x";
+    default: return "off";
+    }
+}
+
+// longest edge run the SMAA area table knows; fragmentShader_smaaWeights.glsl
+// searches 2 pixels per step for up to 16 steps, so one more than that
+const size_t SMAA_AREA_MAX_DISTANCE = 33;
+
+// the SMAA area table, as RG8 texels: 4x4 blocks of crossing edge patterns
+// (the left/bottom end's on x, the right/top end's on y), each
+// SMAA_AREA_MAX_DISTANCE squared, indexed by the pixel's distance to
+// either end of its edge run.
+//
+// A crossing edge pattern says which side of the run a perpendicular edge
+// leaves it on at that end: 1 = the far side, 2 = the pixel's own side,
+// 0 or 3 = neither or both, which says nothing about the slope. Like MLAA
+// the real edge is taken to be a line from half a pixel towards the
+// crossing edge at each end to the middle of the run; r is how much of the
+// pixel it cuts off to the far side, g how much of the far pixel it cuts
+// off to this side
+void computeSMAAAreaTable(std::vector<uint8_t>& texels)
+{
+    const size_t D = SMAA_AREA_MAX_DISTANCE;
+    const int numSamples = 64; // per pixel, plenty for 8 bits
+    texels.assign(4 * D * 4 * D * 2, 0);
+
+    for (int e2 = 0; e2 < 4; e2++)
+    for (int e1 = 0; e1 < 4; e1++)
+    {
+        float heights[4] = { 0.0f, -0.5f, 0.5f, 0.0f };
+        float startHeight = heights[e1];
+        float endHeight = heights[e2];
+        for (size_t d2 = 0; d2 < D; d2++)
+        for (size_t d1 = 0; d1 < D; d1++)
+        {
+            // this pixel spans [0, 1]
+            float start = -float(d1);
+            float end = float(d2) + 1.0f;
+            float middle = 0.5f * (start + end);
+
+            float ownSide = 0.0f;
+            float farSide = 0.0f;
+            for (int s = 0; s < numSamples; s++)
+            {
+                float x = (float(s) + 0.5f) / float(numSamples);
+                float height = x < middle ?
+                    startHeight * (middle - x) / (middle - start) :
+                    endHeight * (x - middle) / (end - middle);
+                ownSide += std::max(height, 0.0f);
+                farSide += std::max(-height, 0.0f);
+            }
+            ownSide /= float(numSamples);
+            farSide /= float(numSamples);
+
+            size_t x = size_t(e1) * D + d1;
+            size_t y = size_t(e2) * D + d2;
+            uint8_t* texel = &texels[(y * 4 * D + x) * 2];
+            texel[0] = uint8_t(std::lround(ownSide * 255.0f));
+            texel[1] = uint8_t(std::lround(farSide * 255.0f));
+        }
+    }
+}
+
+// anti-aliasing as a post process on the tone mapped image, for when
+// multisampling would mean multisampling every G-buffer attachment.
+// Targets are allocated once at Init()'s size and Apply() works on the
+// bottom left part of them that was rendered this frame, like
+// DynamicResolution.h.
+//
+// SMAA follows Jimenez et al.'s three passes but searches edge runs with
+// linear fetches a quarter texel off center, which weigh the two texels
+// they cover 0.75/0.25 so the result tells exactly which have an edge;
+// that does the job of SMAA's search texture with plain arithmetic.
+// Diagonal and corner detection are left out
+class PostAntiAliasing
+{
+public:
+
+    PostAntiAliasing() :
+        mode(PostAAMode::SMAA),
+        width(0),
+        height(0),
+        outputBuffer(0),
+        outputTexture(0),
+        edgesBuffer(0),
+        edgesTexture(0),
+        weightsBuffer(0),
+        weightsTexture(0),
+        areaTexture(0)
+    {}
+    ~PostAntiAliasing() {}
+
+    void Init(size_t width, size_t height)
+    {
+        this->width = width;
+        this->height = height;
+
+        vertexShader = createVertexShader("vertexShader_debugBuffer.glsl");
+        fxaa = createPass("fragmentShader_fxaa.glsl");
+        smaaEdges = createPass("fragmentShader_smaaEdges.glsl");
+        smaaWeights = createPass("fragmentShader_smaaWeights.glsl");
+        smaaBlend = createPass("fragmentShader_smaaBlend.glsl");
+
+        createTarget(GL_RGBA8, GL_RGBA, GL_LINEAR, GL_CLAMP_TO_EDGE, outputBuffer, outputTexture);
+        // the weights pass' linear fetches must read 0 past the image
+        createTarget(GL_RG8, GL_RG, GL_LINEAR, GL_CLAMP_TO_BORDER, edgesBuffer, edgesTexture);
+        createTarget(GL_RGBA8, GL_RGBA, GL_NEAREST, GL_CLAMP_TO_EDGE, weightsBuffer, weightsTexture);
+
+        std::vector<uint8_t> area;
+        computeSMAAAreaTable(area);
+        glGenTextures(1, &areaTexture);
+        glBindTexture(GL_TEXTURE_2D, areaTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, 4 * SMAA_AREA_MAX_DISTANCE, 4 * SMAA_AREA_MAX_DISTANCE,
+            0, GL_RG, GL_UNSIGNED_BYTE, &area[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // anti-aliases the bottom left renderWidth x renderHeight of input, a
+    // linear filtered texture of Init()'s size in [0, 1], and returns the
+    // texture with the result in the same place; input itself when Off.
+    // Leaves the default framebuffer bound
+    GLuint Apply(GLuint input,
+        size_t renderWidth,
+        size_t renderHeight,
+        const ScreenTexture& screenTexture,
+        GpuProfiler* profiler)
+    {
+        if (mode == PostAAMode::Off) {
+            return input;
+        }
+
+        glViewport(0, 0, (GLsizei)renderWidth, (GLsizei)renderHeight);
+        glBindVertexArray(screenTexture.VAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        if (mode == PostAAMode::FXAA) {
+            if (profiler) {
+                profiler->Push("FXAA");
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, outputBuffer);
+            usePass(fxaa, renderWidth, renderHeight);
+            glBindTexture(GL_TEXTURE_2D, input);
+            glUniform1i(fxaa.uInput, 0);
+            glDrawArrays(GL_TRIANGLES, 0, screenTexture.numVertices);
+            if (profiler) {
+                profiler->Pop();
+            }
+        }
+        else {
+            // edges and weights outside the rendered part must read as 0,
+            // and a bigger earlier frame may have left some there
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            if (profiler) {
+                profiler->Push("SMAA edges");
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, edgesBuffer);
+            glClear(GL_COLOR_BUFFER_BIT);
+            usePass(smaaEdges, renderWidth, renderHeight);
+            glBindTexture(GL_TEXTURE_2D, input);
+            glUniform1i(smaaEdges.uInput, 0);
+            glDrawArrays(GL_TRIANGLES, 0, screenTexture.numVertices);
+            if (profiler) {
+                profiler->Pop();
+                profiler->Push("SMAA weights");
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, weightsBuffer);
+            glClear(GL_COLOR_BUFFER_BIT);
+            usePass(smaaWeights, renderWidth, renderHeight);
+            glBindTexture(GL_TEXTURE_2D, edgesTexture);
+            glUniform1i(smaaWeights.uInput, 0);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, areaTexture);
+            glUniform1i(smaaWeights.uTexture, 1);
+            glDrawArrays(GL_TRIANGLES, 0, screenTexture.numVertices);
+            if (profiler) {
+                profiler->Pop();
+                profiler->Push("SMAA blend");
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, outputBuffer);
+            usePass(smaaBlend, renderWidth, renderHeight);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, input);
+            glUniform1i(smaaBlend.uInput, 0);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, weightsTexture);
+            glUniform1i(smaaBlend.uTexture, 1);
+            glDrawArrays(GL_TRIANGLES, 0, screenTexture.numVertices);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glActiveTexture(GL_TEXTURE0);
+            if (profiler) {
+                profiler->Pop();
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindVertexArray(0);
+        return outputTexture;
+    }
+
+    void SetMode(PostAAMode mode) { this->mode = mode; }
+    PostAAMode GetMode() const { return mode; }
+
+    // render target and lookup table memory a mode needs at Init()'s size
+    size_t GetMemoryBytes(PostAAMode mode) const
+    {
+        size_t numPixels = width * height;
+        if (mode == PostAAMode::FXAA) {
+            return numPixels * 4;
+        }
+        if (mode == PostAAMode::SMAA) {
+            size_t areaBytes = 4 * SMAA_AREA_MAX_DISTANCE * 4 * SMAA_AREA_MAX_DISTANCE * 2;
+            return numPixels * (4 + 2 + 4) + areaBytes;
+        }
+        return 0;
+    }
+
+    void Delete()
+    {
+        const Pass* passes[4] = { &fxaa, &smaaEdges, &smaaWeights, &smaaBlend };
+        for (const Pass* pass : passes)
+        {
+            glDeleteProgram(pass->program.id);
+            glDeleteShader(pass->fragmentShader.id);
+        }
+        glDeleteShader(vertexShader.id);
+        GLuint buffers[3] = { outputBuffer, edgesBuffer, weightsBuffer };
+        GLuint textures[4] = { outputTexture, edgesTexture, weightsTexture, areaTexture };
+        glDeleteFramebuffers(3, buffers);
+        glDeleteTextures(4, textures);
+        outputBuffer = edgesBuffer = weightsBuffer = 0;
+        outputTexture = edgesTexture = weightsTexture = areaTexture = 0;
+    }
+
+private:
+
+    typedef struct Pass {
+        Shader fragmentShader;
+        ShaderProgram program;
+        GLint uInput;
+        GLint uTexture;     // the pass' second texture, -1 if none
+        GLint uRenderSize;
+    } Pass;
+
+    PostAAMode mode;
+    size_t width;
+    size_t height;
+
+    Shader vertexShader;
+    Pass fxaa;
+    Pass smaaEdges;
+    Pass smaaWeights;
+    Pass smaaBlend;
+
+    GLuint outputBuffer;
+    GLuint outputTexture;   // RGBA8
+    GLuint edgesBuffer;
+    GLuint edgesTexture;    // RG8: edge on the left, edge below
+    GLuint weightsBuffer;
+    GLuint weightsTexture;  // RGBA8, see fragmentShader_smaaWeights.glsl
+    GLuint areaTexture;     // computeSMAAAreaTable()
+
+    Pass createPass(const std::string& fragmentShaderName)
+    {
+        Pass pass;
+        pass.fragmentShader = createFragmentShader(fragmentShaderName);
+        pass.program = createShaderProgram(vertexShader, pass.fragmentShader);
+        pass.uInput = glGetUniformLocation(pass.program.id, "uInput");
+        pass.uTexture = glGetUniformLocation(pass.program.id, "uTexture");
+        pass.uRenderSize = glGetUniformLocation(pass.program.id, "uRenderSize");
+        return pass;
+    }
+
+    void usePass(const Pass& pass, size_t renderWidth, size_t renderHeight)
+    {
+        glUseProgram(pass.program.id);
+        glUniform2i(pass.uRenderSize, (GLint)renderWidth, (GLint)renderHeight);
+    }
+
+    void createTarget(GLint internalFormat,
+        GLenum format,
+        GLint filter,
+        GLint wrap,
+        GLuint& buffer,
+        GLuint& texture)
+    {
+        glGenFramebuffers(1, &buffer);
+        glGenTextures(1, &texture);
+        glBindFramebuffer(GL_FRAMEBUFFER, buffer);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Post AA framebuffer not complete" << std::endl;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+#endif // !POST_ANTI_ALIASING_H_INCLUDED
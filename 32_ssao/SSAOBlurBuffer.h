@@ -11,11 +11,11 @@ typedef struct SSAOBlurBuffer {
     size_t height;
 } SSAOBlurBuffer;
 
-SSAOBlurBuffer createSSAOBlurBuffer() 
+SSAOBlurBuffer createSSAOBlurBuffer(size_t width = 800, size_t height = 600)
 {
     SSAOBlurBuffer frameBuffer;
-    frameBuffer.width = 800; // screen width and height
-    frameBuffer.height = 600;
+    frameBuffer.width = width;
+    frameBuffer.height = height;
 
     glGenFramebuffers(1, &frameBuffer.id);
     glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.id);
@@ -36,6 +36,8 @@ SSAOBlurBuffer createSSAOBlurBuffer()
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // only the rendered part (see uUvScale) is valid
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glFramebufferTexture2D(GL_FRAMEBUFFER, 
                             GL_COLOR_ATTACHMENT0,
                             GL_TEXTURE_2D, 
@@ -4,99 +4,157 @@
 #include <glad/glad.h>
 
 typedef struct SSAOGeometryBuffer {
-    GLuint colorBufferIDs[3];
-    GLuint renderBufferID;
+    GLuint colorBufferIDs[4]; // position, normal, albedo, velocity
+    GLuint depthTextureID;
     GLuint id;
     size_t width;
     size_t height;
+    bool compact;
 } SSAOGeometryBuffer;
 
-SSAOGeometryBuffer createSSAOGeometryBuffer() 
+// bytes per pixel of every attachment, depth included
+size_t ssaoGeometryBufferBytesPerPixel(bool compact)
+{
+    return compact ?
+        4 + 4 + 4 + 4 :     // normal RG16, albedo RGBA8, velocity RG16F, depth 24
+        8 + 8 + 4 + 4 + 4;  // position RGBA16F, normal RGBA16F, albedo, velocity, depth
+}
+
+// all attachments are width x height.
+// compact leaves out the position attachment (colorBufferIDs[0] = 0);
+// shaders rebuild the position from the depth texture and the inverse
+// projection, and normals are octahedral encoded into the two channels
+// of an RG16 attachment instead of stored as floats
+SSAOGeometryBuffer createSSAOGeometryBuffer(size_t width = 800, size_t height = 600, bool compact = false)
 {
     SSAOGeometryBuffer frameBuffer;
-    frameBuffer.width = 800; // screen width and height
-    frameBuffer.height = 600;
+    frameBuffer.width = width;
+    frameBuffer.height = height;
+    frameBuffer.compact = compact;
 
     glGenFramebuffers(1, &frameBuffer.id);
     glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.id);
 
-    glGenTextures(3, frameBuffer.colorBufferIDs);
+    frameBuffer.colorBufferIDs[0] = 0;
+    glGenTextures(3, &frameBuffer.colorBufferIDs[1]);
 
     // Position buffer
-    glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[0]);
+    if (!compact) {
+        glGenTextures(1, &frameBuffer.colorBufferIDs[0]);
+        glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[0]);
+        glTexImage2D(GL_TEXTURE_2D, 
+                     0, 
+                    GL_RGBA16F, // floating point in order to store values > 1.0 (GL_RGB clamps them)
+                    frameBuffer.width,        // note if this size was different than window size we'd have to call glViewport() to render the full screen
+                    frameBuffer.height, 
+                    0, 
+                    GL_RGBA, 
+                    GL_FLOAT,  // GL_FLOAT now instead of GL_UNSIGNED_BYTE
+                    NULL);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, 
+                                GL_COLOR_ATTACHMENT0,
+                                GL_TEXTURE_2D, 
+                                frameBuffer.colorBufferIDs[0], 
+                                0);
+    }
+
+    // normal buffer
+    glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[1]);
     glTexImage2D(GL_TEXTURE_2D, 
                  0, 
-                GL_RGBA16F, // floating point in order to store values > 1.0 (GL_RGB clamps them)
+                compact ? GL_RG16 : GL_RGBA16F, // octahedral [0, 1] or floating point xyz
                 frameBuffer.width,        // note if this size was different than window size we'd have to call glViewport() to render the full screen
                 frameBuffer.height, 
                 0, 
-                GL_RGBA, 
-                GL_FLOAT,  // GL_FLOAT now instead of GL_UNSIGNED_BYTE
+                compact ? GL_RG : GL_RGBA, 
+                GL_FLOAT,
                 NULL);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glFramebufferTexture2D(GL_FRAMEBUFFER, 
-                            GL_COLOR_ATTACHMENT0,
+                            GL_COLOR_ATTACHMENT1,
                             GL_TEXTURE_2D, 
-                            frameBuffer.colorBufferIDs[0], 
+                            frameBuffer.colorBufferIDs[1], 
                             0);
 
-    // normal buffer
-    glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[1]);
+    // color (albedo) and specular buffer
+    glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[2]);
     glTexImage2D(GL_TEXTURE_2D, 
                  0, 
-                GL_RGBA16F, // floating point in order to store values > 1.0 (GL_RGB clamps them)
+                GL_RGBA, 
                 frameBuffer.width,        // note if this size was different than window size we'd have to call glViewport() to render the full screen
                 frameBuffer.height, 
                 0, 
                 GL_RGBA, 
-                GL_FLOAT,  // GL_FLOAT now instead of GL_UNSIGNED_BYTE
+                GL_UNSIGNED_BYTE,
                 NULL);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, 
-                            GL_COLOR_ATTACHMENT1,
+                            GL_COLOR_ATTACHMENT2,
                             GL_TEXTURE_2D, 
-                            frameBuffer.colorBufferIDs[1], 
+                            frameBuffer.colorBufferIDs[2], 
                             0);
 
-    // color (albedo) and specular buffer
-    glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[2]);
+    // screen space motion since the last frame, for temporal AA
+    glBindTexture(GL_TEXTURE_2D, frameBuffer.colorBufferIDs[3]);
     glTexImage2D(GL_TEXTURE_2D, 
                  0, 
-                GL_RGBA, 
-                frameBuffer.width,        // note if this size was different than window size we'd have to call glViewport() to render the full screen
+                GL_RG16F, // texture coordinate deltas, well under a texel for slow motion
+                frameBuffer.width,
                 frameBuffer.height, 
                 0, 
-                GL_RGBA, 
-                GL_UNSIGNED_BYTE,
+                GL_RG, 
+                GL_FLOAT,
                 NULL);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_FRAMEBUFFER, 
-                            GL_COLOR_ATTACHMENT2,
+                            GL_COLOR_ATTACHMENT3,
                             GL_TEXTURE_2D, 
-                            frameBuffer.colorBufferIDs[2], 
+                            frameBuffer.colorBufferIDs[3], 
+                            0);
+
+    // depth is a texture rather than a renderbuffer so later passes can
+    // read it: temporal AA always, and everything in the compact layout
+    glGenTextures(1, &frameBuffer.depthTextureID);
+    glBindTexture(GL_TEXTURE_2D, frameBuffer.depthTextureID);
+    glTexImage2D(GL_TEXTURE_2D, 
+                 0, 
+                GL_DEPTH_COMPONENT24,
+                frameBuffer.width, 
+                frameBuffer.height, 
+                0, 
+                GL_DEPTH_COMPONENT, 
+                GL_FLOAT,
+                NULL);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, 
+                            GL_DEPTH_ATTACHMENT,
+                            GL_TEXTURE_2D, 
+                            frameBuffer.depthTextureID, 
                             0);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    glGenRenderbuffers(1, &frameBuffer.renderBufferID);
-    glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer.renderBufferID);
-    glRenderbufferStorage(GL_RENDERBUFFER, 
-                            GL_DEPTH_COMPONENT,
-                            frameBuffer.width, 
-                            frameBuffer.height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, 
-                                GL_DEPTH_ATTACHMENT, 
-                                GL_RENDERBUFFER, 
-                                frameBuffer.renderBufferID);
-    // tell OpenGL which color attachments we'll use for this framebuffer
-    static GLuint attachments[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
-    glDrawBuffers(3, attachments);
+    // tell OpenGL which color attachments we'll use for this framebuffer;
+    // the geometry shader's position output goes nowhere when compact
+    GLuint attachments[4] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+    if (compact) {
+        attachments[0] = GL_NONE;
+    }
+    glDrawBuffers(4, attachments);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         std::cout << "Framebuffer error: incomplete" << std::endl;
         exit(0);
@@ -11,11 +11,11 @@ typedef struct SSAOOutputBuffer {
     size_t height;
 } SSAOOutputBuffer;
 
-SSAOOutputBuffer createSSAOOutputBuffer() 
+SSAOOutputBuffer createSSAOOutputBuffer(size_t width = 800, size_t height = 600)
 {
     SSAOOutputBuffer frameBuffer;
-    frameBuffer.width = 800; // screen width and height
-    frameBuffer.height = 600;
+    frameBuffer.width = width;
+    frameBuffer.height = height;
 
     glGenFramebuffers(1, &frameBuffer.id);
     glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer.id);
@@ -36,6 +36,8 @@ SSAOOutputBuffer createSSAOOutputBuffer()
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // only the rendered part (see uUvScale) is valid
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glFramebufferTexture2D(GL_FRAMEBUFFER, 
                             GL_COLOR_ATTACHMENT0,
                             GL_TEXTURE_2D, 
@@ -0,0 +1,243 @@
+#ifndef TEMPORAL_AA_H_INCLUDED
+#define TEMPORAL_AA_H_INCLUDED
+
+#include <iostream>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Shader.h"
+#include "ShaderProgram.h"
+#include "ScreenTexture.h"
+#include "Transform.h"
+#include "GpuProfiler.h"
+
+// frames in the jitter pattern; 8 Halton points cover a pixel well
+// enough and keep the pattern short
+const size_t TAA_JITTER_PHASES = 8;
+
+// temporal anti-aliasing: every frame is rendered with the projection
+// moved by a different sub-pixel offset, and Resolve() blends it into a
+// history of the previous frames, found again through the G-buffer's
+// motion vectors. History that doesn't match what's there now (because
+// something moved in front of it or the lighting changed) is clipped to
+// the color range of the current pixel's neighbours, in YCoCg where
+// that range is a tighter box.
+//
+//   gTemporalAA.BeginFrame(projection * view, renderWidth, renderHeight);
+//   gTemporalAA.JitterProjection(projection);
+//   ... G-buffer pass with uPrevViewProjection = GetPrevViewProjection()
+//   GLuint result = gTemporalAA.Resolve(...);
+//
+// Two history targets are ping ponged: Resolve() reads last frame's and
+// writes this frame's, which is also its result
+class TemporalAA
+{
+public:
+
+    TemporalAA() :
+        width(0),
+        height(0),
+        enabled(false),
+        frameIndex(0),
+        renderWidth(0),
+        renderHeight(0),
+        historyIndex(0),
+        historyValid(false),
+        historyUvScale(1.0f),
+        hasPrevViewProjection(false),
+        jitter(0.0f)
+    {
+        historyBuffers[0] = historyBuffers[1] = 0;
+        historyTextures[0] = historyTextures[1] = 0;
+    }
+    ~TemporalAA() {}
+
+    // width x height = the largest render size
+    void Init(size_t width, size_t height)
+    {
+        this->width = width;
+        this->height = height;
+
+        vertexShader = createVertexShader("vertexShader_debugBuffer.glsl");
+        fragmentShader = createFragmentShader("fragmentShader_taa.glsl");
+        program = createShaderProgram(vertexShader, fragmentShader);
+        glUseProgram(program.id);
+        #define GET_LOC(name) glGetUniformLocation(program.id, name)
+        uInput = GET_LOC("uInput");
+        uVelocity = GET_LOC("uVelocity");
+        uDepth = GET_LOC("uDepth");
+        uHistory = GET_LOC("uHistory");
+        uRenderSize = GET_LOC("uRenderSize");
+        uHistoryUvScale = GET_LOC("uHistoryUvScale");
+        uHistoryValid = GET_LOC("uHistoryValid");
+        uBlend = GET_LOC("uBlend");
+        #undef GET_LOC
+
+        glGenFramebuffers(2, historyBuffers);
+        glGenTextures(2, historyTextures);
+        for (size_t i = 0; i < 2; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, historyBuffers[i]);
+            glBindTexture(GL_TEXTURE_2D, historyTextures[i]);
+            // 16 bit so the small per frame blends don't band
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTextures[i], 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cout << "TAA history framebuffer not complete" << std::endl;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // turning it on starts a new history; off means no jitter
+    void SetEnabled(bool enabled)
+    {
+        if (enabled && !this->enabled) {
+            historyValid = false;
+        }
+        this->enabled = enabled;
+    }
+    bool IsEnabled() const { return enabled; }
+
+    // viewProjection is this frame's, unjittered. Picks the jitter and
+    // keeps last frame's viewProjection for the motion vectors
+    void BeginFrame(const glm::mat4& viewProjection,
+        size_t renderWidth,
+        size_t renderHeight)
+    {
+        prevViewProjection = hasPrevViewProjection ? lastViewProjection : viewProjection;
+        lastViewProjection = viewProjection;
+        hasPrevViewProjection = true;
+
+        this->renderWidth = renderWidth;
+        this->renderHeight = renderHeight;
+        frameIndex++;
+        jitter = enabled ?
+            haltonJitter(1 + frameIndex % TAA_JITTER_PHASES) :
+            glm::vec2(0.0f);
+    }
+
+    void JitterProjection(glm::mat4& projection) const
+    {
+        jitterProjectionMatrix(projection, jitter, renderWidth, renderHeight);
+    }
+
+    const glm::mat4& GetPrevViewProjection() const { return prevViewProjection; }
+    // this frame's, in pixels
+    glm::vec2 GetJitter() const { return jitter; }
+    // counts BeginFrame()s; other effects can use it to vary their
+    // samples from frame to frame and let the history average them
+    size_t GetFrameIndex() const { return frameIndex; }
+
+    // blends input, the lit image in the bottom left renderWidth x
+    // renderHeight of a texture of Init()'s size, into the history using
+    // the G-buffer's velocity and depth textures. Returns the new
+    // history texture; leaves the default framebuffer bound
+    GLuint Resolve(GLuint input,
+        GLuint velocityTexture,
+        GLuint depthTexture,
+        const ScreenTexture& screenTexture,
+        GpuProfiler* profiler)
+    {
+        if (profiler) {
+            profiler->Push("TAA");
+        }
+
+        size_t writeIndex = historyIndex ^ 1;
+        glBindFramebuffer(GL_FRAMEBUFFER, historyBuffers[writeIndex]);
+        glViewport(0, 0, (GLsizei)renderWidth, (GLsizei)renderHeight);
+        glUseProgram(program.id);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, input);
+        glUniform1i(uInput, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, velocityTexture);
+        glUniform1i(uVelocity, 1);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glUniform1i(uDepth, 2);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, historyTextures[historyIndex]);
+        glUniform1i(uHistory, 3);
+
+        glUniform2i(uRenderSize, (GLint)renderWidth, (GLint)renderHeight);
+        // the history was rendered at last frame's size, which dynamic
+        // resolution may have changed since
+        glUniform2fv(uHistoryUvScale, 1, glm::value_ptr(historyUvScale));
+        glUniform1i(uHistoryValid, historyValid);
+        glUniform1f(uBlend, 0.1f);
+
+        glBindVertexArray(screenTexture.VAO);
+        glDrawArrays(GL_TRIANGLES, 0, screenTexture.numVertices);
+        glBindVertexArray(0);
+
+        for (int unit = 3; unit >= 0; unit--)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        historyIndex = writeIndex;
+        historyValid = true;
+        historyUvScale = glm::vec2(float(renderWidth) / float(width), float(renderHeight) / float(height));
+
+        if (profiler) {
+            profiler->Pop();
+        }
+        return historyTextures[historyIndex];
+    }
+
+    void Delete()
+    {
+        glDeleteProgram(program.id);
+        glDeleteShader(fragmentShader.id);
+        glDeleteShader(vertexShader.id);
+        glDeleteFramebuffers(2, historyBuffers);
+        glDeleteTextures(2, historyTextures);
+        historyBuffers[0] = historyBuffers[1] = 0;
+        historyTextures[0] = historyTextures[1] = 0;
+    }
+
+private:
+
+    size_t width;
+    size_t height;
+    bool enabled;
+    size_t frameIndex;
+    size_t renderWidth;
+    size_t renderHeight;
+
+    Shader vertexShader;
+    Shader fragmentShader;
+    ShaderProgram program;
+    GLint uInput;
+    GLint uVelocity;
+    GLint uDepth;
+    GLint uHistory;
+    GLint uRenderSize;
+    GLint uHistoryUvScale;
+    GLint uHistoryValid;
+    GLint uBlend;
+
+    GLuint historyBuffers[2];
+    GLuint historyTextures[2];  // RGBA16F
+    size_t historyIndex;        // the one holding the latest result
+    bool historyValid;
+    glm::vec2 historyUvScale;   // the part of it that was rendered
+
+    glm::mat4 prevViewProjection;
+    glm::mat4 lastViewProjection;
+    bool hasPrevViewProjection;
+    glm::vec2 jitter;
+};
+
+#endif // !TEMPORAL_AA_H_INCLUDED
@@ -85,6 +85,37 @@ void createProjectionMatrix(glm::mat4& res, const Camera& cam)
         farClip);
 }
 
+// point `index` (from 1) of the Halton (2, 3) sequence, moved to
+// [-0.5, 0.5): sub-pixel offsets that cover a pixel evenly however many
+// consecutive ones are used
+glm::vec2 haltonJitter(size_t index)
+{
+    glm::vec2 result(0.0F);
+    float bases[2] = { 2.0F, 3.0F };
+    for (int axis = 0; axis < 2; axis++)
+    {
+        float fraction = 1.0F;
+        for (size_t i = index; i > 0; i /= (size_t)bases[axis])
+        {
+            fraction /= bases[axis];
+            result[axis] += fraction * float(i % (size_t)bases[axis]);
+        }
+    }
+    return result - glm::vec2(0.5F);
+}
+
+// moves everything res projects by jitter pixels of a width x height
+// viewport. Shifting clip x/y by a multiple of w keeps the shift the
+// same in NDC at every depth
+void jitterProjectionMatrix(glm::mat4& res,
+                            const glm::vec2& jitter,
+                            size_t width,
+                            size_t height)
+{
+    res[2][0] += 2.0F * jitter.x / float(width);
+    res[2][1] += 2.0F * jitter.y / float(height);
+}
+
 void createViewMatrix(glm::mat4& res, const Camera& cam)
 {
     // View/camera matrix (world->view coordinates)
@@ -2,17 +2,40 @@
 layout (location = 0) out vec3 gPosition;
 layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec3 gAlbedo; // albedo (color)
+layout (location = 3) out vec2 gVelocity; // texture coordinates moved since last frame
 
 in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+    vec4 ClipPos;
+    vec4 PrevClipPos;
 } fs_in;
 
+// compact G-buffer: gPosition isn't stored and gNormal goes to an RG16
+// target, octahedral encoded
+uniform bool uCompactGBuffer;
+
+// folds the unit sphere onto the [-1, 1] square, the lower half
+// mirrored into the corners; 16 bits a channel keeps the error well
+// under a hundredth of a degree
+vec2 octahedralEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n.xy * 0.5 + 0.5;
+}
+
 void main()
 {
     gPosition = fs_in.FragPos;
     gNormal = normalize(fs_in.Normal);
+    if (uCompactGBuffer) {
+        gNormal = vec3(octahedralEncode(gNormal), 0.0);
+    }
     gAlbedo.rgb = vec3(0.95);
+    gVelocity = (fs_in.ClipPos.xy / fs_in.ClipPos.w - fs_in.PrevClipPos.xy / fs_in.PrevClipPos.w) * 0.5;
 }
 
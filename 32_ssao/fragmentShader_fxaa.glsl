@@ -0,0 +1,60 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D uInput;   // linear filtered, tone mapped
+uniform ivec2 uRenderSize;  // the part of uInput to anti-alias
+
+// Lottes' FXAA 2: blur along the edge direction found from the luma of
+// the diagonal neighbours, over a span that grows as the edge gets closer
+// to horizontal or vertical, and fall back to a shorter blur if the long
+// one brings in colors from outside the local luma range
+const float spanMax = 8.0;
+const float reduceMul = 1.0 / 8.0;
+const float reduceMin = 1.0 / 128.0;
+// FXAA 3's early out for low contrast pixels
+const float edgeThreshold = 1.0 / 8.0;
+const float edgeThresholdMin = 1.0 / 16.0;
+
+vec3 tap(vec2 position)
+{
+    position = clamp(position, vec2(0.5), vec2(uRenderSize) - 0.5);
+    return texture(uInput, position / vec2(textureSize(uInput, 0))).rgb;
+}
+
+float luma(vec3 color)
+{
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec2 position = gl_FragCoord.xy;
+    vec3 rgbM = tap(position);
+    float lumaM = luma(rgbM);
+    float lumaNW = luma(tap(position + vec2(-1.0, 1.0)));
+    float lumaNE = luma(tap(position + vec2(1.0, 1.0)));
+    float lumaSW = luma(tap(position + vec2(-1.0, -1.0)));
+    float lumaSE = luma(tap(position + vec2(1.0, -1.0)));
+
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+    if (lumaMax - lumaMin < max(edgeThresholdMin, lumaMax * edgeThreshold)) {
+        FragColor = vec4(rgbM, 1.0);
+        return;
+    }
+
+    // at right angles to the luma gradient
+    vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)),
+        (lumaNW + lumaSW) - (lumaNE + lumaSE));
+    float directionReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * reduceMul, reduceMin);
+    float rcpDirectionMin = 1.0 / (min(abs(direction.x), abs(direction.y)) + directionReduce);
+    direction = clamp(direction * rcpDirectionMin, vec2(-spanMax), vec2(spanMax));
+
+    vec3 rgbA = 0.5 * (tap(position + direction * (1.0 / 3.0 - 0.5)) +
+        tap(position + direction * (2.0 / 3.0 - 0.5)));
+    vec3 rgbB = rgbA * 0.5 + 0.25 * (tap(position + direction * -0.5) +
+        tap(position + direction * 0.5));
+    float lumaB = luma(rgbB);
+
+    FragColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB, 1.0);
+}
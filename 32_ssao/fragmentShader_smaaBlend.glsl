@@ -0,0 +1,46 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D uInput;   // tone mapped, linear filtered
+uniform sampler2D uTexture; // blend weights, see fragmentShader_smaaWeights.glsl
+uniform ivec2 uRenderSize;  // the part of uInput to anti-alias
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 own = texelFetch(uTexture, texel, 0);
+    // the pixel above and the one on the right own the other two edges
+    float towardsBelow = own.r;
+    float towardsLeft = own.b;
+    float towardsAbove = texel.y + 1 < uRenderSize.y ? texelFetch(uTexture, texel + ivec2(0, 1), 0).g : 0.0;
+    float towardsRight = texel.x + 1 < uRenderSize.x ? texelFetch(uTexture, texel + ivec2(1, 0), 0).a : 0.0;
+
+    float vertical = max(towardsAbove, towardsBelow);
+    float horizontal = max(towardsLeft, towardsRight);
+    if (max(vertical, horizontal) < 1.0 / 255.0) {
+        FragColor = vec4(texelFetch(uInput, texel, 0).rgb, 1.0);
+        return;
+    }
+
+    // blend along one axis only; a linear fetch offset by the weight
+    // mixes in that much of the neighbour
+    vec2 texelSize = 1.0 / vec2(textureSize(uInput, 0));
+    vec2 coords = (vec2(texel) + 0.5) * texelSize;
+    vec2 offsetA;
+    vec2 offsetB;
+    vec2 amounts;
+    if (vertical > horizontal) {
+        offsetA = vec2(0.0, towardsAbove);
+        offsetB = vec2(0.0, -towardsBelow);
+        amounts = vec2(towardsAbove, towardsBelow);
+    }
+    else {
+        offsetA = vec2(towardsRight, 0.0);
+        offsetB = vec2(-towardsLeft, 0.0);
+        amounts = vec2(towardsRight, towardsLeft);
+    }
+    amounts /= amounts.x + amounts.y;
+    vec3 color = amounts.x * texture(uInput, coords + offsetA * texelSize).rgb +
+        amounts.y * texture(uInput, coords + offsetB * texelSize).rgb;
+    FragColor = vec4(color, 1.0);
+}
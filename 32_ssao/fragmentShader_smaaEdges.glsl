@@ -0,0 +1,41 @@
+#version 330 core
+out vec2 FragColor; // r = edge with the pixel on the left, g = with the pixel below
+
+uniform sampler2D uInput;   // tone mapped
+uniform ivec2 uRenderSize;  // the part of uInput to anti-alias
+
+const float threshold = 0.1;
+// an edge is dropped when a neighbouring one is this many times stronger,
+// so a hard edge doesn't drag its faint neighbours into the blend
+const float localContrastFactor = 2.0;
+
+float luma(ivec2 texel)
+{
+    texel = clamp(texel, ivec2(0), uRenderSize - 1);
+    return dot(texelFetch(uInput, texel, 0).rgb, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float center = luma(texel);
+    float left = luma(texel + ivec2(-1, 0));
+    float below = luma(texel + ivec2(0, -1));
+
+    vec2 delta = abs(center - vec2(left, below));
+    vec2 edges = step(threshold, delta);
+    if (edges.x + edges.y == 0.0) {
+        discard; // the target was cleared to no edges
+    }
+
+    float right = luma(texel + ivec2(1, 0));
+    float above = luma(texel + ivec2(0, 1));
+    float leftLeft = luma(texel + ivec2(-2, 0));
+    float belowBelow = luma(texel + ivec2(0, -2));
+    vec2 maxDelta = max(delta, abs(center - vec2(right, above)));
+    maxDelta = max(maxDelta, abs(vec2(left, below) - vec2(leftLeft, belowBelow)));
+    float finalDelta = max(maxDelta.x, maxDelta.y);
+    edges *= step(finalDelta, localContrastFactor * delta);
+
+    FragColor = edges;
+}
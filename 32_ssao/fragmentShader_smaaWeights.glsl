@@ -0,0 +1,88 @@
+#version 330 core
+// how far to blend across the edges this pixel owns, i.e. the one below
+// it (r, g) and the one on its left (b, a):
+//   r = this pixel towards the one below, g = the one below towards this
+//   b = this pixel towards the one on the left, a = the left one towards this
+out vec4 FragColor;
+
+uniform sampler2D uInput;   // edges: linear filtered, 0 past the border
+uniform sampler2D uTexture; // the area table, see computeSMAAAreaTable()
+
+// 2 pixels a step; the area table covers up to 2 * maxSearchSteps + 1
+const int maxSearchSteps = 16;
+
+// a linear fetch a quarter texel off a texel center weighs it 0.75 and
+// its neighbour 0.25, so an edge value of 0, 0.25, 0.75 or 1 tells
+// exactly which of the two have an edge. positions are in texels
+vec2 fetchEdges(vec2 position)
+{
+    return texture(uInput, position / vec2(textureSize(uInput, 0))).rg;
+}
+
+// 2 if only the near texel of such a fetch has an edge, 1 if only the
+// far one, 3 if both
+int decodeCrossing(float value)
+{
+    int near = value > 0.5 ? 1 : 0;
+    int far = value - 0.75 * float(near) > 0.125 ? 1 : 0;
+    return near * 2 + far;
+}
+
+// how many pixels from center along step (one texel, sign included)
+// continue the edge in channel
+int searchRun(vec2 center, vec2 step, int channel)
+{
+    int run = 0;
+    for (int i = 0; i < maxSearchSteps; i++)
+    {
+        // near = run + 1 pixels away, far = run + 2
+        float value = fetchEdges(center + step * (float(run) + 1.25))[channel];
+        if (value < 0.5) {
+            break;
+        }
+        if (value < 0.875) {
+            run += 1;
+            break;
+        }
+        run += 2;
+    }
+    return run;
+}
+
+vec2 area(int start, int end, int startCrossing, int endCrossing)
+{
+    int maxDistance = textureSize(uTexture, 0).x / 4;
+    ivec2 distances = min(ivec2(start, end), ivec2(maxDistance - 1));
+    ivec2 texel = ivec2(startCrossing, endCrossing) * maxDistance + distances;
+    return texelFetch(uTexture, texel, 0).rg;
+}
+
+void main()
+{
+    vec2 center = gl_FragCoord.xy;
+    vec2 edges = texelFetch(uInput, ivec2(center), 0).rg;
+    vec4 weights = vec4(0.0);
+
+    if (edges.g > 0.0) {
+        // edge below: find where it ends to the left and right, and
+        // whether a vertical edge leaves it upwards (this pixel's side)
+        // or downwards at either end
+        int left = searchRun(center, vec2(-1.0, 0.0), 1);
+        int right = searchRun(center, vec2(1.0, 0.0), 1);
+        int leftCrossing = decodeCrossing(fetchEdges(center + vec2(-float(left), -0.25)).r);
+        int rightCrossing = decodeCrossing(fetchEdges(center + vec2(float(right) + 1.0, -0.25)).r);
+        weights.rg = area(left, right, leftCrossing, rightCrossing);
+    }
+
+    if (edges.r > 0.0) {
+        // edge on the left: the same, downwards and upwards, with the
+        // crossing edges towards this pixel's side or the left one's
+        int down = searchRun(center, vec2(0.0, -1.0), 0);
+        int up = searchRun(center, vec2(0.0, 1.0), 0);
+        int downCrossing = decodeCrossing(fetchEdges(center + vec2(-0.25, -float(down))).g);
+        int upCrossing = decodeCrossing(fetchEdges(center + vec2(-0.25, float(up) + 1.0)).g);
+        weights.ba = area(down, up, downCrossing, upCrossing);
+    }
+
+    FragColor = weights;
+}
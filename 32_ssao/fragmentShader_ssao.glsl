@@ -8,25 +8,62 @@ uniform sampler2D uNormalTex;
 uniform sampler2D uNoiseTex;
 
 uniform vec3 uSamples[64];
+// the part of uSamples to use, uKernelSize samples uKernelStride apart
+// from uKernelOffset; spread across frames when the result is averaged
+// over time
+uniform int uKernelSize;
+uniform int uKernelOffset;
+uniform int uKernelStride;
 
 // parameters
-int kernelSize = 64;
 float radius = 0.5;
 float bias = 0.025;
 
-const float screen_width = 800.0;
-const float screen_height = 600.0;
-const float noisetex_width = 4;
-const float noisetex_height = 4;
-const vec2 noiseScale = vec2(screen_width / noisetex_width, screen_height / noisetex_height);
-
 uniform mat4 uProjection;
+uniform vec2 uUvScale; // the rendered part of the input textures
+
+// compact G-buffer: position rebuilt from depth, normals octahedral
+uniform bool uCompactGBuffer;
+uniform sampler2D uDepthTex;
+uniform mat4 uInverseProjection; // of the projection the G-buffer was drawn with
+
+// coords are over the textures, of which uUvScale was rendered
+vec3 getViewPosition(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return texture(uPositionTex, coords).xyz;
+    }
+    float depth = texture(uDepthTex, coords).r;
+    vec4 ndc = vec4(coords / uUvScale * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 viewPos = uInverseProjection * ndc;
+    return viewPos.xyz / viewPos.w;
+}
+
+vec3 getNormal(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return normalize(texture(uNormalTex, coords).xyz);
+    }
+    vec2 f = texture(uNormalTex, coords).xy * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
+    // tile the noise once every 4x4 pixels, whatever part of the
+    // textures is being rendered to. The size comes from the normals,
+    // the one input both layouts have
+    vec2 gBufferSize = vec2(textureSize(uNormalTex, 0));
+    vec2 noiseScale = gBufferSize / vec2(textureSize(uNoiseTex, 0));
+    vec2 maxCoords = uUvScale - 0.5 / gBufferSize;
+
     // get input for SSAO
-    vec3 fragPos = texture(uPositionTex, TexCoords).xyz;
-    vec3 normal = normalize(texture(uNormalTex, TexCoords).rgb);
+    vec3 fragPos = getViewPosition(TexCoords);
+    vec3 normal = getNormal(TexCoords);
     vec3 randVec = normalize(texture(uNoiseTex, TexCoords * noiseScale).xyz);
 
     // create tangent to view space matrix
@@ -36,10 +73,10 @@ void main()
 
     // calculate occlusion
     float occlusion = 0.0;
-    for (int i = 0; i < kernelSize; i++)
+    for (int i = 0; i < uKernelSize; i++)
     {
         // get sample position
-        vec3 sample = TBN * uSamples[i];
+        vec3 sample = TBN * uSamples[uKernelOffset + i * uKernelStride];
         sample = fragPos + sample * radius;
 
         // project sample position into screen space
@@ -47,15 +84,16 @@ void main()
         offset = uProjection * offset;
         offset.xyz /= offset.w;
         offset.xyz = offset.xyz * 0.5 + 0.5; // transform to range 0.0-1.0
+        offset.xy = min(offset.xy * uUvScale, maxCoords); // stay inside the rendered part
 
         // get sample depth
-        float sampleDepth = texture(uPositionTex, offset.xy).z; // get the depth value of the kernel sample
+        float sampleDepth = getViewPosition(offset.xy).z; // get the depth value of the kernel sample
 
         // range check and accumulate
         float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - sampleDepth));
         occlusion += (sampleDepth >= sample.z + bias ? 1.0 : 0.0) * rangeCheck;
     }
-    occlusion = 1.0 - (occlusion / kernelSize);
+    occlusion = 1.0 - (occlusion / float(uKernelSize));
 
     FragColor = occlusion;
 }
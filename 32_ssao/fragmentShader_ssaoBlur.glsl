@@ -4,17 +4,20 @@ out float FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D uSsaoInput;
+uniform vec2 uUvScale; // the rendered part of uSsaoInput
 
 void main()
 {
     vec2 texelSize = 1.0 / vec2(textureSize(uSsaoInput, 0));
+    vec2 minCoords = 0.5 * texelSize;
+    vec2 maxCoords = uUvScale - 0.5 * texelSize;
     float result = 0.0;
     for (int x = -2; x < 2; x++)
     {
         for (int y = -2; y < 2; y++)
         {
             vec2 offset = vec2(float(x), float(y)) * texelSize;
-            result += texture(uSsaoInput, TexCoords + offset).r;
+            result += texture(uSsaoInput, clamp(TexCoords + offset, minCoords, maxCoords)).r;
         }
     }
     FragColor = result / (4.0*4.0);
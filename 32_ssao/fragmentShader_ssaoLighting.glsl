@@ -18,12 +18,43 @@ struct Light
 uniform Light uLight;
 
 uniform bool uUseSSAO;
+uniform vec2 uUvScale; // the rendered part of the input textures
+
+// compact G-buffer: position rebuilt from depth, normals octahedral
+uniform bool uCompactGBuffer;
+uniform sampler2D uDepthTex;
+uniform mat4 uInverseProjection; // of the projection the G-buffer was drawn with
+
+// coords are over the textures, of which uUvScale was rendered
+vec3 getViewPosition(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return texture(uPositionTex, coords).xyz;
+    }
+    float depth = texture(uDepthTex, coords).r;
+    vec4 ndc = vec4(coords / uUvScale * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 viewPos = uInverseProjection * ndc;
+    return viewPos.xyz / viewPos.w;
+}
+
+vec3 getNormal(vec2 coords)
+{
+    if (!uCompactGBuffer) {
+        return normalize(texture(uNormalTex, coords).xyz);
+    }
+    vec2 f = texture(uNormalTex, coords).xy * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
     // retreive geometry data
-    vec3 FragPos = texture(uPositionTex, TexCoords).rgb;
-    vec3 Normal = texture(uNormalTex, TexCoords).rgb;
+    vec3 FragPos = getViewPosition(TexCoords);
+    vec3 Normal = getNormal(TexCoords);
     vec3 Diffuse = texture(uAlbedoTex, TexCoords).rgb;
     float AmbientOcclusion = texture(uSsaoTex, TexCoords).r;
     AmbientOcclusion = uUseSSAO ? AmbientOcclusion : 1.0;
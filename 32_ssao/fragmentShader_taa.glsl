@@ -0,0 +1,157 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D uInput;    // this frame, jittered
+uniform sampler2D uVelocity; // G-buffer, current - previous in uv
+uniform sampler2D uDepth;    // G-buffer depth
+uniform sampler2D uHistory;  // last frame's result, linear filtered
+uniform ivec2 uRenderSize;
+uniform vec2 uHistoryUvScale; // the rendered part of uHistory
+uniform bool uHistoryValid;
+uniform float uBlend;         // weight of this frame
+
+// temporal anti-aliasing resolve, after Karis' "High Quality Temporal
+// Supersampling" and Playdead's INSIDE talk: reproject the history with
+// the motion vector of the nearest surface around the pixel, clip it to
+// the YCoCg box of the 3x3 neighbours so stale history can't ghost, and
+// blend this frame in weighted by inverse luma so single bright samples
+// don't flicker
+
+vec3 rgbToYCoCg(vec3 rgb)
+{
+    return vec3(
+        dot(rgb, vec3(0.25, 0.5, 0.25)),
+        dot(rgb, vec3(0.5, 0.0, -0.5)),
+        dot(rgb, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 yCoCgToRgb(vec3 c)
+{
+    return vec3(
+        c.x + c.y - c.z,
+        c.x + c.z,
+        c.x - c.y - c.z);
+}
+
+vec3 fetchInput(ivec2 texel)
+{
+    return texelFetch(uInput, clamp(texel, ivec2(0), uRenderSize - 1), 0).rgb;
+}
+
+// Catmull-Rom through 9 bilinear taps (Jimenez / Pettineo); sharper than
+// one bilinear tap, which would blur the history a little every frame
+vec3 sampleHistory(vec2 coords)
+{
+    vec2 textureSize2 = vec2(textureSize(uHistory, 0));
+    vec2 minCoords = 0.5 / textureSize2;
+    vec2 maxCoords = uHistoryUvScale - minCoords;
+
+    vec2 samplePos = coords * textureSize2;
+    vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 offset12 = w2 / w12;
+
+    vec2 texPos0 = clamp((texPos1 - 1.0) / textureSize2, minCoords, maxCoords);
+    vec2 texPos3 = clamp((texPos1 + 2.0) / textureSize2, minCoords, maxCoords);
+    vec2 texPos12 = clamp((texPos1 + offset12) / textureSize2, minCoords, maxCoords);
+
+    vec3 result = vec3(0.0);
+    result += texture(uHistory, vec2(texPos0.x, texPos0.y)).rgb * w0.x * w0.y;
+    result += texture(uHistory, vec2(texPos12.x, texPos0.y)).rgb * w12.x * w0.y;
+    result += texture(uHistory, vec2(texPos3.x, texPos0.y)).rgb * w3.x * w0.y;
+
+    result += texture(uHistory, vec2(texPos0.x, texPos12.y)).rgb * w0.x * w12.y;
+    result += texture(uHistory, vec2(texPos12.x, texPos12.y)).rgb * w12.x * w12.y;
+    result += texture(uHistory, vec2(texPos3.x, texPos12.y)).rgb * w3.x * w12.y;
+
+    result += texture(uHistory, vec2(texPos0.x, texPos3.y)).rgb * w0.x * w3.y;
+    result += texture(uHistory, vec2(texPos12.x, texPos3.y)).rgb * w12.x * w3.y;
+    result += texture(uHistory, vec2(texPos3.x, texPos3.y)).rgb * w3.x * w3.y;
+
+    // the negative lobes can undershoot
+    return max(result, vec3(0.0));
+}
+
+// moves history towards the box center until it's inside, rather than
+// clamping each channel, which changes its hue
+vec3 clipToBox(vec3 boxMin, vec3 boxMax, vec3 history)
+{
+    vec3 center = 0.5 * (boxMax + boxMin);
+    vec3 extents = 0.5 * (boxMax - boxMin) + 0.0001;
+    vec3 offset = history - center;
+    vec3 units = abs(offset / extents);
+    float maxUnit = max(units.x, max(units.y, units.z));
+    return maxUnit > 1.0 ? center + offset / maxUnit : history;
+}
+
+float luma(vec3 rgb)
+{
+    return dot(rgb, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec2 uv = gl_FragCoord.xy / vec2(uRenderSize);
+
+    // the neighbourhood box, and the nearest surface's texel; taking its
+    // motion keeps moving edges from reprojecting the background behind
+    vec3 center = rgbToYCoCg(fetchInput(texel));
+    vec3 sum = vec3(0.0);
+    vec3 sumSquares = vec3(0.0);
+    vec3 boxMin = center;
+    vec3 boxMax = center;
+    ivec2 nearest = texel;
+    float nearestDepth = 1.0;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            ivec2 neighbour = clamp(texel + ivec2(x, y), ivec2(0), uRenderSize - 1);
+            vec3 color = rgbToYCoCg(texelFetch(uInput, neighbour, 0).rgb);
+            sum += color;
+            sumSquares += color * color;
+            boxMin = min(boxMin, color);
+            boxMax = max(boxMax, color);
+
+            float depth = texelFetch(uDepth, neighbour, 0).r;
+            if (depth < nearestDepth) {
+                nearestDepth = depth;
+                nearest = neighbour;
+            }
+        }
+    }
+    // tighten the min/max box with the neighbours' spread, which ignores
+    // a single outlier
+    vec3 mean = sum / 9.0;
+    vec3 deviation = sqrt(max(sumSquares / 9.0 - mean * mean, vec3(0.0)));
+    boxMin = max(boxMin, mean - 1.25 * deviation);
+    boxMax = min(boxMax, mean + 1.25 * deviation);
+
+    vec2 velocity = texelFetch(uVelocity, nearest, 0).xy;
+    vec2 prevUv = uv - velocity;
+
+    vec3 current = yCoCgToRgb(center);
+    bool offScreen = any(lessThan(prevUv, vec2(0.0))) || any(greaterThan(prevUv, vec2(1.0)));
+    if (!uHistoryValid || offScreen) {
+        FragColor = vec4(current, 1.0);
+        return;
+    }
+
+    vec3 history = sampleHistory(prevUv * uHistoryUvScale);
+    history = yCoCgToRgb(clipToBox(boxMin, boxMax, rgbToYCoCg(history)));
+
+    float currentWeight = uBlend / (1.0 + luma(current));
+    float historyWeight = (1.0 - uBlend) / (1.0 + luma(history));
+    vec3 result = (current * currentWeight + history * historyWeight) /
+        (currentWeight + historyWeight);
+
+    FragColor = vec4(result, 1.0);
+}
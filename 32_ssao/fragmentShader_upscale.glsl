@@ -0,0 +1,71 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords; // already scaled to the rendered part of uInput
+
+uniform sampler2D uInput; // linear filtered
+uniform vec2 uUvScale;    // the rendered part of uInput
+uniform float uSharpness; // 0 = none
+
+// edge adaptive upscale, loosely after AMD's FSR 1 EASU: a plain bilinear
+// tap, blended along the local edge direction to soften the stair steps
+// bilinear leaves on diagonals, sharpened across it to win back the
+// contrast lost by stretching, then clamped to the texels under it so
+// the sharpening can't ring
+
+float luma(vec3 color)
+{
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+vec3 tap(vec2 coords, vec2 minCoords, vec2 maxCoords)
+{
+    return texture(uInput, clamp(coords, minCoords, maxCoords)).rgb;
+}
+
+void main()
+{
+    vec2 texelSize = 1.0 / vec2(textureSize(uInput, 0));
+    // bilinear taps must not reach the texels outside the rendered part
+    vec2 minCoords = 0.5 * texelSize;
+    vec2 maxCoords = uUvScale - 0.5 * texelSize;
+    vec2 coords = clamp(TexCoords, minCoords, maxCoords);
+
+    vec3 center = texture(uInput, coords).rgb;
+    float lumaE = luma(tap(coords + vec2(texelSize.x, 0.0), minCoords, maxCoords));
+    float lumaW = luma(tap(coords - vec2(texelSize.x, 0.0), minCoords, maxCoords));
+    float lumaN = luma(tap(coords + vec2(0.0, texelSize.y), minCoords, maxCoords));
+    float lumaS = luma(tap(coords - vec2(0.0, texelSize.y), minCoords, maxCoords));
+
+    // the gradient points across the edge
+    vec2 gradient = vec2(lumaE - lumaW, lumaN - lumaS);
+    float gradientLength = length(gradient);
+    if (gradientLength < 1.0 / 64.0) {
+        // flat area, bilinear is as good as anything
+        FragColor = vec4(center, 1.0);
+        return;
+    }
+    vec2 across = gradient / gradientLength;
+    vec2 along = vec2(-across.y, across.x);
+    float edge = smoothstep(1.0 / 64.0, 0.25, gradientLength);
+
+    vec3 alongAverage = 0.5 * (tap(coords + along * texelSize, minCoords, maxCoords) +
+        tap(coords - along * texelSize, minCoords, maxCoords));
+    vec3 acrossAverage = 0.5 * (tap(coords + across * texelSize, minCoords, maxCoords) +
+        tap(coords - across * texelSize, minCoords, maxCoords));
+
+    vec3 color = mix(center, 0.5 * (center + alongAverage), edge);
+    color += uSharpness * edge * (center - acrossAverage);
+
+    // the 2x2 texels the bilinear tap blended
+    ivec2 maxTexel = ivec2(uUvScale * vec2(textureSize(uInput, 0))) - 1;
+    ivec2 texel = ivec2(floor(coords / texelSize - 0.5));
+    vec3 t00 = texelFetch(uInput, clamp(texel, ivec2(0), maxTexel), 0).rgb;
+    vec3 t10 = texelFetch(uInput, clamp(texel + ivec2(1, 0), ivec2(0), maxTexel), 0).rgb;
+    vec3 t01 = texelFetch(uInput, clamp(texel + ivec2(0, 1), ivec2(0), maxTexel), 0).rgb;
+    vec3 t11 = texelFetch(uInput, clamp(texel + ivec2(1, 1), ivec2(0), maxTexel), 0).rgb;
+    vec3 lowest = min(min(t00, t10), min(t01, t11));
+    vec3 highest = max(max(t00, t10), max(t01, t11));
+
+    FragColor = vec4(clamp(color, lowest, highest), 1.0);
+}
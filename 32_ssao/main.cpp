@@ -29,6 +29,11 @@
 #include "ScreenTexture.h"
 #include "Mesh.h"
 #include "Model.h"
+#include "GpuProfiler.h"
+#include "FrameBuffer.h"
+#include "DynamicResolution.h"
+#include "PostAntiAliasing.h"
+#include "TemporalAA.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -61,18 +66,54 @@ Shader gLightVertexShader;
 Shader gLightFragmentShader;
 ShaderProgram gLightShaderProgram;
 
+// stretches the lit result to the window
+Shader gUpscaleVertexShader;
+Shader gUpscaleFragmentShader;
+ShaderProgram gUpscaleShaderProgram;
+
 Camera gCamera;
 
-SSAOGeometryBuffer gSSAOGeometryBuffer;
+SSAOGeometryBuffer gSSAOGeometryBuffer; // one of the two below
+SSAOGeometryBuffer gFullGeometryBuffer;
+SSAOGeometryBuffer gCompactGeometryBuffer;
 SSAOOutputBuffer gSSAOOutputBuffer;
 SSAOBlurBuffer gSSAOBlurBuffer;
 std::vector<glm::vec3> gSSAOKernel;
 SSAONoiseTexture gSSAONoise;
 BlurFrameBuffer gBlurFrameBuffer;
 ScreenTexture gScreenTexture;
+FrameBuffer gSceneColorBuffer; // the lighting pass result before upscaling
 
 bool gUseSSAO = true;
 
+// G switches between the full G-buffer layout and the compact one, which
+// rebuilds position from depth and packs normals into RG16
+bool gUseCompactGBuffer = false;
+
+// R toggles dynamic resolution; up/down change how many times the SSAO
+// pass is drawn, a per pixel load to watch the resolution respond to.
+// Every render target is allocated at the largest render size
+const double DYNRES_TARGET_MS = 16.7;
+DynamicResolution gDynamicResolution;
+size_t gSSAOLoad = 1;
+float gUpscaleSharpness = 0.5f;
+
+// F cycles the anti-aliasing of the lit image: SMAA, off, FXAA, TAA.
+// With TAA on, SSAO takes every fourth sample of its kernel, starting at
+// a different one each frame, and leaves the history to average them; B
+// spins the backpack so there is per object motion to reproject
+PostAntiAliasing gPostAA;
+TemporalAA gTemporalAA;
+const int SSAO_KERNEL_SIZE = 64;
+const int SSAO_KERNEL_SIZE_TAA = 16;
+bool gSpinModel = false;
+const float MODEL_SPIN_SPEED = 60.0F; // degrees per second
+float gDeltaTime = 0.0F; // seconds since the last frame, set by moveCamera()
+
+// P prints the last frame's GPU pass times, T writes a trace of the next
+// 120 frames to gpu_trace.json (open in ui.perfetto.dev)
+GpuProfiler gGpuProfiler;
+
 glm::vec3 gLightPos(2.0, 4.0, -2.0);
 glm::vec3 gLightColor(0.2, 0.2, 0.7);
 ////////////////////////////////////////////////////
@@ -187,12 +228,11 @@ static void moveCamera()
 {
     // move the camera via wasd using time-based 
     // speed instead of relying on frame rate
-    static float deltaTime = 0.0F;
     static float lastFrameTime = 0.0F;
     float currentFrame = glfwGetTime();
-    deltaTime = currentFrame - lastFrameTime;
+    gDeltaTime = currentFrame - lastFrameTime;
     lastFrameTime = currentFrame;
-    float cameraSpeed = 5.0F * deltaTime;
+    float cameraSpeed = 5.0F * gDeltaTime;
     if (glfwGetKey(gWindow, GLFW_KEY_W) == GLFW_PRESS) {
         gCamera.position += cameraSpeed * gCamera.front;
     }
@@ -246,6 +286,10 @@ static void draw()
     static GLuint uView = GET_LOC("uView");
     static GLuint uModel = GET_LOC("uModel");
     static GLuint uInvertNormals = GET_LOC("uInvertNormals");
+    static GLuint uViewProjection = GET_LOC("uViewProjection");
+    static GLuint uPrevViewProjection = GET_LOC("uPrevViewProjection");
+    static GLuint uPrevModel = GET_LOC("uPrevModel");
+    static GLuint uCompactGBuffer = GET_LOC("uCompactGBuffer");
     #undef GET_LOC
 
     glUseProgram(gLightShaderProgram.id);
@@ -259,6 +303,10 @@ static void draw()
     static GLuint uLight_Linear = GET_LOC("uLight.Linear");
     static GLuint uLight_Quadratic = GET_LOC("uLight.Quadratic");
     static GLuint uUseSSAO = GET_LOC("uUseSSAO");
+    static GLuint uUvScale_light = GET_LOC("uUvScale");
+    static GLuint uCompactGBuffer_light = GET_LOC("uCompactGBuffer");
+    static GLuint uDepthTex_light = GET_LOC("uDepthTex");
+    static GLuint uInverseProjection_light = GET_LOC("uInverseProjection");
     #undef GET_LOC
 
     glUseProgram(gSSAOShaderProgram.id);
@@ -268,45 +316,89 @@ static void draw()
     static GLuint uNormalTex_ssao = GET_LOC("uNormalTex");
     static GLuint uProjection_ssao = GET_LOC("uProjection");
     static GLuint uSamples_ssao = GET_LOC("uSamples");
+    static GLuint uUvScale_ssao = GET_LOC("uUvScale");
+    static GLuint uKernelSize_ssao = GET_LOC("uKernelSize");
+    static GLuint uKernelOffset_ssao = GET_LOC("uKernelOffset");
+    static GLuint uKernelStride_ssao = GET_LOC("uKernelStride");
+    static GLuint uCompactGBuffer_ssao = GET_LOC("uCompactGBuffer");
+    static GLuint uDepthTex_ssao = GET_LOC("uDepthTex");
+    static GLuint uInverseProjection_ssao = GET_LOC("uInverseProjection");
     #undef GET_LOC
 
     glUseProgram(gSSAOBlurShaderProgram.id);
     #define GET_LOC(name) glGetUniformLocation(gSSAOBlurShaderProgram.id, name)
     static GLuint uSsaoInput_blur = GET_LOC("uSsaoInput");
+    static GLuint uUvScale_blur = GET_LOC("uUvScale");
+    #undef GET_LOC
+
+    glUseProgram(gUpscaleShaderProgram.id);
+    #define GET_LOC(name) glGetUniformLocation(gUpscaleShaderProgram.id, name)
+    static GLuint uInput_upscale = GET_LOC("uInput");
+    static GLuint uUvScale_upscale = GET_LOC("uUvScale");
+    static GLuint uSharpness_upscale = GET_LOC("uSharpness");
     #undef GET_LOC
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // everything up to the upscale renders into the bottom left of the
+    // render targets
+    GLsizei renderWidth = (GLsizei)gDynamicResolution.GetRenderWidth();
+    GLsizei renderHeight = (GLsizei)gDynamicResolution.GetRenderHeight();
+    float uvScaleX = gDynamicResolution.GetUvScaleX();
+    float uvScaleY = gDynamicResolution.GetUvScaleY();
+    glViewport(0, 0, renderWidth, renderHeight);
+
     // geometry pass
+    gGpuProfiler.Push("Geometry");
     glBindFramebuffer(GL_FRAMEBUFFER, gSSAOGeometryBuffer.id);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         static glm::mat4 projectionMat;
         static glm::mat4 viewMat;
         createProjectionMatrix(projectionMat, gCamera);
         createViewMatrix(viewMat, gCamera);
+        // motion vectors are between unjittered positions, so the jitter
+        // doesn't read as movement
+        glm::mat4 viewProjectionMat = projectionMat * viewMat;
+        gTemporalAA.BeginFrame(viewProjectionMat, renderWidth, renderHeight);
+        gTemporalAA.JitterProjection(projectionMat);
         glUseProgram(gShaderProgram.id);
         glUniformMatrix4fv(uProjection, 1, GL_FALSE, glm::value_ptr(projectionMat));
         glUniformMatrix4fv(uView, 1, GL_FALSE, glm::value_ptr(viewMat));
+        glUniformMatrix4fv(uViewProjection, 1, GL_FALSE, glm::value_ptr(viewProjectionMat));
+        glUniformMatrix4fv(uPrevViewProjection, 1, GL_FALSE, glm::value_ptr(gTemporalAA.GetPrevViewProjection()));
+        glUniform1i(uCompactGBuffer, gSSAOGeometryBuffer.compact);
+        // for the passes rebuilding positions from depth
+        glm::mat4 inverseProjectionMat = glm::inverse(projectionMat);
 
-        // room cube
+        // room cube, which never moves
         glm::mat4 modelMat = glm::mat4(1.0f);
         modelMat = glm::translate(modelMat, glm::vec3(0.0f, 7.0f, 0.0f));
         modelMat = glm::scale(modelMat, glm::vec3(7.5f, 7.5f, 7.5f));
         glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
+        glUniformMatrix4fv(uPrevModel, 1, GL_FALSE, glm::value_ptr(modelMat));
         glUniform1i(uInvertNormals, true);
         glBindVertexArray(gCube.VAO);
         glDrawArrays(GL_TRIANGLES, 0, gCube.numVertices);
         glUniform1i(uInvertNormals, false);
 
-        // backpack model on the floor
+        // backpack model on the floor, spinning if B was pressed
+        static float modelAngle = 0.0f;
+        if (gSpinModel) {
+            modelAngle += MODEL_SPIN_SPEED * gDeltaTime;
+        }
         modelMat = glm::mat4(1.0f);
         modelMat = glm::translate(modelMat, glm::vec3(0.0f, 0.5f, 0.0f));
+        modelMat = glm::rotate(modelMat, glm::radians(modelAngle), glm::vec3(0.0f, 1.0f, 0.0f));
         modelMat = glm::rotate(modelMat, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
         modelMat = glm::scale(modelMat, glm::vec3(1.0f));
+        static glm::mat4 prevModelMat = modelMat;
         glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(modelMat));
+        glUniformMatrix4fv(uPrevModel, 1, GL_FALSE, glm::value_ptr(prevModelMat));
         gModel.Draw(gShaderProgram);
+        prevModelMat = modelMat;
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGpuProfiler.Pop();
 
 #if 0
     // Debug draw intial buffer
@@ -319,12 +411,16 @@ static void draw()
 #endif
 
     // SSAO calculation
+    gGpuProfiler.Push("SSAO");
     glBindFramebuffer(GL_FRAMEBUFFER, gSSAOOutputBuffer.id);
         glClear(GL_COLOR_BUFFER_BIT);
         glUseProgram(gSSAOShaderProgram.id);
         glUniform1i(uPositionTex_ssao, 0); // corresponds to texture 0
         glUniform1i(uNormalTex_ssao, 1); // corresponds to texture 1
         glUniform1i(uNoiseTex_ssao, 2); // corresponds to texture 2
+        glUniform1i(uDepthTex_ssao, 3); // corresponds to texture 3
+        glUniform1i(uCompactGBuffer_ssao, gSSAOGeometryBuffer.compact);
+        glUniformMatrix4fv(uInverseProjection_ssao, 1, GL_FALSE, glm::value_ptr(inverseProjectionMat));
         for (size_t i = 0; i < 64; i++)
         {
             std::string str = "uSamples[" + std::to_string(i) + "]";
@@ -332,6 +428,21 @@ static void draw()
             glUniform3fv(loc, 1, glm::value_ptr(gSSAOKernel[i]));
         }
         glUniformMatrix4fv(uProjection_ssao, 1, GL_FALSE, glm::value_ptr(projectionMat));
+        glUniform2f(uUvScale_ssao, uvScaleX, uvScaleY);
+        // with TAA, cycle through the kernel a quarter at a time. The
+        // samples grow with their index, so each frame takes every fourth
+        // one; a contiguous quarter would only cover one band of the radius
+        if (gTemporalAA.IsEnabled()) {
+            int numParts = SSAO_KERNEL_SIZE / SSAO_KERNEL_SIZE_TAA;
+            glUniform1i(uKernelSize_ssao, SSAO_KERNEL_SIZE_TAA);
+            glUniform1i(uKernelOffset_ssao, int(gTemporalAA.GetFrameIndex() % numParts));
+            glUniform1i(uKernelStride_ssao, numParts);
+        }
+        else {
+            glUniform1i(uKernelSize_ssao, SSAO_KERNEL_SIZE);
+            glUniform1i(uKernelOffset_ssao, 0);
+            glUniform1i(uKernelStride_ssao, 1);
+        }
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, gSSAOGeometryBuffer.colorBufferIDs[0]); // position
@@ -339,12 +450,19 @@ static void draw()
         glBindTexture(GL_TEXTURE_2D, gSSAOGeometryBuffer.colorBufferIDs[1]); // Normal
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, gSSAONoise.id); // noise
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, gSSAOGeometryBuffer.depthTextureID); // depth
 
-        // 'draw' 2D screen-space to calculate SSAO
+        // 'draw' 2D screen-space to calculate SSAO; repeats write the
+        // same result and are only there as extra load
         glBindVertexArray(gScreenTexture.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
+        for (size_t i = 0; i < gSSAOLoad; i++)
+        {
+            glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
+        }
         
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGpuProfiler.Pop();
 
 #if 0
     // Debug draw the SSAO output 
@@ -358,11 +476,13 @@ static void draw()
 
 #if 1
     // Blur SSAO result to remove noise
+    gGpuProfiler.Push("SSAO blur");
     glBindFramebuffer(GL_FRAMEBUFFER, gSSAOBlurBuffer.id);
         glClear(GL_COLOR_BUFFER_BIT);
         glUseProgram(gSSAOBlurShaderProgram.id);
 
         glUniform1i(uSsaoInput_blur, 0); // corresponds to texture 0
+        glUniform2f(uUvScale_blur, uvScaleX, uvScaleY);
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, gSSAOOutputBuffer.colorBufferID);
@@ -371,6 +491,7 @@ static void draw()
         glBindVertexArray(gScreenTexture.VAO);
         glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGpuProfiler.Pop();
 #endif
 
 #if 0
@@ -385,6 +506,8 @@ static void draw()
 
 #if 1
     // Lighting calculation using the SSAO blurred result
+    gGpuProfiler.Push("Lighting");
+    glBindFramebuffer(GL_FRAMEBUFFER, gSceneColorBuffer.id);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glUseProgram(gLightShaderProgram.id);
     glm::vec3 lightPos_viewSpace = glm::vec3(viewMat * glm::vec4(gLightPos, 1.0));
@@ -396,8 +519,12 @@ static void draw()
     glUniform1i(uNormalTex_light, 1); // corresponds to texture 1
     glUniform1i(uAlbedoTex_light, 2); // corresponds to texture 2
     glUniform1i(uSsaoTex_light, 3); // corresponds to texture 3
+    glUniform1i(uDepthTex_light, 4); // corresponds to texture 4
+    glUniform1i(uCompactGBuffer_light, gSSAOGeometryBuffer.compact);
+    glUniformMatrix4fv(uInverseProjection_light, 1, GL_FALSE, glm::value_ptr(inverseProjectionMat));
 
     glUniform1i(uUseSSAO, gUseSSAO);
+    glUniform2f(uUvScale_light, uvScaleX, uvScaleY);
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, gSSAOGeometryBuffer.colorBufferIDs[0]); // position
@@ -407,9 +534,88 @@ static void draw()
     glBindTexture(GL_TEXTURE_2D, gSSAOGeometryBuffer.colorBufferIDs[2]); // albedo
     glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_2D, gSSAOBlurBuffer.colorBufferID); // SSAO occlusion value
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, gSSAOGeometryBuffer.depthTextureID); // depth
     glBindVertexArray(gScreenTexture.VAO);
     glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gGpuProfiler.Pop();
 #endif
+
+    // anti-alias at the render resolution, before upscaling stretches
+    // the jaggies. The lighting output is already in [0, 1], so this is
+    // after tone mapping as far as the AA is concerned
+    glDisable(GL_DEPTH_TEST);
+    GLuint sceneTexture = gTemporalAA.IsEnabled() ?
+        gTemporalAA.Resolve(gSceneColorBuffer.texColorBufferID,
+            gSSAOGeometryBuffer.colorBufferIDs[3], // velocity
+            gSSAOGeometryBuffer.depthTextureID,
+            gScreenTexture, &gGpuProfiler) :
+        gPostAA.Apply(gSceneColorBuffer.texColorBufferID,
+            renderWidth, renderHeight, gScreenTexture, &gGpuProfiler);
+
+    // edge adaptive upscale to the window
+    GpuProfileScope upscaleScope(gGpuProfiler, "Upscale");
+    int windowWidth = 0;
+    int windowHeight = 0;
+    glfwGetFramebufferSize(gWindow, &windowWidth, &windowHeight);
+    glViewport(0, 0, windowWidth, windowHeight);
+    glUseProgram(gUpscaleShaderProgram.id);
+    glUniform1i(uInput_upscale, 0); // corresponds to texture 0
+    glUniform2f(uUvScale_upscale, uvScaleX, uvScaleY);
+    glUniform1f(uSharpness_upscale, gUpscaleSharpness);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sceneTexture);
+    glBindVertexArray(gScreenTexture.VAO);
+    glDrawArrays(GL_TRIANGLES, 0, gScreenTexture.numVertices);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// what each kind of anti-aliasing needs on top of the targets we already
+// have, at the largest render size. 4x MSAA has to store 4 samples of
+// every G-buffer attachment, where a forward renderer only multisamples
+// one color and depth target (and resolves it)
+static void printAntiAliasingMemory()
+{
+    const double MB = 1024.0 * 1024.0;
+    size_t numPixels = gDynamicResolution.GetTargetWidth() * gDynamicResolution.GetTargetHeight();
+    size_t gBufferBytes = ssaoGeometryBufferBytesPerPixel(false);
+    size_t forwardBytes = 4 + 4;            // RGBA8, DEPTH24_STENCIL8
+    std::cout << "AA memory: FXAA " << gPostAA.GetMemoryBytes(PostAAMode::FXAA) / MB
+        << " MB, SMAA " << gPostAA.GetMemoryBytes(PostAAMode::SMAA) / MB
+        << " MB, TAA " << numPixels * (2 * 8 + 4) / MB // 2 RGBA16F histories, velocity
+        << " MB, 4x MSAA G-buffer " << numPixels * gBufferBytes * 3 / MB
+        << " MB, 4x MSAA forward " << numPixels * (forwardBytes * 3 + 4) / MB
+        << " MB" << std::endl;
+}
+
+// the GPU time of the most recently resolved frame, 0 before there is one
+static double lastGpuFrameMs()
+{
+    const std::vector<GpuProfileResult>& results = gGpuProfiler.GetResults();
+    return results.empty() ? 0.0 : results[0].durationMs;
+}
+
+// the GPU time of a named pass in the most recently resolved frame
+static double lastGpuPassMs(const std::string& name)
+{
+    for (const GpuProfileResult& result : gGpuProfiler.GetResults())
+    {
+        if (result.name == name) {
+            return result.durationMs;
+        }
+    }
+    return 0.0;
+}
+
+static void printGeometryBufferLayout()
+{
+    const double MB = 1024.0 * 1024.0;
+    size_t bytesPerPixel = ssaoGeometryBufferBytesPerPixel(gSSAOGeometryBuffer.compact);
+    std::cout << "G-buffer: " << (gSSAOGeometryBuffer.compact ? "compact" : "full")
+        << ", " << bytesPerPixel << " bytes/pixel, "
+        << gSSAOGeometryBuffer.width * gSSAOGeometryBuffer.height * bytesPerPixel / MB
+        << " MB" << std::endl;
 }
 
 int main(void)
@@ -469,15 +675,38 @@ int main(void)
     gDebugBufferFragmentShader = createFragmentShader("fragmentShader_debugBuffer.glsl");
     gDebugBufferShaderProgram = createShaderProgram(gDebugBufferVertexShader, gDebugBufferFragmentShader);
 
+    std::cout << "Creating upscale shader" << std::endl;
+    gUpscaleVertexShader = createVertexShader("vertexShader_ssao.glsl");
+    gUpscaleFragmentShader = createFragmentShader("fragmentShader_upscale.glsl");
+    gUpscaleShaderProgram = createShaderProgram(gUpscaleVertexShader, gUpscaleFragmentShader);
+
+    // DynamicResolution.h
+    gDynamicResolution.Init(WINDOW_WIDTH, WINDOW_HEIGHT,
+        createDynamicResolutionSettings(DYNRES_TARGET_MS));
+    size_t targetWidth = gDynamicResolution.GetTargetWidth();
+    size_t targetHeight = gDynamicResolution.GetTargetHeight();
 
     // SSAOGeometryBuffer.h
-    gSSAOGeometryBuffer = createSSAOGeometryBuffer();
+    gFullGeometryBuffer = createSSAOGeometryBuffer(targetWidth, targetHeight);
+    gCompactGeometryBuffer = createSSAOGeometryBuffer(targetWidth, targetHeight, true);
+    gSSAOGeometryBuffer = gUseCompactGBuffer ? gCompactGeometryBuffer : gFullGeometryBuffer;
+    printGeometryBufferLayout();
 
     // SSAOOutputBuffer.h
-    gSSAOOutputBuffer = createSSAOOutputBuffer();
+    gSSAOOutputBuffer = createSSAOOutputBuffer(targetWidth, targetHeight);
 
     // SSAOBlurBuffer.h
-    gSSAOBlurBuffer = createSSAOBlurBuffer();
+    gSSAOBlurBuffer = createSSAOBlurBuffer(targetWidth, targetHeight);
+
+    // FrameBuffer.h
+    gSceneColorBuffer = createFrameBuffer(targetWidth, targetHeight);
+
+    // PostAntiAliasing.h
+    gPostAA.Init(targetWidth, targetHeight);
+    printAntiAliasingMemory();
+
+    // TemporalAA.h
+    gTemporalAA.Init(targetWidth, targetHeight);
 
     // SSAOKernel.h
     gSSAOKernel = createSSAOKernel();
@@ -492,12 +721,107 @@ int main(void)
     // Model.h
     gModel.Load("backpack/backpack.obj");
 
+    // GpuProfiler.h
+    gGpuProfiler.Init();
+
     while (!glfwWindowShouldClose(gWindow))
     {
         if (glfwGetKey(gWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
             glfwSetWindowShouldClose(gWindow, true);
         }
 
+        // press P to print the GPU pass times
+        static bool printProfileWasPressed = false;
+        bool printProfilePressed = glfwGetKey(gWindow, GLFW_KEY_P) == GLFW_PRESS;
+        if (printProfilePressed && !printProfileWasPressed) {
+            gGpuProfiler.PrintResults();
+            std::cout << "GPU profiler stalls: " << gGpuProfiler.GetNumStalls() << std::endl;
+            gDynamicResolution.Print();
+        }
+        printProfileWasPressed = printProfilePressed;
+
+        // press T to capture a GPU trace, with the render scale and frame
+        // time as counters
+        static bool traceWasPressed = false;
+        bool tracePressed = glfwGetKey(gWindow, GLFW_KEY_T) == GLFW_PRESS;
+        if (tracePressed && !traceWasPressed && !gGpuProfiler.IsCapturing()) {
+            gDynamicResolution.StartCapture();
+            gGpuProfiler.StartCapture("gpu_trace.json", 120,
+                [](std::vector<ChromeTraceEvent>& events, std::vector<std::string>& threadNames) {
+                    gDynamicResolution.AppendEvents(events, threadNames);
+                });
+        }
+        traceWasPressed = tracePressed;
+
+        // press R to toggle dynamic resolution
+        static bool dynamicResolutionWasPressed = false;
+        bool dynamicResolutionPressed = glfwGetKey(gWindow, GLFW_KEY_R) == GLFW_PRESS;
+        if (dynamicResolutionPressed && !dynamicResolutionWasPressed) {
+            gDynamicResolution.SetEnabled(!gDynamicResolution.IsEnabled());
+            gDynamicResolution.Print();
+        }
+        dynamicResolutionWasPressed = dynamicResolutionPressed;
+
+        // up/down to add or remove SSAO load
+        static bool loadUpWasPressed = false;
+        static bool loadDownWasPressed = false;
+        bool loadUpPressed = glfwGetKey(gWindow, GLFW_KEY_UP) == GLFW_PRESS;
+        bool loadDownPressed = glfwGetKey(gWindow, GLFW_KEY_DOWN) == GLFW_PRESS;
+        if ((loadUpPressed && !loadUpWasPressed) || (loadDownPressed && !loadDownWasPressed)) {
+            if (loadUpPressed) {
+                gSSAOLoad *= 2;
+            }
+            else if (gSSAOLoad > 1) {
+                gSSAOLoad /= 2;
+            }
+            std::cout << "SSAO passes: " << gSSAOLoad << std::endl;
+        }
+        loadUpWasPressed = loadUpPressed;
+        loadDownWasPressed = loadDownPressed;
+
+        // press F to switch anti-aliasing
+        static bool antiAliasingWasPressed = false;
+        bool antiAliasingPressed = glfwGetKey(gWindow, GLFW_KEY_F) == GLFW_PRESS;
+        if (antiAliasingPressed && !antiAliasingWasPressed) {
+            if (gTemporalAA.IsEnabled()) {
+                gTemporalAA.SetEnabled(false);
+                gPostAA.SetMode(PostAAMode::SMAA);
+                std::cout << "Anti-aliasing: " << postAAModeName(PostAAMode::SMAA) << std::endl;
+            }
+            else if (gPostAA.GetMode() == PostAAMode::FXAA) {
+                gPostAA.SetMode(PostAAMode::Off);
+                gTemporalAA.SetEnabled(true);
+                std::cout << "Anti-aliasing: TAA" << std::endl;
+            }
+            else {
+                PostAAMode next = gPostAA.GetMode() == PostAAMode::SMAA ? PostAAMode::Off : PostAAMode::FXAA;
+                gPostAA.SetMode(next);
+                std::cout << "Anti-aliasing: " << postAAModeName(next) << std::endl;
+            }
+        }
+        antiAliasingWasPressed = antiAliasingPressed;
+
+        // press G to switch the G-buffer layout; prints the geometry pass
+        // time of the layout being left, P prints the new one's
+        static bool compactGBufferWasPressed = false;
+        bool compactGBufferPressed = glfwGetKey(gWindow, GLFW_KEY_G) == GLFW_PRESS;
+        if (compactGBufferPressed && !compactGBufferWasPressed) {
+            std::cout << "Geometry pass (" << (gUseCompactGBuffer ? "compact" : "full")
+                << "): " << lastGpuPassMs("Geometry") << " ms" << std::endl;
+            gUseCompactGBuffer = !gUseCompactGBuffer;
+            gSSAOGeometryBuffer = gUseCompactGBuffer ? gCompactGeometryBuffer : gFullGeometryBuffer;
+            printGeometryBufferLayout();
+        }
+        compactGBufferWasPressed = compactGBufferPressed;
+
+        // press B to start or stop the backpack spinning
+        static bool spinWasPressed = false;
+        bool spinPressed = glfwGetKey(gWindow, GLFW_KEY_B) == GLFW_PRESS;
+        if (spinPressed && !spinWasPressed) {
+            gSpinModel = !gSpinModel;
+        }
+        spinWasPressed = spinPressed;
+
         moveCamera();
 
         // move the light around
@@ -507,12 +831,18 @@ int main(void)
         // Transform.h
         //updateTransformationMatrix(gLightTransMat, gLightPosition, gCamera);
 
+        gGpuProfiler.BeginFrame();
+        gDynamicResolution.Update(lastGpuFrameMs());
         draw();
+        gGpuProfiler.EndFrame();
 
         glfwSwapBuffers(gWindow);
         glfwPollEvents();
     }
 
+    gTemporalAA.Delete();
+    gPostAA.Delete();
+    gGpuProfiler.Shutdown();
     glDeleteShader(gVertexShader.id);
     glDeleteShader(gFragmentShader.id);
     glfwTerminate();
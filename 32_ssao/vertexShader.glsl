@@ -7,11 +7,18 @@ out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+    vec4 ClipPos;       // unjittered, for the motion vectors
+    vec4 PrevClipPos;
 } vs_out;
 
-uniform mat4 uProjection;
+uniform mat4 uProjection; // jittered when temporal AA is on
 uniform mat4 uView;
 uniform mat4 uModel;
+// last frame's uModel and projection * view, and this frame's without
+// the jitter
+uniform mat4 uPrevModel;
+uniform mat4 uPrevViewProjection;
+uniform mat4 uViewProjection;
 
 uniform bool uInvertNormals;
 
@@ -25,6 +32,8 @@ void main()
                               (uInvertNormals ? -aNormal : aNormal));
     
     vs_out.TexCoords = aTexCoords;
+    vs_out.ClipPos = uViewProjection * uModel * vec4(aPos, 1.0);
+    vs_out.PrevClipPos = uPrevViewProjection * uPrevModel * vec4(aPos, 1.0);
 
 }
 
@@ -4,9 +4,13 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// the inputs are rendered into their bottom left uUvScale, see
+// DynamicResolution.h; (1, 1) when they are used whole
+uniform vec2 uUvScale;
+
 void main()
 {
-    TexCoords =  aTexCoords;
+    TexCoords =  aTexCoords * uUvScale;
     gl_Position = vec4(aPos, 1.0);
 }
 
@@ -3,6 +3,8 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <chrono>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -19,6 +21,7 @@
 #include "Camera.h"
 #include "LightSource.h"
 #include "Floor.h"
+#include "InstancedMaterials.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -47,9 +50,33 @@ int numSphereRows = 7;
 int numSphereCols = 7;
 float sphereSpacing = 2.5f;
 
+// I switches between one draw per sphere and a single instanced draw of
+// the whole grid, G cycles the grid size to compare the two
+InstancedMaterials gSphereInstances;
+bool gDrawInstanced = true;
+const int gSphereGridSizes[] = { 7, 32, 100 };
+size_t gSphereGridSizeIndex = 0;
+
+// time spent submitting (CPU) and executing (GPU) the sphere draws
+typedef struct SphereGridTiming {
+    GLuint queries[2]; // GL_TIME_ELAPSED, read back one frame late
+    size_t frame;
+    double cpuMsTotal;
+    double gpuMsTotal;
+    size_t numCpuSamples;
+    size_t numGpuSamples;
+    double lastPrintTime;
+} SphereGridTiming;
+SphereGridTiming gSphereGridTiming;
+
 Shader gVertexShader;
 Shader gFragmentShader;
 ShaderProgram gShaderProgram;
+
+// material comes from the instance buffer instead of uniforms
+Shader gInstancedVertexShader;
+Shader gInstancedFragmentShader;
+ShaderProgram gInstancedShaderProgram;
 //std::map<std::string, int> gUniformLocations;
 
 // shaders just used by the object representing the light
@@ -238,6 +265,115 @@ static void updateUniforms()
     //glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightDiffuse));
 }
 
+// the same metallic (rows) / roughness (columns) sweep as the per sphere
+// path in draw(), written once into the instance buffer
+static void rebuildSphereGridInstances()
+{
+    std::vector<MaterialInstance> instances;
+    instances.reserve(numSphereRows * numSphereCols);
+    for (size_t row = 0; row < numSphereRows; ++row)
+    {
+        float metallic = float(row) / float(numSphereRows);
+        for (size_t col = 0; col < numSphereCols; ++col)
+        {
+            float roughness = glm::clamp(float(col) / float(numSphereCols), 0.025f, 1.0f);
+            glm::vec3 pos((float(col) - float((numSphereCols / 2))) * sphereSpacing,
+                          (float(row) - float((numSphereRows / 2))) * sphereSpacing,
+                          0.0f);
+            glm::mat4 modelMat = glm::translate(glm::mat4(1.0f), pos);
+            instances.push_back(createMaterialInstance(modelMat,
+                glm::vec3(0.5f, 0.0f, 0.0f),
+                metallic,
+                roughness,
+                1.0f));
+        }
+    }
+    setMaterialInstances(gSphereInstances, instances);
+}
+
+// the whole grid in one draw call; view and projection are computed once
+// per frame instead of once per sphere
+static void drawSpheresInstanced()
+{
+    glUseProgram(gInstancedShaderProgram.id);
+
+    static GLuint uProjection = glGetUniformLocation(gInstancedShaderProgram.id, "uProjection");
+    static GLuint uView = glGetUniformLocation(gInstancedShaderProgram.id, "uView");
+    static GLuint uCamPos = glGetUniformLocation(gInstancedShaderProgram.id, "uCamPos");
+    static std::vector<GLuint> uLightPositions;
+    static std::vector<GLuint> uLightColors;
+    if (uLightPositions.empty()) {
+        for (size_t i = 0; i < gLightPositions.size(); i++)
+        {
+            std::string str = "uLightPositions[" + std::to_string(i) + "]";
+            uLightPositions.push_back(glGetUniformLocation(gInstancedShaderProgram.id, str.c_str()));
+            str = "uLightColors[" + std::to_string(i) + "]";
+            uLightColors.push_back(glGetUniformLocation(gInstancedShaderProgram.id, str.c_str()));
+        }
+    }
+
+    for (size_t i = 0; i < gLightPositions.size(); i++)
+    {
+        glUniform3fv(uLightPositions[i], 1, glm::value_ptr(gLightPositions[i]));
+        glUniform3fv(uLightColors[i], 1, glm::value_ptr(gLightColors[i]));
+    }
+    glUniform3fv(uCamPos, 1, glm::value_ptr(gCamera.position));
+
+    // same matrices as Transform.h
+    glm::mat4 viewMat = glm::lookAt(gCamera.position, gCamera.position + gCamera.front, gCamera.up);
+    glm::mat4 projMat = glm::perspective(glm::radians(gCamera.FOV),
+        800.0F / 600.0F,
+        0.1F,
+        100.0F);
+    glUniformMatrix4fv(uView, 1, GL_FALSE, glm::value_ptr(viewMat));
+    glUniformMatrix4fv(uProjection, 1, GL_FALSE, glm::value_ptr(projMat));
+
+    drawInstancedMaterials(gSphereInstances);
+}
+
+static void beginSphereGridTiming()
+{
+    SphereGridTiming& timing = gSphereGridTiming;
+    glBeginQuery(GL_TIME_ELAPSED, timing.queries[timing.frame % 2]);
+}
+
+static void endSphereGridTiming(double cpuMs)
+{
+    SphereGridTiming& timing = gSphereGridTiming;
+    glEndQuery(GL_TIME_ELAPSED);
+    timing.cpuMsTotal += cpuMs;
+    timing.numCpuSamples++;
+
+    // the other query was issued last frame, so it is normally done by now;
+    // skip the sample rather than stall if it isn't
+    if (timing.frame > 0) {
+        GLuint query = timing.queries[(timing.frame + 1) % 2];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            timing.gpuMsTotal += double(elapsedNs) / 1000000.0;
+            timing.numGpuSamples++;
+        }
+    }
+    timing.frame++;
+
+    double now = glfwGetTime();
+    if (now - timing.lastPrintTime >= 1.0) {
+        std::cout << (gDrawInstanced ? "instanced" : "per sphere") << " "
+            << numSphereRows << "x" << numSphereCols << " spheres: "
+            << "CPU " << timing.cpuMsTotal / double(std::max<size_t>(timing.numCpuSamples, 1)) << " ms, "
+            << "GPU " << timing.gpuMsTotal / double(std::max<size_t>(timing.numGpuSamples, 1)) << " ms"
+            << std::endl;
+        timing.cpuMsTotal = 0.0;
+        timing.gpuMsTotal = 0.0;
+        timing.numCpuSamples = 0;
+        timing.numGpuSamples = 0;
+        timing.lastPrintTime = now;
+    }
+}
+
 // called once every frame during main loop
 static void draw()
 {
@@ -281,9 +417,11 @@ static void draw()
     glUniform3fv(uCamPos, 1, glm::value_ptr(gCamera.position));
 
     // draw the spheres
+    auto cpuStart = std::chrono::high_resolution_clock::now();
+    beginSphereGridTiming();
     glm::mat4 transMat;
     glm::mat4 modelMat;
-    for (size_t row = 0; row < numSphereRows; ++row)
+    for (size_t row = 0; !gDrawInstanced && row < numSphereRows; ++row)
     {
         glUniform1f(uMetallic, float(row) / float(numSphereRows));
 
@@ -306,6 +444,11 @@ static void draw()
             glDrawElements(GL_TRIANGLE_STRIP, gSphere.numIndices, GL_UNSIGNED_INT, 0);
         }
     }
+    if (gDrawInstanced) {
+        drawSpheresInstanced();
+    }
+    auto cpuEnd = std::chrono::high_resolution_clock::now();
+    endSphereGridTiming(std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count());
 }
 
 int main(void)
@@ -341,6 +484,26 @@ int main(void)
         gFragmentShader);
     glUseProgram(gShaderProgram.id);
 
+    std::cout << "Creating instanced shader program" << std::endl;
+    gInstancedVertexShader = createVertexShader("vertexShader_instanced.glsl");
+    gInstancedFragmentShader = createFragmentShader("fragmentShader_instanced.glsl");
+    gInstancedShaderProgram = createShaderProgram(gInstancedVertexShader,
+        gInstancedFragmentShader);
+
+    // InstancedMaterials.h
+    gSphereInstances = createInstancedMaterials(gSphere.VBO,
+        gSphere.EBO,
+        gSphere.numIndices,
+        GL_TRIANGLE_STRIP);
+    rebuildSphereGridInstances();
+    glGenQueries(2, gSphereGridTiming.queries);
+    gSphereGridTiming.frame = 0;
+    gSphereGridTiming.cpuMsTotal = 0.0;
+    gSphereGridTiming.gpuMsTotal = 0.0;
+    gSphereGridTiming.numCpuSamples = 0;
+    gSphereGridTiming.numGpuSamples = 0;
+    gSphereGridTiming.lastPrintTime = glfwGetTime();
+
     // make a shader just for the light source, which uses a different
     // fragment shader and the same vertex shader
     gLightFragmentShader = createFragmentShader("lightFragmentShader.glsl");
@@ -364,6 +527,28 @@ int main(void)
         //    std::cout << "Using blinn shading: " << gUseBlinnShading << std::endl;
         //}
 
+        // press I to switch between instanced and per sphere drawing
+        static bool instancedWasPressed = false;
+        bool instancedPressed = glfwGetKey(gWindow, GLFW_KEY_I) == GLFW_PRESS;
+        if (instancedPressed && !instancedWasPressed) {
+            gDrawInstanced = !gDrawInstanced;
+            std::cout << "Draw instanced: " << gDrawInstanced << std::endl;
+        }
+        instancedWasPressed = instancedPressed;
+
+        // press G to cycle the sphere grid size
+        static bool gridSizeWasPressed = false;
+        bool gridSizePressed = glfwGetKey(gWindow, GLFW_KEY_G) == GLFW_PRESS;
+        if (gridSizePressed && !gridSizeWasPressed) {
+            size_t numGridSizes = sizeof(gSphereGridSizes) / sizeof(gSphereGridSizes[0]);
+            gSphereGridSizeIndex = (gSphereGridSizeIndex + 1) % numGridSizes;
+            numSphereRows = gSphereGridSizes[gSphereGridSizeIndex];
+            numSphereCols = gSphereGridSizes[gSphereGridSizeIndex];
+            rebuildSphereGridInstances();
+            std::cout << "Sphere grid: " << numSphereRows << "x" << numSphereCols << std::endl;
+        }
+        gridSizeWasPressed = gridSizePressed;
+
         moveCamera();
 
         // move the light around
@@ -379,6 +564,9 @@ int main(void)
 
     glDeleteShader(gVertexShader.id);
     glDeleteShader(gFragmentShader.id);
+    glDeleteShader(gInstancedVertexShader.id);
+    glDeleteShader(gInstancedFragmentShader.id);
+    glDeleteQueries(2, gSphereGridTiming.queries);
     glfwTerminate();
     return 0;
 }
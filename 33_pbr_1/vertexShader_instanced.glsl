@@ -0,0 +1,39 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance, see InstancedMaterials.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+layout (location = 10) in vec4 aAlbedoAo;
+layout (location = 11) in vec2 aMetallicRoughness;
+
+// shared by every instance
+uniform mat4 uProjection;
+uniform mat4 uView;
+
+// normal and fragment position (in world space) for lighting calculation
+out vec3 Normal;
+out vec3 WorldPos;
+out vec2 TexCoords;
+
+// material, constant over the instance
+flat out vec3 Albedo;
+flat out float Metallic;
+flat out float Roughness;
+flat out float Ao;
+
+void main()
+{
+    vec4 worldPos = aModel * vec4(aPos, 1.0);
+    gl_Position = uProjection * uView * worldPos;
+    // the normal matrix is precomputed per instance on the CPU
+    Normal = aNormalMatrix * aNormal;
+    WorldPos = vec3(worldPos);
+    TexCoords = aTexCoords;
+
+    Albedo = aAlbedoAo.rgb;
+    Ao = aAlbedoAo.a;
+    Metallic = aMetallicRoughness.x;
+    Roughness = aMetallicRoughness.y;
+}
@@ -0,0 +1,94 @@
+#ifndef CHROME_TRACE_H_INCLUDED
+#define CHROME_TRACE_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+
+// writes timing zones in the Chrome trace event format, which loads in
+// chrome://tracing, about://tracing and ui.perfetto.dev. Every profiler
+// converts its timestamps to microseconds since chromeTraceEpoch() so
+// their events line up in the same file
+typedef struct ChromeTraceEvent {
+    std::string name;
+    std::string category;   // e.g. "gpu"
+    char phase;             // 'X' = zone, 'C' = counter, 'i' = instant marker
+    double startUs;         // since chromeTraceEpoch()
+    double durationUs;      // 'X' only
+    double value;           // 'C' only
+    int threadID;           // rows in the viewer
+} ChromeTraceEvent;
+
+std::chrono::steady_clock::time_point chromeTraceEpoch()
+{
+    static std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return epoch;
+}
+
+double chromeTraceNowUs()
+{
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - chromeTraceEpoch()).count();
+}
+
+// names are our own string literals, so only quotes and backslashes
+// need escaping
+static std::string chromeTraceEscape(const std::string& str)
+{
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+bool writeChromeTrace(const std::string& fileName,
+                      const std::vector<ChromeTraceEvent>& events,
+                      const std::vector<std::string>& threadNames)
+{
+    std::ofstream file(fileName);
+    if (!file) {
+        std::cout << "Failed to open trace file " << fileName << std::endl;
+        return false;
+    }
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (size_t i = 0; i < threadNames.size(); i++)
+    {
+        file << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+            << ",\"args\":{\"name\":\"" << chromeTraceEscape(threadNames[i]) << "\"}}";
+        first = false;
+    }
+    file.precision(3);
+    file << std::fixed;
+    for (const ChromeTraceEvent& event : events)
+    {
+        file << (first ? "" : ",\n")
+            << "{\"name\":\"" << chromeTraceEscape(event.name) << "\""
+            << ",\"cat\":\"" << chromeTraceEscape(event.category) << "\""
+            << ",\"ph\":\"" << event.phase << "\",\"pid\":0,\"tid\":" << event.threadID
+            << ",\"ts\":" << event.startUs;
+        if (event.phase == 'X') {
+            file << ",\"dur\":" << event.durationUs;
+        }
+        else if (event.phase == 'C') {
+            file << ",\"args\":{\"value\":" << event.value << "}";
+        }
+        else if (event.phase == 'i') {
+            file << ",\"s\":\"g\""; // a line across every row
+        }
+        file << "}";
+        first = false;
+    }
+    file << "\n]}\n";
+    return true;
+}
+
+#endif // !CHROME_TRACE_H_INCLUDED
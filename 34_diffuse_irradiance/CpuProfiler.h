@@ -0,0 +1,332 @@
+#ifndef CPU_PROFILER_H_INCLUDED
+#define CPU_PROFILER_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ChromeTrace.h"
+
+// scoped CPU timing zones, counters and frame markers:
+//
+//   CPU_THREAD_NAME("Main");
+//   {
+//       CPU_ZONE("Model import");
+//       ...
+//   }
+//   CPU_ZONE_BEGIN("Startup"); ... CPU_ZONE_END();
+//   CPU_COUNTER("Visible items", gVisibleItems.size());
+//   CPU_FRAME_MARK();
+//   CPU_PRINT_ZONES(2);
+//   CPU_WRITE_TRACE("startup_trace.json");
+//
+// Each thread records into its own ring buffer, so recording takes no
+// locks and costs a TSC read plus one 32 byte store. The rings keep the
+// last CPU_PROFILER_RING_SIZE events of every thread and are turned into
+// Chrome trace events only when dumped. Names must be string literals
+// since only the pointer is stored.
+//
+// Build with -DNO_CPU_PROFILER to compile every zone out
+const size_t CPU_PROFILER_RING_SIZE = 1 << 15; // power of two
+
+enum CpuProfileEventType {
+    CPU_EVENT_ZONE_BEGIN,
+    CPU_EVENT_ZONE_END,
+    CPU_EVENT_COUNTER,
+    CPU_EVENT_FRAME_MARK
+};
+
+typedef struct CpuProfileEvent {
+    const char* name;
+    uint64_t ticks;
+    int64_t value;      // counters only
+    uint32_t type;      // CpuProfileEventType
+} CpuProfileEvent;
+
+// written only by its own thread; head is published after the event so a
+// dump from another thread never reads a half written event it can't
+// detect (see CpuProfiler::readRing)
+typedef struct CpuProfileRing {
+    CpuProfileEvent events[CPU_PROFILER_RING_SIZE];
+    std::atomic<uint64_t> head; // events written so far
+    std::string threadName;
+    size_t threadIndex;
+} CpuProfileRing;
+
+// invariant TSC on x86, the steady clock elsewhere
+inline uint64_t cpuProfilerTicks()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+class CpuProfiler
+{
+public:
+
+    static CpuProfiler& Get()
+    {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    // the calling thread's ring, created on its first event
+    static CpuProfileRing* ThreadRing()
+    {
+        static thread_local CpuProfileRing* ring = nullptr;
+        if (!ring) {
+            ring = Get().registerThread();
+        }
+        return ring;
+    }
+
+    static void Record(uint32_t type, const char* name, int64_t value)
+    {
+        CpuProfileRing* ring = ThreadRing();
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        CpuProfileEvent& event = ring->events[head & (CPU_PROFILER_RING_SIZE - 1)];
+        event.name = name;
+        event.ticks = cpuProfilerTicks();
+        event.value = value;
+        event.type = type;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    void SetThreadName(const std::string& name)
+    {
+        CpuProfileRing* ring = ThreadRing();
+        std::lock_guard<std::mutex> lock(mutex);
+        ring->threadName = name;
+    }
+
+    // convert what is still in the rings to trace events, one row per
+    // thread after the rows already in threadNames. Has the signature
+    // GpuProfiler::StartCapture() expects for addEvents
+    void AppendEvents(std::vector<ChromeTraceEvent>& events, std::vector<std::string>& threadNames)
+    {
+        calibrate();
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t firstThreadID = threadNames.size();
+        for (CpuProfileRing* ring : rings)
+        {
+            threadNames.push_back(ring->threadName);
+            appendRingEvents(*ring, firstThreadID + ring->threadIndex, events);
+        }
+    }
+
+    bool WriteTrace(const std::string& fileName)
+    {
+        std::vector<ChromeTraceEvent> events;
+        std::vector<std::string> threadNames;
+        AppendEvents(events, threadNames);
+        return writeChromeTrace(fileName, events, threadNames);
+    }
+
+    // print the calling thread's zones up to maxDepth as an indented list,
+    // e.g. to show the startup breakdown on the console
+    void PrintZones(size_t maxDepth)
+    {
+        calibrate();
+        std::vector<ChromeTraceEvent> events;
+        std::vector<size_t> depths;
+        CpuProfileRing* ring = ThreadRing();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            appendRingEvents(*ring, 0, events, &depths);
+        }
+        // zones are appended when they end; print them in start order
+        std::vector<size_t> order(events.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&events](size_t a, size_t b) {
+            return events[a].startUs < events[b].startUs;
+        });
+        for (size_t i : order)
+        {
+            if (events[i].phase == 'X' && depths[i] <= maxDepth) {
+                std::cout << std::string(2 * depths[i], ' ') << events[i].name << ": "
+                    << events[i].durationUs / 1000.0 << " ms" << std::endl;
+            }
+        }
+    }
+
+private:
+
+    std::mutex mutex;
+    std::vector<CpuProfileRing*> rings; // never freed, so finished threads can still be dumped
+
+    // ticks -> chromeTraceEpoch() microseconds
+    uint64_t calibrationTicks;
+    double calibrationUs;
+    double ticksPerUs;
+
+    CpuProfiler()
+    {
+        calibrationTicks = cpuProfilerTicks();
+        calibrationUs = chromeTraceNowUs();
+        ticksPerUs = 1000.0;
+    }
+
+    CpuProfileRing* registerThread()
+    {
+        CpuProfileRing* ring = new CpuProfileRing;
+        ring->head.store(0);
+        std::lock_guard<std::mutex> lock(mutex);
+        ring->threadIndex = rings.size();
+        ring->threadName = "Thread " + std::to_string(ring->threadIndex);
+        rings.push_back(ring);
+        return ring;
+    }
+
+    // the tick rate is measured against the steady clock over the time
+    // since startup, which is long enough by the time anything is dumped
+    void calibrate()
+    {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        double elapsedUs = chromeTraceNowUs() - calibrationUs;
+        if (elapsedUs < 10000.0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        uint64_t ticks = cpuProfilerTicks();
+        elapsedUs = chromeTraceNowUs() - calibrationUs;
+        ticksPerUs = double(ticks - calibrationTicks) / elapsedUs;
+#else
+        ticksPerUs = 1000.0;
+#endif
+    }
+
+    double ticksToUs(uint64_t ticks) const
+    {
+        return calibrationUs + (double(int64_t(ticks - calibrationTicks))) / ticksPerUs;
+    }
+
+    // copy the events still held by a ring. The owning thread may keep
+    // writing meanwhile, so anything it could have overwritten during the
+    // copy is dropped afterwards
+    void readRing(const CpuProfileRing& ring, std::vector<CpuProfileEvent>& out) const
+    {
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+        uint64_t begin = head > CPU_PROFILER_RING_SIZE ? head - CPU_PROFILER_RING_SIZE : 0;
+        out.clear();
+        for (uint64_t i = begin; i < head; i++) {
+            out.push_back(ring.events[i & (CPU_PROFILER_RING_SIZE - 1)]);
+        }
+        uint64_t newHead = ring.head.load(std::memory_order_acquire);
+        if (newHead + 1 > begin + CPU_PROFILER_RING_SIZE) {
+            size_t numOverwritten = std::min<uint64_t>(out.size(), newHead + 1 - CPU_PROFILER_RING_SIZE - begin);
+            out.erase(out.begin(), out.begin() + numOverwritten);
+        }
+    }
+
+    // pairs begin/end events into zones. Ends whose begin was overwritten
+    // and zones still open are skipped
+    void appendRingEvents(const CpuProfileRing& ring,
+                          int threadID,
+                          std::vector<ChromeTraceEvent>& events,
+                          std::vector<size_t>* depths = nullptr) const
+    {
+        std::vector<CpuProfileEvent> ringEvents;
+        readRing(ring, ringEvents);
+
+        std::vector<const CpuProfileEvent*> openZones;
+        for (const CpuProfileEvent& ringEvent : ringEvents)
+        {
+            ChromeTraceEvent event;
+            event.name = ringEvent.name;
+            event.category = "cpu";
+            event.startUs = ticksToUs(ringEvent.ticks);
+            event.durationUs = 0.0;
+            event.value = 0.0;
+            event.threadID = threadID;
+            size_t depth = 0;
+
+            if (ringEvent.type == CPU_EVENT_ZONE_BEGIN) {
+                openZones.push_back(&ringEvent);
+                continue;
+            }
+            else if (ringEvent.type == CPU_EVENT_ZONE_END) {
+                if (openZones.empty()) {
+                    continue;
+                }
+                const CpuProfileEvent* begin = openZones.back();
+                openZones.pop_back();
+                event.phase = 'X';
+                event.name = begin->name;
+                event.startUs = ticksToUs(begin->ticks);
+                event.durationUs = event.startUs < ticksToUs(ringEvent.ticks) ?
+                    ticksToUs(ringEvent.ticks) - event.startUs : 0.0;
+                depth = openZones.size();
+            }
+            else if (ringEvent.type == CPU_EVENT_COUNTER) {
+                event.phase = 'C';
+                event.value = double(ringEvent.value);
+            }
+            else {
+                event.phase = 'i';
+            }
+            events.push_back(event);
+            if (depths) {
+                depths->push_back(depth);
+            }
+        }
+    }
+};
+
+// records a zone from construction to the end of the enclosing block
+class CpuZoneScope
+{
+public:
+    explicit CpuZoneScope(const char* name) :
+        name(name)
+    {
+        CpuProfiler::Record(CPU_EVENT_ZONE_BEGIN, name, 0);
+    }
+    ~CpuZoneScope() { CpuProfiler::Record(CPU_EVENT_ZONE_END, name, 0); }
+
+private:
+    const char* name;
+};
+
+#ifndef NO_CPU_PROFILER
+#define CPU_PROFILER_CONCAT2(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT2(a, b)
+#define CPU_ZONE(name) CpuZoneScope CPU_PROFILER_CONCAT(cpuZone, __LINE__)(name)
+// for zones that don't match a C++ scope
+#define CPU_ZONE_BEGIN(name) CpuProfiler::Record(CPU_EVENT_ZONE_BEGIN, name, 0)
+#define CPU_ZONE_END() CpuProfiler::Record(CPU_EVENT_ZONE_END, "", 0)
+#define CPU_COUNTER(name, value) CpuProfiler::Record(CPU_EVENT_COUNTER, name, (int64_t)(value))
+#define CPU_FRAME_MARK() CpuProfiler::Record(CPU_EVENT_FRAME_MARK, "Frame", 0)
+#define CPU_THREAD_NAME(name) CpuProfiler::Get().SetThreadName(name)
+#define CPU_PRINT_ZONES(maxDepth) CpuProfiler::Get().PrintZones(maxDepth)
+#define CPU_WRITE_TRACE(fileName) CpuProfiler::Get().WriteTrace(fileName)
+#define CPU_APPEND_EVENTS(events, threadNames) CpuProfiler::Get().AppendEvents(events, threadNames)
+#else
+#define CPU_ZONE(name)
+#define CPU_ZONE_BEGIN(name) ((void)0)
+#define CPU_ZONE_END() ((void)0)
+#define CPU_COUNTER(name, value) ((void)0)
+#define CPU_FRAME_MARK() ((void)0)
+#define CPU_THREAD_NAME(name) ((void)0)
+#define CPU_PRINT_ZONES(maxDepth) ((void)0)
+#define CPU_WRITE_TRACE(fileName) ((void)0)
+#define CPU_APPEND_EVENTS(events, threadNames) ((void)0)
+#endif
+
+#endif // !CPU_PROFILER_H_INCLUDED
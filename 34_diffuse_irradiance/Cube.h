@@ -3,6 +3,8 @@
 
 #include <glad/glad.h>
 
+#include "GpuMemory.h"
+
 typedef struct Cube {
     GLfloat* vertices;
     GLuint*  indices;
@@ -77,14 +79,15 @@ Cube createCube()
         sizeof(GLfloat) /
         floatsPerVertex;
     cube.numIndices = 0;
-    glGenBuffers(1, &cube.VBO);
-    glGenVertexArrays(1, &cube.VAO);
+    cube.VBO = genTrackedBuffer(GPU_MEMORY_VERTEX_BUFFER, "Cube.h");
+    cube.VAO = genTrackedVertexArray("Cube.h");
     glBindVertexArray(cube.VAO);
     glBindBuffer(GL_ARRAY_BUFFER, cube.VBO);
     glBufferData(GL_ARRAY_BUFFER,
         cube.numVertices * floatsPerVertex * sizeof(GLfloat),
         cube.vertices,
         GL_STATIC_DRAW);
+    trackBufferData(cube.VBO, cube.numVertices * floatsPerVertex * sizeof(GLfloat));
 
     // set object attribs
     int posAttribLocation = 0; // aPos, where we set location = 0
@@ -130,5 +133,11 @@ Cube createCube()
 }
 
 
+void deleteCube(Cube& cube)
+{
+    deleteTrackedVertexArray(cube.VAO);
+    deleteTrackedBuffer(cube.VBO);
+}
+
 #endif // !CUBE_H_INCLUDED
 
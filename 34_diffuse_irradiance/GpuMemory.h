@@ -0,0 +1,411 @@
+#ifndef GPU_MEMORY_H_INCLUDED
+#define GPU_MEMORY_H_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+// keeps a record of every GL texture, buffer, renderbuffer and framebuffer
+// created through the genTracked*()/deleteTracked*() functions below, with
+// the number of bytes its storage takes, a category and an owner (usually
+// the header or object that made it). The sizes are computed from the
+// format and dimensions passed to the track*() calls, so they are what the
+// data needs, not what the driver may round up to.
+//
+//   GLuint id = genTrackedTexture(GPU_MEMORY_TEXTURE, "Texture.h " + fileName);
+//   glBindTexture(GL_TEXTURE_2D, id);
+//   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, h, ...);
+//   glGenerateMipmap(GL_TEXTURE_2D);
+//   trackTextureImage(id, GL_RGB8, w, h, 1, true);
+//
+// printGpuMemoryReport() prints live and peak totals per category and any
+// render targets that look like duplicates, reportGpuMemoryLeaks() lists
+// whatever hasn't been deleted (call it right before exit)
+enum GpuMemoryCategory {
+    GPU_MEMORY_TEXTURE,
+    GPU_MEMORY_CUBEMAP,
+    GPU_MEMORY_RENDER_TARGET,   // textures/renderbuffers drawn into
+    GPU_MEMORY_VERTEX_BUFFER,
+    GPU_MEMORY_INDEX_BUFFER,
+    GPU_MEMORY_FRAMEBUFFER,     // no storage of its own, counted for leaks
+    GPU_MEMORY_VERTEX_ARRAY,    // same
+    NUM_GPU_MEMORY_CATEGORIES
+};
+
+enum GpuObjectKind {
+    GPU_OBJECT_TEXTURE,
+    GPU_OBJECT_BUFFER,
+    GPU_OBJECT_RENDERBUFFER,
+    GPU_OBJECT_FRAMEBUFFER,
+    GPU_OBJECT_VERTEX_ARRAY
+};
+
+typedef struct GpuAllocation {
+    GpuMemoryCategory category;
+    std::string owner;
+    size_t bytes;
+    // of the last storage call, for spotting duplicate render targets
+    GLenum internalFormat;
+    GLsizei width;
+    GLsizei height;
+    GLsizei layers;     // 6 for cubemaps
+    GLsizei samples;
+} GpuAllocation;
+
+typedef struct GpuMemoryCategoryStats {
+    size_t liveBytes;
+    size_t peakBytes;
+    size_t liveObjects;
+} GpuMemoryCategoryStats;
+
+typedef struct GpuMemoryRegistry {
+    std::map<std::pair<GpuObjectKind, GLuint>, GpuAllocation> allocations;
+    GpuMemoryCategoryStats categories[NUM_GPU_MEMORY_CATEGORIES];
+    size_t liveBytes;
+    size_t peakBytes;
+    size_t budgetBytes; // 0 = no budget
+    bool overBudget;
+} GpuMemoryRegistry;
+
+GpuMemoryRegistry& gpuMemoryRegistry()
+{
+    static GpuMemoryRegistry registry = GpuMemoryRegistry();
+    return registry;
+}
+
+const char* gpuMemoryCategoryName(GpuMemoryCategory category)
+{
+    switch (category)
+    {
+    case GPU_MEMORY_TEXTURE:        return "Texture";
+    case GPU_MEMORY_CUBEMAP:        return "Cubemap";
+    case GPU_MEMORY_RENDER_TARGET:  return "Render target";
+    case GPU_MEMORY_VERTEX_BUFFER:  return "Vertex buffer";
+    case GPU_MEMORY_INDEX_BUFFER:   return "Index buffer";
+    case GPU_MEMORY_FRAMEBUFFER:    return "Framebuffer";
+    case GPU_MEMORY_VERTEX_ARRAY:   return "Vertex array";
+    default:                        return "Unknown";
+    }
+}
+
+// bytes per texel of the sized (and the few unsized) formats we use
+size_t gpuFormatBytesPerTexel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_RED:
+    case GL_R8:
+        return 1;
+    case GL_RG:
+    case GL_RG8:
+    case GL_R16F:
+    case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_RGB:
+    case GL_RGB8:
+    case GL_SRGB:
+    case GL_SRGB8:
+        return 3;
+    case GL_RGBA:
+    case GL_RGBA8:
+    case GL_SRGB_ALPHA:
+    case GL_SRGB8_ALPHA8:
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_RGB10_A2:
+    case GL_R11F_G11F_B10F:
+    case GL_DEPTH_COMPONENT:
+    case GL_DEPTH_COMPONENT24: // stored in 32 bits
+    case GL_DEPTH_COMPONENT32:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+        return 4;
+    case GL_RGB16F:
+        return 6;
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+        return 8;
+    case GL_RGB32F:
+        return 12;
+    case GL_RGBA32F:
+        return 16;
+    default:
+        std::cout << "GpuMemory: unknown format 0x" << std::hex << internalFormat
+            << std::dec << ", counting 4 bytes per texel" << std::endl;
+        return 4;
+    }
+}
+
+// layers = array layers or 6 for a cubemap; mipmapped = the full chain
+// down to 1x1 (glGenerateMipmap)
+size_t gpuTextureBytes(GLenum internalFormat,
+                       GLsizei width,
+                       GLsizei height,
+                       GLsizei layers,
+                       bool mipmapped,
+                       GLsizei samples = 1)
+{
+    size_t texels = 0;
+    GLsizei w = width;
+    GLsizei h = height;
+    while (true)
+    {
+        texels += size_t(w) * size_t(h);
+        if (!mipmapped || (w == 1 && h == 1)) {
+            break;
+        }
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+    return texels * size_t(layers) * size_t(samples) * gpuFormatBytesPerTexel(internalFormat);
+}
+
+void setGpuMemoryBudget(size_t bytes)
+{
+    gpuMemoryRegistry().budgetBytes = bytes;
+    gpuMemoryRegistry().overBudget = false;
+}
+
+static void trackGpuObject(GpuObjectKind kind, GLuint id, GpuMemoryCategory category, const std::string& owner)
+{
+    GpuMemoryRegistry& registry = gpuMemoryRegistry();
+    GpuAllocation allocation = GpuAllocation();
+    allocation.category = category;
+    allocation.owner = owner;
+    registry.allocations[std::make_pair(kind, id)] = allocation;
+    registry.categories[category].liveObjects++;
+}
+
+// replace the storage size of an object, e.g. after glTexImage2D or a
+// second glBufferData on the same buffer
+static void resizeGpuObject(GpuObjectKind kind, GLuint id, size_t bytes)
+{
+    GpuMemoryRegistry& registry = gpuMemoryRegistry();
+    auto it = registry.allocations.find(std::make_pair(kind, id));
+    if (it == registry.allocations.end()) {
+        std::cout << "GpuMemory: storage for untracked object " << id << std::endl;
+        return;
+    }
+    GpuAllocation& allocation = it->second;
+    GpuMemoryCategoryStats& stats = registry.categories[allocation.category];
+    stats.liveBytes = stats.liveBytes - allocation.bytes + bytes;
+    registry.liveBytes = registry.liveBytes - allocation.bytes + bytes;
+    allocation.bytes = bytes;
+    stats.peakBytes = std::max(stats.peakBytes, stats.liveBytes);
+    registry.peakBytes = std::max(registry.peakBytes, registry.liveBytes);
+
+    if (registry.budgetBytes > 0 && registry.liveBytes > registry.budgetBytes && !registry.overBudget) {
+        std::cout << "GpuMemory: over budget, " << registry.liveBytes / 1024 << " KB live of "
+            << registry.budgetBytes / 1024 << " KB after " << allocation.owner << std::endl;
+    }
+    registry.overBudget = registry.budgetBytes > 0 && registry.liveBytes > registry.budgetBytes;
+}
+
+static void untrackGpuObject(GpuObjectKind kind, GLuint id)
+{
+    GpuMemoryRegistry& registry = gpuMemoryRegistry();
+    auto it = registry.allocations.find(std::make_pair(kind, id));
+    if (it == registry.allocations.end()) {
+        return;
+    }
+    GpuMemoryCategoryStats& stats = registry.categories[it->second.category];
+    stats.liveBytes -= it->second.bytes;
+    stats.liveObjects--;
+    registry.liveBytes -= it->second.bytes;
+    registry.allocations.erase(it);
+    registry.overBudget = registry.budgetBytes > 0 && registry.liveBytes > registry.budgetBytes;
+}
+
+GLuint genTrackedTexture(GpuMemoryCategory category, const std::string& owner)
+{
+    GLuint id;
+    glGenTextures(1, &id);
+    trackGpuObject(GPU_OBJECT_TEXTURE, id, category, owner);
+    return id;
+}
+
+// call after the glTexImage*() calls (and glGenerateMipmap if mipmapped)
+void trackTextureImage(GLuint id,
+                       GLenum internalFormat,
+                       GLsizei width,
+                       GLsizei height,
+                       GLsizei layers,
+                       bool mipmapped)
+{
+    resizeGpuObject(GPU_OBJECT_TEXTURE, id,
+        gpuTextureBytes(internalFormat, width, height, layers, mipmapped));
+    GpuAllocation& allocation = gpuMemoryRegistry().allocations[std::make_pair(GPU_OBJECT_TEXTURE, id)];
+    allocation.internalFormat = internalFormat;
+    allocation.width = width;
+    allocation.height = height;
+    allocation.layers = layers;
+    allocation.samples = 1;
+}
+
+void deleteTrackedTexture(GLuint id)
+{
+    untrackGpuObject(GPU_OBJECT_TEXTURE, id);
+    glDeleteTextures(1, &id);
+}
+
+GLuint genTrackedBuffer(GpuMemoryCategory category, const std::string& owner)
+{
+    GLuint id;
+    glGenBuffers(1, &id);
+    trackGpuObject(GPU_OBJECT_BUFFER, id, category, owner);
+    return id;
+}
+
+// call after glBufferData
+void trackBufferData(GLuint id, size_t bytes)
+{
+    resizeGpuObject(GPU_OBJECT_BUFFER, id, bytes);
+}
+
+void deleteTrackedBuffer(GLuint id)
+{
+    untrackGpuObject(GPU_OBJECT_BUFFER, id);
+    glDeleteBuffers(1, &id);
+}
+
+GLuint genTrackedRenderbuffer(const std::string& owner)
+{
+    GLuint id;
+    glGenRenderbuffers(1, &id);
+    trackGpuObject(GPU_OBJECT_RENDERBUFFER, id, GPU_MEMORY_RENDER_TARGET, owner);
+    return id;
+}
+
+// call after glRenderbufferStorage(Multisample)
+void trackRenderbufferStorage(GLuint id,
+                              GLenum internalFormat,
+                              GLsizei width,
+                              GLsizei height,
+                              GLsizei samples = 1)
+{
+    resizeGpuObject(GPU_OBJECT_RENDERBUFFER, id,
+        gpuTextureBytes(internalFormat, width, height, 1, false, samples));
+    GpuAllocation& allocation = gpuMemoryRegistry().allocations[std::make_pair(GPU_OBJECT_RENDERBUFFER, id)];
+    allocation.internalFormat = internalFormat;
+    allocation.width = width;
+    allocation.height = height;
+    allocation.layers = 1;
+    allocation.samples = samples;
+}
+
+void deleteTrackedRenderbuffer(GLuint id)
+{
+    untrackGpuObject(GPU_OBJECT_RENDERBUFFER, id);
+    glDeleteRenderbuffers(1, &id);
+}
+
+GLuint genTrackedFramebuffer(const std::string& owner)
+{
+    GLuint id;
+    glGenFramebuffers(1, &id);
+    trackGpuObject(GPU_OBJECT_FRAMEBUFFER, id, GPU_MEMORY_FRAMEBUFFER, owner);
+    return id;
+}
+
+void deleteTrackedFramebuffer(GLuint id)
+{
+    untrackGpuObject(GPU_OBJECT_FRAMEBUFFER, id);
+    glDeleteFramebuffers(1, &id);
+}
+
+GLuint genTrackedVertexArray(const std::string& owner)
+{
+    GLuint id;
+    glGenVertexArrays(1, &id);
+    trackGpuObject(GPU_OBJECT_VERTEX_ARRAY, id, GPU_MEMORY_VERTEX_ARRAY, owner);
+    return id;
+}
+
+void deleteTrackedVertexArray(GLuint id)
+{
+    untrackGpuObject(GPU_OBJECT_VERTEX_ARRAY, id);
+    glDeleteVertexArrays(1, &id);
+}
+
+// render targets alive at the same time with the same format and size;
+// if they are never used together they could share one
+static void printDuplicateRenderTargets()
+{
+    const GpuMemoryRegistry& registry = gpuMemoryRegistry();
+    std::map<std::vector<GLsizei>, std::vector<const GpuAllocation*> > renderTargets;
+    for (const auto& entry : registry.allocations)
+    {
+        const GpuAllocation& allocation = entry.second;
+        if (allocation.category == GPU_MEMORY_RENDER_TARGET && allocation.bytes > 0) {
+            std::vector<GLsizei> key = { GLsizei(allocation.internalFormat), allocation.width,
+                allocation.height, allocation.layers, allocation.samples };
+            renderTargets[key].push_back(&allocation);
+        }
+    }
+    for (const auto& entry : renderTargets)
+    {
+        if (entry.second.size() < 2) {
+            continue;
+        }
+        std::cout << "  " << entry.second.size() << " render targets of "
+            << entry.first[1] << "x" << entry.first[2] << " format 0x" << std::hex
+            << entry.first[0] << std::dec << ":";
+        for (const GpuAllocation* allocation : entry.second) {
+            std::cout << " " << allocation->owner;
+        }
+        std::cout << std::endl;
+    }
+}
+
+void printGpuMemoryReport()
+{
+    const GpuMemoryRegistry& registry = gpuMemoryRegistry();
+    std::cout << "GPU memory: " << registry.liveBytes / 1024 << " KB live, "
+        << registry.peakBytes / 1024 << " KB peak";
+    if (registry.budgetBytes > 0) {
+        std::cout << ", budget " << registry.budgetBytes / 1024 << " KB";
+    }
+    std::cout << std::endl;
+    for (size_t i = 0; i < NUM_GPU_MEMORY_CATEGORIES; i++)
+    {
+        const GpuMemoryCategoryStats& stats = registry.categories[i];
+        std::cout << "  " << gpuMemoryCategoryName(GpuMemoryCategory(i)) << ": "
+            << stats.liveObjects << " objects, "
+            << stats.liveBytes / 1024 << " KB live, "
+            << stats.peakBytes / 1024 << " KB peak" << std::endl;
+    }
+    printDuplicateRenderTargets();
+}
+
+// call at shutdown after deleting everything: lists whatever is still
+// alive, largest first
+void reportGpuMemoryLeaks()
+{
+    const GpuMemoryRegistry& registry = gpuMemoryRegistry();
+    std::vector<const GpuAllocation*> live;
+    for (const auto& entry : registry.allocations) {
+        live.push_back(&entry.second);
+    }
+    std::stable_sort(live.begin(), live.end(), [](const GpuAllocation* a, const GpuAllocation* b) {
+        return a->bytes > b->bytes;
+    });
+    if (live.empty()) {
+        std::cout << "GPU memory: no leaks" << std::endl;
+        return;
+    }
+    std::cout << "GPU memory: " << live.size() << " objects (" << registry.liveBytes / 1024
+        << " KB) never deleted:" << std::endl;
+    for (const GpuAllocation* allocation : live)
+    {
+        std::cout << "  " << gpuMemoryCategoryName(allocation->category) << " "
+            << allocation->owner << ": " << allocation->bytes / 1024 << " KB" << std::endl;
+    }
+}
+
+#endif // !GPU_MEMORY_H_INCLUDED
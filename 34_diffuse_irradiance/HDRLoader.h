@@ -0,0 +1,380 @@
+#ifndef HDR_LOADER_H_INCLUDED
+#define HDR_LOADER_H_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "CpuProfiler.h"
+
+// Radiance .hdr (RGBE) loader that decodes straight to half floats.
+//
+// The file is memory mapped and walked once to find where each scanline
+// starts (new style run length scanlines can be skipped by their run codes
+// without decoding them), then the scanlines are decoded on several threads
+// and each RGBE texel is converted to three half floats for a GL_RGB16F
+// upload with GL_HALF_FLOAT. Rows are stored bottom first, the same as
+// stbi_loadf with stbi_set_flip_vertically_on_load(true).
+//
+// Only the standard "-Y height +X width" orientation and 32-bit_rle_rgbe
+// format are handled, and flat scanlines are assumed not to use the pre-1991
+// (1,1,1,count) run encoding; loadHDRImage() returns false for anything else
+// so the caller can fall back to stbi_loadf.
+//
+// With F16C available (e.g. -mf16c or -march=native) 4 channels are
+// converted per instruction; otherwise the half is assembled from the RGBE
+// mantissa/exponent with integer ops, which is exact for normal halves.
+typedef struct HDRImage {
+    int width;
+    int height;
+    std::vector<uint16_t> pixels; // RGB half floats, bottom row first
+} HDRImage;
+
+typedef struct MappedFile {
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} MappedFile;
+
+static bool mapFile(const std::string& fileName, MappedFile& mapped)
+{
+    mapped.data = nullptr;
+    mapped.size = 0;
+#ifdef _WIN32
+    mapped.file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mapped.file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(mapped.file, &size);
+    mapped.size = (size_t)size.QuadPart;
+    mapped.mapping = CreateFileMappingA(mapped.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped.mapping) {
+        mapped.data = (const unsigned char*)MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!mapped.data) {
+        if (mapped.mapping) {
+            CloseHandle(mapped.mapping);
+        }
+        CloseHandle(mapped.file);
+        return false;
+    }
+#else
+    mapped.fd = open(fileName.c_str(), O_RDONLY);
+    if (mapped.fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(mapped.fd, &st) != 0 || st.st_size == 0) {
+        close(mapped.fd);
+        return false;
+    }
+    mapped.size = (size_t)st.st_size;
+    void* data = mmap(NULL, mapped.size, PROT_READ, MAP_PRIVATE, mapped.fd, 0);
+    if (data == MAP_FAILED) {
+        close(mapped.fd);
+        return false;
+    }
+    madvise(data, mapped.size, MADV_WILLNEED);
+    mapped.data = (const unsigned char*)data;
+#endif
+    return true;
+}
+
+static void unmapFile(MappedFile& mapped)
+{
+    if (!mapped.data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mapped.data);
+    CloseHandle(mapped.mapping);
+    CloseHandle(mapped.file);
+#else
+    munmap((void*)mapped.data, mapped.size);
+    close(mapped.fd);
+#endif
+    mapped.data = nullptr;
+}
+
+// reads one header line (without the newline); returns false at end of data
+static bool readHDRLine(const unsigned char* data, size_t size, size_t& pos, std::string& line)
+{
+    line.clear();
+    while (pos < size && data[pos] != '\n') {
+        line += (char)data[pos++];
+    }
+    if (pos >= size) {
+        return false;
+    }
+    ++pos; // skip '\n'
+    return true;
+}
+
+// RGBE mantissa m with shared exponent e to IEEE half bits
+static inline uint16_t rgbeToHalf(unsigned int m, unsigned int e)
+{
+    if (m == 0 || e == 0) {
+        return 0;
+    }
+    // value = m * 2^(e - 136); with p = index of m's top bit that is
+    // 1.xxx * 2^(p + e - 136), so the half exponent is p + e - 136 + 15
+    int p = 7;
+    while (!(m & (1u << p))) {
+        --p;
+    }
+    int halfExp = p + (int)e - 121;
+    if (halfExp >= 31) {
+        return 0x7BFF; // clamp to the largest finite half
+    }
+    if (halfExp <= 0) {
+        // subnormal: value / 2^-24 = m * 2^(e - 112)
+        int shift = 112 - (int)e;
+        if (shift <= 0) {
+            return (uint16_t)(m << -shift);
+        }
+        if (shift >= 16) {
+            return 0;
+        }
+        return (uint16_t)((m + (1u << (shift - 1))) >> shift);
+    }
+    return (uint16_t)((halfExp << 10) | ((m << (10 - p)) & 0x3FF));
+}
+
+// one scanline of RGBE bytes (width * 4) to RGB halves
+static void convertRGBEScanline(const unsigned char* rgbe, int width, uint16_t* dst)
+{
+    int x = 0;
+#ifdef __F16C__
+    // 2^(e - 136), 0 for e == 0
+    struct ExponentScale {
+        float scale[256];
+        ExponentScale()
+        {
+            scale[0] = 0.0f;
+            for (int e = 1; e < 256; ++e) {
+                scale[e] = (float)std::ldexp(1.0, e - 136);
+            }
+        }
+    };
+    static const ExponentScale exponentScale; // thread safe init in C++11
+    const __m128 maxHalf = _mm_set1_ps(65504.0f);
+    for (; x + 4 <= width; x += 4)
+    {
+        const unsigned char* p = rgbe + x * 4;
+        float s0 = exponentScale.scale[p[3]];
+        float s1 = exponentScale.scale[p[7]];
+        float s2 = exponentScale.scale[p[11]];
+        float s3 = exponentScale.scale[p[15]];
+        // 4 texels = 12 channels, as three vec4s: rgbr gbrg brgb
+        __m128 a = _mm_mul_ps(_mm_setr_ps(p[0], p[1], p[2], p[4]), _mm_setr_ps(s0, s0, s0, s1));
+        __m128 b = _mm_mul_ps(_mm_setr_ps(p[5], p[6], p[8], p[9]), _mm_setr_ps(s1, s1, s2, s2));
+        __m128 c = _mm_mul_ps(_mm_setr_ps(p[10], p[12], p[13], p[14]), _mm_setr_ps(s2, s3, s3, s3));
+        uint16_t* out = dst + x * 3;
+        _mm_storel_epi64((__m128i*)(out + 0), _mm_cvtps_ph(_mm_min_ps(a, maxHalf), 0));
+        _mm_storel_epi64((__m128i*)(out + 4), _mm_cvtps_ph(_mm_min_ps(b, maxHalf), 0));
+        _mm_storel_epi64((__m128i*)(out + 8), _mm_cvtps_ph(_mm_min_ps(c, maxHalf), 0));
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        const unsigned char* p = rgbe + x * 4;
+        uint16_t* out = dst + x * 3;
+        out[0] = rgbeToHalf(p[0], p[3]);
+        out[1] = rgbeToHalf(p[1], p[3]);
+        out[2] = rgbeToHalf(p[2], p[3]);
+    }
+}
+
+static inline bool isRLEScanline(const unsigned char* p, size_t remaining, int width)
+{
+    return width >= 8 && width < 32768 && remaining >= 4 &&
+        p[0] == 2 && p[1] == 2 && !(p[2] & 0x80) &&
+        ((p[2] << 8) | p[3]) == width;
+}
+
+// byte offset just past the scanline starting at pos, or 0 if it's truncated
+static size_t skipHDRScanline(const unsigned char* data, size_t size, size_t pos, int width)
+{
+    if (!isRLEScanline(data + pos, size - pos, width)) {
+        size_t end = pos + (size_t)width * 4;
+        return end <= size ? end : 0;
+    }
+    pos += 4;
+    for (int channel = 0; channel < 4; ++channel)
+    {
+        int x = 0;
+        while (x < width)
+        {
+            if (pos >= size) {
+                return 0;
+            }
+            unsigned int count = data[pos++];
+            if (count > 128) {
+                x += count - 128; // run: one value repeated
+                pos += 1;
+            }
+            else {
+                if (count == 0) {
+                    return 0;
+                }
+                x += count;       // literal values
+                pos += count;
+            }
+        }
+        if (x != width || pos > size) {
+            return 0;
+        }
+    }
+    return pos;
+}
+
+// decode the scanline at pos into width * 4 RGBE bytes
+static void decodeHDRScanline(const unsigned char* data, size_t pos, int width, unsigned char* rgbe)
+{
+    if (!isRLEScanline(data + pos, (size_t)-1, width)) {
+        memcpy(rgbe, data + pos, (size_t)width * 4);
+        return;
+    }
+    pos += 4;
+    // channels are stored planar (all r, then all g...), interleave them
+    for (int channel = 0; channel < 4; ++channel)
+    {
+        unsigned char* dst = rgbe + channel;
+        int x = 0;
+        while (x < width)
+        {
+            unsigned int count = data[pos++];
+            if (count > 128) {
+                count -= 128;
+                unsigned char value = data[pos++];
+                for (unsigned int i = 0; i < count; ++i) {
+                    dst[(x + i) * 4] = value;
+                }
+            }
+            else {
+                for (unsigned int i = 0; i < count; ++i) {
+                    dst[(x + i) * 4] = data[pos + i];
+                }
+                pos += count;
+            }
+            x += count;
+        }
+    }
+}
+
+// numThreads = 0 uses every hardware thread
+bool loadHDRImage(const std::string& fileName, HDRImage& image, size_t numThreads = 0)
+{
+    CPU_ZONE("HDR decode");
+    MappedFile mapped;
+    if (!mapFile(fileName, mapped)) {
+        return false;
+    }
+    const unsigned char* data = mapped.data;
+    size_t size = mapped.size;
+    size_t pos = 0;
+
+    // header: magic line, key=value lines, blank line, resolution line
+    std::string line;
+    if (!readHDRLine(data, size, pos, line) ||
+        (line != "#?RADIANCE" && line != "#?RGBE")) {
+        unmapFile(mapped);
+        return false;
+    }
+    bool formatOk = true;
+    while (readHDRLine(data, size, pos, line) && !line.empty())
+    {
+        if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+            formatOk = false;
+        }
+    }
+    int width = 0;
+    int height = 0;
+    if (!formatOk ||
+        !readHDRLine(data, size, pos, line) ||
+        sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 ||
+        width <= 0 || height <= 0) {
+        unmapFile(mapped);
+        return false;
+    }
+
+    // scanline starts; the only serial part of the decode
+    std::vector<size_t> scanlineStarts(height);
+    {
+        CPU_ZONE("Find scanlines");
+        for (int y = 0; y < height; ++y)
+        {
+            scanlineStarts[y] = pos;
+            pos = skipHDRScanline(data, size, pos, width);
+            if (pos == 0) {
+                unmapFile(mapped);
+                return false;
+            }
+        }
+    }
+
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t)width * height * 3);
+
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    numThreads = std::max<size_t>(1, std::min<size_t>(numThreads, height));
+
+    auto decodeRows = [&](int firstRow, int endRow) {
+        std::vector<unsigned char> rgbe((size_t)width * 4);
+        for (int y = firstRow; y < endRow; ++y)
+        {
+            decodeHDRScanline(data, scanlineStarts[y], width, &rgbe[0]);
+            // the file is top row first; flip for GL
+            uint16_t* dst = &image.pixels[(size_t)(height - 1 - y) * width * 3];
+            convertRGBEScanline(&rgbe[0], width, dst);
+        }
+    };
+
+    // no zones on the decode threads; each would keep a ring for good
+    CPU_ZONE("Decode scanlines");
+    std::vector<std::thread> threads;
+    int rowsPerThread = (height + (int)numThreads - 1) / (int)numThreads;
+    for (int firstRow = rowsPerThread; firstRow < height; firstRow += rowsPerThread)
+    {
+        threads.push_back(std::thread(decodeRows, firstRow, std::min(height, firstRow + rowsPerThread)));
+    }
+    decodeRows(0, std::min(height, rowsPerThread));
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    unmapFile(mapped);
+    return true;
+}
+
+#endif // !HDR_LOADER_H_INCLUDED
@@ -0,0 +1,197 @@
+#ifndef INSTANCED_MATERIALS_H_INCLUDED
+#define INSTANCED_MATERIALS_H_INCLUDED
+
+#include <vector>
+#include <cstddef>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "GpuMemory.h"
+
+// draws many copies of one mesh, each with its own transform and PBR
+// material, in a single instanced draw call. Everything that used to be a
+// per object uniform lives in the instance buffer instead:
+//   location 3-6   aModel             mat4
+//   location 7-9   aNormalMatrix      mat3, transpose(inverse(model)) done once on the CPU
+//   location 10    aAlbedoAo          rgb = albedo, a = ambient occlusion
+//   location 11    aMetallicRoughness
+// The mesh attributes (0-2) use the 8 float position/normal/texcoord layout
+// of Sphere.h/Cube.h; see vertexShader_instanced.glsl
+typedef struct MaterialInstance {
+    glm::mat4 model;
+    glm::vec3 normalMatrix[3]; // columns
+    glm::vec4 albedoAo;
+    glm::vec2 metallicRoughness;
+} MaterialInstance;
+
+typedef struct InstancedMaterials {
+    GLuint VAO;
+    GLuint instanceVBO;
+    GLenum primitive;       // e.g. GL_TRIANGLE_STRIP for Sphere.h
+    size_t numIndices;
+    size_t numInstances;
+    size_t instanceCapacity; // size of instanceVBO in instances
+} InstancedMaterials;
+
+MaterialInstance createMaterialInstance(const glm::mat4& model,
+                                        const glm::vec3& albedo,
+                                        float metallic,
+                                        float roughness,
+                                        float ao)
+{
+    MaterialInstance instance;
+    instance.model = model;
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    instance.normalMatrix[0] = normalMatrix[0];
+    instance.normalMatrix[1] = normalMatrix[1];
+    instance.normalMatrix[2] = normalMatrix[2];
+    instance.albedoAo = glm::vec4(albedo, ao);
+    instance.metallicRoughness = glm::vec2(metallic, roughness);
+    return instance;
+}
+
+// shares the vertex and index buffers of an existing indexed mesh
+InstancedMaterials createInstancedMaterials(GLuint meshVBO,
+                                            GLuint meshEBO,
+                                            size_t numIndices,
+                                            GLenum primitive)
+{
+    InstancedMaterials instanced;
+    instanced.primitive = primitive;
+    instanced.numIndices = numIndices;
+    instanced.numInstances = 0;
+    instanced.instanceCapacity = 0;
+
+    size_t floatsPerVertex = 8;
+    size_t floatsPerPosition = 3;
+    size_t floatsPerNormal = 3;
+    size_t floatsPerTexCoord = 2;
+    int vertexStride = floatsPerVertex * sizeof(GLfloat);
+
+    instanced.VAO = genTrackedVertexArray("InstancedMaterials");
+    glBindVertexArray(instanced.VAO);
+
+    // per vertex attributes
+    glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEBO);
+    glVertexAttribPointer(0,
+        floatsPerPosition,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1,
+        floatsPerNormal,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)(floatsPerPosition * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2,
+        floatsPerTexCoord,
+        GL_FLOAT,
+        GL_FALSE,
+        vertexStride,
+        (void*)((floatsPerPosition + floatsPerNormal) * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+
+    // per instance attributes
+    instanced.instanceVBO = genTrackedBuffer(GPU_MEMORY_VERTEX_BUFFER, "InstancedMaterials instances");
+    glBindBuffer(GL_ARRAY_BUFFER, instanced.instanceVBO);
+    size_t instanceStride = sizeof(MaterialInstance);
+    size_t modelLoc = 3;
+    for (size_t i = 0; i < 4; i++)
+    {
+        glVertexAttribPointer(modelLoc + i,
+            4,
+            GL_FLOAT,
+            GL_FALSE,
+            instanceStride,
+            (void*)(offsetof(MaterialInstance, model) + i * sizeof(glm::vec4)));
+    }
+    size_t normalMatrixLoc = 7;
+    for (size_t i = 0; i < 3; i++)
+    {
+        glVertexAttribPointer(normalMatrixLoc + i,
+            3,
+            GL_FLOAT,
+            GL_FALSE,
+            instanceStride,
+            (void*)(offsetof(MaterialInstance, normalMatrix) + i * sizeof(glm::vec3)));
+    }
+    size_t albedoAoLoc = 10;
+    glVertexAttribPointer(albedoAoLoc,
+        4,
+        GL_FLOAT,
+        GL_FALSE,
+        instanceStride,
+        (void*)offsetof(MaterialInstance, albedoAo));
+    size_t metallicRoughnessLoc = 11;
+    glVertexAttribPointer(metallicRoughnessLoc,
+        2,
+        GL_FLOAT,
+        GL_FALSE,
+        instanceStride,
+        (void*)offsetof(MaterialInstance, metallicRoughness));
+    for (size_t loc = modelLoc; loc <= metallicRoughnessLoc; loc++)
+    {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1); // 1 = update the attribute every instance (0 = every vertex)
+    }
+
+    // unbind the current buffers
+    // ORDER MATTERS - the VAO must be unbinded FIRST!
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return instanced;
+}
+
+// replace every instance; only needed when the set of objects changes
+void setMaterialInstances(InstancedMaterials& instanced,
+                          const std::vector<MaterialInstance>& instances)
+{
+    instanced.numInstances = instances.size();
+    if (instances.empty()) {
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanced.instanceVBO);
+    if (instanced.numInstances > instanced.instanceCapacity) {
+        instanced.instanceCapacity = instanced.numInstances;
+        glBufferData(GL_ARRAY_BUFFER,
+            instanced.instanceCapacity * sizeof(MaterialInstance),
+            &instances[0],
+            GL_STATIC_DRAW);
+        trackBufferData(instanced.instanceVBO, instanced.instanceCapacity * sizeof(MaterialInstance));
+    }
+    else {
+        glBufferSubData(GL_ARRAY_BUFFER,
+            0,
+            instanced.numInstances * sizeof(MaterialInstance),
+            &instances[0]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawInstancedMaterials(const InstancedMaterials& instanced)
+{
+    glBindVertexArray(instanced.VAO);
+    glDrawElementsInstanced(instanced.primitive,
+        instanced.numIndices,
+        GL_UNSIGNED_INT,
+        0,
+        instanced.numInstances);
+    glBindVertexArray(0);
+}
+
+void deleteInstancedMaterials(InstancedMaterials& instanced)
+{
+    deleteTrackedVertexArray(instanced.VAO);
+    deleteTrackedBuffer(instanced.instanceVBO);
+}
+
+#endif // !INSTANCED_MATERIALS_H_INCLUDED
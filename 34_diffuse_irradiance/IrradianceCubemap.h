@@ -3,6 +3,8 @@
 
 #include <glad/glad.h>
 
+#include "GpuMemory.h"
+
 typedef struct IrradianceCubemap
 {
     GLuint FBO; // frame buffer object
@@ -14,15 +16,16 @@ IrradianceCubemap createIrradianceCubemap()
 {
     IrradianceCubemap cubeMap;
 
-    glGenFramebuffers(1, &cubeMap.FBO);
-    glGenRenderbuffers(1, &cubeMap.RBO);
+    cubeMap.FBO = genTrackedFramebuffer("IrradianceCubemap");
+    cubeMap.RBO = genTrackedRenderbuffer("IrradianceCubemap depth");
 
     glBindFramebuffer(GL_FRAMEBUFFER, cubeMap.FBO);
     glBindRenderbuffer(GL_RENDERBUFFER, cubeMap.RBO);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
+    trackRenderbufferStorage(cubeMap.RBO, GL_DEPTH_COMPONENT24, 512, 512);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, cubeMap.RBO);
 
-    glGenTextures(1, &cubeMap.textureID);
+    cubeMap.textureID = genTrackedTexture(GPU_MEMORY_CUBEMAP, "IrradianceCubemap");
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap.textureID);
     for (size_t i = 0; i < 6; i++)
     {
@@ -36,6 +39,7 @@ IrradianceCubemap createIrradianceCubemap()
                      GL_FLOAT,
                      nullptr);
     }
+    trackTextureImage(cubeMap.textureID, GL_RGB16F, 512, 512, 6, false);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -48,5 +52,12 @@ IrradianceCubemap createIrradianceCubemap()
     return cubeMap;
 }
 
+void deleteIrradianceCubemap(IrradianceCubemap& cubeMap)
+{
+    deleteTrackedFramebuffer(cubeMap.FBO);
+    deleteTrackedRenderbuffer(cubeMap.RBO);
+    deleteTrackedTexture(cubeMap.textureID);
+}
+
 #endif // !IRRADIANCE_CUBEMAP_H_INCLUDED
 
@@ -3,6 +3,8 @@
 
 #include <glad/glad.h>
 
+#include "GpuMemory.h"
+
 typedef struct IrradiancePrecomputedMap
 {
     //GLuint FBO; // frame buffer object
@@ -14,7 +16,7 @@ IrradiancePrecomputedMap createIrradiancePrecomputedMap()
 {
     IrradiancePrecomputedMap cubeMap;
     
-    glGenTextures(1, &cubeMap.textureID);
+    cubeMap.textureID = genTrackedTexture(GPU_MEMORY_CUBEMAP, "IrradiancePrecomputedMap");
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap.textureID);
     for (size_t i = 0; i < 6; i++)
     {
@@ -28,6 +30,7 @@ IrradiancePrecomputedMap createIrradiancePrecomputedMap()
                      GL_FLOAT,
                      nullptr);
     }
+    trackTextureImage(cubeMap.textureID, GL_RGB16F, 32, 32, 6, false);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -49,5 +52,10 @@ IrradiancePrecomputedMap createIrradiancePrecomputedMap()
     return cubeMap;
 }
 
+void deleteIrradiancePrecomputedMap(IrradiancePrecomputedMap& cubeMap)
+{
+    deleteTrackedTexture(cubeMap.textureID);
+}
+
 #endif // !IRRADIANCE_PRECOMPUTE_MAP_H_INCLUDED
 
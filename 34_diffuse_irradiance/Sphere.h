@@ -4,6 +4,8 @@
 #include <cmath>
 #include <glad/glad.h>
 
+#include "GpuMemory.h"
+
 typedef struct Sphere {
     GLfloat* vertices;
     GLuint*  indices;
@@ -102,9 +104,9 @@ Sphere createSphere()
     sphere.numVertices = data.size() /
         floatsPerVertex;
     sphere.numIndices = indices.size();
-    glGenBuffers(1, &sphere.VBO);
-    glGenBuffers(1, &sphere.EBO);
-    glGenVertexArrays(1, &sphere.VAO);
+    sphere.VBO = genTrackedBuffer(GPU_MEMORY_VERTEX_BUFFER, "Sphere.h");
+    sphere.EBO = genTrackedBuffer(GPU_MEMORY_INDEX_BUFFER, "Sphere.h");
+    sphere.VAO = genTrackedVertexArray("Sphere.h");
     glBindVertexArray(sphere.VAO);
     glBindBuffer(GL_ARRAY_BUFFER, sphere.VBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere.EBO);
@@ -116,6 +118,8 @@ Sphere createSphere()
         indices.size() * sizeof(GLuint),
         indices.data(),
         GL_STATIC_DRAW);
+    trackBufferData(sphere.VBO, sphere.numVertices * floatsPerVertex * sizeof(GLfloat));
+    trackBufferData(sphere.EBO, indices.size() * sizeof(GLuint));
 
     // set object attribs
     int posAttribLocation = 0; // aPos, where we set location = 0
@@ -161,5 +165,12 @@ Sphere createSphere()
 }
 
 
+void deleteSphere(Sphere& sphere)
+{
+    deleteTrackedVertexArray(sphere.VAO);
+    deleteTrackedBuffer(sphere.VBO);
+    deleteTrackedBuffer(sphere.EBO);
+}
+
 #endif // !SPHERE_H_INCLUDED
 
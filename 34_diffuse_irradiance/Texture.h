@@ -8,6 +8,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "../stb_image.h"
 
+#include "HDRLoader.h"
+#include "GpuMemory.h"
+
 enum class TextureType {
     Diffuse,
     Specular
@@ -60,7 +63,7 @@ Texture createTexture(const std::string& fileName)
         exit(EXIT_FAILURE);
     }
 
-    glGenTextures(1, &texture.id);
+    texture.id = genTrackedTexture(GPU_MEMORY_TEXTURE, "Texture.h " + fileName);
     glBindTexture(GL_TEXTURE_2D, texture.id);
     glTexImage2D(GL_TEXTURE_2D,
         0,  // mipmap level  = 0 = default; OpenGL auto chooses
@@ -72,6 +75,7 @@ Texture createTexture(const std::string& fileName)
         GL_UNSIGNED_BYTE,
         data);
     glGenerateMipmap(GL_TEXTURE_2D);
+    trackTextureImage(texture.id, GL_RGB, texture.width, texture.height, 1, true);
 
     setTextureOptions();
 
@@ -80,7 +84,7 @@ Texture createTexture(const std::string& fileName)
     return texture;
 }
 
-Texture createHDRTexture(const std::string& fileName)
+Texture createHDRTextureStb(const std::string& fileName)
 {
     Texture texture;
 
@@ -98,7 +102,7 @@ Texture createHDRTexture(const std::string& fileName)
         exit(EXIT_FAILURE);
     }
 
-    glGenTextures(1, &texture.id);
+    texture.id = genTrackedTexture(GPU_MEMORY_TEXTURE, "Texture.h " + fileName);
     glBindTexture(GL_TEXTURE_2D, texture.id);
     glTexImage2D(GL_TEXTURE_2D,
         0,  // mipmap level  = 0 = default; OpenGL auto chooses
@@ -109,6 +113,7 @@ Texture createHDRTexture(const std::string& fileName)
         GL_RGB, // input format - PNG's need alpha component
         GL_FLOAT,
         data);
+    trackTextureImage(texture.id, GL_RGB16F, texture.width, texture.height, 1, false);
 
     setHDRTextureOptions();
 
@@ -117,5 +122,46 @@ Texture createHDRTexture(const std::string& fileName)
     return texture;
 }
 
+// decodes with HDRLoader.h straight to half floats, or stbi_loadf if the
+// file uses something HDRLoader.h doesn't handle
+Texture createHDRTexture(const std::string& fileName)
+{
+    HDRImage image;
+    if (!loadHDRImage(fileName, image)) {
+        return createHDRTextureStb(fileName);
+    }
+
+    Texture texture;
+    texture.fileName = fileName;
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.numChannels = 3;
+
+    texture.id = genTrackedTexture(GPU_MEMORY_TEXTURE, "Texture.h " + fileName);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2); // rows are width * 6 bytes
+    glTexImage2D(GL_TEXTURE_2D,
+        0,
+        GL_RGB16F,
+        texture.width,
+        texture.height,
+        0,
+        GL_RGB,
+        GL_HALF_FLOAT,
+        &image.pixels[0]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    trackTextureImage(texture.id, GL_RGB16F, texture.width, texture.height, 1, false);
+
+    setHDRTextureOptions();
+
+    return texture;
+}
+
+void deleteTexture(Texture& texture)
+{
+    deleteTrackedTexture(texture.id);
+    texture.id = 0;
+}
+
 #endif // !TEXTURE_H_INCLUDED
 
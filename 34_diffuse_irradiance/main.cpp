@@ -3,6 +3,9 @@
 #include <cmath>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -19,8 +22,11 @@
 #include "Camera.h"
 #include "LightSource.h"
 #include "Floor.h"
+#include "InstancedMaterials.h"
 #include "IrradianceCubemap.h"
 #include "IrradiancePrecomputedMap.h"
+#include "GpuMemory.h"
+#include "CpuProfiler.h"
 
 // Globals
 const size_t WINDOW_WIDTH = 800;
@@ -33,6 +39,9 @@ Texture gWoodTexture;
 
 Texture gHDRRadianceTex;
 
+// H compares HDRLoader.h against stbi_loadf on this file (argv[1] if given)
+std::string gHDRBenchmarkFile = "newport_loft.hdr";
+
 std::vector<glm::vec3> gLightPositions = {
     glm::vec3(-10.0f,  10.0f, 10.0f),
     glm::vec3( 10.0f,  10.0f, 10.0f),
@@ -51,9 +60,33 @@ int numSphereRows = 7;
 int numSphereCols = 7;
 float sphereSpacing = 2.5f;
 
+// I switches between one draw per sphere and a single instanced draw of
+// the whole grid, G cycles the grid size to compare the two
+InstancedMaterials gSphereInstances;
+bool gDrawInstanced = true;
+const int gSphereGridSizes[] = { 7, 32, 100 };
+size_t gSphereGridSizeIndex = 0;
+
+// time spent submitting (CPU) and executing (GPU) the sphere draws
+typedef struct SphereGridTiming {
+    GLuint queries[2]; // GL_TIME_ELAPSED, read back one frame late
+    size_t frame;
+    double cpuMsTotal;
+    double gpuMsTotal;
+    size_t numCpuSamples;
+    size_t numGpuSamples;
+    double lastPrintTime;
+} SphereGridTiming;
+SphereGridTiming gSphereGridTiming;
+
 Shader gVertexShader;
 Shader gFragmentShader;
 ShaderProgram gShaderProgram;
+
+// material comes from the instance buffer instead of uniforms
+Shader gInstancedVertexShader;
+Shader gInstancedFragmentShader;
+ShaderProgram gInstancedShaderProgram;
 //std::map<std::string, int> gUniformLocations;
 
 // shaders just used by the object representing the light
@@ -235,6 +268,122 @@ static void moveCamera()
     }
 }
 
+// the same metallic (rows) / roughness (columns) sweep as the per sphere
+// path in draw(), written once into the instance buffer
+static void rebuildSphereGridInstances()
+{
+    std::vector<MaterialInstance> instances;
+    instances.reserve(numSphereRows * numSphereCols);
+    for (size_t row = 0; row < numSphereRows; ++row)
+    {
+        float metallic = float(row) / float(numSphereRows);
+        for (size_t col = 0; col < numSphereCols; ++col)
+        {
+            float roughness = glm::clamp(float(col) / float(numSphereCols), 0.025f, 1.0f);
+            glm::vec3 pos((float(col) - float((numSphereCols / 2))) * sphereSpacing,
+                          (float(row) - float((numSphereRows / 2))) * sphereSpacing,
+                          0.0f);
+            glm::mat4 modelMat = glm::translate(glm::mat4(1.0f), pos);
+            instances.push_back(createMaterialInstance(modelMat,
+                glm::vec3(0.5f, 0.0f, 0.0f),
+                metallic,
+                roughness,
+                1.0f));
+        }
+    }
+    setMaterialInstances(gSphereInstances, instances);
+}
+
+// the whole grid in one draw call; view and projection are computed once
+// per frame instead of once per sphere
+static void drawSpheresInstanced()
+{
+    glUseProgram(gInstancedShaderProgram.id);
+
+    static GLuint uProjection = glGetUniformLocation(gInstancedShaderProgram.id, "uProjection");
+    static GLuint uView = glGetUniformLocation(gInstancedShaderProgram.id, "uView");
+    static GLuint uCamPos = glGetUniformLocation(gInstancedShaderProgram.id, "uCamPos");
+    static std::vector<GLuint> uLightPositions;
+    static std::vector<GLuint> uLightColors;
+    if (uLightPositions.empty()) {
+        for (size_t i = 0; i < gLightPositions.size(); i++)
+        {
+            std::string str = "uLightPositions[" + std::to_string(i) + "]";
+            uLightPositions.push_back(glGetUniformLocation(gInstancedShaderProgram.id, str.c_str()));
+            str = "uLightColors[" + std::to_string(i) + "]";
+            uLightColors.push_back(glGetUniformLocation(gInstancedShaderProgram.id, str.c_str()));
+        }
+    }
+
+    for (size_t i = 0; i < gLightPositions.size(); i++)
+    {
+        glUniform3fv(uLightPositions[i], 1, glm::value_ptr(gLightPositions[i]));
+        glUniform3fv(uLightColors[i], 1, glm::value_ptr(gLightColors[i]));
+    }
+    glUniform3fv(uCamPos, 1, glm::value_ptr(gCamera.position));
+
+    static GLuint uIrradianceMap = glGetUniformLocation(gInstancedShaderProgram.id, "uIrradianceMap");
+    glUniform1i(uIrradianceMap, 0); // GL_TEXTURE0
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, gIrradiancePrecomputedMap.textureID);
+    static GLuint uUseIrradiance = glGetUniformLocation(gInstancedShaderProgram.id, "uUseIrradiance");
+    glUniform1i(uUseIrradiance, gUseIrradiance);
+
+    // same matrices as Transform.h
+    glm::mat4 viewMat = glm::lookAt(gCamera.position, gCamera.position + gCamera.front, gCamera.up);
+    glm::mat4 projMat = glm::perspective(glm::radians(gCamera.FOV),
+        800.0F / 600.0F,
+        0.1F,
+        100.0F);
+    glUniformMatrix4fv(uView, 1, GL_FALSE, glm::value_ptr(viewMat));
+    glUniformMatrix4fv(uProjection, 1, GL_FALSE, glm::value_ptr(projMat));
+
+    drawInstancedMaterials(gSphereInstances);
+}
+
+static void beginSphereGridTiming()
+{
+    SphereGridTiming& timing = gSphereGridTiming;
+    glBeginQuery(GL_TIME_ELAPSED, timing.queries[timing.frame % 2]);
+}
+
+static void endSphereGridTiming(double cpuMs)
+{
+    SphereGridTiming& timing = gSphereGridTiming;
+    glEndQuery(GL_TIME_ELAPSED);
+    timing.cpuMsTotal += cpuMs;
+    timing.numCpuSamples++;
+
+    // the other query was issued last frame, so it is normally done by now;
+    // skip the sample rather than stall if it isn't
+    if (timing.frame > 0) {
+        GLuint query = timing.queries[(timing.frame + 1) % 2];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            timing.gpuMsTotal += double(elapsedNs) / 1000000.0;
+            timing.numGpuSamples++;
+        }
+    }
+    timing.frame++;
+
+    double now = glfwGetTime();
+    if (now - timing.lastPrintTime >= 1.0) {
+        std::cout << (gDrawInstanced ? "instanced" : "per sphere") << " "
+            << numSphereRows << "x" << numSphereCols << " spheres: "
+            << "CPU " << timing.cpuMsTotal / double(std::max<size_t>(timing.numCpuSamples, 1)) << " ms, "
+            << "GPU " << timing.gpuMsTotal / double(std::max<size_t>(timing.numGpuSamples, 1)) << " ms"
+            << std::endl;
+        timing.cpuMsTotal = 0.0;
+        timing.gpuMsTotal = 0.0;
+        timing.numCpuSamples = 0;
+        timing.numGpuSamples = 0;
+        timing.lastPrintTime = now;
+    }
+}
+
 // called once every frame during main loop
 static void draw()
 {
@@ -288,9 +437,11 @@ static void draw()
     glUniform1i(uUseIrradiance, gUseIrradiance);
 
     // draw the spheres
+    auto cpuStart = std::chrono::high_resolution_clock::now();
+    beginSphereGridTiming();
     glm::mat4 transMat;
     glm::mat4 modelMat;
-    for (size_t row = 0; row < numSphereRows; ++row)
+    for (size_t row = 0; !gDrawInstanced && row < numSphereRows; ++row)
     {
         glUniform1f(uMetallic, float(row) / float(numSphereRows));
 
@@ -313,6 +464,11 @@ static void draw()
             glDrawElements(GL_TRIANGLE_STRIP, gSphere.numIndices, GL_UNSIGNED_INT, 0);
         }
     }
+    if (gDrawInstanced) {
+        drawSpheresInstanced();
+    }
+    auto cpuEnd = std::chrono::high_resolution_clock::now();
+    endSphereGridTiming(std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count());
 
 
     // Draw the cubemap environment
@@ -340,10 +496,77 @@ static void draw()
     glDepthFunc(GL_LESS);
 }
 
-int main(void)
+// decode + upload one HDR file through both paths. Time to first upload
+// runs from opening the file until the texture data has reached the GPU
+static void benchmarkHDRDecode(const std::string& fileName)
 {
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    double fileMB = file ? (double)file.tellg() / (1024.0 * 1024.0) : 0.0;
+    file.close();
+
+    typedef std::chrono::high_resolution_clock Clock;
+    for (int path = 0; path < 2; path++)
+    {
+        const char* name = path == 0 ? "stbi_loadf" : "HDRLoader.h";
+        int width = 0;
+        int height = 0;
+        float* floatData = nullptr;
+        HDRImage image;
+
+        auto start = Clock::now();
+        if (path == 0) {
+            int numChannels;
+            stbi_set_flip_vertically_on_load(true);
+            floatData = stbi_loadf(fileName.c_str(), &width, &height, &numChannels, 3);
+        }
+        else if (loadHDRImage(fileName, image)) {
+            width = image.width;
+            height = image.height;
+        }
+        auto decoded = Clock::now();
+        if (width == 0) {
+            std::cout << name << " failed to decode " << fileName << std::endl;
+            continue;
+        }
+
+        GLuint textureID = genTrackedTexture(GPU_MEMORY_TEXTURE, "HDR decode benchmark");
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, path == 0 ? 4 : 2);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB,
+            path == 0 ? GL_FLOAT : GL_HALF_FLOAT,
+            path == 0 ? (const void*)floatData : (const void*)&image.pixels[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        trackTextureImage(textureID, GL_RGB16F, width, height, 1, false);
+        glFinish();
+        auto uploaded = Clock::now();
+        deleteTrackedTexture(textureID);
+        if (floatData) {
+            stbi_image_free(floatData);
+        }
+
+        double decodeMs = std::chrono::duration<double, std::milli>(decoded - start).count();
+        double firstUploadMs = std::chrono::duration<double, std::milli>(uploaded - start).count();
+        std::cout << name << ": " << fileName << " " << width << "x" << height
+            << " decode " << decodeMs << " ms (" << fileMB / (decodeMs / 1000.0) << " MB/s), "
+            << "time to first upload " << firstUploadMs << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        gHDRBenchmarkFile = argv[1];
+    }
+
+    CPU_THREAD_NAME("Main");
+    CPU_ZONE_BEGIN("Startup");
+
+    CPU_ZONE_BEGIN("Window and GL init");
     initGlfw();
     createWindow();
+
+    // warns once if the tracked resources ever go over this
+    setGpuMemoryBudget(256 * 1024 * 1024);
     initGlad();
     registerGlfwCallbacks();
 
@@ -357,6 +580,7 @@ int main(void)
     // by default the function is GL_LESS 
     // (if the depth of the new pixel is less than the current pixel)
     //glDepthFunc(GL_ALWAYS);
+    CPU_ZONE_END();
 
     // Sphere.h
     std::cout << "Creating sphere" << std::endl;
@@ -375,6 +599,7 @@ int main(void)
     gIrradiancePrecomputedMap = createIrradiancePrecomputedMap();
 
     // Shader.h/ShaderProgram.h
+    CPU_ZONE_BEGIN("Shader compile");
     std::cout << "Creating main shader program" << std::endl;
     gVertexShader = createVertexShader("vertexShader.glsl");
     gFragmentShader = createFragmentShader("fragmentShader.glsl");
@@ -382,8 +607,30 @@ int main(void)
         gFragmentShader);
     glUseProgram(gShaderProgram.id);
 
+    std::cout << "Creating instanced shader program" << std::endl;
+    gInstancedVertexShader = createVertexShader("vertexShader_instanced.glsl");
+    gInstancedFragmentShader = createFragmentShader("fragmentShader_instanced.glsl");
+    gInstancedShaderProgram = createShaderProgram(gInstancedVertexShader,
+        gInstancedFragmentShader);
+    CPU_ZONE_END();
+
+    // InstancedMaterials.h
+    gSphereInstances = createInstancedMaterials(gSphere.VBO,
+        gSphere.EBO,
+        gSphere.numIndices,
+        GL_TRIANGLE_STRIP);
+    rebuildSphereGridInstances();
+    glGenQueries(2, gSphereGridTiming.queries);
+    gSphereGridTiming.frame = 0;
+    gSphereGridTiming.cpuMsTotal = 0.0;
+    gSphereGridTiming.gpuMsTotal = 0.0;
+    gSphereGridTiming.numCpuSamples = 0;
+    gSphereGridTiming.numGpuSamples = 0;
+    gSphereGridTiming.lastPrintTime = glfwGetTime();
+
     // make a shader just for the light source, which uses a different
     // fragment shader and the same vertex shader
+    CPU_ZONE_BEGIN("IBL shader compile");
     gLightFragmentShader = createFragmentShader("lightFragmentShader.glsl");
     gLightShaderProgram = createShaderProgram(gVertexShader,
         gLightFragmentShader);
@@ -407,14 +654,24 @@ int main(void)
     gPrecomputeIrradianceFragmentShader = createFragmentShader("fragmentShader_preComputeIrradiance.glsl");
     gPrecomputeIrradianceShaderProgram = createShaderProgram(gPrecomputeIrradianceVertexShader, 
         gPrecomputeIrradianceFragmentShader);
+    CPU_ZONE_END();
 
     // Texture.h
+    CPU_ZONE_BEGIN("Texture decode");
     gDiffuseMap = createTexture("marble.jpg");
     gSpecularMap = createTexture("container2_specular.png");
     gWoodTexture = createTexture("wood.png");
+    CPU_ZONE_END();
+    CPU_ZONE_BEGIN("HDR load");
     gHDRRadianceTex = createHDRTexture("newport_loft.hdr");
+    CPU_ZONE_END();
+
+    // the bake is GPU work; each step ends with a glFinish so its zone
+    // covers the GPU time and not only the command submission
+    CPU_ZONE_BEGIN("IBL bake");
 
     // Convert the HDR irradiant texture to a cubemap texture
+    CPU_ZONE_BEGIN("Equirectangular to cubemap");
     glBindFramebuffer(GL_FRAMEBUFFER, gIrradianceCubemap.FBO);
     glBindRenderbuffer(GL_RENDERBUFFER, gIrradianceCubemap.RBO);
     glUseProgram(gEqui2CubeShaderProgram.id);
@@ -442,11 +699,15 @@ int main(void)
         glDrawArrays(GL_TRIANGLES, 0, gDebugEquiCube.numVertices);
     }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glFinish();
+    CPU_ZONE_END();
 
     // Precompute Irradiance using the Irradiance cubmap texture, convoluting it
+    CPU_ZONE_BEGIN("Irradiance convolution");
     glBindFramebuffer(GL_FRAMEBUFFER, gIrradianceCubemap.FBO);
     glBindRenderbuffer(GL_RENDERBUFFER, gIrradianceCubemap.RBO);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32); // match the precompute irradiance texture size
+    trackRenderbufferStorage(gIrradianceCubemap.RBO, GL_DEPTH_COMPONENT24, 32, 32);
     glUseProgram(gPrecomputeIrradianceShaderProgram.id);
     glUniform1i(glGetUniformLocation(gPrecomputeIrradianceShaderProgram.id, "uEnvMap"), 0); // GL_TEXTURE0
     static GLuint uProjection_precompute = glGetUniformLocation(gPrecomputeIrradianceShaderProgram.id, "uProjection");
@@ -472,10 +733,20 @@ int main(void)
     }
     
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glFinish();
+    CPU_ZONE_END();
+    CPU_ZONE_END(); // IBL bake
     
     // restore the viewport
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 
+    CPU_ZONE_END(); // Startup
+    std::cout << "Startup:" << std::endl;
+    CPU_PRINT_ZONES(3);
+    CPU_WRITE_TRACE("startup_trace.json");
+
+    printGpuMemoryReport();
+
     while (!glfwWindowShouldClose(gWindow))
     {
         if (glfwGetKey(gWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
@@ -487,6 +758,44 @@ int main(void)
             std::cout << "Use Irradiance: " << gUseIrradiance << std::endl;
         }
 
+        // press H to benchmark the HDR decoders
+        static bool benchmarkWasPressed = false;
+        bool benchmarkPressed = glfwGetKey(gWindow, GLFW_KEY_H) == GLFW_PRESS;
+        if (benchmarkPressed && !benchmarkWasPressed) {
+            benchmarkHDRDecode(gHDRBenchmarkFile);
+        }
+        benchmarkWasPressed = benchmarkPressed;
+
+        // press I to switch between instanced and per sphere drawing
+        static bool instancedWasPressed = false;
+        bool instancedPressed = glfwGetKey(gWindow, GLFW_KEY_I) == GLFW_PRESS;
+        if (instancedPressed && !instancedWasPressed) {
+            gDrawInstanced = !gDrawInstanced;
+            std::cout << "Draw instanced: " << gDrawInstanced << std::endl;
+        }
+        instancedWasPressed = instancedPressed;
+
+        // press G to cycle the sphere grid size
+        static bool gridSizeWasPressed = false;
+        bool gridSizePressed = glfwGetKey(gWindow, GLFW_KEY_G) == GLFW_PRESS;
+        if (gridSizePressed && !gridSizeWasPressed) {
+            size_t numGridSizes = sizeof(gSphereGridSizes) / sizeof(gSphereGridSizes[0]);
+            gSphereGridSizeIndex = (gSphereGridSizeIndex + 1) % numGridSizes;
+            numSphereRows = gSphereGridSizes[gSphereGridSizeIndex];
+            numSphereCols = gSphereGridSizes[gSphereGridSizeIndex];
+            rebuildSphereGridInstances();
+            std::cout << "Sphere grid: " << numSphereRows << "x" << numSphereCols << std::endl;
+        }
+        gridSizeWasPressed = gridSizePressed;
+
+        // press M to print the GPU memory report
+        static bool memoryReportWasPressed = false;
+        bool memoryReportPressed = glfwGetKey(gWindow, GLFW_KEY_M) == GLFW_PRESS;
+        if (memoryReportPressed && !memoryReportWasPressed) {
+            printGpuMemoryReport();
+        }
+        memoryReportWasPressed = memoryReportPressed;
+
         moveCamera();
 
         // move the light around
@@ -502,6 +811,21 @@ int main(void)
 
     glDeleteShader(gVertexShader.id);
     glDeleteShader(gFragmentShader.id);
+    glDeleteShader(gInstancedVertexShader.id);
+    glDeleteShader(gInstancedFragmentShader.id);
+    glDeleteQueries(2, gSphereGridTiming.queries);
+
+    deleteTexture(gDiffuseMap);
+    deleteTexture(gSpecularMap);
+    deleteTexture(gWoodTexture);
+    deleteTexture(gHDRRadianceTex);
+    deleteInstancedMaterials(gSphereInstances);
+    deleteSphere(gSphere);
+    deleteCube(gDebugEquiCube);
+    deleteIrradianceCubemap(gIrradianceCubemap);
+    deleteIrradiancePrecomputedMap(gIrradiancePrecomputedMap);
+    reportGpuMemoryLeaks();
+
     glfwTerminate();
     return 0;
 }